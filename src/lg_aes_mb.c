@@ -0,0 +1,466 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+
+#include "lg_aes_mb.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#	define LG_AES_MB_X86	1
+#	include <immintrin.h>
+#	define LG_AES_MB_TARGET_AESNI	__attribute__((target("sse2,aes")))
+#	define LG_AES_MB_TARGET_VAES	__attribute__((target("avx512f,vaes,aes")))
+/* Lanes and rounds loops must be flat to keep state in registers. */
+#	define LG_AES_MB_UNROLL		_Pragma("GCC unroll 16")
+#endif
+
+
+static const char *lg_aes_mb_impl_names[LG_AES_MB_IMPL_COUNT] = {
+	"evp",
+	"aesni",
+	"vaes"
+};
+
+
+uint32_t
+lg_aes_mb_impl_detect(void) {
+
+#ifdef LG_AES_MB_X86
+	__builtin_cpu_init();
+	if (0 == __builtin_cpu_supports("aes"))
+		return (LG_AES_MB_IMPL_NONE);
+	if (0 != __builtin_cpu_supports("avx512f") &&
+	    0 != __builtin_cpu_supports("vaes"))
+		return (LG_AES_MB_IMPL_VAES);
+	return (LG_AES_MB_IMPL_AESNI);
+#else
+	return (LG_AES_MB_IMPL_NONE);
+#endif
+}
+
+const char *
+lg_aes_mb_impl_name(uint32_t impl) {
+
+	if (LG_AES_MB_IMPL_COUNT <= impl)
+		return ("unknown");
+	return (lg_aes_mb_impl_names[impl]);
+}
+
+
+#ifdef LG_AES_MB_X86
+#define LG_AES_MB_AESNI_LANES	8
+#define LG_AES_MB_VAES_LANES	16
+
+/* AES-256 key expansion step: next even round key. */
+static inline __m128i LG_AES_MB_TARGET_AESNI
+lg_aes_mb_key_exp_even(__m128i prev, __m128i assist) {
+	__m128i tmp;
+
+	assist = _mm_shuffle_epi32(assist, 0xff);
+	tmp = _mm_slli_si128(prev, 4);
+	prev = _mm_xor_si128(prev, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	prev = _mm_xor_si128(prev, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	prev = _mm_xor_si128(prev, tmp);
+
+	return (_mm_xor_si128(prev, assist));
+}
+
+/* AES-256 key expansion step: next odd round key. */
+static inline __m128i LG_AES_MB_TARGET_AESNI
+lg_aes_mb_key_exp_odd(__m128i prev, __m128i even) {
+	__m128i tmp, assist;
+
+	assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(even, 0x00),
+	    0xaa);
+	tmp = _mm_slli_si128(prev, 4);
+	prev = _mm_xor_si128(prev, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	prev = _mm_xor_si128(prev, tmp);
+	tmp = _mm_slli_si128(tmp, 4);
+	prev = _mm_xor_si128(prev, tmp);
+
+	return (_mm_xor_si128(prev, assist));
+}
+
+#define LG_AES_MB_KEY_EXP(__rk, __i, __rcon)				\
+	(__rk)[(__i)] = lg_aes_mb_key_exp_even((__rk)[((__i) - 2)],	\
+	    _mm_aeskeygenassist_si128((__rk)[((__i) - 1)], (__rcon)));	\
+	if (LG_AES_MB_ROUNDS > (__i)) {					\
+		(__rk)[((__i) + 1)] = lg_aes_mb_key_exp_odd(		\
+		    (__rk)[((__i) - 1)], (__rk)[(__i)]);		\
+	}
+
+static void LG_AES_MB_TARGET_AESNI
+lg_aes_mb_key_init_aesni(lg_aes_mb_key_p key, const uint8_t *key256) {
+	size_t i;
+	__m128i rk[(LG_AES_MB_ROUNDS + 1)];
+
+	rk[0] = _mm_loadu_si128((const __m128i*)(const void*)key256);
+	rk[1] = _mm_loadu_si128((const __m128i*)(const void*)(key256 + 16));
+	LG_AES_MB_KEY_EXP(rk, 2, 0x01);
+	LG_AES_MB_KEY_EXP(rk, 4, 0x02);
+	LG_AES_MB_KEY_EXP(rk, 6, 0x04);
+	LG_AES_MB_KEY_EXP(rk, 8, 0x08);
+	LG_AES_MB_KEY_EXP(rk, 10, 0x10);
+	LG_AES_MB_KEY_EXP(rk, 12, 0x20);
+	LG_AES_MB_KEY_EXP(rk, 14, 0x40);
+	/* Equivalent inverse cipher: reversed, InvMixColumns applied. */
+	for (i = 0; i <= LG_AES_MB_ROUNDS; i ++) {
+		_mm_storeu_si128((__m128i*)(void*)key->enc[i], rk[i]);
+		_mm_storeu_si128((__m128i*)(void*)key->dec[i],
+		    ((0 == i || LG_AES_MB_ROUNDS == i) ?
+		    rk[(LG_AES_MB_ROUNDS - i)] :
+		    _mm_aesimc_si128(rk[(LG_AES_MB_ROUNDS - i)])));
+	}
+}
+
+
+/* Lanes scheduler: lane takes next not empty job when done. */
+#define LG_AES_MB_LANE_FILL(__l)					\
+	left[(__l)] = 0;						\
+	while (next < jobs_cnt && 0 == left[(__l)]) {			\
+		ptr[(__l)] = jobs[next].data;				\
+		left[(__l)] = (jobs[next].size / LG_AES_MB_BLOCK_SIZE);	\
+		next ++;						\
+	}								\
+	if (0 != left[(__l)]) {						\
+		active ++;						\
+	}
+
+static void LG_AES_MB_TARGET_AESNI
+lg_aes_mb_cbc_enc_aesni(const lg_aes_mb_key_t *key, const uint8_t *iv,
+    lg_aes_mb_job_p jobs, size_t jobs_cnt) {
+	size_t i, l, next = 0, active = 0, left[LG_AES_MB_AESNI_LANES];
+	uint8_t *ptr[LG_AES_MB_AESNI_LANES];
+	__m128i rk[(LG_AES_MB_ROUNDS + 1)], st[LG_AES_MB_AESNI_LANES], iv_x;
+
+	for (i = 0; i <= LG_AES_MB_ROUNDS; i ++) {
+		rk[i] = _mm_loadu_si128((const __m128i*)(const void*)key->enc[i]);
+	}
+	iv_x = _mm_loadu_si128((const __m128i*)(const void*)iv);
+	for (l = 0; l < LG_AES_MB_AESNI_LANES; l ++) {
+		st[l] = iv_x;
+		LG_AES_MB_LANE_FILL(l);
+	}
+	while (0 != active) {
+		/* Idle lanes are encrypted too: it is cheaper than branch
+		 * per round, result is dropped. */
+		LG_AES_MB_UNROLL
+		for (l = 0; l < LG_AES_MB_AESNI_LANES; l ++) {
+			if (0 != left[l]) {
+				st[l] = _mm_xor_si128(st[l], _mm_loadu_si128(
+				    (const __m128i*)(const void*)ptr[l]));
+			}
+			st[l] = _mm_xor_si128(st[l], rk[0]);
+		}
+		LG_AES_MB_UNROLL
+		for (i = 1; i < LG_AES_MB_ROUNDS; i ++) {
+			LG_AES_MB_UNROLL
+			for (l = 0; l < LG_AES_MB_AESNI_LANES; l ++) {
+				st[l] = _mm_aesenc_si128(st[l], rk[i]);
+			}
+		}
+		LG_AES_MB_UNROLL
+		for (l = 0; l < LG_AES_MB_AESNI_LANES; l ++) {
+			st[l] = _mm_aesenclast_si128(st[l],
+			    rk[LG_AES_MB_ROUNDS]);
+			if (0 == left[l])
+				continue;
+			_mm_storeu_si128((__m128i*)(void*)ptr[l], st[l]);
+			ptr[l] += LG_AES_MB_BLOCK_SIZE;
+			left[l] --;
+			if (0 != left[l])
+				continue;
+			active --;
+			st[l] = iv_x;
+			LG_AES_MB_LANE_FILL(l);
+		}
+	}
+}
+
+static void LG_AES_MB_TARGET_AESNI
+lg_aes_mb_cbc_dec_aesni(const lg_aes_mb_key_t *key, const uint8_t *iv,
+    const uint8_t *in, uint8_t *out, size_t size) {
+	size_t i, b;
+	__m128i rk[(LG_AES_MB_ROUNDS + 1)], prev, ct[LG_AES_MB_AESNI_LANES];
+	__m128i st[LG_AES_MB_AESNI_LANES];
+
+	for (i = 0; i <= LG_AES_MB_ROUNDS; i ++) {
+		rk[i] = _mm_loadu_si128((const __m128i*)(const void*)key->dec[i]);
+	}
+	prev = _mm_loadu_si128((const __m128i*)(const void*)iv);
+	/* All cipher blocks are loaded before store: in place is safe. */
+	for (; (LG_AES_MB_AESNI_LANES * LG_AES_MB_BLOCK_SIZE) <= size;
+	    size -= (LG_AES_MB_AESNI_LANES * LG_AES_MB_BLOCK_SIZE)) {
+		LG_AES_MB_UNROLL
+		for (b = 0; b < LG_AES_MB_AESNI_LANES; b ++) {
+			ct[b] = _mm_loadu_si128((const __m128i*)(const void*)in);
+			st[b] = _mm_xor_si128(ct[b], rk[0]);
+			in += LG_AES_MB_BLOCK_SIZE;
+		}
+		LG_AES_MB_UNROLL
+		for (i = 1; i < LG_AES_MB_ROUNDS; i ++) {
+			LG_AES_MB_UNROLL
+			for (b = 0; b < LG_AES_MB_AESNI_LANES; b ++) {
+				st[b] = _mm_aesdec_si128(st[b], rk[i]);
+			}
+		}
+		LG_AES_MB_UNROLL
+		for (b = 0; b < LG_AES_MB_AESNI_LANES; b ++) {
+			st[b] = _mm_aesdeclast_si128(st[b],
+			    rk[LG_AES_MB_ROUNDS]);
+			st[b] = _mm_xor_si128(st[b],
+			    ((0 == b) ? prev : ct[(b - 1)]));
+			_mm_storeu_si128((__m128i*)(void*)out, st[b]);
+			out += LG_AES_MB_BLOCK_SIZE;
+		}
+		prev = ct[(LG_AES_MB_AESNI_LANES - 1)];
+	}
+	/* Tail: block by block. */
+	for (; LG_AES_MB_BLOCK_SIZE <= size; size -= LG_AES_MB_BLOCK_SIZE) {
+		ct[0] = _mm_loadu_si128((const __m128i*)(const void*)in);
+		st[0] = _mm_xor_si128(ct[0], rk[0]);
+		LG_AES_MB_UNROLL
+		for (i = 1; i < LG_AES_MB_ROUNDS; i ++) {
+			st[0] = _mm_aesdec_si128(st[0], rk[i]);
+		}
+		st[0] = _mm_aesdeclast_si128(st[0], rk[LG_AES_MB_ROUNDS]);
+		_mm_storeu_si128((__m128i*)(void*)out,
+		    _mm_xor_si128(st[0], prev));
+		prev = ct[0];
+		in += LG_AES_MB_BLOCK_SIZE;
+		out += LG_AES_MB_BLOCK_SIZE;
+	}
+}
+
+
+/* 4 lanes per register, lanes state: (__g * 4) + lane. */
+#define LG_AES_MB_VAES_LOAD(__l)					\
+	((0 != left[(__l)]) ? _mm_loadu_si128(				\
+	    (const __m128i*)(const void*)ptr[(__l)]) : _mm_setzero_si128())
+#define LG_AES_MB_VAES_LOAD4(__g)					\
+	_mm512_inserti32x4(_mm512_inserti32x4(_mm512_inserti32x4(	\
+	    _mm512_castsi128_si512(LG_AES_MB_VAES_LOAD(((__g) * 4))),	\
+	    LG_AES_MB_VAES_LOAD((((__g) * 4) + 1)), 1),			\
+	    LG_AES_MB_VAES_LOAD((((__g) * 4) + 2)), 2),			\
+	    LG_AES_MB_VAES_LOAD((((__g) * 4) + 3)), 3)
+#define LG_AES_MB_VAES_STORE(__g, __lane)				\
+	if (0 != left[(((__g) * 4) + (__lane))]) {			\
+		_mm_storeu_si128(					\
+		    (__m128i*)(void*)ptr[(((__g) * 4) + (__lane))],	\
+		    _mm512_extracti32x4_epi32(st[(__g)], (__lane)));	\
+	}
+
+static void LG_AES_MB_TARGET_VAES
+lg_aes_mb_cbc_enc_vaes(const lg_aes_mb_key_t *key, const uint8_t *iv,
+    lg_aes_mb_job_p jobs, size_t jobs_cnt) {
+	size_t i, g, l, next = 0, active = 0, left[LG_AES_MB_VAES_LANES];
+	uint8_t *ptr[LG_AES_MB_VAES_LANES];
+	__mmask8 reset[(LG_AES_MB_VAES_LANES / 4)];
+	__m512i rk[(LG_AES_MB_ROUNDS + 1)], st[(LG_AES_MB_VAES_LANES / 4)];
+	__m512i iv_z;
+
+	for (i = 0; i <= LG_AES_MB_ROUNDS; i ++) {
+		rk[i] = _mm512_broadcast_i32x4(_mm_loadu_si128(
+		    (const __m128i*)(const void*)key->enc[i]));
+	}
+	iv_z = _mm512_broadcast_i32x4(_mm_loadu_si128(
+	    (const __m128i*)(const void*)iv));
+	for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+		st[g] = iv_z;
+		reset[g] = 0;
+	}
+	for (l = 0; l < LG_AES_MB_VAES_LANES; l ++) {
+		LG_AES_MB_LANE_FILL(l);
+	}
+	while (0 != active) {
+		LG_AES_MB_UNROLL
+		for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+			/* Lanes with new job restart from IV. */
+			st[g] = _mm512_mask_blend_epi64(reset[g], st[g], iv_z);
+			reset[g] = 0;
+			st[g] = _mm512_xor_si512(st[g], LG_AES_MB_VAES_LOAD4(g));
+			st[g] = _mm512_xor_si512(st[g], rk[0]);
+		}
+		LG_AES_MB_UNROLL
+		for (i = 1; i < LG_AES_MB_ROUNDS; i ++) {
+			LG_AES_MB_UNROLL
+			for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+				st[g] = _mm512_aesenc_epi128(st[g], rk[i]);
+			}
+		}
+		LG_AES_MB_UNROLL
+		for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+			st[g] = _mm512_aesenclast_epi128(st[g],
+			    rk[LG_AES_MB_ROUNDS]);
+			LG_AES_MB_VAES_STORE(g, 0);
+			LG_AES_MB_VAES_STORE(g, 1);
+			LG_AES_MB_VAES_STORE(g, 2);
+			LG_AES_MB_VAES_STORE(g, 3);
+		}
+		for (l = 0; l < LG_AES_MB_VAES_LANES; l ++) {
+			if (0 == left[l])
+				continue;
+			ptr[l] += LG_AES_MB_BLOCK_SIZE;
+			left[l] --;
+			if (0 != left[l])
+				continue;
+			active --;
+			reset[(l / 4)] |= (__mmask8)(0x03 << ((l % 4) * 2));
+			LG_AES_MB_LANE_FILL(l);
+		}
+	}
+}
+
+static void LG_AES_MB_TARGET_VAES
+lg_aes_mb_cbc_dec_vaes(const lg_aes_mb_key_t *key, const uint8_t *iv,
+    const uint8_t *in, uint8_t *out, size_t size) {
+	size_t i, g;
+	__m512i rk[(LG_AES_MB_ROUNDS + 1)], carry;
+	__m512i ct[(LG_AES_MB_VAES_LANES / 4)], st[(LG_AES_MB_VAES_LANES / 4)];
+	uint8_t prev[LG_AES_MB_BLOCK_SIZE];
+
+	for (i = 0; i <= LG_AES_MB_ROUNDS; i ++) {
+		rk[i] = _mm512_broadcast_i32x4(_mm_loadu_si128(
+		    (const __m128i*)(const void*)key->dec[i]));
+	}
+	/* Previous cipher block is kept in lane 3. */
+	carry = _mm512_broadcast_i32x4(_mm_loadu_si128(
+	    (const __m128i*)(const void*)iv));
+	for (; (LG_AES_MB_VAES_LANES * LG_AES_MB_BLOCK_SIZE) <= size;
+	    size -= (LG_AES_MB_VAES_LANES * LG_AES_MB_BLOCK_SIZE)) {
+		LG_AES_MB_UNROLL
+		for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+			ct[g] = _mm512_loadu_si512((const void*)in);
+			st[g] = _mm512_xor_si512(ct[g], rk[0]);
+			in += (4 * LG_AES_MB_BLOCK_SIZE);
+		}
+		LG_AES_MB_UNROLL
+		for (i = 1; i < LG_AES_MB_ROUNDS; i ++) {
+			LG_AES_MB_UNROLL
+			for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+				st[g] = _mm512_aesdec_epi128(st[g], rk[i]);
+			}
+		}
+		LG_AES_MB_UNROLL
+		for (g = 0; g < (LG_AES_MB_VAES_LANES / 4); g ++) {
+			st[g] = _mm512_aesdeclast_epi128(st[g],
+			    rk[LG_AES_MB_ROUNDS]);
+			/* Cipher blocks shifted by one lane. */
+			st[g] = _mm512_xor_si512(st[g], _mm512_alignr_epi64(
+			    ct[g], ((0 == g) ? carry : ct[(g - 1)]), 6));
+			_mm512_storeu_si512((void*)out, st[g]);
+			out += (4 * LG_AES_MB_BLOCK_SIZE);
+		}
+		carry = ct[((LG_AES_MB_VAES_LANES / 4) - 1)];
+	}
+	if (0 == size)
+		return;
+	_mm_storeu_si128((__m128i*)(void*)prev,
+	    _mm512_extracti32x4_epi32(carry, 3));
+	lg_aes_mb_cbc_dec_aesni(key, prev, in, out, size);
+}
+#endif /* LG_AES_MB_X86 */
+
+
+void
+lg_aes_mb_key_init(lg_aes_mb_key_p key, const uint8_t *key256,
+    uint32_t impl) {
+
+	if (NULL == key)
+		return;
+	memset(key, 0x00, sizeof(lg_aes_mb_key_t));
+	key->impl = MIN(impl, lg_aes_mb_impl_detect());
+	if (NULL == key256) {
+		key->impl = LG_AES_MB_IMPL_NONE;
+		return;
+	}
+#ifdef LG_AES_MB_X86
+	if (LG_AES_MB_IMPL_NONE != key->impl) {
+		lg_aes_mb_key_init_aesni(key, key256);
+	}
+#endif
+}
+
+void
+lg_aes_mb_cbc_encrypt(const lg_aes_mb_key_t *key, const uint8_t *iv,
+    lg_aes_mb_job_p jobs, size_t jobs_cnt) {
+
+	if (NULL == key || NULL == iv || NULL == jobs || 0 == jobs_cnt)
+		return;
+	switch (key->impl) {
+#ifdef LG_AES_MB_X86
+	case LG_AES_MB_IMPL_AESNI:
+		lg_aes_mb_cbc_enc_aesni(key, iv, jobs, jobs_cnt);
+		break;
+	case LG_AES_MB_IMPL_VAES:
+		/* Few lanes: AES-NI is enough and avoids zmm warm up. */
+		if (LG_AES_MB_AESNI_LANES >= jobs_cnt) {
+			lg_aes_mb_cbc_enc_aesni(key, iv, jobs, jobs_cnt);
+		} else {
+			lg_aes_mb_cbc_enc_vaes(key, iv, jobs, jobs_cnt);
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+void
+lg_aes_mb_cbc_decrypt(const lg_aes_mb_key_t *key, const uint8_t *iv,
+    const uint8_t *in, uint8_t *out, size_t size) {
+
+	if (NULL == key || NULL == iv || NULL == in || NULL == out)
+		return;
+	switch (key->impl) {
+#ifdef LG_AES_MB_X86
+	case LG_AES_MB_IMPL_AESNI:
+		lg_aes_mb_cbc_dec_aesni(key, iv, in, out, size);
+		break;
+	case LG_AES_MB_IMPL_VAES:
+		if ((LG_AES_MB_VAES_LANES * LG_AES_MB_BLOCK_SIZE) > size) {
+			lg_aes_mb_cbc_dec_aesni(key, iv, in, out, size);
+		} else {
+			lg_aes_mb_cbc_dec_vaes(key, iv, in, out, size);
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+}
@@ -0,0 +1,86 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_AES_MB_H__
+#define __LG_AES_MB_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+
+/*
+ * AES-256-CBC kernels for many packets at once.
+ * CBC encryption is serial inside packet, so independent packets are
+ * encrypted interleaved: one block of every lane per round pass.
+ * CBC decryption is parallel inside packet: many blocks of same
+ * payload are decrypted at once.
+ * Implementation is selected at run time by CPUID; without AES-NI
+ * caller must use OpenSSL EVP: lg_aes_mb_impl_detect() returns
+ * LG_AES_MB_IMPL_NONE.
+ */
+
+#define LG_AES_MB_IMPL_NONE	0 /* Portable: OpenSSL EVP, packet by packet. */
+#define LG_AES_MB_IMPL_AESNI	1 /* AES-NI: 8 lanes / blocks. */
+#define LG_AES_MB_IMPL_VAES	2 /* AVX-512 VAES: 16 lanes / blocks. */
+#define LG_AES_MB_IMPL_COUNT	3
+
+#define LG_AES_MB_BLOCK_SIZE	16
+#define LG_AES_MB_ROUNDS	14 /* AES-256. */
+
+typedef struct lg_aes_mb_key_s {
+	uint32_t	impl;	/* LG_AES_MB_IMPL_* */
+	uint8_t		enc[(LG_AES_MB_ROUNDS + 1)][LG_AES_MB_BLOCK_SIZE];
+	uint8_t		dec[(LG_AES_MB_ROUNDS + 1)][LG_AES_MB_BLOCK_SIZE];
+} lg_aes_mb_key_t, *lg_aes_mb_key_p;
+
+/* In place CBC encryption of one packet, size: multiple of 16. */
+typedef struct lg_aes_mb_job_s {
+	uint8_t		*data;
+	size_t		size;
+} lg_aes_mb_job_t, *lg_aes_mb_job_p;
+
+
+/* Best implementation for this CPU. */
+uint32_t lg_aes_mb_impl_detect(void);
+const char *lg_aes_mb_impl_name(uint32_t impl);
+
+/* 32 bytes key. impl is limited by lg_aes_mb_impl_detect(). */
+void	lg_aes_mb_key_init(lg_aes_mb_key_p key, const uint8_t *key256,
+	    uint32_t impl);
+
+/* All jobs use same IV. Does nothing for LG_AES_MB_IMPL_NONE. */
+void	lg_aes_mb_cbc_encrypt(const lg_aes_mb_key_t *key, const uint8_t *iv,
+	    lg_aes_mb_job_p jobs, size_t jobs_cnt);
+/* in may be equal to out. Does nothing for LG_AES_MB_IMPL_NONE. */
+void	lg_aes_mb_cbc_decrypt(const lg_aes_mb_key_t *key, const uint8_t *iv,
+	    const uint8_t *in, uint8_t *out, size_t size);
+
+
+#endif /* __LG_AES_MB_H__ */
@@ -0,0 +1,204 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "lg_ctl_cap.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+
+
+/* Copy to ring at off, wrap at ring end. */
+static inline void
+lg_ctl_cap_copy(lg_ctl_cap_p cap, const size_t off, const void *data,
+    const size_t size) {
+	const size_t pos = (off & (cap->ring_size - 1));
+	const size_t part = MIN(size, (cap->ring_size - pos));
+
+	memcpy((cap->ring + pos), data, part);
+	memcpy(cap->ring, (((const uint8_t*)data) + part), (size - part));
+}
+
+/* Writer thread: move ring data to file, one write per wrap part. */
+static void *
+lg_ctl_cap_writer(void *arg) {
+	lg_ctl_cap_p cap = arg;
+	size_t head, tail, pos, size;
+	ssize_t ios;
+	int stop;
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = (LG_CTL_CAP_IDLE_SLEEP * 1000000);
+	for (;;) {
+		/* Stop flag first: head is final after stop is set. */
+		stop = __atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+		tail = cap->tail;
+		if (head == tail) {
+			if (0 != stop)
+				break;
+			nanosleep(&ts, NULL);
+			continue;
+		}
+		pos = (tail & (cap->ring_size - 1));
+		size = MIN((head - tail), (cap->ring_size - pos));
+		ios = write(cap->fd, (cap->ring + pos), size);
+		if (-1 == ios) {
+			if (EINTR == errno)
+				continue;
+			__atomic_store_n(&cap->error, errno, __ATOMIC_RELEASE);
+			break;
+		}
+		__atomic_store_n(&cap->tail, (tail + (size_t)ios),
+		    __ATOMIC_RELEASE);
+	}
+
+	return (NULL);
+}
+
+
+int
+lg_ctl_cap_open(lg_ctl_cap_p cap, const char *file_name,
+    size_t ring_size) {
+	int error;
+	struct timespec ts;
+	lg_ctl_cap_start_t start;
+
+	if (NULL == cap)
+		return (EINVAL);
+	memset(cap, 0x00, sizeof(lg_ctl_cap_t));
+	cap->fd = -1;
+	if (NULL == file_name)
+		return (EINVAL);
+	if (0 == ring_size) {
+		ring_size = LG_CTL_CAP_DEF_RING_SIZE;
+	}
+	/* Power of 2: position is masked offset. */
+	cap->ring_size = 4096;
+	while (cap->ring_size < ring_size) {
+		cap->ring_size *= 2;
+	}
+	cap->ring = lg_malloc(cap->ring_size);
+	if (NULL == cap->ring)
+		return (ENOMEM);
+	cap->fd = open(file_name, (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC),
+	    0644);
+	if (-1 == cap->fd) {
+		error = errno;
+		goto err_out;
+	}
+
+	memset(&start, 0x00, sizeof(start));
+	memcpy(start.magic, LG_CTL_CAP_MAGIC, sizeof(start.magic));
+	start.version = LG_CTL_CAP_VERSION;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	start.ts_real = ((((uint64_t)ts.tv_sec) * 1000000) +
+	    (((uint64_t)ts.tv_nsec) / 1000));
+	lg_ctl_cap_rec(cap, LG_CTL_CAP_T_START, 0,
+	    (const uint8_t*)&start, sizeof(start));
+
+	error = pthread_create(&cap->thread, NULL, lg_ctl_cap_writer, cap);
+	if (0 != error)
+		goto err_out;
+
+	return (0);
+
+err_out:
+	if (-1 != cap->fd) {
+		close(cap->fd);
+		cap->fd = -1;
+	}
+	lg_free(cap->ring);
+	cap->ring = NULL;
+
+	return (error);
+}
+
+void
+lg_ctl_cap_close(lg_ctl_cap_p cap) {
+
+	if (NULL == cap || NULL == cap->ring)
+		return;
+	__atomic_store_n(&cap->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(cap->thread, NULL);
+	close(cap->fd);
+	cap->fd = -1;
+	lg_free(cap->ring);
+	cap->ring = NULL; /* Counters are kept for report. */
+}
+
+void
+lg_ctl_cap_rec(lg_ctl_cap_p cap, const uint32_t type,
+    const uint32_t target, const uint8_t *data, const size_t size) {
+	static const uint8_t pad[LG_CTL_CAP_REC_ALIGN];
+	size_t head, data_size, full_size;
+	lg_ctl_cap_rec_t rec;
+
+	if (NULL == cap || NULL == cap->ring)
+		return;
+	data_size = MIN(size, LG_CTL_CAP_REC_SIZE_MASK);
+	full_size = LG_CTL_CAP_REC_FULL_SIZE(data_size);
+	head = cap->head;
+	if (0 != __atomic_load_n(&cap->error, __ATOMIC_RELAXED) ||
+	    full_size > (cap->ring_size -
+	    (head - __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE)))) {
+		cap->dropped ++;
+		return;
+	}
+	rec.ts = lg_ev_time_us();
+	rec.target = target;
+	rec.info = ((type << LG_CTL_CAP_REC_TYPE_SHIFT) | (uint32_t)data_size);
+	lg_ctl_cap_copy(cap, head, &rec, sizeof(rec));
+	head += sizeof(rec);
+	lg_ctl_cap_copy(cap, head, data, data_size);
+	head += data_size;
+	lg_ctl_cap_copy(cap, head, pad,
+	    (full_size - sizeof(rec) - data_size));
+	/* Publish: writer sees complete record only. */
+	__atomic_store_n(&cap->head, (cap->head + full_size),
+	    __ATOMIC_RELEASE);
+	cap->frames ++;
+	cap->bytes += full_size;
+}
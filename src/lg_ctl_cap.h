@@ -0,0 +1,133 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_CTL_CAP_H__
+#define __LG_CTL_CAP_H__
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+
+/*
+ * Wire capture: every packet sent to and received from soundbars is
+ * appended to binary log file.
+ * Poll loop only copies record to lock free single producer / single
+ * consumer ring, background thread writes ring to file, so disk never
+ * blocks poll. Record is dropped and counted if ring is full.
+ *
+ * File is sequence of records, all in host byte order, every record
+ * starts at 8 bytes boundary:
+ *	lg_ctl_cap_rec_t
+ *	data, padded by zeroes to 8 bytes
+ * Every capture starts with LG_CTL_CAP_T_START record, so captures can
+ * be appended to same file.
+ * Received stream is recorded completely: packets as LG_CTL_CAP_T_RX,
+ * bytes that are not part of any valid packet as LG_CTL_CAP_T_RX_RAW.
+ * Sent packets are recorded when queued to send.
+ */
+
+typedef struct lg_ctl_cap_rec_s {
+	uint64_t	ts;		/* Monotonic time, us. */
+	uint32_t	target;		/* Target index. */
+	uint32_t	info;		/* Type and data size. */
+} lg_ctl_cap_rec_t, *lg_ctl_cap_rec_p;
+
+#define LG_CTL_CAP_REC_TYPE_SHIFT	28
+#define LG_CTL_CAP_REC_SIZE_MASK					\
+    ((((uint32_t)1) << LG_CTL_CAP_REC_TYPE_SHIFT) - 1)
+#define LG_CTL_CAP_REC_TYPE(__info)	((__info) >> LG_CTL_CAP_REC_TYPE_SHIFT)
+#define LG_CTL_CAP_REC_SIZE(__info)	((__info) & LG_CTL_CAP_REC_SIZE_MASK)
+#define LG_CTL_CAP_REC_ALIGN		8
+/* Record size in file, with data and padding. */
+#define LG_CTL_CAP_REC_FULL_SIZE(__size)				\
+    (sizeof(lg_ctl_cap_rec_t) + roundup((__size), LG_CTL_CAP_REC_ALIGN))
+
+#define LG_CTL_CAP_T_START	0 /* lg_ctl_cap_start_t, target = 0. */
+#define LG_CTL_CAP_T_TARGET	1 /* Target name, on connect. */
+#define LG_CTL_CAP_T_RX		2 /* Packet from soundbar. */
+#define LG_CTL_CAP_T_TX		3 /* Packet to soundbar. */
+#define LG_CTL_CAP_T_RX_RAW	4 /* Garbage / bad header bytes. */
+#define LG_CTL_CAP_T_COUNT	5
+
+typedef struct lg_ctl_cap_start_s {
+	uint8_t		magic[8];	/* LG_CTL_CAP_MAGIC */
+	uint32_t	version;	/* LG_CTL_CAP_VERSION */
+	uint32_t	flags;		/* Not used, 0. */
+	uint64_t	ts_real;	/* Unix time, us, at rec.ts. */
+} lg_ctl_cap_start_t, *lg_ctl_cap_start_p;
+
+#define LG_CTL_CAP_MAGIC	"LGSPKCAP"
+#define LG_CTL_CAP_VERSION	1
+
+
+/* Producer and consumer fields are on own cache lines: counters
+ * updated on every record do not invalidate writer thread tail. */
+#define LG_CTL_CAP_CACHE_LINE	64
+#define LG_CTL_CAP_CL_ALIGNED						\
+    __attribute__((__aligned__(LG_CTL_CAP_CACHE_LINE)))
+
+typedef struct lg_ctl_cap_s {
+	/* Set on open, stop on close. */
+	uint8_t		*ring;
+	size_t		ring_size;	/* Power of 2. */
+	int		fd;
+	int		stop;
+	pthread_t	thread;
+	/* Producer: poll thread. */
+	size_t		head LG_CTL_CAP_CL_ALIGNED;
+	uint64_t	frames;		/* Recorded. */
+	uint64_t	bytes;
+	uint64_t	dropped;	/* Ring full or writer failed. */
+	/* Consumer: writer thread. */
+	size_t		tail LG_CTL_CAP_CL_ALIGNED; /* Written to file. */
+	int		error;		/* Write error, capture stopped. */
+} lg_ctl_cap_t, *lg_ctl_cap_p;
+
+#define LG_CTL_CAP_DEF_RING_SIZE	(4 * 1024 * 1024)
+#define LG_CTL_CAP_IDLE_SLEEP		5 /* ms, writer sleep if ring empty. */
+
+
+/*
+ * Open / create file for append and start writer thread.
+ * ring_size: rounded up to power of 2, 0 - default.
+ */
+int	lg_ctl_cap_open(lg_ctl_cap_p cap, const char *file_name,
+	    size_t ring_size);
+/* Write all queued records, stop writer thread and close file. */
+void	lg_ctl_cap_close(lg_ctl_cap_p cap);
+
+/* Append record, time is now. Never blocks, cap = NULL is allowed. */
+void	lg_ctl_cap_rec(lg_ctl_cap_p cap, const uint32_t type,
+	    const uint32_t target, const uint8_t *data, const size_t size);
+
+
+#endif /* __LG_CTL_CAP_H__ */
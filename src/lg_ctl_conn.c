@@ -0,0 +1,259 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_ctl_conn.h"
+#include "lg_mem.h"
+
+
+void
+lg_ctl_conn_init(lg_ctl_conn_p conn, const uintptr_t skt,
+    const size_t buf_max_size) {
+
+	if (NULL == conn)
+		return;
+	memset(conn, 0x00, sizeof(lg_ctl_conn_t));
+	conn->skt = skt;
+	conn->buf_max_size = ((0 != buf_max_size) ?
+	    buf_max_size : LG_CTL_CONN_BUF_MAX_SIZE);
+}
+
+void
+lg_ctl_conn_close(lg_ctl_conn_p conn) {
+
+	if (NULL == conn)
+		return;
+	if (((uintptr_t)-1) != conn->skt) {
+		close((int)conn->skt);
+		conn->skt = (uintptr_t)-1;
+	}
+	conn->rd_off = 0;
+	conn->wr_off = 0;
+	conn->need_size = 0;
+}
+
+void
+lg_ctl_conn_open(lg_ctl_conn_p conn, const uintptr_t skt) {
+
+	if (NULL == conn)
+		return;
+	lg_ctl_conn_close(conn);
+	conn->skt = skt;
+}
+
+void
+lg_ctl_conn_destroy(lg_ctl_conn_p conn) {
+
+	if (NULL == conn)
+		return;
+	lg_ctl_conn_close(conn);
+	lg_free(conn->buf);
+	memset(conn, 0x00, sizeof(lg_ctl_conn_t));
+	conn->skt = (uintptr_t)-1;
+}
+
+/* Make free space at buffer end for at least next packet. */
+static int
+lg_ctl_conn_buf_prepare(lg_ctl_conn_p conn) {
+	size_t data_size, need_size, new_size;
+	uint8_t *new_buf;
+
+	data_size = (conn->wr_off - conn->rd_off);
+	need_size = MAX(conn->need_size, (data_size + 1));
+	if (need_size <= (conn->buf_size - conn->rd_off))
+		return (0); /* Fit to buffer end. */
+	if (need_size <= conn->buf_size) { /* Fit after move to start. */
+		memmove(conn->buf, (conn->buf + conn->rd_off), data_size);
+		conn->rd_off = 0;
+		conn->wr_off = data_size;
+		return (0);
+	}
+	/* Grow. */
+	if (need_size > conn->buf_max_size)
+		return (ENOBUFS);
+	new_size = MAX(conn->buf_size, LG_CTL_CONN_BUF_INIT_SIZE);
+	while (new_size < need_size) {
+		new_size *= 2;
+	}
+	new_size = MIN(new_size, conn->buf_max_size);
+	if (0 != conn->rd_off) {
+		memmove(conn->buf, (conn->buf + conn->rd_off), data_size);
+		conn->rd_off = 0;
+		conn->wr_off = data_size;
+	}
+	new_buf = lg_realloc(conn->buf, new_size);
+	if (NULL == new_buf)
+		return (ENOMEM);
+	conn->buf = new_buf;
+	conn->buf_size = new_size;
+
+	return (0);
+}
+
+int
+lg_ctl_conn_recv(lg_ctl_conn_p conn) {
+	int error;
+	ssize_t ios;
+
+	if (NULL == conn || ((uintptr_t)-1) == conn->skt)
+		return (EINVAL);
+
+	error = lg_ctl_conn_buf_prepare(conn);
+	if (0 != error)
+		return (error);
+	ios = recv((int)conn->skt, (conn->buf + conn->wr_off),
+	    (conn->buf_size - conn->wr_off), MSG_NOSIGNAL);
+	if (0 >= ios)
+		return (((-1 == ios) ? errno : ECONNRESET));
+	conn->wr_off += (size_t)ios;
+
+	return (0);
+}
+
+int
+lg_ctl_conn_buf_get(lg_ctl_conn_p conn, uint8_t **buf, size_t *buf_size) {
+	int error;
+
+	if (NULL == conn || NULL == buf || NULL == buf_size)
+		return (EINVAL);
+
+	error = lg_ctl_conn_buf_prepare(conn);
+	if (0 != error)
+		return (error);
+	(*buf) = (conn->buf + conn->wr_off);
+	(*buf_size) = (conn->buf_size - conn->wr_off);
+
+	return (0);
+}
+
+void
+lg_ctl_conn_buf_commit(lg_ctl_conn_p conn, const size_t size) {
+
+	if (NULL == conn)
+		return;
+	conn->wr_off += MIN(size, (conn->buf_size - conn->wr_off));
+}
+
+/* Capture received bytes [start, end). */
+static inline void
+lg_ctl_conn_cap(lg_ctl_conn_p conn, const uint32_t type, const size_t start,
+    const size_t end) {
+
+	if (NULL == conn->cap || start >= end)
+		return;
+	lg_ctl_cap_rec(conn->cap, type, conn->cap_target,
+	    (conn->buf + start), (end - start));
+}
+
+int
+lg_ctl_conn_pkt_get(lg_ctl_conn_p conn, uint8_t **payload,
+    size_t *payload_size) {
+	int error;
+	size_t off, pkt_off;
+	const uint8_t *ptr;
+
+	if (NULL == conn || NULL == payload || NULL == payload_size)
+		return (EINVAL);
+	if (conn->rd_off == conn->wr_off) { /* All processed, rewind. */
+		conn->rd_off = 0;
+		conn->wr_off = 0;
+		conn->need_size = 0;
+		return (EAGAIN);
+	}
+
+	off = conn->rd_off;
+	error = lg_ctl_pkt_payload_get(&off, conn->buf, conn->wr_off,
+	    &ptr, payload_size);
+	switch (error) {
+	case 0:
+		if (NULL != conn->cap) {
+			pkt_off = (size_t)((ptr - conn->buf) -
+			    (ssize_t)sizeof(lg_ctl_pkt_hdr_t));
+			lg_ctl_conn_cap(conn, LG_CTL_CAP_T_RX_RAW,
+			    conn->rd_off, pkt_off);
+			lg_ctl_conn_cap(conn, LG_CTL_CAP_T_RX, pkt_off, off);
+		}
+		conn->rd_off = off;
+		conn->need_size = 0;
+		(*payload) = (uint8_t*)ptr;
+		break;
+	case EAGAIN:
+		/* Skip garbage before packet start. */
+		lg_ctl_conn_cap(conn, LG_CTL_CAP_T_RX_RAW, conn->rd_off, off);
+		conn->rd_off = off;
+		conn->need_size = (0 != (*payload_size)) ?
+		    (sizeof(lg_ctl_pkt_hdr_t) + (*payload_size)) : 0;
+		break;
+	default:
+		/* Bad header: skip magic byte and look for next packet. */
+		lg_ctl_conn_cap(conn, LG_CTL_CAP_T_RX_RAW, conn->rd_off,
+		    (off + 1));
+		conn->rd_off = (off + 1);
+		conn->need_size = 0;
+		break;
+	}
+
+	return (error);
+}
+
+int
+lg_ctl_conn_data_get(lg_ctl_conn_p conn, lg_ctl_crypto_p crypto,
+    uint8_t **data, size_t *data_size) {
+	int error;
+	uint8_t *payload;
+	size_t payload_size;
+
+	if (NULL == data || NULL == data_size)
+		return (EINVAL);
+
+	error = lg_ctl_conn_pkt_get(conn, &payload, &payload_size);
+	if (0 != error)
+		return (error);
+	/* Packet already skipped in buffer: it is safe to overwrite it. */
+	error = lg_ctl_pkt_payload_decrypt(crypto, payload, payload_size,
+	    payload, payload_size, data_size);
+	if (0 != error)
+		return (error);
+	(*data) = payload;
+
+	return (0);
+}
@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_CTL_CONN_H__
+#define __LG_CTL_CONN_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_cap.h"
+
+
+/*
+ * Connection to soundbar: socket + receive buffer that lives as long as
+ * connection. Received data is kept between calls, every complete
+ * packet is returned as pointer into buffer, without copy.
+ * Buffer used as ring: read and write offsets are moved forward and
+ * reset to start once all data is processed; data is moved to buffer
+ * start only when next packet does not fit to buffer end.
+ * Buffer grows on demand up to buf_max_size, it also limits max
+ * payload size.
+ * If cap is set, every received byte is recorded: packets once complete,
+ * skipped garbage as raw.
+ */
+typedef struct lg_ctl_conn_s {
+	uintptr_t	skt;		/* Socket, owned by conn. */
+	uint8_t		*buf;		/* Receive buffer. */
+	size_t		buf_size;	/* Allocated size. */
+	size_t		buf_max_size;	/* Buffer grow limit. */
+	size_t		rd_off;		/* Start of not processed data. */
+	size_t		wr_off;		/* End of received data. */
+	size_t		need_size;	/* Size of partially received packet. */
+	lg_ctl_cap_p	cap;		/* Optional wire capture. */
+	uint32_t	cap_target;	/* Target index for capture. */
+} lg_ctl_conn_t, *lg_ctl_conn_p;
+
+#define LG_CTL_CONN_BUF_INIT_SIZE	4096
+#define LG_CTL_CONN_BUF_MAX_SIZE	(1024 * 1024)
+
+
+void	lg_ctl_conn_init(lg_ctl_conn_p conn, const uintptr_t skt,
+	    const size_t buf_max_size);
+/* Close socket and drop buffered data, buffer memory is kept for reuse. */
+void	lg_ctl_conn_close(lg_ctl_conn_p conn);
+/* Attach new socket to closed connection, reuse buffer. */
+void	lg_ctl_conn_open(lg_ctl_conn_p conn, const uintptr_t skt);
+void	lg_ctl_conn_destroy(lg_ctl_conn_p conn);
+
+/*
+ * Do one recv() to buffer.
+ * Returns errno from recv(), ECONNRESET on connection close and
+ * ENOBUFS if packet does not fit into buf_max_size.
+ */
+int	lg_ctl_conn_recv(lg_ctl_conn_p conn);
+/*
+ * Receive without socket: get free space at buffer end, copy or read
+ * data there and commit received size.
+ * Returns ENOBUFS if packet does not fit into buf_max_size.
+ */
+int	lg_ctl_conn_buf_get(lg_ctl_conn_p conn, uint8_t **buf,
+	    size_t *buf_size);
+void	lg_ctl_conn_buf_commit(lg_ctl_conn_p conn, const size_t size);
+/*
+ * Get next complete packet from buffer.
+ * Returns 0 and encrypted payload, EAGAIN if more data required.
+ * payload valid until next lg_ctl_conn_recv() / lg_ctl_conn_buf_get()
+ * call.
+ */
+int	lg_ctl_conn_pkt_get(lg_ctl_conn_p conn, uint8_t **payload,
+	    size_t *payload_size);
+/*
+ * Get next complete packet and decrypt it in place, inside buffer.
+ * Returns 0 and zero terminated plain data, EAGAIN if more data required.
+ * data valid until next lg_ctl_conn_recv() / lg_ctl_conn_buf_get() call.
+ */
+int	lg_ctl_conn_data_get(lg_ctl_conn_p conn, lg_ctl_crypto_p crypto,
+	    uint8_t **data, size_t *data_size);
+
+
+#endif /* __LG_CTL_CONN_H__ */
@@ -0,0 +1,459 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <netinet/in.h>
+
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf */
+#include <limits.h>
+#include <openssl/aes.h>
+#include <openssl/evp.h>
+
+#include "lgspkctl.h"
+#include "lg_mem.h"
+
+
+/* "\'%^Ur7gy$~t+f)%@" */
+static const uint8_t lg_aes_iv[LG_AES_IV_SIZE] = {
+	0x27, 0x25, 0x5e, 0x55, 0x72, 0x37, 0x67, 0x79,
+	0x24, 0x7e, 0x74, 0x2b, 0x66, 0x29, 0x25, 0x40
+};
+
+/* "T^&*J%^7tr~4^%^&I(o%^!jIJ__+a0 k" */
+static const uint8_t lg_aes_key[LG_AES_KEY_SIZE] = {
+	0x54, 0x5e, 0x26, 0x2a, 0x4a, 0x25, 0x5e, 0x37,
+	0x74, 0x72, 0x7e, 0x34, 0x5e, 0x25, 0x5e, 0x26,
+	0x49, 0x28, 0x6f, 0x25, 0x5e, 0x21, 0x6a, 0x49,
+	0x4a, 0x5f, 0x5f, 0x2b, 0x61, 0x30, 0x20, 0x6b
+};
+
+
+const char *lg_ctl_msg[LG_CTL_MSG_COUNT] = {
+	"EQ_VIEW_INFO",
+	"SPK_LIST_VIEW_INFO",
+	"PLAY_INFO",
+	"FUNC_VIEW_INFO",
+	"SETTING_VIEW_INFO",
+	"PRODUCT_INFO",
+	"C4A_SETTING_INFO",
+	"RADIO_VIEW_INFO",
+	"SHARE_AP_INFO",
+	"UPDATE_VIEW_INFO",
+	"BUILD_INFO_DEV",
+	"OPTION_INFO_DEV",
+	"MAC_INFO_DEV",
+	"MEM_MON_DEV",
+	"TEST_DEV",
+	"TEST_TONE_REQ",
+	"FACTORY_SET_REQ"
+};
+
+/*
+ * Perfect hash of lg_ctl_msg[] names:
+ * (msg[2] + msg[size - 1] * 15 + size) & 31 -> lg_ctl_msg[] index.
+ * Must be regenerated if lg_ctl_msg[] is changed.
+ */
+#define LG_CTL_MSG_HASH(__msg, __size)					\
+	    ((((uint8_t)(__msg)[2]) +					\
+	    (((uint8_t)(__msg)[((__size) - 1)]) * 15) + (__size)) & 31)
+static const uint8_t lg_ctl_msg_hash[32] = {
+	0xff,   10,   13, 0xff, 0xff,   14,    4, 0xff,
+	0xff, 0xff, 0xff,    2,    0,   11, 0xff,    8,
+	0xff,   16,    6, 0xff,    7,    9, 0xff, 0xff,
+	0xff,   12, 0xff, 0xff,    5,    3,    1,   15,
+};
+
+/* Returns lg_ctl_msg[] index or LG_CTL_MSG_COUNT if msg is unknown. */
+size_t
+lg_ctl_msg_idx_get(const char *msg, const size_t msg_size) {
+	size_t idx;
+
+	if (NULL == msg || 3 > msg_size)
+		return (LG_CTL_MSG_COUNT);
+	idx = lg_ctl_msg_hash[LG_CTL_MSG_HASH(msg, msg_size)];
+	if (LG_CTL_MSG_COUNT <= idx ||
+	    0 != strncmp(lg_ctl_msg[idx], msg, msg_size) ||
+	    0 != lg_ctl_msg[idx][msg_size])
+		return (LG_CTL_MSG_COUNT);
+
+	return (idx);
+}
+
+/* EQ_VIEW_INFO: i_curr_eq, ai_eq_list */
+const char *lg_ctl_equalisers[LG_CTL_EQUALISERS_COUNT] = {
+	"Standard",
+	"Bass",
+	"Flat",
+	"Boost",
+	"Treble and Bass",
+	"User",
+	"Music",
+	"Cinema",
+	"Night",
+	"News",
+	"Voice",
+	"ia_sound",
+	"Adaptive Sound Control",
+	"Movie",
+	"Bass Blast",
+	"Dolby Atmos",
+	"DTS Virtual X",
+	"Bass Boost Plus"
+};
+
+/* FUNC_VIEW_INFO: i_curr_func, ai_func_list */
+const char *lg_ctl_functions[LG_CTL_FUNCTIONS_COUNT] = {
+	"Wifi",
+	"Bluetooth",
+	"Portable",
+	"Aux",
+	"Optical",
+	"CP",
+	"HDMI",
+	"ARC",
+	"Spotify",
+	"Optical2",
+	"HDMI2",
+	"HDMI3",
+	"LG TV",
+	"Mic",
+	"Chromecast",
+	"Optical/HDMI ARC",
+	"LG Optical",
+	"FM",
+	"USB"
+};
+
+
+void
+lg_ctl_crypto_destroy(lg_ctl_crypto_p crypto) {
+
+	if (NULL == crypto)
+		return;
+	EVP_CIPHER_CTX_free(crypto->enc_ctx);
+	EVP_CIPHER_CTX_free(crypto->dec_ctx);
+	memset(crypto, 0x00, sizeof(lg_ctl_crypto_t));
+}
+
+int
+lg_ctl_crypto_init(lg_ctl_crypto_p crypto) {
+
+	if (NULL == crypto)
+		return (EINVAL);
+	memset(crypto, 0x00, sizeof(lg_ctl_crypto_t));
+	crypto->enc_ctx = EVP_CIPHER_CTX_new();
+	crypto->dec_ctx = EVP_CIPHER_CTX_new();
+	if (NULL == crypto->enc_ctx || NULL == crypto->dec_ctx)
+		goto err_out;
+	/* Expand keys here, per packet only IV is reset. */
+	if (1 != EVP_EncryptInit_ex(crypto->enc_ctx, EVP_aes_256_cbc(), NULL,
+	    lg_aes_key, lg_aes_iv) ||
+	    1 != EVP_DecryptInit_ex(crypto->dec_ctx, EVP_aes_256_cbc(), NULL,
+	    lg_aes_key, lg_aes_iv))
+		goto err_out;
+	/* PADding handled by us: decrypt side is more tolerant than PKCS#7. */
+	EVP_CIPHER_CTX_set_padding(crypto->enc_ctx, 0);
+	EVP_CIPHER_CTX_set_padding(crypto->dec_ctx, 0);
+	/* Own AES-NI kernels if CPU has it, EVP otherwise. */
+	lg_aes_mb_key_init(&crypto->mb, lg_aes_key, LG_AES_MB_IMPL_COUNT);
+
+	return (0);
+
+err_out:
+	lg_ctl_crypto_destroy(crypto);
+	return (ENOMEM);
+}
+
+/* Header and PADding, returns payload size. */
+static size_t
+lg_ctl_pkt_frame(const uint8_t *data, const size_t data_size, uint8_t *buf) {
+	const size_t pad_size = (AES_BLOCK_SIZE - (data_size % AES_BLOCK_SIZE));
+	const size_t payload_size = (data_size + pad_size);
+	const uint32_t payload32n_size = htonl((uint32_t)payload_size);
+	uint8_t *out;
+
+	/* Write pcaket header: magic + size. */
+	buf[0] = LG_CTL_PKT_HDR_MAGIC;
+	memcpy((buf + 1), &payload32n_size, sizeof(uint32_t));
+
+	/* Plain data + PADding in place, data may be already there. */
+	out = (buf + sizeof(lg_ctl_pkt_hdr_t));
+	if (out != data) {
+		memmove(out, data, data_size);
+	}
+	memset((out + data_size), (uint8_t)pad_size, pad_size);
+
+	return (payload_size);
+}
+
+int
+lg_ctl_pkt_create(lg_ctl_crypto_p crypto, const uint8_t *data,
+    const size_t data_size, uint8_t *buf, size_t *buf_size_ret) {
+	const size_t payload_size = (data_size +
+	    (AES_BLOCK_SIZE - (data_size % AES_BLOCK_SIZE)));
+	uint8_t *out;
+	int out_size;
+
+	if (NULL != buf_size_ret) {
+		(*buf_size_ret) = ((sizeof(lg_ctl_pkt_hdr_t) + payload_size));
+	}
+	if (NULL == buf)
+		return (ENOBUFS); /* Allow delayed mem alloc. */
+	if (NULL == crypto || NULL == data || 0 == data_size ||
+	    NULL == buf_size_ret || INT_MAX < payload_size)
+		return (EINVAL);
+
+	lg_ctl_pkt_frame(data, data_size, buf);
+	/* Encrypt peyload data in place: reset IV only, key schedule
+	 * is reused. */
+	out = (buf + sizeof(lg_ctl_pkt_hdr_t));
+	if (1 != EVP_EncryptInit_ex(crypto->enc_ctx, NULL, NULL, NULL,
+	    lg_aes_iv) ||
+	    1 != EVP_EncryptUpdate(crypto->enc_ctx, out, &out_size,
+	    out, (int)payload_size))
+		return (EINVAL);
+
+	return (0);
+}
+
+int
+lg_ctl_pkt_create_batch(lg_ctl_crypto_p crypto, lg_ctl_pkt_job_p jobs,
+    const size_t jobs_cnt) {
+	int error;
+	size_t i, j, cnt;
+	lg_aes_mb_job_t mb_jobs[LG_CTL_PKT_BATCH_MAX];
+
+	if (NULL == crypto || NULL == jobs)
+		return (EINVAL);
+	for (i = 0; i < jobs_cnt; i ++) {
+		if (NULL == jobs[i].data || 0 == jobs[i].data_size ||
+		    NULL == jobs[i].buf || INT_MAX <= jobs[i].data_size)
+			return (EINVAL);
+	}
+	if (LG_AES_MB_IMPL_NONE == crypto->mb.impl) {
+		/* Portable: packet by packet. */
+		for (i = 0; i < jobs_cnt; i ++) {
+			error = lg_ctl_pkt_create(crypto, jobs[i].data,
+			    jobs[i].data_size, jobs[i].buf,
+			    &jobs[i].buf_size);
+			if (0 != error)
+				return (error);
+		}
+		return (0);
+	}
+	/* Interleaved: one block of every packet per pass. */
+	for (i = 0; i < jobs_cnt; i += cnt) {
+		cnt = MIN((jobs_cnt - i), LG_CTL_PKT_BATCH_MAX);
+		for (j = 0; j < cnt; j ++) {
+			mb_jobs[j].size = lg_ctl_pkt_frame(jobs[(i + j)].data,
+			    jobs[(i + j)].data_size, jobs[(i + j)].buf);
+			mb_jobs[j].data = (jobs[(i + j)].buf +
+			    sizeof(lg_ctl_pkt_hdr_t));
+			jobs[(i + j)].buf_size = (sizeof(lg_ctl_pkt_hdr_t) +
+			    mb_jobs[j].size);
+		}
+		lg_aes_mb_cbc_encrypt(&crypto->mb, lg_aes_iv, mb_jobs, cnt);
+	}
+
+	return (0);
+}
+
+int
+lg_ctl_pkt_payload_get(size_t *buf_off, const uint8_t *buf,
+    const size_t buf_size, const uint8_t **payload, size_t *payload_size) {
+	size_t pkt_size;
+	uint32_t payload32n_size;
+	const uint8_t *ptr;
+
+	if (NULL == buf || NULL == buf_off || (*buf_off) >= buf_size ||
+	    NULL == payload || NULL == payload_size)
+		return (EINVAL);
+	(*payload_size) = 0;
+
+	/* Looking for packet header start. */
+	ptr = memchr((buf + (*buf_off)), LG_CTL_PKT_HDR_MAGIC,
+	    (buf_size - (*buf_off)));
+	if (NULL == ptr) {
+		(*buf_off) = buf_size;
+		return (EAGAIN);
+	}
+	(*buf_off) = (size_t)(ptr - buf); /* Remember packet offset in buf. */
+	ptr ++;
+
+	/* Read packet size from header. */
+	if ((buf_size - (size_t)(ptr - buf)) < sizeof(uint32_t))
+		return (EAGAIN); /* Not enough data received. */
+	memcpy(&payload32n_size, ptr, sizeof(uint32_t));
+	pkt_size = ntohl(payload32n_size);
+	ptr += sizeof(uint32_t);
+	if (0 == pkt_size || 0 != (pkt_size % AES_BLOCK_SIZE) ||
+	    INT_MAX < pkt_size)
+		return (EBADMSG); /* Bad payload. */
+	(*payload_size) = pkt_size;
+
+	/* Check available data. */
+	if ((buf_size - (size_t)(ptr - buf)) < pkt_size)
+		return (EAGAIN); /* Not enough data received. */
+
+	(*buf_off) = (size_t)((ptr + pkt_size) - buf); /* Set next packet offset. */
+	(*payload) = ptr;
+
+	return (0);
+}
+
+int
+lg_ctl_pkt_payload_decrypt(lg_ctl_crypto_p crypto,
+    const uint8_t *payload, const size_t payload_size,
+    uint8_t *data, const size_t data_size, size_t *data_size_ret) {
+	size_t pad_size;
+	int out_size;
+
+	if (NULL == crypto || NULL == payload || 0 == payload_size ||
+	    0 != (payload_size % AES_BLOCK_SIZE) || INT_MAX < payload_size)
+		return (EINVAL);
+	if (data_size < payload_size || NULL == data) {
+		if (NULL != data_size_ret) {
+			(*data_size_ret) = payload_size;
+		}
+		return (ENOBUFS); /* Allow delayed mem alloc. */
+	}
+
+	/* Decrypt peyload data: reset IV only, key schedule is reused.
+	 * CBC decryption is parallel: many blocks at once if CPU allows. */
+	if (LG_AES_MB_IMPL_NONE != crypto->mb.impl) {
+		lg_aes_mb_cbc_decrypt(&crypto->mb, lg_aes_iv, payload, data,
+		    payload_size);
+	} else if (1 != EVP_DecryptInit_ex(crypto->dec_ctx, NULL, NULL, NULL,
+	    lg_aes_iv) ||
+	    1 != EVP_DecryptUpdate(crypto->dec_ctx, data, &out_size,
+	    payload, (int)payload_size))
+		return (EINVAL);
+
+	/* Process PADding. */
+	pad_size = data[(payload_size - 1)];
+	if (0 == pad_size || AES_BLOCK_SIZE < pad_size)
+		return (EBADMSG); /* Bad payload. */
+	/* Zeroize end, we always have space for that. */
+	data[(payload_size - pad_size)] = 0;
+	if (NULL != data_size_ret) { /* Decrease PADding size. */
+		(*data_size_ret) = (payload_size - pad_size);
+	}
+
+	return (0);
+}
+
+int
+lg_ctl_pkt_data_get(lg_ctl_crypto_p crypto, size_t *buf_off,
+    const uint8_t *buf, const size_t buf_size,
+    uint8_t *data, const size_t data_size, size_t *data_size_ret) {
+	int error;
+	size_t off, payload_size;
+	const uint8_t *payload;
+
+	if (NULL == crypto || NULL == buf_off)
+		return (EINVAL);
+
+	off = (*buf_off);
+	error = lg_ctl_pkt_payload_get(&off, buf, buf_size,
+	    &payload, &payload_size);
+	if (0 != error) {
+		(*buf_off) = off;
+		return (error);
+	}
+	error = lg_ctl_pkt_payload_decrypt(crypto, payload, payload_size,
+	    data, data_size, data_size_ret);
+	if (ENOBUFS == error) { /* Point to packet start. */
+		(*buf_off) = (size_t)((payload - buf) -
+		    (ssize_t)sizeof(lg_ctl_pkt_hdr_t));
+		return (error);
+	}
+	(*buf_off) = off; /* Set next packet offset. */
+
+	return (error);
+}
+
+void
+lg_ctl_get_pkts_destroy(lg_ctl_get_pkts_p get_pkts) {
+
+	if (NULL == get_pkts)
+		return;
+	lg_free(get_pkts->mem);
+	memset(get_pkts, 0x00, sizeof(lg_ctl_get_pkts_t));
+}
+
+int
+lg_ctl_get_pkts_create(lg_ctl_crypto_p crypto, lg_ctl_get_pkts_p get_pkts) {
+	int error;
+	size_t i, off, pkt_size, req_size[LG_CTL_MSG_GET_COUNT];
+	char req[LG_CTL_MSG_GET_COUNT][64];
+	lg_ctl_pkt_job_t jobs[LG_CTL_MSG_GET_COUNT];
+
+	if (NULL == crypto || NULL == get_pkts)
+		return (EINVAL);
+	memset(get_pkts, 0x00, sizeof(lg_ctl_get_pkts_t));
+
+	/* Calc total size. */
+	for (i = 0; i < LG_CTL_MSG_GET_COUNT; i ++) {
+		req_size[i] = (size_t)snprintf(req[i], sizeof(req[i]),
+		    LG_CTL_GET_REQ_FMT, lg_ctl_msg[i]);
+		lg_ctl_pkt_create(crypto, (const uint8_t*)req[i], req_size[i],
+		    NULL, &pkt_size);
+		get_pkts->mem_size += pkt_size;
+	}
+	get_pkts->mem = lg_malloc(get_pkts->mem_size);
+	if (NULL == get_pkts->mem)
+		return (ENOMEM);
+	/* Encrypt all at once. */
+	for (i = 0, off = 0; i < LG_CTL_MSG_GET_COUNT; i ++) {
+		jobs[i].data = (const uint8_t*)req[i];
+		jobs[i].data_size = req_size[i];
+		jobs[i].buf = (get_pkts->mem + off);
+		lg_ctl_pkt_create(crypto, jobs[i].data, jobs[i].data_size,
+		    NULL, &pkt_size);
+		off += pkt_size;
+	}
+	error = lg_ctl_pkt_create_batch(crypto, jobs, LG_CTL_MSG_GET_COUNT);
+	if (0 != error)
+		goto err_out;
+	for (i = 0; i < LG_CTL_MSG_GET_COUNT; i ++) {
+		get_pkts->pkt[i].data = jobs[i].buf;
+		get_pkts->pkt[i].size = jobs[i].buf_size;
+	}
+
+	return (0);
+
+err_out:
+	lg_ctl_get_pkts_destroy(get_pkts);
+	return (error);
+}
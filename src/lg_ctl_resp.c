@@ -0,0 +1,170 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_resp.h"
+
+
+typedef struct lg_ctl_resp_rd_s {
+	lg_ctl_resp_p	resp;
+	lg_ctl_resp_cb	cb;
+	void		*udata;
+	int		in_data;	/* Inside "data" object. */
+	int		data_pass;	/* "data" events are passed to cb. */
+} lg_ctl_resp_rd_t, *lg_ctl_resp_rd_p;
+
+
+static int
+lg_ctl_resp_data_cb(const lg_json_ev_t *ev, void *udata) {
+	lg_ctl_resp_rd_p rd = udata;
+
+	return (rd->cb(rd->resp, ev, rd->udata));
+}
+
+static int
+lg_ctl_resp_json_cb(const lg_json_ev_t *ev, void *udata) {
+	lg_ctl_resp_rd_p rd = udata;
+	lg_ctl_resp_p resp = rd->resp;
+	lg_json_ev_t data_ev;
+
+	switch (ev->depth) {
+	case 0: /* Root must be object. */
+		if (LG_JSON_EV_OBJ_BEGIN != ev->type &&
+		    LG_JSON_EV_OBJ_END != ev->type)
+			return (EBADMSG);
+		return (0);
+	case 1:
+		break;
+	default:
+		if (0 == rd->in_data || 0 == rd->data_pass)
+			return (0);
+		data_ev = (*ev);
+		data_ev.depth --;
+		return (rd->cb(resp, &data_ev, rd->udata));
+	}
+
+	/* Root members. */
+	switch (ev->name_size) {
+	case 3:
+		if (0 == memcmp(ev->name, "msg", 3)) {
+			if (LG_JSON_EV_STRING != ev->type)
+				return (EBADMSG);
+			resp->msg = ev->value;
+			resp->msg_size = ev->value_size;
+			resp->msg_idx = lg_ctl_msg_idx_get(ev->value,
+			    ev->value_size);
+		} else if (0 == memcmp(ev->name, "cmd", 3)) {
+			resp->notify = (LG_JSON_EV_STRING == ev->type &&
+			    9 == ev->value_size &&
+			    0 == memcmp(ev->value, "notibyget", 9));
+		}
+		break;
+	case 4:
+		if (0 != memcmp(ev->name, "data", 4))
+			break;
+		switch (ev->type) {
+		case LG_JSON_EV_OBJ_BEGIN:
+			rd->in_data = 1;
+			if (NULL != rd->cb &&
+			    LG_CTL_MSG_COUNT != resp->msg_idx &&
+			    0 != resp->result) {
+				rd->data_pass = 1;
+			}
+			break;
+		case LG_JSON_EV_OBJ_END:
+			rd->in_data = 0;
+			resp->data = ev->value;
+			resp->data_size = ev->value_size;
+			break;
+		default:
+			return (0);
+		}
+		if (0 == rd->data_pass)
+			return (0);
+		data_ev = (*ev);
+		data_ev.depth --;
+		return (rd->cb(resp, &data_ev, rd->udata));
+	case 6:
+		if (0 != memcmp(ev->name, "result", 6))
+			break;
+		switch (ev->type) {
+		case LG_JSON_EV_STRING:
+			resp->result = (2 == ev->value_size &&
+			    0 == memcmp(ev->value, "ok", 2));
+			break;
+		case LG_JSON_EV_TRUE:
+			resp->result = 1;
+			break;
+		default:
+			resp->result = 0;
+			break;
+		}
+		break;
+	}
+
+	return (0);
+}
+
+
+int
+lg_ctl_resp_parse(const char *buf, const size_t buf_size,
+    lg_ctl_resp_cb cb, void *udata, lg_ctl_resp_p resp) {
+	int error;
+	lg_ctl_resp_rd_t rd;
+
+	if (NULL == buf || NULL == resp)
+		return (EINVAL);
+
+	memset(resp, 0x00, sizeof(lg_ctl_resp_t));
+	resp->msg_idx = LG_CTL_MSG_COUNT;
+	memset(&rd, 0x00, sizeof(rd));
+	rd.resp = resp;
+	rd.cb = cb;
+	rd.udata = udata;
+	error = lg_json_parse(buf, buf_size, lg_ctl_resp_json_cb, &rd);
+	if (0 != error)
+		return (error);
+	if (LG_CTL_MSG_COUNT == resp->msg_idx)
+		return (EBADMSG);
+	/* "data" was before "msg" / "result": pass it now. */
+	if (NULL != cb && 0 == rd.data_pass &&
+	    NULL != resp->data && 0 != resp->result) {
+		error = lg_json_parse(resp->data, resp->data_size,
+		    lg_ctl_resp_data_cb, &rd);
+	}
+
+	return (error);
+}
@@ -0,0 +1,67 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_CTL_RESP_H__
+#define __LG_CTL_RESP_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lg_json.h"
+
+
+/*
+ * Responce decoder: {"msg": "...", "result": "ok", "data": {...}}
+ * in one pass with lg_json, no DOM and no allocations.
+ */
+
+typedef struct lg_ctl_resp_s {
+	size_t		msg_idx; /* lg_ctl_msg[] index, LG_CTL_MSG_COUNT if unknown. */
+	const char	*msg;
+	size_t		msg_size;
+	int		notify;	/* "cmd": "notibyget". */
+	int		result;	/* 1: "ok" or true, 0: other or absent. */
+	const char	*data;	/* "data" object text, NULL if absent. */
+	size_t		data_size;
+} lg_ctl_resp_t, *lg_ctl_resp_p;
+
+/* Events for "data" object, depth is relative to it: "data" is 0,
+ * its members are 1.
+ * Called only if msg is known and result is ok, if "data" goes before
+ * "msg" / "result" its events are delivered after document is parsed. */
+typedef int (*lg_ctl_resp_cb)(const lg_ctl_resp_t *resp,
+	    const lg_json_ev_t *ev, void *udata);
+
+/* Returns EBADMSG if not valid JSON object or msg is unknown. */
+int	lg_ctl_resp_parse(const char *buf, size_t buf_size,
+	    lg_ctl_resp_cb cb, void *udata, lg_ctl_resp_p resp);
+
+
+#endif /* __LG_CTL_RESP_H__ */
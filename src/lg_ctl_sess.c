@@ -0,0 +1,470 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf */
+#include <errno.h>
+
+#include "lg_ctl_sess.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+
+
+#define LG_CTL_SESS_REQ_GET	"{\"cmd\": \"get\", \"msg\": \"%s\"}"
+#define LG_CTL_SESS_REQ_SET	"{\"cmd\": \"set\", \"msg\": \"%s\", \"data\": %.*s}"
+
+
+void
+lg_ctl_sess_init(lg_ctl_sess_p sess, lg_ctl_crypto_p crypto,
+    lg_ctl_get_pkts_p get_pkts, size_t buf_max_size) {
+
+	if (NULL == sess)
+		return;
+	memset(sess, 0x00, sizeof(lg_ctl_sess_t));
+	sess->crypto = crypto;
+	sess->get_pkts = get_pkts;
+	sess->timeout = LG_CTL_SESS_DEF_TIMEOUT;
+	lg_ctl_conn_init(&sess->in, (uintptr_t)-1,
+	    ((0 != buf_max_size) ? buf_max_size : LG_CTL_CONN_BUF_MAX_SIZE));
+}
+
+void
+lg_ctl_sess_destroy(lg_ctl_sess_p sess) {
+
+	if (NULL == sess)
+		return;
+	lg_ctl_conn_destroy(&sess->in);
+	lg_free(sess->out);
+	memset(sess, 0x00, sizeof(lg_ctl_sess_t));
+}
+
+void
+lg_ctl_sess_reset(lg_ctl_sess_p sess) {
+
+	if (NULL == sess)
+		return;
+	lg_ctl_conn_close(&sess->in);
+	sess->out_off = 0;
+	sess->out_size = 0;
+	sess->out_total = 0;
+	sess->sent_total = 0;
+	sess->in_flight_cnt = 0;
+	memset(sess->in_flight, 0x00, sizeof(sess->in_flight));
+}
+
+
+/* Free space for size bytes at out end. */
+static int
+lg_ctl_sess_out_reserve(lg_ctl_sess_p sess, const size_t size) {
+	size_t new_size;
+	uint8_t *out;
+
+	if ((sess->out_allocated - sess->out_size) >= size)
+		return (0);
+	if (0 != sess->out_off) { /* Drop sent data first. */
+		sess->out_size -= sess->out_off;
+		memmove(sess->out, (sess->out + sess->out_off),
+		    sess->out_size);
+		sess->out_off = 0;
+		if ((sess->out_allocated - sess->out_size) >= size)
+			return (0);
+	}
+	new_size = roundup((sess->out_size + size), LG_CTL_CONN_BUF_INIT_SIZE);
+	out = lg_realloc(sess->out, new_size);
+	if (NULL == out)
+		return (ENOMEM);
+	sess->out = out;
+	sess->out_allocated = new_size;
+
+	return (0);
+}
+
+/* Packet of pkt_size bytes is at out end: queue it. */
+static void
+lg_ctl_sess_req_queued(lg_ctl_sess_p sess, const size_t msg_idx,
+    const size_t pkt_size, const uint64_t now) {
+
+	lg_ctl_cap_rec(sess->in.cap, LG_CTL_CAP_T_TX, sess->in.cap_target,
+	    (sess->out + sess->out_size), pkt_size);
+	if (0 == sess->in_flight[msg_idx]) {
+		sess->ts_req[msg_idx] = now;
+		sess->req_off[msg_idx] = sess->out_total;
+	}
+	sess->out_size += pkt_size;
+	sess->out_total += pkt_size;
+	sess->in_flight[msg_idx] ++;
+	sess->in_flight_cnt ++;
+	if (NULL != sess->stats) {
+		sess->stats->tx_reqs ++;
+	}
+}
+
+/* Build request packet in place, at out end. data = NULL: GET. */
+static int
+lg_ctl_sess_req(lg_ctl_sess_p sess, const size_t msg_idx,
+    const char *data, const size_t data_size, const uint64_t now) {
+	int error;
+	uint8_t *pkt;
+	size_t plain_size, pkt_size;
+
+	if (UINT8_MAX == sess->in_flight[msg_idx])
+		return (EBUSY);
+	if (NULL == data && NULL != sess->get_pkts &&
+	    LG_CTL_MSG_GET_COUNT > msg_idx) { /* Ready packet. */
+		return (lg_ctl_sess_pkt_add(sess, msg_idx,
+		    sess->get_pkts->pkt[msg_idx].data,
+		    sess->get_pkts->pkt[msg_idx].size, now));
+	} else {
+		plain_size = (strlen(lg_ctl_msg[msg_idx]) + ((NULL == data) ?
+		    sizeof(LG_CTL_SESS_REQ_GET) :
+		    (sizeof(LG_CTL_SESS_REQ_SET) + data_size)));
+		lg_ctl_pkt_create(sess->crypto, NULL, plain_size, NULL,
+		    &pkt_size);
+		error = lg_ctl_sess_out_reserve(sess, pkt_size);
+		if (0 != error)
+			return (error);
+		pkt = (sess->out + sess->out_size);
+		if (NULL == data) {
+			plain_size = (size_t)snprintf(
+			    (char*)(pkt + sizeof(lg_ctl_pkt_hdr_t)),
+			    plain_size, LG_CTL_SESS_REQ_GET,
+			    lg_ctl_msg[msg_idx]);
+		} else {
+			plain_size = (size_t)snprintf(
+			    (char*)(pkt + sizeof(lg_ctl_pkt_hdr_t)),
+			    plain_size, LG_CTL_SESS_REQ_SET,
+			    lg_ctl_msg[msg_idx], (int)data_size, data);
+		}
+		error = lg_ctl_pkt_create(sess->crypto,
+		    (pkt + sizeof(lg_ctl_pkt_hdr_t)), plain_size, pkt,
+		    &pkt_size);
+		if (0 != error)
+			return (error);
+	}
+	lg_ctl_sess_req_queued(sess, msg_idx, pkt_size, now);
+
+	return (0);
+}
+
+int
+lg_ctl_sess_get(lg_ctl_sess_p sess, size_t msg_idx, uint64_t now) {
+
+	if (NULL == sess || NULL == sess->crypto ||
+	    LG_CTL_MSG_COUNT <= msg_idx)
+		return (EINVAL);
+	if (0 != sess->in_flight[msg_idx])
+		return (0); /* Answer to pending request will do. */
+
+	return (lg_ctl_sess_req(sess, msg_idx, NULL, 0, now));
+}
+
+int
+lg_ctl_sess_set(lg_ctl_sess_p sess, size_t msg_idx,
+    const char *data, size_t data_size, uint64_t now) {
+
+	if (NULL == sess || NULL == sess->crypto ||
+	    LG_CTL_MSG_COUNT <= msg_idx || NULL == data || 0 == data_size ||
+	    INT_MAX < data_size)
+		return (EINVAL);
+
+	return (lg_ctl_sess_req(sess, msg_idx, data, data_size, now));
+}
+
+int
+lg_ctl_sess_pkt_add(lg_ctl_sess_p sess, size_t msg_idx,
+    const uint8_t *pkt, size_t pkt_size, uint64_t now) {
+	int error;
+
+	if (NULL == sess || LG_CTL_MSG_COUNT <= msg_idx || NULL == pkt ||
+	    sizeof(lg_ctl_pkt_hdr_t) > pkt_size)
+		return (EINVAL);
+	if (UINT8_MAX == sess->in_flight[msg_idx])
+		return (EBUSY);
+	error = lg_ctl_sess_out_reserve(sess, pkt_size);
+	if (0 != error)
+		return (error);
+	memcpy((sess->out + sess->out_size), pkt, pkt_size);
+	lg_ctl_sess_req_queued(sess, msg_idx, pkt_size, now);
+
+	return (0);
+}
+
+
+int
+lg_ctl_sess_out_get(lg_ctl_sess_p sess, const uint8_t **data,
+    size_t *data_size) {
+
+	if (NULL == sess || NULL == data || NULL == data_size)
+		return (EINVAL);
+	if (sess->out_off == sess->out_size) {
+		sess->out_off = 0;
+		sess->out_size = 0;
+		return (EAGAIN);
+	}
+	(*data) = (sess->out + sess->out_off);
+	(*data_size) = (sess->out_size - sess->out_off);
+
+	return (0);
+}
+
+int
+lg_ctl_sess_out_done(lg_ctl_sess_p sess, ssize_t ios, uint64_t now) {
+	size_t i, sent;
+
+	if (0 > ios)
+		return (((-1 == ios && 0 != errno) ? errno : EINVAL));
+	if (NULL == sess)
+		return (EINVAL);
+	sent = MIN((size_t)ios, (sess->out_size - sess->out_off));
+	if (NULL != sess->stats && 0 != sent) {
+		/* Requests with first byte sent now. */
+		for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+			if (0 == sess->in_flight[i] ||
+			    sess->sent_total > sess->req_off[i] ||
+			    (sess->sent_total + sent) <= sess->req_off[i])
+				continue;
+			sess->ts_sent[i] = now;
+			lg_spk_stats_add(sess->stats, sess->stats_target, i,
+			    LG_SPK_STAT_SEND, (now - sess->ts_req[i]));
+		}
+		sess->stats->tx_bytes += sent;
+	}
+	sess->out_off += sent;
+	sess->sent_total += sent;
+
+	return (0);
+}
+
+
+int
+lg_ctl_sess_in_get(lg_ctl_sess_p sess, uint8_t **buf, size_t *buf_size) {
+
+	if (NULL == sess)
+		return (EINVAL);
+
+	return (lg_ctl_conn_buf_get(&sess->in, buf, buf_size));
+}
+
+/* Stages of one responce, msg_idx: LG_CTL_MSG_COUNT if not requested. */
+static void
+lg_ctl_sess_stats(lg_ctl_sess_p sess, const size_t msg_idx,
+    const uint64_t ts_req, const uint64_t ts_frame, const uint64_t now,
+    const uint64_t ts_handle, const uint64_t ts_decrypted,
+    const uint64_t ts_decoded) {
+
+	if (LG_CTL_MSG_COUNT > msg_idx) {
+		if (ts_frame >= sess->ts_sent[msg_idx]) {
+			lg_spk_stats_add(sess->stats, sess->stats_target,
+			    msg_idx, LG_SPK_STAT_WAIT,
+			    (ts_frame - sess->ts_sent[msg_idx]));
+		}
+		lg_spk_stats_add(sess->stats, sess->stats_target, msg_idx,
+		    LG_SPK_STAT_TOTAL, (ts_decoded - ts_req));
+	}
+	lg_spk_stats_add(sess->stats, sess->stats_target, msg_idx,
+	    LG_SPK_STAT_RECV, (now - ts_frame));
+	lg_spk_stats_add(sess->stats, sess->stats_target, msg_idx,
+	    LG_SPK_STAT_DECRYPT, (ts_decrypted - ts_handle));
+	lg_spk_stats_add(sess->stats, sess->stats_target, msg_idx,
+	    LG_SPK_STAT_DECODE, (ts_decoded - ts_decrypted));
+}
+
+int
+lg_ctl_sess_in_done(lg_ctl_sess_p sess, ssize_t ios, uint64_t now) {
+	int error, parse_error = 0;
+	uint8_t *data;
+	size_t payload_size, data_size, msg_idx;
+	uint64_t ts_req = 0, ts_frame, ts_handle = 0, ts_decrypted = 0;
+	uint64_t ts_decoded = 0;
+	lg_ctl_resp_t resp;
+	lg_spk_info_dec_t dec;
+
+	if (0 >= ios)
+		return (((0 == ios) ? ECONNRESET :
+		    ((-1 == ios && 0 != errno) ? errno : EINVAL)));
+	if (NULL == sess || NULL == sess->crypto)
+		return (EINVAL);
+
+	if (sess->in.rd_off == sess->in.wr_off) {
+		sess->ts_rx = now; /* Next frame starts in this data. */
+	}
+	lg_ctl_conn_buf_commit(&sess->in, (size_t)ios);
+	/* Process all received responces. */
+	for (;;) {
+		error = lg_ctl_conn_pkt_get(&sess->in, &data, &payload_size);
+		if (EAGAIN == error)
+			break;
+		if (0 != error)
+			return (error);
+		/* Frame started before, rest of data is from this call. */
+		ts_frame = sess->ts_rx;
+		sess->ts_rx = now;
+		if (NULL != sess->stats) { /* Frames are handled one by one. */
+			ts_handle = ((0 != ts_decoded) ? ts_decoded :
+			    lg_ev_time_us());
+		}
+		/* Packet already skipped in buffer: it is safe to overwrite
+		 * it. */
+		error = lg_ctl_pkt_payload_decrypt(sess->crypto, data,
+		    payload_size, data, payload_size, &data_size);
+		if (0 != error)
+			return (error);
+		if (NULL != sess->stats) {
+			ts_decrypted = lg_ev_time_us();
+			sess->stats->rx_frames ++;
+			sess->stats->rx_bytes += (sizeof(lg_ctl_pkt_hdr_t) +
+			    payload_size);
+		}
+		if (NULL != sess->data_cb) {
+			msg_idx = LG_CTL_MSG_COUNT;
+			error = sess->data_cb(sess, data, data_size, now,
+			    &msg_idx, sess->udata);
+			if (0 != error)
+				return (error);
+		} else if (NULL != sess->info) {
+			lg_spk_info_dec_init(&dec, sess->info);
+			parse_error = lg_ctl_resp_parse((const char*)data,
+			    data_size, lg_spk_info_dec_cb, &dec, &resp);
+		} else {
+			parse_error = lg_ctl_resp_parse((const char*)data,
+			    data_size, NULL, NULL, &resp);
+		}
+		if (NULL == sess->data_cb) {
+			msg_idx = ((0 != parse_error) ? LG_CTL_MSG_COUNT :
+			    ((0 != resp.notify) ? LG_CTL_SESS_MSG_NOTIFY :
+			    resp.msg_idx));
+		}
+		if (NULL != sess->stats) {
+			ts_decoded = lg_ev_time_us();
+		}
+		if (LG_CTL_SESS_MSG_NOTIFY == msg_idx) {
+			msg_idx = LG_CTL_MSG_COUNT; /* Pushed, not answer. */
+		} else {
+			if (LG_CTL_MSG_COUNT <= msg_idx &&
+			    1 == sess->in_flight_cnt) {
+				/* Only one request can be answered. */
+				for (msg_idx = 0;
+				    0 == sess->in_flight[msg_idx];
+				    msg_idx ++)
+					;
+			}
+			if (LG_CTL_MSG_COUNT > msg_idx &&
+			    0 != sess->in_flight[msg_idx]) {
+				sess->in_flight[msg_idx] --;
+				sess->in_flight_cnt --;
+				ts_req = sess->ts_req[msg_idx];
+				if (0 != sess->in_flight[msg_idx]) {
+					/* Next answer is waited from now. */
+					sess->ts_req[msg_idx] = now;
+				}
+			} else {
+				msg_idx = LG_CTL_MSG_COUNT;
+			}
+		}
+		if (NULL != sess->stats) {
+			lg_ctl_sess_stats(sess, msg_idx, ts_req, ts_frame, now,
+			    ts_handle, ts_decrypted, ts_decoded);
+		}
+		if (NULL != sess->cb) {
+			sess->cb(sess, msg_idx, parse_error,
+			    ((NULL == sess->data_cb && 0 == parse_error) ?
+			    &resp : NULL), data, data_size, sess->udata);
+		}
+	}
+
+	return (0);
+}
+
+int
+lg_ctl_sess_input(lg_ctl_sess_p sess, const uint8_t *data,
+    size_t data_size, uint64_t now) {
+	int error;
+	uint8_t *buf;
+	size_t buf_size;
+
+	if (NULL == data && 0 != data_size)
+		return (EINVAL);
+	while (0 != data_size) {
+		error = lg_ctl_sess_in_get(sess, &buf, &buf_size);
+		if (0 != error)
+			return (error);
+		buf_size = MIN(buf_size, data_size);
+		memcpy(buf, data, buf_size);
+		error = lg_ctl_sess_in_done(sess, (ssize_t)buf_size, now);
+		if (0 != error)
+			return (error);
+		data += buf_size;
+		data_size -= buf_size;
+	}
+
+	return (0);
+}
+
+
+uint64_t
+lg_ctl_sess_deadline(const lg_ctl_sess_t *sess) {
+	size_t i;
+	uint64_t deadline = (uint64_t)-1;
+
+	if (NULL == sess || 0 == sess->timeout || 0 == sess->in_flight_cnt)
+		return (deadline);
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		if (0 == sess->in_flight[i])
+			continue;
+		deadline = MIN(deadline,
+		    (sess->ts_req[i] + (sess->timeout * 1000)));
+	}
+
+	return (deadline);
+}
+
+void
+lg_ctl_sess_timer(lg_ctl_sess_p sess, uint64_t now) {
+	size_t i;
+
+	if (NULL == sess || 0 == sess->timeout || 0 == sess->in_flight_cnt)
+		return;
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		if (0 == sess->in_flight[i] ||
+		    now < (sess->ts_req[i] + (sess->timeout * 1000)))
+			continue;
+		sess->in_flight_cnt -= sess->in_flight[i];
+		sess->in_flight[i] = 0;
+		if (NULL != sess->cb) {
+			sess->cb(sess, i, ETIMEDOUT, NULL, NULL, 0,
+			    sess->udata);
+		}
+	}
+}
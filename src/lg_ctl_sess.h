@@ -0,0 +1,168 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_CTL_SESS_H__
+#define __LG_CTL_SESS_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_conn.h"
+#include "lg_ctl_resp.h"
+#include "lg_spk_info.h"
+#include "lg_spk_stats.h"
+
+
+/*
+ * Session with one soundbar without any I/O: caller owns socket and
+ * event loop and moves bytes, session does framing, crypto, request
+ * tracking, responce decoding and time limits.
+ *
+ *   lg_ctl_sess_get() / lg_ctl_sess_set()  - queue request;
+ *   lg_ctl_sess_out_get() / out_done()     - bytes to send;
+ *   lg_ctl_sess_in_get() / in_done()       - bytes received;
+ *   lg_ctl_sess_deadline() / timer()       - when to call timer.
+ *
+ * Every answer, pushed notification and timed out request is reported
+ * to cb from in_done() / timer().
+ * Time is monotonic, us, for example lg_ev_time_us().
+ * Wire capture: set in.cap and in.cap_target after init.
+ * Latency stats: set stats and stats_target after init, request stages
+ * are added to it, see lg_spk_stats.h: two more clock reads per
+ * responce.
+ * Session is not thread safe, but sessions are independent.
+ */
+
+typedef struct lg_ctl_sess_s *lg_ctl_sess_p;
+
+/*
+ * error: 0 - resp is decoded, typed fields are in sess->info if set;
+ * EBADMSG - data is not valid responce; ETIMEDOUT - no answer, resp and
+ * data are NULL.
+ * msg_idx: answered request, LG_CTL_MSG_COUNT for notification or not
+ * requested message.
+ * data: zero terminated plain JSON, valid only during call.
+ */
+typedef void (*lg_ctl_sess_cb)(lg_ctl_sess_p sess, size_t msg_idx,
+	    int error, const lg_ctl_resp_t *resp, const uint8_t *data,
+	    size_t data_size, void *udata);
+
+/*
+ * Optional own decoder, replaces lg_ctl_resp_parse(): cb is called
+ * after it with error 0 and resp NULL.
+ * Must set msg_idx: lg_ctl_msg[] index of responce, LG_CTL_MSG_COUNT
+ * if unknown, LG_CTL_SESS_MSG_NOTIFY for pushed notification.
+ * Non zero return value stops in_done() and returned by it.
+ */
+#define LG_CTL_SESS_MSG_NOTIFY	((size_t)-1)
+typedef int (*lg_ctl_sess_data_cb)(lg_ctl_sess_p sess, uint8_t *data,
+	    size_t data_size, uint64_t now, size_t *msg_idx, void *udata);
+
+typedef struct lg_ctl_sess_s {
+	/* Settings. */
+	lg_ctl_crypto_p	crypto;
+	lg_ctl_get_pkts_p get_pkts;	/* Optional: pre encrypted GETs. */
+	uint64_t	timeout;	/* Responce time limit, ms, 0 - none. */
+	lg_spk_info_p	info;		/* Optional: typed decoding to. */
+	lg_ctl_sess_cb	cb;
+	lg_ctl_sess_data_cb data_cb;	/* Optional. */
+	void		*udata;
+	lg_spk_stats_p	stats;		/* Optional latency stats. */
+	size_t		stats_target;	/* Target index for stats. */
+	/* Internal. */
+	lg_ctl_conn_t	in;		/* Receive buffer, no socket. */
+	uint8_t		*out;		/* Packets to send. */
+	size_t		out_off;	/* Sent. */
+	size_t		out_size;
+	size_t		out_allocated;
+	uint64_t	out_total;	/* Bytes queued since reset. */
+	uint64_t	sent_total;	/* Bytes sent since reset. */
+	size_t		in_flight_cnt;
+	uint8_t		in_flight[LG_CTL_MSG_COUNT]; /* Requests count. */
+	uint64_t	ts_req[LG_CTL_MSG_COUNT]; /* Last request time. */
+	uint64_t	ts_sent[LG_CTL_MSG_COUNT]; /* Its first byte sent. */
+	uint64_t	req_off[LG_CTL_MSG_COUNT]; /* Its out_total. */
+	uint64_t	ts_rx;		/* First byte of next frame. */
+} lg_ctl_sess_t;
+
+#define LG_CTL_SESS_DEF_TIMEOUT		5000
+
+
+void	lg_ctl_sess_init(lg_ctl_sess_p sess, lg_ctl_crypto_p crypto,
+	    lg_ctl_get_pkts_p get_pkts, size_t buf_max_size);
+void	lg_ctl_sess_destroy(lg_ctl_sess_p sess);
+/*
+ * Transport lost: drop buffered data, requests in flight are forgotten
+ * without cb call. Buffers are kept for reuse.
+ */
+void	lg_ctl_sess_reset(lg_ctl_sess_p sess);
+
+/* GET message, not sent GET of same message is not duplicated. */
+int	lg_ctl_sess_get(lg_ctl_sess_p sess, size_t msg_idx, uint64_t now);
+/* SET message, data: JSON object text. */
+int	lg_ctl_sess_set(lg_ctl_sess_p sess, size_t msg_idx,
+	    const char *data, size_t data_size, uint64_t now);
+/* Request packet from lg_ctl_pkt_create(), for example one packet for
+ * many sessions. Not deduplicated. */
+int	lg_ctl_sess_pkt_add(lg_ctl_sess_p sess, size_t msg_idx,
+	    const uint8_t *pkt, size_t pkt_size, uint64_t now);
+
+/* Returns EAGAIN if nothing to send. */
+int	lg_ctl_sess_out_get(lg_ctl_sess_p sess, const uint8_t **data,
+	    size_t *data_size);
+/*
+ * ios: send() / write() result. -1: errno is returned, EAGAIN / EINTR -
+ * try later, other - transport must be reset.
+ */
+int	lg_ctl_sess_out_done(lg_ctl_sess_p sess, ssize_t ios, uint64_t now);
+#define lg_ctl_sess_out_pending(__sess)					\
+	    ((__sess)->out_off != (__sess)->out_size)
+
+/*
+ * Zero copy receive: read up to buf_size bytes to buf, then call
+ * in_done() with recv() / read() result. -1: errno is returned, as for
+ * out_done(); 0: ECONNRESET. ENOBUFS: responce does not fit in
+ * buf_max_size. Transport must be reset on all errors except
+ * EAGAIN / EINTR.
+ */
+int	lg_ctl_sess_in_get(lg_ctl_sess_p sess, uint8_t **buf,
+	    size_t *buf_size);
+int	lg_ctl_sess_in_done(lg_ctl_sess_p sess, ssize_t ios, uint64_t now);
+/* Copy data and process, same as in_get() + memcpy() + in_done(). */
+int	lg_ctl_sess_input(lg_ctl_sess_p sess, const uint8_t *data,
+	    size_t data_size, uint64_t now);
+
+/* Returns (uint64_t)-1 if nothing is waited. */
+uint64_t lg_ctl_sess_deadline(const lg_ctl_sess_t *sess);
+void	lg_ctl_sess_timer(lg_ctl_sess_p sess, uint64_t now);
+
+
+#endif /* __LG_CTL_SESS_H__ */
@@ -0,0 +1,208 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#ifdef __linux__ /* Linux specific code. */
+#	include <sys/epoll.h>
+#else /* BSD specific code. */
+#	include <sys/event.h>
+#endif
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <time.h>
+#include <errno.h>
+
+#include "lg_ev.h"
+
+
+int
+lg_ev_open(uintptr_t *ev_ret) {
+	int fd;
+
+	if (NULL == ev_ret)
+		return (EINVAL);
+#ifdef __linux__
+	fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+	fd = kqueue();
+#endif
+	if (-1 == fd)
+		return (errno);
+	(*ev_ret) = (uintptr_t)fd;
+
+	return (0);
+}
+
+void
+lg_ev_close(uintptr_t ev) {
+
+	if (((uintptr_t)-1) == ev)
+		return;
+	close((int)ev);
+}
+
+int
+lg_ev_set(uintptr_t ev, uintptr_t fd, uint32_t events,
+    uint32_t events_prev, void *udata) {
+#ifdef __linux__
+	int op;
+	struct epoll_event epev;
+
+	if (events == events_prev)
+		return (0);
+	memset(&epev, 0x00, sizeof(epev));
+	if (0 != (LG_EV_READ & events)) {
+		epev.events |= EPOLLIN;
+	}
+	if (0 != (LG_EV_WRITE & events)) {
+		epev.events |= EPOLLOUT;
+	}
+	epev.data.ptr = udata;
+	if (0 == events_prev) {
+		op = EPOLL_CTL_ADD;
+	} else if (0 == events) {
+		op = EPOLL_CTL_DEL;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+	if (0 != epoll_ctl((int)ev, op, (int)fd, &epev))
+		return (errno);
+#else
+	struct kevent kev[2];
+	int kev_cnt = 0;
+
+	if (events == events_prev)
+		return (0);
+	if ((LG_EV_READ & events) != (LG_EV_READ & events_prev)) {
+		EV_SET(&kev[kev_cnt ++], fd, EVFILT_READ,
+		    ((0 != (LG_EV_READ & events)) ? EV_ADD : EV_DELETE),
+		    0, 0, udata);
+	}
+	if ((LG_EV_WRITE & events) != (LG_EV_WRITE & events_prev)) {
+		EV_SET(&kev[kev_cnt ++], fd, EVFILT_WRITE,
+		    ((0 != (LG_EV_WRITE & events)) ? EV_ADD : EV_DELETE),
+		    0, 0, udata);
+	}
+	if (0 != kevent((int)ev, kev, kev_cnt, NULL, 0, NULL))
+		return (errno);
+#endif
+
+	return (0);
+}
+
+int
+lg_ev_wait(uintptr_t ev, lg_ev_event_p events, size_t events_max,
+    int timeout_ms, size_t *events_cnt_ret) {
+	int i, cnt;
+#ifdef __linux__
+	struct epoll_event epev[LG_EV_WAIT_MAX];
+#else
+	int j, out;
+	uint32_t ev_flags;
+	struct kevent kev[LG_EV_WAIT_MAX];
+	struct timespec ts, *pts = NULL;
+#endif
+
+	if (NULL == events || 0 == events_max || NULL == events_cnt_ret)
+		return (EINVAL);
+	events_max = MIN(events_max, LG_EV_WAIT_MAX);
+	(*events_cnt_ret) = 0;
+
+#ifdef __linux__
+	cnt = epoll_wait((int)ev, epev, (int)events_max, timeout_ms);
+	if (-1 == cnt)
+		return (((EINTR == errno) ? 0 : errno));
+	for (i = 0; i < cnt; i ++) {
+		events[i].udata = epev[i].data.ptr;
+		events[i].events = 0;
+		if (0 != ((EPOLLIN | EPOLLRDHUP) & epev[i].events)) {
+			events[i].events |= LG_EV_READ;
+		}
+		if (0 != (EPOLLOUT & epev[i].events)) {
+			events[i].events |= LG_EV_WRITE;
+		}
+		if (0 != ((EPOLLERR | EPOLLHUP) & epev[i].events)) {
+			events[i].events |= LG_EV_ERR;
+		}
+	}
+#else
+	if (0 <= timeout_ms) {
+		ts.tv_sec = (timeout_ms / 1000);
+		ts.tv_nsec = ((timeout_ms % 1000) * 1000000);
+		pts = &ts;
+	}
+	cnt = kevent((int)ev, NULL, 0, kev, (int)events_max, pts);
+	if (-1 == cnt)
+		return (((EINTR == errno) ? 0 : errno));
+	/*
+	 * READ and WRITE of one fd are separate kevents: merge them to one
+	 * event, as epoll does. Handler may close fd and free udata, so
+	 * second event for same fd must not follow.
+	 */
+	for (i = 0, out = 0; i < cnt; i ++) {
+		ev_flags = ((EVFILT_READ == kev[i].filter) ?
+		    LG_EV_READ : LG_EV_WRITE);
+		if (0 != ((EV_EOF | EV_ERROR) & kev[i].flags)) {
+			ev_flags |= LG_EV_ERR;
+		}
+		for (j = 0; j < out && kev[j].ident != kev[i].ident; j ++)
+			;
+		if (j < out) {
+			events[j].events |= ev_flags;
+			continue;
+		}
+		kev[out].ident = kev[i].ident; /* Compact: merge lookup. */
+		events[out].udata = kev[i].udata;
+		events[out].events = ev_flags;
+		out ++;
+	}
+	cnt = out;
+#endif
+	(*events_cnt_ret) = (size_t)cnt;
+
+	return (0);
+}
+
+uint64_t
+lg_ev_time_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((((uint64_t)ts.tv_sec) * 1000000) +
+	    (((uint64_t)ts.tv_nsec) / 1000));
+}
@@ -0,0 +1,70 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_EV_H__
+#define __LG_EV_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+
+/* Minimal event loop: epoll on Linux, kqueue on BSD and macOS. */
+
+#define LG_EV_READ	(((uint32_t)1) << 0)
+#define LG_EV_WRITE	(((uint32_t)1) << 1)
+#define LG_EV_ERR	(((uint32_t)1) << 2) /* Only returned: error / EOF. */
+
+typedef struct lg_ev_event_s {
+	void		*udata;
+	uint32_t	events;	/* LG_EV_* */
+} lg_ev_event_t, *lg_ev_event_p;
+
+#define LG_EV_WAIT_MAX	256 /* Events per one lg_ev_wait() call. */
+
+
+int	lg_ev_open(uintptr_t *ev_ret);
+void	lg_ev_close(uintptr_t ev);
+/* Set interest list for fd, events = 0 - remove fd. */
+int	lg_ev_set(uintptr_t ev, uintptr_t fd, uint32_t events,
+	    uint32_t events_prev, void *udata);
+/*
+ * timeout_ms: -1 - infinite.
+ * At most one event per fd is returned, so handler may close fd and
+ * free its udata: no other event of this call refers to it.
+ */
+int	lg_ev_wait(uintptr_t ev, lg_ev_event_p events, size_t events_max,
+	    int timeout_ms, size_t *events_cnt_ret);
+
+/* Monotonic time. */
+uint64_t lg_ev_time_us(void);
+#define lg_ev_time_ms()		(lg_ev_time_us() / 1000)
+
+
+#endif /* __LG_EV_H__ */
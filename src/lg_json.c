@@ -0,0 +1,453 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_json.h"
+
+
+typedef struct lg_json_rd_s {
+	const char	*cur;
+	const char	*end;
+	lg_json_cb	cb;
+	void		*udata;
+} lg_json_rd_t, *lg_json_rd_p;
+
+#define LG_JSON_IS_SPACE(__c)						\
+	    (' ' == (__c) || '\n' == (__c) || '\r' == (__c) || '\t' == (__c))
+#define LG_JSON_IS_DIGIT(__c)	('0' <= (__c) && '9' >= (__c))
+
+
+static inline void
+lg_json_ws_skip(lg_json_rd_p rd) {
+
+	while (rd->cur < rd->end && LG_JSON_IS_SPACE((*rd->cur))) {
+		rd->cur ++;
+	}
+}
+
+static inline int
+lg_json_hex_get(const char *buf, uint32_t *val_ret) {
+	size_t i;
+	uint32_t val = 0;
+
+	for (i = 0; i < 4; i ++) {
+		val <<= 4;
+		if (LG_JSON_IS_DIGIT(buf[i])) {
+			val |= (uint32_t)(buf[i] - '0');
+		} else if ('a' <= buf[i] && 'f' >= buf[i]) {
+			val |= (uint32_t)(10 + (buf[i] - 'a'));
+		} else if ('A' <= buf[i] && 'F' >= buf[i]) {
+			val |= (uint32_t)(10 + (buf[i] - 'A'));
+		} else {
+			return (EBADMSG);
+		}
+	}
+	(*val_ret) = val;
+
+	return (0);
+}
+
+/* rd->cur points to opening quote. */
+static int
+lg_json_str_read(lg_json_rd_p rd, const char **str_ret,
+    size_t *str_size_ret, int *esc_ret) {
+	uint32_t val;
+	const char *start;
+
+	rd->cur ++;
+	start = rd->cur;
+	(*esc_ret) = 0;
+	while (rd->cur < rd->end) {
+		switch ((*rd->cur)) {
+		case '"':
+			(*str_ret) = start;
+			(*str_size_ret) = (size_t)(rd->cur - start);
+			rd->cur ++;
+			return (0);
+		case '\\':
+			(*esc_ret) = 1;
+			rd->cur ++;
+			if (rd->cur >= rd->end)
+				return (EBADMSG);
+			switch ((*rd->cur)) {
+			case '"':
+			case '\\':
+			case '/':
+			case 'b':
+			case 'f':
+			case 'n':
+			case 'r':
+			case 't':
+				break;
+			case 'u':
+				if (4 > (rd->end - rd->cur - 1) ||
+				    0 != lg_json_hex_get((rd->cur + 1), &val))
+					return (EBADMSG);
+				rd->cur += 4;
+				break;
+			default:
+				return (EBADMSG);
+			}
+			break;
+		default:
+			if (0x20 > (uint8_t)(*rd->cur))
+				return (EBADMSG);
+		}
+		rd->cur ++;
+	}
+
+	return (EBADMSG);
+}
+
+static int
+lg_json_num_read(lg_json_rd_p rd, lg_json_ev_p ev) {
+	int neg = 0, is_int = 1;
+	uint64_t num = 0;
+	const char *start = rd->cur;
+
+	if ('-' == (*rd->cur)) {
+		neg = 1;
+		rd->cur ++;
+	}
+	/* Integer part. */
+	if (rd->cur >= rd->end || 0 == LG_JSON_IS_DIGIT((*rd->cur)))
+		return (EBADMSG);
+	if ('0' == (*rd->cur)) {
+		rd->cur ++;
+	} else {
+		while (rd->cur < rd->end && LG_JSON_IS_DIGIT((*rd->cur))) {
+			if (num > ((((uint64_t)INT64_MAX) + 1) / 10)) {
+				is_int = 0;
+			}
+			num = ((num * 10) + (uint64_t)((*rd->cur) - '0'));
+			rd->cur ++;
+		}
+		if (num > (((uint64_t)INT64_MAX) + (uint64_t)neg)) {
+			is_int = 0;
+		}
+	}
+	/* Fraction. */
+	if (rd->cur < rd->end && '.' == (*rd->cur)) {
+		is_int = 0;
+		rd->cur ++;
+		if (rd->cur >= rd->end || 0 == LG_JSON_IS_DIGIT((*rd->cur)))
+			return (EBADMSG);
+		while (rd->cur < rd->end && LG_JSON_IS_DIGIT((*rd->cur))) {
+			rd->cur ++;
+		}
+	}
+	/* Exponent. */
+	if (rd->cur < rd->end && ('e' == (*rd->cur) || 'E' == (*rd->cur))) {
+		is_int = 0;
+		rd->cur ++;
+		if (rd->cur < rd->end &&
+		    ('+' == (*rd->cur) || '-' == (*rd->cur))) {
+			rd->cur ++;
+		}
+		if (rd->cur >= rd->end || 0 == LG_JSON_IS_DIGIT((*rd->cur)))
+			return (EBADMSG);
+		while (rd->cur < rd->end && LG_JSON_IS_DIGIT((*rd->cur))) {
+			rd->cur ++;
+		}
+	}
+
+	ev->type = LG_JSON_EV_NUMBER;
+	ev->value = start;
+	ev->value_size = (size_t)(rd->cur - start);
+	if (0 != is_int) {
+		ev->flags |= LG_JSON_EV_F_INT;
+		ev->num = ((0 != neg) ? (int64_t)(0 - num) : (int64_t)num);
+	}
+
+	return (0);
+}
+
+static int
+lg_json_literal_read(lg_json_rd_p rd, const char *literal,
+    const size_t literal_size) {
+
+	if (literal_size > (size_t)(rd->end - rd->cur) ||
+	    0 != memcmp(rd->cur, literal, literal_size))
+		return (EBADMSG);
+	rd->cur += literal_size;
+
+	return (0);
+}
+
+/* name, name_size, idx, depth and flags must be set in ev. */
+static int
+lg_json_value_read(lg_json_rd_p rd, lg_json_ev_p ev) {
+	int error, esc;
+	size_t idx;
+	const char *start;
+	lg_json_ev_t child;
+
+	lg_json_ws_skip(rd);
+	if (rd->cur >= rd->end)
+		return (EBADMSG);
+	start = rd->cur;
+	ev->value = start;
+	ev->value_size = 0;
+
+	switch ((*rd->cur)) {
+	case '{':
+		if (LG_JSON_DEPTH_MAX <= ev->depth)
+			return (EBADMSG);
+		ev->type = LG_JSON_EV_OBJ_BEGIN;
+		error = rd->cb(ev, rd->udata);
+		if (0 != error)
+			return (error);
+		rd->cur ++;
+		lg_json_ws_skip(rd);
+		for (idx = 0; rd->cur < rd->end && '}' != (*rd->cur); idx ++) {
+			if (0 != idx) {
+				if (',' != (*rd->cur))
+					return (EBADMSG);
+				rd->cur ++;
+				lg_json_ws_skip(rd);
+				if (rd->cur >= rd->end)
+					return (EBADMSG);
+			}
+			if ('"' != (*rd->cur))
+				return (EBADMSG);
+			memset(&child, 0x00, sizeof(child));
+			error = lg_json_str_read(rd, &child.name,
+			    &child.name_size, &esc);
+			if (0 != error)
+				return (error);
+			if (0 != esc) {
+				child.flags |= LG_JSON_EV_F_NAME_ESC;
+			}
+			lg_json_ws_skip(rd);
+			if (rd->cur >= rd->end || ':' != (*rd->cur))
+				return (EBADMSG);
+			rd->cur ++;
+			child.depth = (ev->depth + 1);
+			child.idx = idx;
+			error = lg_json_value_read(rd, &child);
+			if (0 != error)
+				return (error);
+			lg_json_ws_skip(rd);
+		}
+		if (rd->cur >= rd->end)
+			return (EBADMSG);
+		rd->cur ++;
+		ev->type = LG_JSON_EV_OBJ_END;
+		break;
+	case '[':
+		if (LG_JSON_DEPTH_MAX <= ev->depth)
+			return (EBADMSG);
+		ev->type = LG_JSON_EV_ARR_BEGIN;
+		error = rd->cb(ev, rd->udata);
+		if (0 != error)
+			return (error);
+		rd->cur ++;
+		lg_json_ws_skip(rd);
+		for (idx = 0; rd->cur < rd->end && ']' != (*rd->cur); idx ++) {
+			if (0 != idx) {
+				if (',' != (*rd->cur))
+					return (EBADMSG);
+				rd->cur ++;
+			}
+			memset(&child, 0x00, sizeof(child));
+			child.depth = (ev->depth + 1);
+			child.idx = idx;
+			error = lg_json_value_read(rd, &child);
+			if (0 != error)
+				return (error);
+			lg_json_ws_skip(rd);
+		}
+		if (rd->cur >= rd->end)
+			return (EBADMSG);
+		rd->cur ++;
+		ev->type = LG_JSON_EV_ARR_END;
+		break;
+	case '"':
+		error = lg_json_str_read(rd, &ev->value, &ev->value_size, &esc);
+		if (0 != error)
+			return (error);
+		if (0 != esc) {
+			ev->flags |= LG_JSON_EV_F_ESC;
+		}
+		ev->type = LG_JSON_EV_STRING;
+		return (rd->cb(ev, rd->udata));
+	case 't':
+		ev->type = LG_JSON_EV_TRUE;
+		error = lg_json_literal_read(rd, "true", 4);
+		break;
+	case 'f':
+		ev->type = LG_JSON_EV_FALSE;
+		error = lg_json_literal_read(rd, "false", 5);
+		break;
+	case 'n':
+		ev->type = LG_JSON_EV_NULL;
+		error = lg_json_literal_read(rd, "null", 4);
+		break;
+	default:
+		error = lg_json_num_read(rd, ev);
+		break;
+	}
+	if (0 != error)
+		return (error);
+	ev->value_size = (size_t)(rd->cur - start);
+
+	return (rd->cb(ev, rd->udata));
+}
+
+
+int
+lg_json_parse(const char *buf, const size_t buf_size,
+    lg_json_cb cb, void *udata) {
+	int error;
+	lg_json_rd_t rd;
+	lg_json_ev_t ev;
+
+	if (NULL == buf || NULL == cb)
+		return (EINVAL);
+
+	rd.cur = buf;
+	rd.end = (buf + buf_size);
+	rd.cb = cb;
+	rd.udata = udata;
+	memset(&ev, 0x00, sizeof(ev));
+	error = lg_json_value_read(&rd, &ev);
+	if (0 != error)
+		return (error);
+	/* Only whitespace allowed after value, '\0' too: C strings. */
+	while (rd.cur < rd.end &&
+	    (LG_JSON_IS_SPACE((*rd.cur)) || 0 == (*rd.cur))) {
+		rd.cur ++;
+	}
+	if (rd.cur != rd.end)
+		return (EBADMSG);
+
+	return (0);
+}
+
+int
+lg_json_str_unescape(const char *src, const size_t src_size,
+    char *dst, const size_t dst_size, size_t *dst_size_ret) {
+	size_t i, off = 0;
+	uint32_t cp, cp2;
+
+	if (NULL == src || NULL == dst || 0 == dst_size)
+		return (EINVAL);
+
+	for (i = 0; i < src_size; i ++) {
+		if (off >= (dst_size - 1))
+			goto err_out;
+		if ('\\' != src[i]) {
+			dst[off ++] = src[i];
+			continue;
+		}
+		i ++;
+		if (i >= src_size)
+			return (EBADMSG);
+		switch (src[i]) {
+		case 'b':
+			dst[off ++] = '\b';
+			continue;
+		case 'f':
+			dst[off ++] = '\f';
+			continue;
+		case 'n':
+			dst[off ++] = '\n';
+			continue;
+		case 'r':
+			dst[off ++] = '\r';
+			continue;
+		case 't':
+			dst[off ++] = '\t';
+			continue;
+		case 'u':
+			break;
+		default: /* '"', '\\', '/' */
+			dst[off ++] = src[i];
+			continue;
+		}
+		/* \uXXXX */
+		if (4 > (src_size - i - 1) ||
+		    0 != lg_json_hex_get(&src[(i + 1)], &cp))
+			return (EBADMSG);
+		i += 4;
+		if (0xd800 <= cp && 0xdbff >= cp) { /* Surrogate pair. */
+			if (6 <= (src_size - i - 1) &&
+			    '\\' == src[(i + 1)] && 'u' == src[(i + 2)] &&
+			    0 == lg_json_hex_get(&src[(i + 3)], &cp2) &&
+			    0xdc00 <= cp2 && 0xdfff >= cp2) {
+				cp = (0x10000 + ((cp - 0xd800) << 10) +
+				    (cp2 - 0xdc00));
+				i += 6;
+			} else {
+				cp = 0xfffd;
+			}
+		} else if (0xdc00 <= cp && 0xdfff >= cp) {
+			cp = 0xfffd;
+		}
+		/* UTF-8. */
+		if (0x80 > cp) {
+			dst[off ++] = (char)cp;
+			continue;
+		}
+		if ((off + 4) >= dst_size)
+			goto err_out;
+		if (0x800 > cp) {
+			dst[off ++] = (char)(0xc0 | (cp >> 6));
+		} else {
+			if (0x10000 > cp) {
+				dst[off ++] = (char)(0xe0 | (cp >> 12));
+			} else {
+				dst[off ++] = (char)(0xf0 | (cp >> 18));
+				dst[off ++] = (char)(0x80 | ((cp >> 12) & 0x3f));
+			}
+			dst[off ++] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		}
+		dst[off ++] = (char)(0x80 | (cp & 0x3f));
+	}
+	dst[off] = 0;
+	if (NULL != dst_size_ret) {
+		(*dst_size_ret) = off;
+	}
+
+	return (0);
+
+err_out: /* Truncated, UTF-8 sequences are not split. */
+	dst[off] = 0;
+	if (NULL != dst_size_ret) {
+		(*dst_size_ret) = off;
+	}
+
+	return (ENOBUFS);
+}
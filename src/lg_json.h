@@ -0,0 +1,90 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_JSON_H__
+#define __LG_JSON_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+
+/*
+ * Streaming JSON reader: one pass over buffer, events to callback,
+ * no memory allocation. Buffer is not modified, strings and numbers
+ * are passed as pointers into it; escape sequences are not decoded,
+ * use lg_json_str_unescape() if LG_JSON_EV_F_ESC is set.
+ */
+
+#define LG_JSON_EV_OBJ_BEGIN	0
+#define LG_JSON_EV_OBJ_END	1
+#define LG_JSON_EV_ARR_BEGIN	2
+#define LG_JSON_EV_ARR_END	3
+#define LG_JSON_EV_STRING	4
+#define LG_JSON_EV_NUMBER	5
+#define LG_JSON_EV_TRUE		6
+#define LG_JSON_EV_FALSE	7
+#define LG_JSON_EV_NULL		8
+
+#define LG_JSON_EV_F_ESC	(((uint32_t)1) << 0) /* value has escapes. */
+#define LG_JSON_EV_F_NAME_ESC	(((uint32_t)1) << 1) /* name has escapes. */
+#define LG_JSON_EV_F_INT	(((uint32_t)1) << 2) /* num is valid. */
+
+typedef struct lg_json_ev_s {
+	uint32_t	type;	/* LG_JSON_EV_* */
+	uint32_t	flags;	/* LG_JSON_EV_F_* */
+	size_t		depth;	/* Root value: 0. */
+	size_t		idx;	/* Position in parent object/array. */
+	const char	*name;	/* Object member name, NULL for others. */
+	size_t		name_size;
+	/* String: without quotes; number: as is;
+	 * *_END: whole object/array text, from '{' / '[' to '}' / ']'. */
+	const char	*value;
+	size_t		value_size;
+	int64_t		num;	/* Integer number value. */
+} lg_json_ev_t, *lg_json_ev_p;
+
+#define LG_JSON_DEPTH_MAX	32
+
+/* Non zero return value stops parsing and returned by lg_json_parse(). */
+typedef int (*lg_json_cb)(const lg_json_ev_t *ev, void *udata);
+
+/* Buffer must hold exactly one value, whitespace around is allowed.
+ * Returns EBADMSG on invalid JSON. */
+int	lg_json_parse(const char *buf, size_t buf_size,
+	    lg_json_cb cb, void *udata);
+
+/* Decode escape sequences, \uXXXX to UTF-8; dst is zero terminated.
+ * Result is never longer than src, so dst == src is allowed.
+ * Returns ENOBUFS if result was truncated to fit dst. */
+int	lg_json_str_unescape(const char *src, size_t src_size,
+	    char *dst, size_t dst_size, size_t *dst_size_ret);
+
+
+#endif /* __LG_JSON_H__ */
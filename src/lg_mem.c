@@ -0,0 +1,131 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+#include <openssl/crypto.h>
+
+#include "lg_mem.h"
+
+
+lg_mem_stat_t lg_mem_stat;
+
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+static void *
+lg_mem_openssl_malloc(size_t size, const char *file, int line) {
+
+	(void)file;
+	(void)line;
+	return (lg_malloc(size));
+}
+
+static void *
+lg_mem_openssl_realloc(void *ptr, size_t size, const char *file, int line) {
+
+	(void)file;
+	(void)line;
+	return (lg_realloc(ptr, size));
+}
+
+static void
+lg_mem_openssl_free(void *ptr, const char *file, int line) {
+
+	(void)file;
+	(void)line;
+	lg_free(ptr);
+}
+#endif
+
+int
+lg_mem_openssl_hook(void) {
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+	if (1 != CRYPTO_set_mem_functions(lg_mem_openssl_malloc,
+	    lg_mem_openssl_realloc, lg_mem_openssl_free))
+		return (EBUSY);
+	return (0);
+#else
+	return (EOPNOTSUPP);
+#endif
+}
+
+
+void
+lg_arena_init(lg_arena_p arena) {
+
+	if (NULL == arena)
+		return;
+	memset(arena, 0x00, sizeof(lg_arena_t));
+}
+
+void
+lg_arena_destroy(lg_arena_p arena) {
+
+	if (NULL == arena)
+		return;
+	lg_free(arena->mem);
+	memset(arena, 0x00, sizeof(lg_arena_t));
+}
+
+void *
+lg_arena_alloc(lg_arena_p arena, size_t size) {
+	uint8_t *mem;
+	size_t mem_size;
+
+	if (NULL == arena)
+		return (NULL);
+	size = roundup(size, LG_ARENA_ALIGN);
+	if (size > (arena->size - arena->off)) {
+		/* Can not move memory that is in use. */
+		if (0 != arena->off)
+			return (NULL);
+		mem_size = MAX(4096, roundup(size, 4096));
+		mem = lg_realloc(arena->mem, mem_size);
+		if (NULL == mem)
+			return (NULL);
+		arena->mem = mem;
+		arena->size = mem_size;
+	}
+	mem = (arena->mem + arena->off);
+	arena->off += size;
+
+	return (mem);
+}
+
+void *
+lg_arena_json_alloc(void *arena, size_t size) {
+
+	return (lg_arena_alloc(arena, size));
+}
@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_MEM_H__
+#define __LG_MEM_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdlib.h> /* malloc, exit */
+
+
+/*
+ * Heap wrappers with counters: lets check that steady state polling
+ * does not allocate. Counters are atomic: replay workers allocate too.
+ */
+
+typedef struct lg_mem_stat_s {
+	uint64_t	alloc_cnt;	/* malloc + calloc + realloc calls. */
+	uint64_t	free_cnt;
+} lg_mem_stat_t, *lg_mem_stat_p;
+
+extern lg_mem_stat_t lg_mem_stat;
+
+/* Count OpenSSL allocations too, must be called before any other
+ * OpenSSL call. */
+int	lg_mem_openssl_hook(void);
+
+
+static inline void *
+lg_malloc(const size_t size) {
+
+	__atomic_fetch_add(&lg_mem_stat.alloc_cnt, 1, __ATOMIC_RELAXED);
+	return (malloc(size));
+}
+
+static inline void *
+lg_calloc(const size_t nmemb, const size_t size) {
+
+	__atomic_fetch_add(&lg_mem_stat.alloc_cnt, 1, __ATOMIC_RELAXED);
+	return (calloc(nmemb, size));
+}
+
+static inline void *
+lg_realloc(void *ptr, const size_t size) {
+
+	__atomic_fetch_add(&lg_mem_stat.alloc_cnt, 1, __ATOMIC_RELAXED);
+	return (realloc(ptr, size));
+}
+
+static inline void
+lg_free(void *ptr) {
+
+	if (NULL == ptr)
+		return;
+	__atomic_fetch_add(&lg_mem_stat.free_cnt, 1, __ATOMIC_RELAXED);
+	free(ptr);
+}
+
+
+/*
+ * Reusable arena: bump allocator over one buffer.
+ * Buffer grows only while arena is empty, so call lg_arena_reset()
+ * before each unit of work (packet, document).
+ */
+typedef struct lg_arena_s {
+	uint8_t		*mem;
+	size_t		size;
+	size_t		off;
+} lg_arena_t, *lg_arena_p;
+
+#define LG_ARENA_ALIGN		16
+
+void	lg_arena_init(lg_arena_p arena);
+void	lg_arena_destroy(lg_arena_p arena);
+#define lg_arena_reset(__arena)		(__arena)->off = 0
+void	*lg_arena_alloc(lg_arena_p arena, size_t size);
+/* For json_parse_ex(): alloc_func_ptr with arena as user_data. */
+void	*lg_arena_json_alloc(void *arena, size_t size);
+
+
+#endif /* __LG_MEM_H__ */
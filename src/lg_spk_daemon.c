@@ -0,0 +1,1719 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> /* TCP_NODELAY */
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <strings.h> /* ffs */
+#include <ctype.h> /* tolower */
+#include <stdio.h> /* snprintf, fprintf */
+#include <stdarg.h>
+#include <errno.h>
+
+#include "lg_spk_daemon.h"
+#include "lg_spk_out.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+#include "net/socket.h"
+#include "utils/mem_utils.h"
+#include "utils/str2num.h"
+
+
+static int
+lg_spk_buf_reserve(lg_spk_buf_p buf, const size_t size) {
+	size_t allocated;
+	uint8_t *tmp;
+
+	if ((buf->size + size) <= buf->allocated)
+		return (0);
+	allocated = MAX(256, ((buf->size + size) * 2));
+	tmp = lg_realloc(buf->data, allocated);
+	if (NULL == tmp)
+		return (ENOMEM);
+	buf->data = tmp;
+	buf->allocated = allocated;
+
+	return (0);
+}
+
+/* Data is always zero terminated. */
+static int
+lg_spk_buf_add(lg_spk_buf_p buf, const void *data, const size_t data_size) {
+	int error;
+
+	error = lg_spk_buf_reserve(buf, (data_size + 1));
+	if (0 != error)
+		return (error);
+	memcpy((buf->data + buf->size), data, data_size);
+	buf->size += data_size;
+	buf->data[buf->size] = 0;
+
+	return (0);
+}
+#define lg_spk_buf_add_cstr(__buf, __cstr)				\
+	    lg_spk_buf_add((__buf), (__cstr), strlen((__cstr)))
+
+/* JSON string with quotes. */
+static int
+lg_spk_buf_add_json_str(lg_spk_buf_p buf, const char *str) {
+	int error;
+	size_t i;
+	char esc[8];
+
+	error = lg_spk_buf_add(buf, "\"", 1);
+	for (i = 0; 0 == error && 0 != str[i]; i ++) {
+		if ('"' == str[i] || '\\' == str[i]) {
+			esc[0] = '\\';
+			esc[1] = str[i];
+			error = lg_spk_buf_add(buf, esc, 2);
+		} else if (0x20 > (uint8_t)str[i]) {
+			snprintf(esc, sizeof(esc), "\\u%04x", (uint8_t)str[i]);
+			error = lg_spk_buf_add(buf, esc, 6);
+		} else {
+			error = lg_spk_buf_add(buf, &str[i], 1);
+		}
+	}
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_buf_add(buf, "\"", 1));
+}
+
+static int
+lg_spk_buf_printf(lg_spk_buf_p buf, const char *fmt, ...)
+    __attribute__((__format__(__printf__, 2, 3)));
+static int
+lg_spk_buf_printf(lg_spk_buf_p buf, const char *fmt, ...) {
+	int error, ret;
+	va_list ap;
+
+	for (;;) {
+		va_start(ap, fmt);
+		ret = vsnprintf((char*)(buf->data + buf->size),
+		    (buf->allocated - buf->size), fmt, ap);
+		va_end(ap);
+		if (0 > ret)
+			return (EINVAL);
+		if ((buf->allocated - buf->size) > (size_t)ret)
+			break;
+		error = lg_spk_buf_reserve(buf, ((size_t)ret + 1));
+		if (0 != error)
+			return (error);
+	}
+	buf->size += (size_t)ret;
+
+	return (0);
+}
+
+static void
+lg_spk_buf_reset(lg_spk_buf_p buf) {
+
+	buf->size = 0;
+	buf->off = 0;
+}
+
+static void
+lg_spk_buf_free(lg_spk_buf_p buf) {
+
+	lg_free(buf->data);
+	memset(buf, 0x00, sizeof(lg_spk_buf_t));
+}
+
+/* Send as much as possible, buffer is reset when all sent. */
+static int
+lg_spk_buf_send(lg_spk_buf_p buf, const uintptr_t skt) {
+	ssize_t ios;
+
+	while (buf->off < buf->size) {
+		ios = send((int)skt, (buf->data + buf->off),
+		    (buf->size - buf->off), MSG_NOSIGNAL);
+		if (-1 == ios) {
+			if (EAGAIN == errno || EINTR == errno)
+				return (0); /* Wait for LG_EV_WRITE. */
+			return (errno);
+		}
+		buf->off += (size_t)ios;
+	}
+	lg_spk_buf_reset(buf);
+
+	return (0);
+}
+
+
+static inline void
+lg_spk_daemon_timer_set(lg_spk_daemon_p d, const uint64_t due) {
+
+	if (due < d->next_timer) {
+		d->next_timer = due;
+	}
+}
+
+
+/* Reply to all clients that wait msg_idx from link,
+ * LG_CTL_MSG_COUNT - all messages. */
+static void
+lg_spk_client_wake(lg_spk_daemon_p d, lg_spk_link_p link,
+    const size_t msg_idx, const int error, const uint8_t *data,
+    const size_t data_size);
+
+
+static int
+lg_spk_link_ev_update(lg_spk_daemon_p d, lg_spk_link_p link) {
+	int error;
+	uint32_t ev_flags;
+
+	switch (link->state) {
+	case LG_SPK_LINK_S_CONNECT:
+		ev_flags = LG_EV_WRITE;
+		break;
+	case LG_SPK_LINK_S_READY:
+		ev_flags = LG_EV_READ;
+		if (0 != lg_ctl_sess_out_pending(&link->sess)) {
+			ev_flags |= LG_EV_WRITE;
+		}
+		break;
+	default:
+		return (0);
+	}
+	if (ev_flags == link->ev_flags)
+		return (0);
+	error = lg_ev_set(d->ev, link->skt, ev_flags, link->ev_flags, link);
+	if (0 != error)
+		return (error);
+	link->ev_flags = ev_flags;
+
+	return (0);
+}
+
+static void
+lg_spk_link_fail(lg_spk_daemon_p d, lg_spk_link_p link, const int error,
+    const uint64_t now) {
+
+	/* Close removes socket from event loop, buffers are kept. */
+	if (((uintptr_t)-1) != link->skt) {
+		close((int)link->skt);
+		link->skt = (uintptr_t)-1;
+	}
+	lg_ctl_sess_reset(&link->sess);
+	link->ev_flags = 0;
+	link->state = LG_SPK_LINK_S_WAIT;
+	link->error = error;
+	link->fails ++;
+	link->ts_state = now;
+	link->get_pend = 0;
+	link->poll_pend = 0;
+	link->poll_sent = 0;
+	link->poll_in_flight_cnt = 0;
+	lg_spk_state_push_reset(&link->cache);
+	/* Exponential backoff, reset by first responce. */
+	link->reconnect_delay = MIN(LG_SPK_LINK_RECONNECT_MAX,
+	    MAX(LG_SPK_LINK_RECONNECT_MIN, (link->reconnect_delay * 2)));
+	lg_spk_daemon_timer_set(d, (now + link->reconnect_delay));
+	lg_spk_client_wake(d, link, LG_CTL_MSG_COUNT, error, NULL, 0);
+}
+
+static void
+lg_spk_link_connect(lg_spk_daemon_p d, lg_spk_link_p link,
+    const uint64_t now) {
+	int error, on = 1;
+	uintptr_t skt = (uintptr_t)-1;
+	const struct sockaddr_storage *addr;
+
+	link->connects ++;
+	/* Name resolved to IPv6 and IPv4: alternate on reconnect. */
+	addr = &link->target->addr;
+	if (0 != link->target->addr_alt.ss_family &&
+	    0 == (link->connects & 1)) {
+		addr = &link->target->addr_alt;
+	}
+	error = skt_connect(addr, SOCK_STREAM, IPPROTO_TCP,
+	    SO_F_NONBLOCK, &skt);
+	if (EINPROGRESS == error) {
+		error = 0;
+	}
+	link->skt = skt;
+	if (0 != error)
+		goto err_out;
+	/* Let kernel detect dead peer on idle connection too. */
+	setsockopt((int)skt, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+	setsockopt((int)skt, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	link->state = LG_SPK_LINK_S_CONNECT;
+	link->ts_state = now;
+	/* Warm up cache: state may be changed while not connected. */
+	link->poll_pend = ((((uint32_t)1) << LG_CTL_MSG_GET_COUNT) - 1);
+	error = lg_spk_link_ev_update(d, link);
+	if (0 != error)
+		goto err_out;
+	lg_spk_daemon_timer_set(d, (now + (d->timeout * 1000)));
+
+	return;
+
+err_out:
+	lg_spk_link_fail(d, link, error, now);
+}
+
+/* Send as much as possible. */
+static int
+lg_spk_link_send(lg_spk_link_p link, const uint64_t now) {
+	int error;
+	const uint8_t *data;
+	size_t data_size;
+
+	while (0 == lg_ctl_sess_out_get(&link->sess, &data, &data_size)) {
+		error = lg_ctl_sess_out_done(&link->sess,
+		    send((int)link->skt, data, data_size, MSG_NOSIGNAL), now);
+		if (0 != error) {
+			if (EAGAIN == error || EINTR == error)
+				return (0); /* Wait for LG_EV_WRITE. */
+			return (error);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Queue pending GETs while pipeline allows and send: client ones
+ * first, background only if no client GET waits.
+ */
+static int
+lg_spk_link_flush(lg_spk_daemon_p d, lg_spk_link_p link,
+    const uint64_t now) {
+	int error;
+	size_t msg_idx;
+	uint32_t *pend, bit;
+
+	if (LG_SPK_LINK_S_READY != link->state)
+		return (0); /* Sent once connected. */
+	while (d->pipeline > link->sess.in_flight_cnt) {
+		if (0 != link->get_pend) {
+			pend = &link->get_pend;
+		} else if (0 != link->poll_pend &&
+		    d->poll_pipeline > link->poll_in_flight_cnt) {
+			pend = &link->poll_pend;
+		} else {
+			break;
+		}
+		msg_idx = (size_t)(ffs((int)(*pend)) - 1);
+		bit = (((uint32_t)1) << msg_idx);
+		(*pend) &= ~bit;
+		if (0 != link->sess.in_flight[msg_idx])
+			continue; /* Answer will come anyway. */
+		error = lg_ctl_sess_get(&link->sess, msg_idx, now);
+		if (0 != error)
+			return (error);
+		if (pend == &link->poll_pend) {
+			link->poll_sent |= bit;
+			link->poll_in_flight_cnt ++;
+		}
+		lg_spk_daemon_timer_set(d, (now + (d->timeout * 1000)));
+	}
+	error = lg_spk_link_send(link, now);
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_link_ev_update(d, link));
+}
+
+/*
+ * Queue GET, answer is delivered to waiting clients.
+ * background: poll / probe, sent after client GETs.
+ */
+static int
+lg_spk_link_get(lg_spk_daemon_p d, lg_spk_link_p link,
+    const size_t msg_idx, const int background, const uint64_t now) {
+	const uint32_t bit = (((uint32_t)1) << msg_idx);
+
+	if (LG_SPK_LINK_S_WAIT == link->state)
+		return (ENOTCONN);
+	if (0 == link->sess.in_flight[msg_idx]) {
+		if (0 != background) {
+			if (0 == (link->get_pend & bit)) {
+				link->poll_pend |= bit;
+			}
+		} else { /* Promote pending background GET. */
+			link->poll_pend &= ~bit;
+			link->get_pend |= bit;
+		}
+	}
+
+	return (lg_spk_link_flush(d, link, now));
+}
+
+/* Encrypt SET packet in place, at buf end, buf->size is not changed. */
+static int
+lg_spk_set_pkt_create(lg_spk_daemon_p d, lg_spk_buf_p buf,
+    const size_t msg_idx, const char *data, const size_t data_size,
+    size_t *pkt_size) {
+	int error;
+	uint8_t *pkt;
+	size_t plain_size;
+
+	plain_size = (sizeof("{\"cmd\": \"set\", \"msg\": \"\", \"data\": }") +
+	    strlen(lg_ctl_msg[msg_idx]) + data_size);
+	lg_ctl_pkt_create(d->crypto, NULL, plain_size, NULL, pkt_size);
+	error = lg_spk_buf_reserve(buf, (*pkt_size));
+	if (0 != error)
+		return (error);
+	pkt = (buf->data + buf->size);
+	plain_size = (size_t)snprintf((char*)(pkt + sizeof(lg_ctl_pkt_hdr_t)),
+	    plain_size, "{\"cmd\": \"set\", \"msg\": \"%s\", \"data\": %.*s}",
+	    lg_ctl_msg[msg_idx], (int)data_size, data);
+
+	return (lg_ctl_pkt_create(d->crypto,
+	    (pkt + sizeof(lg_ctl_pkt_hdr_t)), plain_size, pkt, pkt_size));
+}
+
+/* Queue SET and send. */
+static int
+lg_spk_link_set(lg_spk_daemon_p d, lg_spk_link_p link,
+    const size_t msg_idx, const char *data, const size_t data_size,
+    const uint64_t now) {
+	int error;
+
+	if (LG_SPK_LINK_S_WAIT == link->state)
+		return (ENOTCONN);
+	error = lg_ctl_sess_set(&link->sess, msg_idx, data, data_size, now);
+	if (0 != error)
+		return (error);
+	lg_spk_daemon_timer_set(d, (now + (d->timeout * 1000)));
+
+	return (lg_spk_link_flush(d, link, now));
+}
+
+/* Every responce updates cache, routing is done by lg_ctl_sess. */
+static int
+lg_spk_link_data_cb(lg_ctl_sess_p sess, uint8_t *data, size_t data_size,
+    uint64_t now, size_t *msg_idx, void *udata) {
+	int error;
+	lg_spk_link_p link = udata;
+	lg_spk_daemon_p d = link->d;
+	lg_ctl_resp_t resp;
+
+	link->ts_io = now;
+	link->reconnect_delay = 0;
+	error = lg_spk_state_update(&link->cache, data, data_size, now,
+	    &resp);
+	if (ENOMEM == error)
+		return (error);
+	(*msg_idx) = ((0 == error) ? resp.msg_idx : LG_CTL_MSG_COUNT);
+	if (0 != d->poll && LG_CTL_MSG_GET_COUNT > (*msg_idx)) {
+		lg_spk_daemon_timer_set(d, lg_spk_state_poll_due(
+		    &link->cache, (*msg_idx), (d->poll * 1000),
+		    sess->ts_req[(*msg_idx)]));
+	}
+	if (0 == error && 0 != resp.notify) {
+		(*msg_idx) = LG_CTL_SESS_MSG_NOTIFY; /* Only state update. */
+	}
+
+	return (0);
+}
+
+/* Answer to request: wake clients. */
+static void
+lg_spk_link_sess_cb(lg_ctl_sess_p sess, size_t msg_idx, int error,
+    const lg_ctl_resp_t *resp, const uint8_t *data, size_t data_size,
+    void *udata) {
+	lg_spk_link_p link = udata;
+
+	(void)resp;
+	if (0 != error || LG_CTL_MSG_COUNT <= msg_idx)
+		return; /* Unroutable or pushed. */
+	if (0 != (link->poll_sent & (((uint32_t)1) << msg_idx))) {
+		link->poll_sent &= ~(((uint32_t)1) << msg_idx);
+		link->poll_in_flight_cnt --;
+	}
+	if (0 != sess->in_flight[msg_idx])
+		return; /* SET waiters need answer to last request. */
+	lg_spk_client_wake(link->d, link, msg_idx, 0, data, data_size);
+}
+
+static int
+lg_spk_link_recv(lg_spk_daemon_p d, lg_spk_link_p link,
+    const uint64_t now) {
+	int error;
+	uint8_t *buf;
+	size_t buf_size;
+
+	error = lg_ctl_sess_in_get(&link->sess, &buf, &buf_size);
+	if (0 != error)
+		return (error);
+	/* Process all received responces. */
+	error = lg_ctl_sess_in_done(&link->sess,
+	    recv((int)link->skt, buf, buf_size, MSG_NOSIGNAL), now);
+	if (0 != error) {
+		if (EAGAIN == error || EINTR == error)
+			return (0);
+		return (error);
+	}
+
+	return (lg_spk_link_flush(d, link, now));
+}
+
+static void
+lg_spk_link_io(lg_spk_daemon_p d, lg_spk_link_p link, const uint32_t events,
+    const uint64_t now) {
+	int error = 0;
+	socklen_t optlen;
+
+	switch (link->state) {
+	case LG_SPK_LINK_S_CONNECT:
+		optlen = sizeof(error);
+		if (0 != getsockopt((int)link->skt, SOL_SOCKET, SO_ERROR,
+		    &error, &optlen)) {
+			error = errno;
+		}
+		if (0 != error)
+			break;
+		link->state = LG_SPK_LINK_S_READY;
+		lg_spk_stats_add(d->stats, (size_t)(link - d->links),
+		    LG_SPK_STATS_ALL, LG_SPK_STAT_CONNECT,
+		    (now - link->ts_state));
+		link->ts_state = now;
+		link->ts_io = now;
+		link->error = 0;
+		lg_ctl_cap_rec(d->cap, LG_CTL_CAP_T_TARGET,
+		    link->sess.in.cap_target, (const uint8_t*)link->target->name,
+		    strlen(link->target->name));
+		lg_spk_daemon_timer_set(d, (now + (d->keepalive * 1000)));
+		error = lg_spk_link_flush(d, link, now);
+		break;
+	case LG_SPK_LINK_S_READY:
+		if (0 != (LG_EV_READ & events)) {
+			error = lg_spk_link_recv(d, link, now);
+		} else if (0 != (LG_EV_ERR & events)) {
+			error = ECONNRESET;
+		} else {
+			error = lg_spk_link_flush(d, link, now);
+		}
+		break;
+	default:
+		return;
+	}
+	if (0 != error) {
+		lg_spk_link_fail(d, link, error, now);
+	}
+}
+
+/* Reconnects, connect and responce timeouts, keepalive probes. */
+static void
+lg_spk_link_timers(lg_spk_daemon_p d, lg_spk_link_p link,
+    const uint64_t now) {
+	int error;
+	size_t i;
+	uint64_t due;
+	const uint64_t timeout = (d->timeout * 1000);
+
+	switch (link->state) {
+	case LG_SPK_LINK_S_WAIT:
+		due = (link->ts_state + link->reconnect_delay);
+		if (now < due) {
+			lg_spk_daemon_timer_set(d, due);
+			break;
+		}
+		lg_spk_link_connect(d, link, now);
+		break;
+	case LG_SPK_LINK_S_CONNECT:
+		due = (link->ts_state + timeout);
+		if (now < due) {
+			lg_spk_daemon_timer_set(d, due);
+			break;
+		}
+		lg_spk_link_fail(d, link, ETIMEDOUT, now);
+		break;
+	case LG_SPK_LINK_S_READY:
+		due = lg_ctl_sess_deadline(&link->sess);
+		if (now >= due) {
+			lg_spk_link_fail(d, link, ETIMEDOUT, now);
+			return;
+		}
+		lg_spk_daemon_timer_set(d, due);
+		/* Background poll, pushed messages less often. */
+		for (i = 0; 0 != d->poll && i < LG_CTL_MSG_GET_COUNT; i ++) {
+			if (0 != link->sess.in_flight[i] ||
+			    0 != ((link->get_pend | link->poll_pend) &
+			    (((uint32_t)1) << i)))
+				continue;
+			due = lg_spk_state_poll_due(&link->cache, i,
+			    (d->poll * 1000), link->sess.ts_req[i]);
+			if (now < due) {
+				lg_spk_daemon_timer_set(d, due);
+				continue;
+			}
+			link->poll_pend |= (((uint32_t)1) << i);
+		}
+		if (0 != (link->get_pend | link->poll_pend)) {
+			error = lg_spk_link_flush(d, link, now);
+			if (0 != error) {
+				lg_spk_link_fail(d, link, error, now);
+				return;
+			}
+		}
+		due = (link->ts_io + (d->keepalive * 1000));
+		if (now < due) {
+			lg_spk_daemon_timer_set(d, due);
+			break;
+		}
+		/* Idle: probe, no answer in timeout - reconnect. */
+		link->ts_io = now;
+		lg_spk_daemon_timer_set(d, (now + (d->keepalive * 1000)));
+		error = lg_spk_link_get(d, link, LG_SPK_LINK_KEEPALIVE_MSG, 1,
+		    now);
+		if (0 != error) {
+			lg_spk_link_fail(d, link, error, now);
+		}
+		break;
+	}
+}
+
+static lg_spk_link_p
+lg_spk_link_find(lg_spk_daemon_p d, const char *name,
+    const size_t name_size) {
+	size_t i;
+
+	for (i = 0; i < d->links_cnt; i ++) {
+		if (0 == strncmp(d->links[i].target->name, name, name_size) &&
+		    0 == d->links[i].target->name[name_size])
+			return (&d->links[i]);
+	}
+
+	return (NULL);
+}
+
+
+static void
+lg_spk_client_close(lg_spk_daemon_p d, lg_spk_client_p client) {
+
+	if (NULL != client->prev) {
+		client->prev->next = client->next;
+	} else {
+		d->clients = client->next;
+	}
+	if (NULL != client->next) {
+		client->next->prev = client->prev;
+	}
+	close((int)client->skt);
+	lg_spk_buf_free(&client->tx);
+	lg_free(client->gset);
+	lg_free(client);
+}
+
+static int
+lg_spk_client_ev_update(lg_spk_daemon_p d, lg_spk_client_p client) {
+	int error;
+	uint32_t ev_flags = 0;
+
+	/* Do not read next requests while waiting. */
+	if (NULL == client->wait_link && 0 == client->gset_wait &&
+	    0 == client->rx_eof &&
+	    sizeof(client->rx_buf) > client->rx_size) {
+		ev_flags |= LG_EV_READ;
+	}
+	if (client->tx.off < client->tx.size) {
+		ev_flags |= LG_EV_WRITE;
+	}
+	if (ev_flags == client->ev_flags)
+		return (0);
+	error = lg_ev_set(d->ev, client->skt, ev_flags, client->ev_flags,
+	    client);
+	if (0 != error)
+		return (error);
+	client->ev_flags = ev_flags;
+
+	return (0);
+}
+
+static int
+lg_spk_client_reply(lg_spk_client_p client, const int error,
+    const uint8_t *data, const size_t data_size) {
+	int ret;
+	size_t i;
+	char hdr[256];
+	uint8_t *ptr;
+
+	if (0 != error) {
+		ret = snprintf(hdr, sizeof(hdr), "err %i %s\n",
+		    error, strerror(error));
+		return (lg_spk_buf_add(&client->tx, hdr, (size_t)ret));
+	}
+	ret = lg_spk_buf_reserve(&client->tx, (data_size + 5));
+	if (0 != ret)
+		return (ret);
+	ptr = (client->tx.data + client->tx.size);
+	memcpy(ptr, "ok ", 3);
+	ptr += 3;
+	/* One reply per line: JSON allows line breaks only between
+	 * tokens. */
+	for (i = 0; i < data_size; i ++) {
+		ptr[i] = ((('\r' == data[i] || '\n' == data[i])) ?
+		    ' ' : data[i]);
+	}
+	ptr[data_size] = '\n';
+	client->tx.size += (data_size + 4);
+
+	return (0);
+}
+
+/* Group SET is done: per target timings, from release start. */
+static int
+lg_spk_client_gset_reply(lg_spk_client_p client) {
+	int error;
+	size_t i;
+	uint64_t ts_sent = client->gset_ts, ack_min = UINT64_MAX, ack_max = 0;
+	lg_spk_gset_ent_p ent;
+	char buf[256];
+
+	for (i = 0; i < client->gset_cnt; i ++) {
+		ent = &client->gset[i];
+		ts_sent = MAX(ts_sent, ent->ts_sent);
+		if (0 != ent->error)
+			continue;
+		ack_min = MIN(ack_min, ent->ts_ack);
+		ack_max = MAX(ack_max, ent->ts_ack);
+	}
+	snprintf(buf, sizeof(buf), "ok {\"msg\": \"%s\", "
+	    "\"send_us\": %"PRIu64", \"ack_skew_us\": %"PRIu64", "
+	    "\"targets\": [", lg_ctl_msg[client->gset_msg],
+	    (ts_sent - client->gset_ts),
+	    ((ack_min <= ack_max) ? (ack_max - ack_min) : 0));
+	error = lg_spk_buf_add_cstr(&client->tx, buf);
+	for (i = 0; 0 == error && i < client->gset_cnt; i ++) {
+		ent = &client->gset[i];
+		error = lg_spk_buf_add_cstr(&client->tx,
+		    ((0 == i) ? "{\"name\": " : ", {\"name\": "));
+		if (0 != error)
+			break;
+		error = lg_spk_buf_add_json_str(&client->tx,
+		    ent->link->target->name);
+		if (0 != error)
+			break;
+		snprintf(buf, sizeof(buf), ", \"error\": %i, "
+		    "\"sent_us\": %"PRIu64", \"ack_us\": %"PRIu64"}",
+		    ent->error,
+		    ((0 != ent->ts_sent) ? (ent->ts_sent - client->gset_ts) : 0),
+		    ((0 != ent->ts_ack) ? (ent->ts_ack - client->gset_ts) : 0));
+		error = lg_spk_buf_add_cstr(&client->tx, buf);
+	}
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_buf_add_cstr(&client->tx, "]}\n"));
+}
+
+/* Answer or failure of group SET member. */
+static void
+lg_spk_client_gset_ack(lg_spk_daemon_p d, lg_spk_client_p client,
+    lg_spk_link_p link, const size_t msg_idx, const int error) {
+	size_t i;
+	lg_spk_gset_ent_p ent;
+
+	if (LG_CTL_MSG_COUNT != msg_idx && msg_idx != client->gset_msg)
+		return;
+	for (i = 0; i < client->gset_cnt; i ++) {
+		ent = &client->gset[i];
+		if (link != ent->link || EINPROGRESS != ent->error)
+			continue;
+		ent->error = error;
+		ent->ts_ack = lg_ev_time_us();
+		client->gset_wait --;
+		if (0 != client->gset_wait)
+			return;
+		if (0 != lg_spk_client_gset_reply(client)) {
+			client->rx_eof = 1; /* Out of memory: drop client. */
+			client->rx_size = 0;
+		}
+		client->run = 1;
+		d->run_pending = 1;
+		return;
+	}
+}
+
+static void
+lg_spk_client_wake(lg_spk_daemon_p d, lg_spk_link_p link,
+    const size_t msg_idx, const int error, const uint8_t *data,
+    const size_t data_size) {
+	lg_spk_client_p client;
+
+	for (client = d->clients; NULL != client; client = client->next) {
+		if (0 != client->gset_wait) {
+			lg_spk_client_gset_ack(d, client, link, msg_idx,
+			    error);
+			continue;
+		}
+		if (link != client->wait_link ||
+		    (LG_CTL_MSG_COUNT != msg_idx &&
+		     msg_idx != client->wait_msg))
+			continue;
+		client->wait_link = NULL;
+		if (0 != lg_spk_client_reply(client, error, data, data_size)) {
+			client->rx_eof = 1; /* Out of memory: drop client. */
+			client->rx_size = 0;
+		}
+		/* Next requests are processed from main loop. */
+		client->run = 1;
+		d->run_pending = 1;
+	}
+}
+
+/* Next token separated by spaces. */
+static int
+lg_spk_token_get(const char **ptr, const char *end, const char **tok,
+    size_t *tok_size) {
+	const char *cur = (*ptr);
+
+	while (cur < end && (' ' == (*cur) || '\t' == (*cur))) {
+		cur ++;
+	}
+	(*tok) = cur;
+	while (cur < end && ' ' != (*cur) && '\t' != (*cur)) {
+		cur ++;
+	}
+	(*tok_size) = (size_t)(cur - (*tok));
+	(*ptr) = cur;
+
+	return ((0 == (*tok_size)) ? ENOENT : 0);
+}
+
+static int
+lg_spk_json_obj_check_cb(const lg_json_ev_t *ev, void *udata) {
+
+	(void)udata;
+	if (0 == ev->depth &&
+	    LG_JSON_EV_OBJ_BEGIN != ev->type &&
+	    LG_JSON_EV_OBJ_END != ev->type)
+		return (EINVAL);
+
+	return (0);
+}
+
+static int
+lg_spk_client_targets(lg_spk_daemon_p d, lg_spk_client_p client) {
+	int error;
+	size_t i;
+	lg_spk_link_p link;
+	char buf[256];
+	static const char *state[] = { "wait", "connect", "ready" };
+
+	error = lg_spk_buf_add_cstr(&client->tx, "ok {\"targets\": [");
+	for (i = 0; 0 == error && i < d->links_cnt; i ++) {
+		link = &d->links[i];
+		error = lg_spk_buf_add_cstr(&client->tx,
+		    ((0 == i) ? "{\"name\": " : ", {\"name\": "));
+		if (0 != error)
+			break;
+		error = lg_spk_buf_add_json_str(&client->tx,
+		    link->target->name);
+		if (0 != error)
+			break;
+		snprintf(buf, sizeof(buf), ", \"state\": \"%s\", "
+		    "\"error\": %i, \"connects\": %"PRIu64"}",
+		    state[link->state], link->error, link->connects);
+		error = lg_spk_buf_add_cstr(&client->tx, buf);
+	}
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_buf_add_cstr(&client->tx, "]}\n"));
+}
+
+static int
+lg_spk_client_stats(lg_spk_daemon_p d, lg_spk_client_p client) {
+	int error;
+	size_t pos = 0;
+	const char *scope = NULL;
+	char buf[512];
+	lg_spk_stats_ent_t ent;
+	lg_spk_hist_sum_t sum;
+
+	if (NULL == d->stats)
+		return (EOPNOTSUPP);
+	snprintf(buf, sizeof(buf), "ok {\"elapsed_ms\": %"PRIu64", "
+	    "\"rx_frames\": %"PRIu64", \"rx_bytes\": %"PRIu64", "
+	    "\"tx_bytes\": %"PRIu64", \"hist\": [",
+	    ((lg_ev_time_us() - d->stats->ts_start) / 1000),
+	    d->stats->rx_frames, d->stats->rx_bytes, d->stats->tx_bytes);
+	error = lg_spk_buf_add_cstr(&client->tx, buf);
+	while (0 == error && 0 == lg_spk_stats_next(d->stats, &pos, &ent)) {
+		snprintf(buf, sizeof(buf), "%s{\"stage\": \"%s\"",
+		    ((NULL == scope) ? "" : ", "), lg_spk_stat_name(ent.stat));
+		error = lg_spk_buf_add_cstr(&client->tx, buf);
+		if (0 != error)
+			break;
+		scope = "";
+		if (LG_SPK_STATS_ALL != ent.target) {
+			error = lg_spk_buf_add_cstr(&client->tx,
+			    ", \"target\": ");
+			if (0 == error) {
+				error = lg_spk_buf_add_json_str(&client->tx,
+				    d->links[ent.target].target->name);
+			}
+		} else if (LG_SPK_STATS_ALL != ent.msg_idx) {
+			snprintf(buf, sizeof(buf), ", \"msg\": \"%s\"",
+			    ((LG_CTL_MSG_COUNT > ent.msg_idx) ?
+			    lg_ctl_msg[ent.msg_idx] : "other"));
+			error = lg_spk_buf_add_cstr(&client->tx, buf);
+		}
+		if (0 != error)
+			break;
+		lg_spk_hist_sum(ent.hist, &sum);
+		snprintf(buf, sizeof(buf), ", \"count\": %"PRIu64", "
+		    "\"min_us\": %"PRIu64", \"mean_us\": %"PRIu64", "
+		    "\"p50_us\": %"PRIu64", \"p90_us\": %"PRIu64", "
+		    "\"p99_us\": %"PRIu64", \"p999_us\": %"PRIu64", "
+		    "\"max_us\": %"PRIu64"}",
+		    sum.cnt, sum.min, sum.mean, sum.p50, sum.p90, sum.p99,
+		    sum.p999, sum.max);
+		error = lg_spk_buf_add_cstr(&client->tx, buf);
+	}
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_buf_add_cstr(&client->tx, "]}\n"));
+}
+
+/* Prometheus label value: \\, \" and \n escaped, zero terminated. */
+static void
+lg_spk_label_esc(const char *str, char *buf, const size_t buf_size) {
+	size_t i, off = 0;
+
+	for (i = 0; 0 != str[i] && (off + 3) < buf_size; i ++) {
+		switch (str[i]) {
+		case '\\':
+		case '"':
+			buf[off ++] = '\\';
+			buf[off ++] = str[i];
+			break;
+		case '\n':
+			buf[off ++] = '\\';
+			buf[off ++] = 'n';
+			break;
+		default:
+			buf[off ++] = str[i];
+		}
+	}
+	buf[off] = 0;
+}
+
+typedef struct lg_spk_metrics_ctx_s {
+	lg_spk_buf_p	buf;
+	const char	*family;
+	const char	*target;	/* Escaped. */
+} lg_spk_metrics_ctx_t, *lg_spk_metrics_ctx_p;
+
+/* Numeric and boolean members of cached "data" object. */
+static int
+lg_spk_metrics_field_cb(const lg_ctl_resp_t *resp, const lg_json_ev_t *ev,
+    void *udata) {
+	const char *value;
+	size_t value_size;
+	lg_spk_metrics_ctx_p ctx = udata;
+
+	(void)resp;
+	if (1 != ev->depth || NULL == ev->name ||
+	    0 != (LG_JSON_EV_F_NAME_ESC & ev->flags))
+		return (0);
+	switch (ev->type) {
+	case LG_JSON_EV_NUMBER:
+		value = ev->value;
+		value_size = ev->value_size;
+		break;
+	case LG_JSON_EV_TRUE:
+		value = "1";
+		value_size = 1;
+		break;
+	case LG_JSON_EV_FALSE:
+		value = "0";
+		value_size = 1;
+		break;
+	default:
+		return (0);
+	}
+
+	return (lg_spk_buf_printf(ctx->buf,
+	    "%s{target=\"%s\",field=\"%.*s\"} %.*s\n",
+	    ctx->family, ctx->target, (int)ev->name_size, ev->name,
+	    (int)value_size, value));
+}
+
+static int
+lg_spk_metrics_hdr(lg_spk_buf_p buf, const char *family, const char *type,
+    const char *help) {
+
+	return (lg_spk_buf_printf(buf, "# HELP %s %s\n# TYPE %s %s\n",
+	    family, help, family, type));
+}
+
+/* Scrape: cache and counters only, no soundbar requests. */
+static int
+lg_spk_metrics_render(lg_spk_daemon_p d, lg_spk_buf_p buf,
+    const uint64_t now) {
+	int error = 0;
+	size_t i, j, k;
+	uint64_t value, quantile[4];
+	char family[64], target[(2 * LG_SPK_TARGET_NAME_MAX)];
+	lg_spk_link_p link;
+	const lg_spk_state_ent_t *ent;
+	const lg_spk_hist_t *hist;
+	lg_spk_hist_sum_t sum;
+	lg_spk_metrics_ctx_t ctx;
+	lg_ctl_resp_t resp;
+	static const size_t msgs[] = { LG_SPK_METRICS_MSGS };
+	static const char *quantile_name[] = { "0.5", "0.9", "0.99", "0.999" };
+	static const char *link_metric[][3] = {
+		{ "lgspk_up", "gauge", "Soundbar connection is ready." },
+		{ "lgspk_connects_total", "counter", "Connections made." },
+		{ "lgspk_failures_total", "counter",
+		  "Connect and responce timeout failures." },
+		{ "lgspk_notifications_total", "counter",
+		  "State changes pushed by soundbar." }
+	};
+
+	for (j = 0; 0 == error && j < nitems(link_metric); j ++) {
+		error = lg_spk_metrics_hdr(buf, link_metric[j][0],
+		    link_metric[j][1], link_metric[j][2]);
+		for (i = 0; 0 == error && i < d->links_cnt; i ++) {
+			link = &d->links[i];
+			switch (j) {
+			case 0:
+				value = (LG_SPK_LINK_S_READY == link->state);
+				break;
+			case 1:
+				value = link->connects;
+				break;
+			case 2:
+				value = link->fails;
+				break;
+			default:
+				for (k = 0, value = 0; k < LG_CTL_MSG_COUNT;
+				    k ++) {
+					value += link->cache.ent[k].push_cnt;
+				}
+			}
+			lg_spk_label_esc(link->target->name, target,
+			    sizeof(target));
+			error = lg_spk_buf_printf(buf,
+			    "%s{target=\"%s\"} %"PRIu64"\n",
+			    link_metric[j][0], target, value);
+		}
+	}
+	/* Family per message: lgspk_<msg>{target, field}. */
+	ctx.buf = buf;
+	ctx.family = family;
+	ctx.target = target;
+	for (j = 0; 0 == error && j < nitems(msgs); j ++) {
+		snprintf(family, sizeof(family), "lgspk_%s",
+		    lg_ctl_msg[msgs[j]]);
+		for (k = 0; 0 != family[k]; k ++) {
+			family[k] = (char)tolower(family[k]);
+		}
+		error = lg_spk_buf_printf(buf, "# HELP %s %s numeric fields, "
+		    "booleans as 1 / 0.\n# TYPE %s gauge\n",
+		    family, lg_ctl_msg[msgs[j]], family);
+		for (i = 0; 0 == error && i < d->links_cnt; i ++) {
+			ent = &d->links[i].cache.ent[msgs[j]];
+			if (0 == ent->version)
+				continue; /* Never received. */
+			lg_spk_label_esc(d->links[i].target->name, target,
+			    sizeof(target));
+			error = lg_ctl_resp_parse((const char*)ent->data,
+			    ent->size, lg_spk_metrics_field_cb, &ctx, &resp);
+		}
+	}
+	if (0 == error) {
+		error = lg_spk_metrics_hdr(buf, "lgspk_cache_age_seconds",
+		    "gauge", "Time since cached responce update.");
+	}
+	for (i = 0; 0 == error && i < d->links_cnt; i ++) {
+		lg_spk_label_esc(d->links[i].target->name, target,
+		    sizeof(target));
+		for (j = 0; 0 == error && j < nitems(msgs); j ++) {
+			ent = &d->links[i].cache.ent[msgs[j]];
+			if (0 == ent->version)
+				continue;
+			error = lg_spk_buf_printf(buf,
+			    "lgspk_cache_age_seconds{target=\"%s\",msg=\"%s\"} "
+			    "%.3f\n", target, lg_ctl_msg[msgs[j]],
+			    ((double)(now - MIN(now, ent->ts)) / 1000000));
+		}
+	}
+	if (0 != error || NULL == d->stats)
+		return (error);
+
+	/* Own counters and latency. */
+	error = lg_spk_buf_printf(buf,
+	    "# HELP lgspk_rx_frames_total Responces received.\n"
+	    "# TYPE lgspk_rx_frames_total counter\n"
+	    "lgspk_rx_frames_total %"PRIu64"\n"
+	    "# HELP lgspk_rx_bytes_total Bytes received in frames.\n"
+	    "# TYPE lgspk_rx_bytes_total counter\n"
+	    "lgspk_rx_bytes_total %"PRIu64"\n"
+	    "# HELP lgspk_tx_bytes_total Bytes sent.\n"
+	    "# TYPE lgspk_tx_bytes_total counter\n"
+	    "lgspk_tx_bytes_total %"PRIu64"\n",
+	    d->stats->rx_frames, d->stats->rx_bytes, d->stats->tx_bytes);
+	if (0 == error) {
+		error = lg_spk_metrics_hdr(buf, "lgspk_latency_seconds",
+		    "summary", "Request stage latency, see lg_spk_stats.h.");
+	}
+	for (i = 0; 0 == error && i < LG_SPK_STAT_COUNT; i ++) {
+		hist = &d->stats->stage[i];
+		if (0 == hist->cnt)
+			continue;
+		lg_spk_hist_sum(hist, &sum);
+		quantile[0] = sum.p50;
+		quantile[1] = sum.p90;
+		quantile[2] = sum.p99;
+		quantile[3] = sum.p999;
+		for (k = 0; 0 == error && k < nitems(quantile); k ++) {
+			error = lg_spk_buf_printf(buf,
+			    "lgspk_latency_seconds{stage=\"%s\","
+			    "quantile=\"%s\"} %.6f\n",
+			    lg_spk_stat_name(i), quantile_name[k],
+			    ((double)quantile[k] / 1000000));
+		}
+		if (0 != error)
+			break;
+		error = lg_spk_buf_printf(buf,
+		    "lgspk_latency_seconds_sum{stage=\"%s\"} %.6f\n"
+		    "lgspk_latency_seconds_count{stage=\"%s\"} %"PRIu64"\n",
+		    lg_spk_stat_name(i), ((double)hist->sum / 1000000),
+		    lg_spk_stat_name(i), hist->cnt);
+	}
+
+	return (error);
+}
+
+/* Rest of line: data JSON object. */
+static int
+lg_spk_data_get(const char **ptr, const char *end, size_t *data_size) {
+
+	while ((*ptr) < end && (' ' == (**ptr) || '\t' == (**ptr))) {
+		(*ptr) ++;
+	}
+	(*data_size) = (size_t)(end - (*ptr));
+	if (0 != lg_json_parse((*ptr), (*data_size),
+	    lg_spk_json_obj_check_cb, NULL))
+		return (EINVAL);
+
+	return (0);
+}
+
+/* Group SET: same packet to all, sends are released back to back. */
+static int
+lg_spk_client_gset(lg_spk_daemon_p d, lg_spk_client_p client,
+    const char *ptr, const char *end, const uint64_t now) {
+	int error, all;
+	const char *tok, *names, *names_end, *name_end;
+	size_t tok_size, i, j, cnt, msg_idx, data_size, pkt_size;
+	lg_spk_link_p link;
+	lg_spk_gset_ent_p ent;
+
+	/* Targets, message and data. */
+	if (0 != lg_spk_token_get(&ptr, end, &names, &tok_size))
+		return (EINVAL);
+	names_end = (names + tok_size);
+	all = (0 == mem_cmpn_cstr("*", names, tok_size));
+	if (0 != lg_spk_token_get(&ptr, end, &tok, &tok_size))
+		return (EINVAL);
+	msg_idx = lg_ctl_msg_idx_get(tok, tok_size);
+	if (LG_CTL_MSG_COUNT == msg_idx)
+		return (EINVAL);
+	error = lg_spk_data_get(&ptr, end, &data_size);
+	if (0 != error)
+		return (error);
+	cnt = d->links_cnt;
+	if (0 == all) {
+		for (cnt = 1, tok = names; tok < names_end; tok ++) {
+			if (',' == (*tok)) {
+				cnt ++;
+			}
+		}
+	}
+	if (cnt > client->gset_allocated) {
+		ent = lg_realloc(client->gset,
+		    (cnt * sizeof(lg_spk_gset_ent_t)));
+		if (NULL == ent)
+			return (ENOMEM);
+		client->gset = ent;
+		client->gset_allocated = cnt;
+	}
+	client->gset_cnt = 0;
+	for (i = 0; i < cnt; i ++) {
+		if (0 != all) {
+			link = &d->links[i];
+		} else {
+			name_end = memchr(names, ',',
+			    (size_t)(names_end - names));
+			if (NULL == name_end) {
+				name_end = names_end;
+			}
+			link = lg_spk_link_find(d, names,
+			    (size_t)(name_end - names));
+			if (NULL == link)
+				return (ENOENT);
+			for (j = 0; j < client->gset_cnt; j ++) {
+				if (link == client->gset[j].link)
+					return (EINVAL); /* Duplicate. */
+			}
+			names = (name_end + 1);
+		}
+		ent = &client->gset[client->gset_cnt ++];
+		ent->link = link;
+		ent->error = ((LG_SPK_LINK_S_READY == link->state) ?
+		    EINPROGRESS : ENOTCONN);
+		ent->ts_sent = 0;
+		ent->ts_ack = 0;
+	}
+	/* Key and IV are constant: packet is same for all targets. */
+	lg_spk_buf_reset(&d->gset_pkt);
+	error = lg_spk_set_pkt_create(d, &d->gset_pkt, msg_idx, ptr,
+	    data_size, &pkt_size);
+	if (0 != error)
+		return (error);
+	/* Queue to all, so release loop only calls send(). */
+	for (i = 0; i < client->gset_cnt; i ++) {
+		ent = &client->gset[i];
+		if (EINPROGRESS != ent->error)
+			continue;
+		ent->error = lg_ctl_sess_pkt_add(&ent->link->sess, msg_idx,
+		    d->gset_pkt.data, pkt_size, now);
+		if (0 != ent->error)
+			continue;
+		lg_spk_daemon_timer_set(d, (now + (d->timeout * 1000)));
+		ent->error = EINPROGRESS;
+	}
+	client->gset_msg = msg_idx;
+	client->gset_wait = 0;
+	client->gset_ts = lg_ev_time_us();
+	for (i = 0; i < client->gset_cnt; i ++) {
+		ent = &client->gset[i];
+		if (EINPROGRESS != ent->error)
+			continue;
+		link = ent->link;
+		error = lg_spk_link_send(link, now);
+		ent->ts_sent = lg_ev_time_us();
+		if (0 != error) {
+			ent->error = error;
+			ent->ts_ack = ent->ts_sent;
+			lg_spk_link_fail(d, link, error, now);
+			continue;
+		}
+	}
+	/* Rest of partially sent packets go on write readiness. */
+	for (i = 0; i < client->gset_cnt; i ++) {
+		ent = &client->gset[i];
+		if (EINPROGRESS != ent->error)
+			continue;
+		error = lg_spk_link_ev_update(d, ent->link);
+		if (0 != error) {
+			ent->error = error;
+			ent->ts_ack = lg_ev_time_us();
+			lg_spk_link_fail(d, ent->link, error, now);
+			continue;
+		}
+		client->gset_wait ++;
+	}
+	if (0 != client->gset_wait)
+		return (0); /* Wake on answers. */
+
+	return (lg_spk_client_gset_reply(client));
+}
+
+/* Returns error to reply with, 0 if replied or waits responce. */
+static int
+lg_spk_client_request(lg_spk_daemon_p d, lg_spk_client_p client,
+    const char *line, const size_t line_size, const uint64_t now) {
+	int error, set;
+	const char *ptr = line, *end = (line + line_size), *tok;
+	size_t tok_size, msg_idx, data_size;
+	uint64_t max_age;
+	lg_spk_link_p link;
+	const lg_spk_state_ent_t *ent;
+
+	if (0 != lg_spk_token_get(&ptr, end, &tok, &tok_size))
+		return (0); /* Empty line. */
+	if (0 == mem_cmpn_cstr("targets", tok, tok_size))
+		return (lg_spk_client_targets(d, client));
+	if (0 == mem_cmpn_cstr("stats", tok, tok_size))
+		return (lg_spk_client_stats(d, client));
+	if (0 == mem_cmpn_cstr("gset", tok, tok_size))
+		return (lg_spk_client_gset(d, client, ptr, end, now));
+	if (0 == mem_cmpn_cstr("get", tok, tok_size)) {
+		set = 0;
+	} else if (0 == mem_cmpn_cstr("set", tok, tok_size)) {
+		set = 1;
+	} else {
+		return (EINVAL);
+	}
+	/* Target and message. */
+	if (0 != lg_spk_token_get(&ptr, end, &tok, &tok_size))
+		return (EINVAL);
+	link = lg_spk_link_find(d, tok, tok_size);
+	if (NULL == link)
+		return (ENOENT);
+	if (0 != lg_spk_token_get(&ptr, end, &tok, &tok_size))
+		return (EINVAL);
+	msg_idx = lg_ctl_msg_idx_get(tok, tok_size);
+	if (LG_CTL_MSG_COUNT == msg_idx)
+		return (EINVAL);
+
+	if (0 != set) {
+		error = lg_spk_data_get(&ptr, end, &data_size);
+		if (0 != error)
+			return (error);
+		error = lg_spk_link_set(d, link, msg_idx, ptr, data_size,
+		    now);
+	} else {
+		if (LG_CTL_MSG_GET_COUNT <= msg_idx)
+			return (EINVAL); /* Not info message. */
+		max_age = d->cache_ttl;
+		if (0 == lg_spk_token_get(&ptr, end, &tok, &tok_size)) {
+			max_age = str2usize(tok, tok_size);
+		}
+		ent = lg_spk_state_get(&link->cache, msg_idx,
+		    (max_age * 1000), now);
+		if (NULL != ent)
+			return (lg_spk_client_reply(client, 0,
+			    ent->data, ent->size));
+		error = lg_spk_link_get(d, link, msg_idx, 0, now);
+	}
+	if (ENOTCONN == error)
+		return (error);
+	/* Link failure wakes all its clients, so wait in any case. */
+	client->wait_link = link;
+	client->wait_msg = msg_idx;
+	if (0 != error) {
+		lg_spk_link_fail(d, link, error, now);
+	}
+
+	return (0);
+}
+
+static void
+lg_spk_client_process(lg_spk_daemon_p d, lg_spk_client_p client,
+    const uint64_t now) {
+	int error;
+	char *eol;
+	size_t line_size;
+
+	while (NULL == client->wait_link && 0 == client->gset_wait &&
+	    0 != client->rx_size) {
+		eol = memchr(client->rx_buf, '\n', client->rx_size);
+		if (NULL != eol) {
+			line_size = (size_t)(eol - client->rx_buf);
+		} else if (0 != client->rx_eof) {
+			line_size = client->rx_size; /* Last line. */
+		} else {
+			if (sizeof(client->rx_buf) > client->rx_size)
+				break; /* Wait for line end. */
+			client->rx_eof = 1;
+			client->rx_size = 0;
+			if (0 != lg_spk_client_reply(client, E2BIG, NULL, 0))
+				goto err_out;
+			break;
+		}
+		error = lg_spk_client_request(d, client, client->rx_buf,
+		    ((0 != line_size && '\r' == client->rx_buf[(line_size - 1)]) ?
+		    (line_size - 1) : line_size), now);
+		if (0 != error) {
+			error = lg_spk_client_reply(client, error, NULL, 0);
+			if (0 != error)
+				goto err_out;
+		}
+		/* Remove processed line. */
+		line_size = MIN((line_size + 1), client->rx_size);
+		client->rx_size -= line_size;
+		memmove(client->rx_buf, (client->rx_buf + line_size),
+		    client->rx_size);
+	}
+	error = lg_spk_buf_send(&client->tx, client->skt);
+	if (0 != error)
+		goto err_out;
+	if (0 != client->rx_eof && NULL == client->wait_link &&
+	    0 == client->gset_wait && 0 == client->rx_size &&
+	    client->tx.off == client->tx.size) {
+		lg_spk_client_close(d, client); /* All answered. */
+		return;
+	}
+	error = lg_spk_client_ev_update(d, client);
+	if (0 != error)
+		goto err_out;
+
+	return;
+
+err_out:
+	lg_spk_client_close(d, client);
+}
+
+/* Metrics endpoint: one request per connection, reply and close. */
+static void
+lg_spk_http_process(lg_spk_daemon_p d, lg_spk_client_p client,
+    const uint64_t now) {
+	int error;
+
+	if (0 == client->rx_eof || 0 != client->rx_size) { /* Not replied. */
+		if (NULL == memmem(client->rx_buf, client->rx_size,
+		    "\r\n\r\n", 4) &&
+		    NULL == memmem(client->rx_buf, client->rx_size,
+		    "\n\n", 2)) {
+			if (0 != client->rx_eof ||
+			    sizeof(client->rx_buf) == client->rx_size)
+				goto err_out; /* Closed or too large. */
+			goto ev_update; /* Wait for headers end. */
+		}
+		if (0 != mem_cmpn_cstr("GET ", client->rx_buf,
+		    MIN(4, client->rx_size))) {
+			error = lg_spk_buf_add_cstr(&client->tx,
+			    "HTTP/1.0 405 Method Not Allowed\r\n"
+			    "Allow: GET\r\nConnection: close\r\n\r\n");
+		} else if (0 != mem_cmpn_cstr("GET /metrics ", client->rx_buf,
+		    MIN(13, client->rx_size))) {
+			error = lg_spk_buf_add_cstr(&client->tx,
+			    "HTTP/1.0 404 Not Found\r\n"
+			    "Connection: close\r\n\r\n");
+		} else {
+			/* No Content-Length: body ends on close. */
+			error = lg_spk_buf_add_cstr(&client->tx,
+			    "HTTP/1.0 200 OK\r\n"
+			    "Content-Type: text/plain; version=0.0.4\r\n"
+			    "Connection: close\r\n\r\n");
+			if (0 == error) {
+				error = lg_spk_metrics_render(d, &client->tx,
+				    now);
+			}
+		}
+		if (0 != error)
+			goto err_out;
+		client->rx_eof = 1; /* Do not read more. */
+		client->rx_size = 0;
+	}
+	error = lg_spk_buf_send(&client->tx, client->skt);
+	if (0 != error || client->tx.off == client->tx.size)
+		goto err_out; /* All sent. */
+ev_update:
+	if (0 == lg_spk_client_ev_update(d, client))
+		return;
+err_out:
+	lg_spk_client_close(d, client);
+}
+
+static void
+lg_spk_client_io(lg_spk_daemon_p d, lg_spk_client_p client,
+    const uint32_t events, const uint64_t now) {
+	ssize_t ios;
+
+	if (0 != (LG_EV_READ & events)) {
+		ios = recv((int)client->skt, (client->rx_buf + client->rx_size),
+		    (sizeof(client->rx_buf) - client->rx_size), 0);
+		if (0 == ios) {
+			client->rx_eof = 1;
+		} else if (-1 == ios) {
+			if (EAGAIN != errno && EINTR != errno) {
+				lg_spk_client_close(d, client);
+				return;
+			}
+		} else {
+			client->rx_size += (size_t)ios;
+		}
+	} else if (0 != (LG_EV_ERR & events)) {
+		lg_spk_client_close(d, client);
+		return;
+	}
+	if (LG_SPK_DAEMON_T_HTTP == client->type) {
+		lg_spk_http_process(d, client, now);
+		return;
+	}
+	lg_spk_client_process(d, client, now);
+}
+
+static void
+lg_spk_daemon_accept(lg_spk_daemon_p d, const uintptr_t listen_skt,
+    const uint32_t type) {
+	int error;
+	uintptr_t skt;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	lg_spk_client_p client;
+
+	for (;;) {
+		addrlen = sizeof(addr);
+		error = skt_accept(listen_skt, &addr, &addrlen, SO_F_NONBLOCK,
+		    &skt);
+		if (0 != error)
+			return;
+		client = lg_calloc(1, sizeof(lg_spk_client_t));
+		if (NULL == client) {
+			close((int)skt);
+			return;
+		}
+		client->type = type;
+		client->skt = skt;
+		client->next = d->clients;
+		if (NULL != d->clients) {
+			d->clients->prev = client;
+		}
+		d->clients = client;
+		if (0 != lg_spk_client_ev_update(d, client)) {
+			lg_spk_client_close(d, client);
+		}
+	}
+}
+
+static int
+lg_spk_daemon_listen(lg_spk_daemon_p d, const char *sock_path) {
+	int error;
+	size_t path_size;
+	struct sockaddr_un addr;
+	struct stat st;
+
+	path_size = strlen(sock_path);
+	if (0 == path_size || sizeof(addr.sun_path) <= path_size)
+		return (EINVAL);
+	memset(&addr, 0x00, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, sock_path, path_size);
+	/* Remove stale socket, but do not touch other files. */
+	if (0 == lstat(sock_path, &st)) {
+		if (!S_ISSOCK(st.st_mode))
+			return (EEXIST);
+		unlink(sock_path);
+	}
+	error = skt_create(AF_UNIX, SOCK_STREAM, 0, SO_F_NONBLOCK, &d->skt);
+	if (0 != error)
+		return (error);
+	if (0 != bind((int)d->skt, (struct sockaddr*)&addr, sizeof(addr)) ||
+	    0 != listen((int)d->skt, -1))
+		return (errno);
+	d->sock_path = sock_path;
+	error = lg_ev_set(d->ev, d->skt, LG_EV_READ, 0, NULL);
+	if (0 != error || 0 == d->metrics.ss_family)
+		return (error);
+
+	/* Metrics: udata points to own socket to tell it from others. */
+	error = skt_bind(&d->metrics, SOCK_STREAM, IPPROTO_TCP,
+	    (SO_F_NONBLOCK | SO_F_REUSEADDR), &d->metrics_skt);
+	if (0 != error)
+		return (error);
+	if (0 != listen((int)d->metrics_skt, -1))
+		return (errno);
+
+	return (lg_ev_set(d->ev, d->metrics_skt, LG_EV_READ, 0,
+	    &d->metrics_skt));
+}
+
+
+void
+lg_spk_daemon_init(lg_spk_daemon_p d, lg_ctl_crypto_p crypto,
+    lg_ctl_get_pkts_p get_pkts) {
+
+	if (NULL == d)
+		return;
+	memset(d, 0x00, sizeof(lg_spk_daemon_t));
+	d->crypto = crypto;
+	d->get_pkts = get_pkts;
+	d->pipeline = 1;
+	d->max_payload = LG_CTL_CONN_BUF_MAX_SIZE;
+	d->timeout = LG_SPK_ENGINE_DEF_TIMEOUT;
+	d->keepalive = LG_SPK_DAEMON_DEF_KEEPALIVE;
+	d->cache_ttl = LG_SPK_DAEMON_DEF_CACHE_TTL;
+	d->poll_pipeline = LG_SPK_DAEMON_DEF_POLL_PIPELINE;
+	d->ev = (uintptr_t)-1;
+	d->skt = (uintptr_t)-1;
+	d->metrics_skt = (uintptr_t)-1;
+}
+
+void
+lg_spk_daemon_destroy(lg_spk_daemon_p d) {
+	size_t i;
+
+	if (NULL == d)
+		return;
+	while (NULL != d->clients) {
+		lg_spk_client_close(d, d->clients);
+	}
+	for (i = 0; i < d->links_cnt; i ++) {
+		lg_ctl_sess_destroy(&d->links[i].sess);
+		lg_spk_state_destroy(&d->links[i].cache);
+	}
+	lg_free(d->links);
+	d->links = NULL;
+	d->links_cnt = 0;
+	if (((uintptr_t)-1) != d->skt) {
+		close((int)d->skt);
+		d->skt = (uintptr_t)-1;
+	}
+	if (((uintptr_t)-1) != d->metrics_skt) {
+		close((int)d->metrics_skt);
+		d->metrics_skt = (uintptr_t)-1;
+	}
+	if (NULL != d->sock_path) {
+		unlink(d->sock_path);
+		d->sock_path = NULL;
+	}
+	lg_spk_buf_free(&d->gset_pkt);
+	lg_ev_close(d->ev);
+	d->ev = (uintptr_t)-1;
+}
+
+static void
+lg_spk_daemon_stats_dump(lg_spk_daemon_p d, lg_spk_target_p targets) {
+	lg_spk_out_t out;
+
+	if (NULL == d->stats)
+		return;
+	lg_spk_out_init(&out, LG_SPK_OUT_FMT_TREE, STDERR_FILENO);
+	lg_spk_out_stats(&out, d->stats, targets);
+	lg_spk_out_flush(&out);
+	lg_spk_out_destroy(&out);
+}
+
+int
+lg_spk_daemon_run(lg_spk_daemon_p d, const char *sock_path,
+    lg_spk_target_p targets, size_t targets_cnt,
+    volatile sig_atomic_t *stop) {
+	int error, timeout_ms;
+	size_t i, ev_cnt;
+	uint64_t now;
+	lg_ev_event_t ev[LG_EV_WAIT_MAX];
+	lg_spk_client_p client, client_next;
+
+	if (NULL == d || NULL == d->crypto || NULL == d->get_pkts ||
+	    NULL == sock_path || NULL == targets || 0 == targets_cnt ||
+	    NULL == stop || NULL != d->links)
+		return (EINVAL);
+	if (0 == d->pipeline) {
+		d->pipeline = 1;
+	}
+
+	d->links = lg_calloc(targets_cnt, sizeof(lg_spk_link_t));
+	if (NULL == d->links)
+		return (ENOMEM);
+	d->links_cnt = targets_cnt;
+	for (i = 0; i < targets_cnt; i ++) {
+		d->links[i].type = LG_SPK_DAEMON_T_LINK;
+		d->links[i].target = &targets[i];
+		d->links[i].d = d;
+		d->links[i].skt = (uintptr_t)-1;
+		lg_ctl_sess_init(&d->links[i].sess, d->crypto, d->get_pkts,
+		    d->max_payload);
+		d->links[i].sess.timeout = d->timeout;
+		d->links[i].sess.cb = lg_spk_link_sess_cb;
+		d->links[i].sess.data_cb = lg_spk_link_data_cb;
+		d->links[i].sess.udata = &d->links[i];
+		d->links[i].sess.stats = d->stats;
+		d->links[i].sess.stats_target = i;
+		d->links[i].sess.in.cap = d->cap;
+		d->links[i].sess.in.cap_target = (uint32_t)i;
+		/* LG_SPK_LINK_S_WAIT with zero delay: connect now. */
+	}
+	error = lg_ev_open(&d->ev);
+	if (0 != error)
+		return (error);
+	error = lg_spk_daemon_listen(d, sock_path);
+	if (0 != error)
+		return (error);
+
+	d->next_timer = 0;
+	while (0 == (*stop)) {
+		if (NULL != d->stats_dump && 0 != (*d->stats_dump)) {
+			(*d->stats_dump) = 0;
+			lg_spk_daemon_stats_dump(d, targets);
+		}
+		now = lg_ev_time_us();
+		if ((uint64_t)-1 == d->next_timer) {
+			timeout_ms = -1;
+		} else {
+			timeout_ms = ((d->next_timer > now) ?
+			    (int)(((d->next_timer - now) + 999) / 1000) : 0);
+		}
+		error = lg_ev_wait(d->ev, ev, LG_EV_WAIT_MAX, timeout_ms,
+		    &ev_cnt);
+		if (0 != error)
+			break;
+		now = lg_ev_time_us();
+		for (i = 0; i < ev_cnt; i ++) {
+			if (NULL == ev[i].udata) {
+				lg_spk_daemon_accept(d, d->skt,
+				    LG_SPK_DAEMON_T_CLIENT);
+				continue;
+			}
+			if (&d->metrics_skt == ev[i].udata) {
+				lg_spk_daemon_accept(d, d->metrics_skt,
+				    LG_SPK_DAEMON_T_HTTP);
+				continue;
+			}
+			switch ((*((uint32_t*)ev[i].udata))) {
+			case LG_SPK_DAEMON_T_LINK:
+				lg_spk_link_io(d, (lg_spk_link_p)ev[i].udata,
+				    ev[i].events, now);
+				break;
+			case LG_SPK_DAEMON_T_CLIENT:
+			case LG_SPK_DAEMON_T_HTTP:
+				lg_spk_client_io(d,
+				    (lg_spk_client_p)ev[i].udata,
+				    ev[i].events, now);
+				break;
+			}
+		}
+		/* Timers. */
+		if (now >= d->next_timer) {
+			d->next_timer = (uint64_t)-1;
+			for (i = 0; i < d->links_cnt; i ++) {
+				lg_spk_link_timers(d, &d->links[i], now);
+			}
+		}
+		/* Clients with replies: send and process next requests. */
+		while (0 != d->run_pending) {
+			d->run_pending = 0;
+			for (client = d->clients; NULL != client;
+			    client = client_next) {
+				client_next = client->next;
+				if (0 == client->run)
+					continue;
+				client->run = 0;
+				lg_spk_client_process(d, client, now);
+			}
+		}
+	}
+
+	return (error);
+}
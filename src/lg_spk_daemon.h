@@ -0,0 +1,223 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_DAEMON_H__
+#define __LG_SPK_DAEMON_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <inttypes.h>
+#include <signal.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_conn.h"
+#include "lg_ctl_sess.h"
+#include "lg_spk_engine.h"
+#include "lg_spk_state.h"
+
+
+/*
+ * Daemon: keeps connection to every soundbar open, probes idle ones and
+ * reconnects with backoff on failure. State of every soundbar is cached
+ * (lg_spk_state), including pushed changes; local clients get answers
+ * from cache or over already open connection, without connect.
+ * Optional background poll refreshes cache, pushed messages are polled
+ * LG_SPK_STATE_PUSH_BACKOFF times less often.
+ * Two priority classes per link: client GETs are sent first, background
+ * ones (poll, cache warm up, keepalive probe) only if no client GET is
+ * pending and less than poll_pipeline of them are in flight, so client
+ * request waits for no more than poll_pipeline background answers.
+ * Pending background GET of message requested by client is moved to
+ * client class, not duplicated. SETs are sent at once.
+ *
+ * Clients protocol, unix stream socket, one request per line, replies
+ * are in same order:
+ *	get <target> <MSG> [max_age_ms]
+ *		Cached responce if it is not older than max_age_ms
+ *		(default: cache_ttl) or message is pushed by soundbar,
+ *		otherwise GET is sent to soundbar; 0 - always send.
+ *		Concurrent GETs of same message share one request.
+ *	set <target> <MSG> <data JSON object>
+ *		Reply is soundbar responce with new state.
+ *	gset <target[,target...]|*> <MSG> <data JSON object>
+ *		Group SET: packet is encrypted once, queued to all ready
+ *		links, then released by back to back send() calls.
+ *		Reply after all answers or failures: per target error,
+ *		sent_us (send() done, from release start) and ack_us
+ *		(answer, from release start), send_us (release time)
+ *		and ack_skew_us (first to last answer).
+ *		Not connected targets are reported with ENOTCONN.
+ *	targets
+ *		Links state.
+ *	stats
+ *		Latency histograms, in us: per stage, message and target,
+ *		see lg_spk_stats.h. EOPNOTSUPP if stats are off.
+ * Reply: "ok <JSON>\n" or "err <errno> <description>\n".
+ * JSON is responce as received from soundbar, line breaks are replaced
+ * by spaces.
+ * <target>: name from targets file or address as given.
+ *
+ * Optional HTTP metrics endpoint: GET /metrics returns Prometheus text
+ * format made from cache only, without soundbar requests: numeric and
+ * boolean fields of LG_SPK_METRICS_MSGS, links state and latency
+ * stats. Use poll to keep cache fresh.
+ */
+
+/* Growable output buffer. */
+typedef struct lg_spk_buf_s {
+	uint8_t		*data;
+	size_t		size;		/* Used. */
+	size_t		allocated;
+	size_t		off;		/* Sent. */
+} lg_spk_buf_t, *lg_spk_buf_p;
+
+/* Event loop udata types, first member of all structs. */
+#define LG_SPK_DAEMON_T_LINK	1
+#define LG_SPK_DAEMON_T_CLIENT	2
+#define LG_SPK_DAEMON_T_HTTP	3 /* lg_spk_client_t on metrics socket. */
+
+#define LG_SPK_LINK_S_WAIT	0 /* Wait for reconnect. */
+#define LG_SPK_LINK_S_CONNECT	1
+#define LG_SPK_LINK_S_READY	2
+
+/* Persistent connection to soundbar. */
+typedef struct lg_spk_link_s {
+	uint32_t	type;		/* LG_SPK_DAEMON_T_LINK */
+	uint32_t	state;		/* LG_SPK_LINK_S_* */
+	uint32_t	ev_flags;	/* Registered in event loop. */
+	int		error;		/* Last failure reason. */
+	lg_spk_target_p	target;
+	struct lg_spk_daemon_s *d;
+	uintptr_t	skt;
+	lg_ctl_sess_t	sess;		/* Requests and responces. */
+	uint32_t	get_pend;	/* Client GETs to send, bit per msg. */
+	uint32_t	poll_pend;	/* Background GETs to send. */
+	uint32_t	poll_sent;	/* In flight GET is background. */
+	size_t		poll_in_flight_cnt;
+	uint64_t	ts_state;	/* State change time, us. */
+	uint64_t	ts_io;		/* Last responce or probe time, us. */
+	uint64_t	reconnect_delay; /* us. */
+	uint64_t	connects;
+	uint64_t	fails;		/* Connect / responce failures. */
+	lg_spk_state_t	cache;		/* Replies and notifications. */
+} lg_spk_link_t, *lg_spk_link_p;
+
+#define LG_SPK_CLIENT_LINE_MAX	8192
+
+/* Group SET member. */
+typedef struct lg_spk_gset_ent_s {
+	lg_spk_link_p	link;
+	int		error;		/* EINPROGRESS: waits answer. */
+	uint64_t	ts_sent;	/* send() returned, us. */
+	uint64_t	ts_ack;		/* Answer or failure, us. */
+} lg_spk_gset_ent_t, *lg_spk_gset_ent_p;
+
+/* Local API client. */
+typedef struct lg_spk_client_s {
+	uint32_t	type;		/* LG_SPK_DAEMON_T_CLIENT */
+	uint32_t	ev_flags;
+	struct lg_spk_client_s *next;
+	struct lg_spk_client_s *prev;
+	uintptr_t	skt;
+	int		rx_eof;		/* Close after last reply. */
+	int		run;		/* Reply is ready, process next line. */
+	size_t		rx_size;
+	char		rx_buf[LG_SPK_CLIENT_LINE_MAX];
+	lg_spk_buf_t	tx;
+	lg_spk_link_p	wait_link;	/* Waits responce, NULL - none. */
+	size_t		wait_msg;
+	lg_spk_gset_ent_p gset;		/* Group SET members, reused. */
+	size_t		gset_cnt;
+	size_t		gset_allocated;
+	size_t		gset_wait;	/* Answers to wait, 0 - none. */
+	size_t		gset_msg;
+	uint64_t	gset_ts;	/* Release start, us. */
+} lg_spk_client_t, *lg_spk_client_p;
+
+typedef struct lg_spk_daemon_s {
+	/* Settings, set before lg_spk_daemon_run(). */
+	lg_ctl_crypto_p	crypto;
+	lg_ctl_get_pkts_p get_pkts;
+	size_t		pipeline;	/* Max GETs in flight per link. */
+	size_t		poll_pipeline;	/* Max background GETs of them. */
+	size_t		max_payload;	/* Receive buffer limit per link. */
+	uint64_t	timeout;	/* Connect / responce time limit, ms. */
+	uint64_t	keepalive;	/* Probe link after idle time, ms. */
+	uint64_t	cache_ttl;	/* Default get max_age, ms. */
+	uint64_t	poll;		/* Refresh cache interval, ms, 0 - off. */
+	lg_ctl_cap_p	cap;		/* Optional wire capture. */
+	lg_spk_stats_p	stats;		/* Optional latency stats. */
+	volatile sig_atomic_t *stats_dump; /* Set: print stats to stderr. */
+	struct sockaddr_storage metrics; /* HTTP endpoint, ss_family = 0:
+					 * off. */
+	/* Internal. */
+	uintptr_t	ev;
+	uintptr_t	skt;		/* Listen socket. */
+	uintptr_t	metrics_skt;
+	lg_spk_buf_t	gset_pkt;	/* Group SET packet. */
+	const char	*sock_path;
+	lg_spk_link_p	links;
+	size_t		links_cnt;
+	lg_spk_client_p	clients;
+	int		run_pending;	/* Some clients have run set. */
+	uint64_t	next_timer;	/* Nearest deadline, us. */
+} lg_spk_daemon_t, *lg_spk_daemon_p;
+
+#define LG_SPK_DAEMON_DEF_KEEPALIVE	30000
+#define LG_SPK_DAEMON_DEF_CACHE_TTL	1000
+#define LG_SPK_DAEMON_DEF_POLL_PIPELINE	1
+#define LG_SPK_LINK_RECONNECT_MIN	500000 /* us. */
+#define LG_SPK_LINK_RECONNECT_MAX	30000000 /* us. */
+/* Keepalive probe, also refreshes volume / function. */
+#define LG_SPK_LINK_KEEPALIVE_MSG	LG_CTL_MSG_SPK_LIST_VIEW_INFO
+/* Exported by metrics endpoint: family per message, field label. */
+#define LG_SPK_METRICS_MSGS						\
+	LG_CTL_MSG_EQ_VIEW_INFO,					\
+	LG_CTL_MSG_SPK_LIST_VIEW_INFO,					\
+	LG_CTL_MSG_FUNC_VIEW_INFO,					\
+	LG_CTL_MSG_PLAY_INFO,						\
+	LG_CTL_MSG_SETTING_VIEW_INFO,					\
+	LG_CTL_MSG_MEM_MON_DEV
+
+
+void	lg_spk_daemon_init(lg_spk_daemon_p d, lg_ctl_crypto_p crypto,
+	    lg_ctl_get_pkts_p get_pkts);
+void	lg_spk_daemon_destroy(lg_spk_daemon_p d);
+/*
+ * Create unix socket at sock_path (stale socket is removed), connect to
+ * all targets and serve clients until stop is set.
+ * targets must stay valid until lg_spk_daemon_destroy().
+ */
+int	lg_spk_daemon_run(lg_spk_daemon_p d, const char *sock_path,
+	    lg_spk_target_p targets, size_t targets_cnt,
+	    volatile sig_atomic_t *stop);
+
+
+#endif /* __LG_SPK_DAEMON_H__ */
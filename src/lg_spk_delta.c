@@ -0,0 +1,210 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_spk_delta.h"
+
+
+void
+lg_spk_fields_init(lg_spk_fields_p fields, lg_spk_info_dec_p dec) {
+
+	if (NULL == fields)
+		return;
+	fields->cnt = 0;
+	fields->dec = dec;
+	fields->skip_depth = 0;
+	fields->path_size = 0;
+	fields->obj_off[0] = 0;
+	fields->obj_size[0] = 0;
+}
+
+/* Append path of member: parent object path + "." + name. */
+static int
+lg_spk_fields_path_add(lg_spk_fields_p fields, const lg_json_ev_t *ev,
+    size_t *off_ret, size_t *size_ret) {
+	const size_t parent_off = fields->obj_off[(ev->depth - 1)];
+	const size_t parent_size = fields->obj_size[(ev->depth - 1)];
+	char *ptr;
+
+	if ((parent_size + 1 + ev->name_size) >
+	    (sizeof(fields->path) - fields->path_size))
+		return (ENOBUFS);
+	ptr = (fields->path + fields->path_size);
+	memmove(ptr, (fields->path + parent_off), parent_size);
+	ptr += parent_size;
+	if (0 != parent_size) {
+		(*ptr ++) = '.';
+	}
+	memcpy(ptr, ev->name, ev->name_size);
+	(*off_ret) = fields->path_size;
+	(*size_ret) = (size_t)((ptr + ev->name_size) -
+	    (fields->path + fields->path_size));
+	fields->path_size += (*size_ret);
+
+	return (0);
+}
+
+int
+lg_spk_fields_cb(const lg_ctl_resp_t *resp, const lg_json_ev_t *ev,
+    void *udata) {
+	int error;
+	lg_spk_fields_p fields = udata;
+	lg_spk_fv_p fv;
+
+	if (NULL != fields->dec) {
+		error = lg_spk_info_dec_cb(resp, ev, fields->dec);
+		if (0 != error)
+			return (error);
+	}
+	if (0 == ev->depth)
+		return (0); /* "data" object. */
+	if (0 != fields->skip_depth) {
+		if (fields->skip_depth != ev->depth ||
+		    LG_JSON_EV_ARR_END != ev->type)
+			return (0);
+		fields->skip_depth = 0;
+	}
+	if (NULL == ev->name)
+		return (0);
+
+	switch (ev->type) {
+	case LG_JSON_EV_OBJ_BEGIN:
+		if (LG_JSON_DEPTH_MAX <= ev->depth)
+			return (0);
+		return (lg_spk_fields_path_add(fields, ev,
+		    &fields->obj_off[ev->depth],
+		    &fields->obj_size[ev->depth]));
+	case LG_JSON_EV_OBJ_END:
+		return (0);
+	case LG_JSON_EV_ARR_BEGIN: /* Whole array is value. */
+		fields->skip_depth = ev->depth;
+		return (0);
+	}
+
+	if (LG_SPK_FIELDS_MAX <= fields->cnt)
+		return (ENOBUFS);
+	fv = &fields->fv[fields->cnt];
+	error = lg_spk_fields_path_add(fields, ev, &fv->path_off,
+	    &fv->path_size);
+	if (0 != error)
+		return (error);
+	if (LG_JSON_EV_STRING == ev->type) { /* With quotes. */
+		fv->value = (ev->value - 1);
+		fv->value_size = (ev->value_size + 2);
+	} else {
+		fv->value = ev->value;
+		fv->value_size = ev->value_size;
+	}
+	fields->cnt ++;
+
+	return (0);
+}
+
+int
+lg_spk_fields_parse(lg_spk_fields_p fields, const char *buf,
+    const size_t buf_size, lg_ctl_resp_p resp) {
+
+	if (NULL == fields)
+		return (EINVAL);
+	lg_spk_fields_init(fields, fields->dec);
+
+	return (lg_ctl_resp_parse(buf, buf_size, lg_spk_fields_cb, fields,
+	    resp));
+}
+
+/* Returns index in fields or fields->cnt if not found.
+ * Same index is checked first: order of fields is usually kept. */
+static size_t
+lg_spk_fields_find(const lg_spk_fields_t *fields, const size_t hint,
+    const char *path, const size_t path_size) {
+	size_t i;
+	const lg_spk_fv_t *fv;
+
+	for (i = 0; i < fields->cnt; i ++) {
+		fv = &fields->fv[((hint + i) % fields->cnt)];
+		if (path_size == fv->path_size &&
+		    0 == memcmp(path, (fields->path + fv->path_off),
+		    path_size))
+			return (((hint + i) % fields->cnt));
+	}
+
+	return (fields->cnt);
+}
+
+int
+lg_spk_fields_diff(const lg_spk_fields_t *old, const lg_spk_fields_t *new,
+    lg_spk_delta_cb cb, void *udata) {
+	int error;
+	size_t i, idx;
+	const lg_spk_fv_t *fv, *ofv;
+
+	if (NULL == old || NULL == new || NULL == cb)
+		return (EINVAL);
+
+	/* Changed and added. */
+	for (i = 0; i < new->cnt; i ++) {
+		fv = &new->fv[i];
+		idx = lg_spk_fields_find(old, i,
+		    (new->path + fv->path_off), fv->path_size);
+		if (idx == old->cnt) {
+			error = cb((new->path + fv->path_off), fv->path_size,
+			    NULL, 0, fv->value, fv->value_size, udata);
+		} else {
+			ofv = &old->fv[idx];
+			if (fv->value_size == ofv->value_size &&
+			    0 == memcmp(fv->value, ofv->value,
+			    fv->value_size))
+				continue;
+			error = cb((new->path + fv->path_off), fv->path_size,
+			    ofv->value, ofv->value_size,
+			    fv->value, fv->value_size, udata);
+		}
+		if (0 != error)
+			return (error);
+	}
+	/* Removed. */
+	for (i = 0; i < old->cnt; i ++) {
+		ofv = &old->fv[i];
+		if (new->cnt != lg_spk_fields_find(new, i,
+		    (old->path + ofv->path_off), ofv->path_size))
+			continue;
+		error = cb((old->path + ofv->path_off), ofv->path_size,
+		    ofv->value, ofv->value_size, NULL, 0, udata);
+		if (0 != error)
+			return (error);
+	}
+
+	return (0);
+}
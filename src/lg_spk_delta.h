@@ -0,0 +1,89 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_DELTA_H__
+#define __LG_SPK_DELTA_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lg_json.h"
+#include "lg_ctl_resp.h"
+#include "lg_spk_info.h"
+
+
+/*
+ * Field level difference of two responces.
+ * "data" object is flattened to path -> raw JSON value text: nested
+ * objects give dotted paths ("a.b"), arrays are compared as whole
+ * values. Values point into parsed buffer, no allocations.
+ */
+
+#define LG_SPK_FIELDS_MAX	128
+#define LG_SPK_FIELDS_PATH_MAX	4096
+
+typedef struct lg_spk_fv_s {
+	size_t		path_off;	/* In lg_spk_fields_t.path. */
+	size_t		path_size;
+	const char	*value;		/* Raw JSON text. */
+	size_t		value_size;
+} lg_spk_fv_t, *lg_spk_fv_p;
+
+typedef struct lg_spk_fields_s {
+	size_t		cnt;
+	lg_spk_fv_t	fv[LG_SPK_FIELDS_MAX];
+	lg_spk_info_dec_p dec;		/* Typed decoder to call, may be NULL. */
+	size_t		skip_depth;	/* Inside array, 0 - none. */
+	size_t		path_size;	/* Used in path. */
+	size_t		obj_off[LG_JSON_DEPTH_MAX]; /* Path of object at depth. */
+	size_t		obj_size[LG_JSON_DEPTH_MAX];
+	char		path[LG_SPK_FIELDS_PATH_MAX];
+} lg_spk_fields_t, *lg_spk_fields_p;
+
+/* old: NULL if field is added, new: NULL if field is removed. */
+typedef int (*lg_spk_delta_cb)(const char *path, size_t path_size,
+	    const char *old, size_t old_size,
+	    const char *new, size_t new_size, void *udata);
+
+
+void	lg_spk_fields_init(lg_spk_fields_p fields, lg_spk_info_dec_p dec);
+/* lg_ctl_resp_cb, udata: lg_spk_fields_p.
+ * Returns ENOBUFS if there are too many fields. */
+int	lg_spk_fields_cb(const lg_ctl_resp_t *resp,
+	    const lg_json_ev_t *ev, void *udata);
+/* Parse responce and flatten its "data", fields->dec is kept. */
+int	lg_spk_fields_parse(lg_spk_fields_p fields, const char *buf,
+	    size_t buf_size, lg_ctl_resp_p resp);
+/* Call cb for every changed, added and removed field. */
+int	lg_spk_fields_diff(const lg_spk_fields_t *old,
+	    const lg_spk_fields_t *new, lg_spk_delta_cb cb, void *udata);
+
+
+#endif /* __LG_SPK_DELTA_H__ */
@@ -0,0 +1,584 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_spk_discover.h"
+#include "lg_ctl_resp.h"
+#include "lg_mem.h"
+#include "net/socket_address.h"
+#include "utils/mem_utils.h"
+#include "utils/str2num.h"
+
+
+const char *lg_spk_disc_state[LG_SPK_DISC_S_COUNT] = {
+	"cached",
+	"new",
+	"moved",
+	"same"
+};
+
+
+#define LG_SPK_DISC_CACHE_MIN	64
+#define LG_SPK_DISC_CACHE_HDR						\
+    "# lgspkctl discovery cache: addr:port mac model"
+
+/* Per target answers. */
+typedef struct lg_spk_disc_res_s {
+	uint64_t	mac;
+	uint32_t	msgs;		/* Answered: bit per lg_ctl_msg[] index. */
+	char		model[32];
+} lg_spk_disc_res_t, *lg_spk_disc_res_p;
+
+typedef struct lg_spk_disc_ctx_s {
+	lg_spk_engine_p	eng;
+	lg_spk_disc_res_p res;		/* Per target. */
+} lg_spk_disc_ctx_t, *lg_spk_disc_ctx_p;
+
+#define LG_SPK_DISC_MSGS						\
+	    ((((uint32_t)1) << LG_CTL_MSG_PRODUCT_INFO) |		\
+	    (((uint32_t)1) << LG_CTL_MSG_MAC_INFO_DEV))
+
+
+int
+lg_spk_mac_parse(const char *str, const size_t str_size, uint64_t *mac) {
+	size_t i;
+	uint64_t ret = 0;
+	uint8_t ch;
+
+	if (NULL == str || 17 != str_size || NULL == mac)
+		return (EINVAL);
+	for (i = 0; i < str_size; i ++) {
+		if (2 == (i % 3)) {
+			if (':' != str[i] && '-' != str[i])
+				return (EINVAL);
+			continue;
+		}
+		ch = (uint8_t)str[i];
+		if ('0' <= ch && '9' >= ch) {
+			ch -= '0';
+		} else if ('a' <= (ch | 0x20) && 'f' >= (ch | 0x20)) {
+			ch = (uint8_t)((ch | 0x20) - 'a' + 10);
+		} else {
+			return (EINVAL);
+		}
+		ret = ((ret << 4) | ch);
+	}
+	(*mac) = ret;
+
+	return (0);
+}
+
+char *
+lg_spk_mac_fmt(const uint64_t mac, char *buf, const size_t buf_size) {
+
+	snprintf(buf, buf_size, "%02x:%02x:%02x:%02x:%02x:%02x",
+	    (uint8_t)(mac >> 40), (uint8_t)(mac >> 32),
+	    (uint8_t)(mac >> 24), (uint8_t)(mac >> 16),
+	    (uint8_t)(mac >> 8), (uint8_t)mac);
+
+	return (buf);
+}
+
+
+/* "a.b.c.d/prefix[:port]" */
+static int
+lg_spk_cidr_parse(const char *cidr, const size_t cidr_size,
+    uint32_t *first_ret, uint32_t *cnt_ret, uint16_t *port_ret) {
+	const char *slash, *colon;
+	char addr[INET_ADDRSTRLEN];
+	struct in_addr in;
+	uint32_t prefix, net, mask;
+
+	slash = memchr(cidr, '/', cidr_size);
+	if (NULL == slash ||
+	    sizeof(addr) <= (size_t)(slash - cidr))
+		return (EINVAL);
+	memcpy(addr, cidr, (size_t)(slash - cidr));
+	addr[(slash - cidr)] = 0;
+	if (1 != inet_pton(AF_INET, addr, &in))
+		return (EINVAL);
+	slash ++;
+	colon = memchr(slash, ':', (size_t)((cidr + cidr_size) - slash));
+	if (NULL == colon) {
+		colon = (cidr + cidr_size);
+		(*port_ret) = LG_CTL_TCP_PORT;
+	} else {
+		(*port_ret) = (uint16_t)str2u32((colon + 1),
+		    (size_t)((cidr + cidr_size) - (colon + 1)));
+		if (0 == (*port_ret))
+			return (EINVAL);
+	}
+	if (slash == colon)
+		return (EINVAL);
+	prefix = str2u32(slash, (size_t)(colon - slash));
+	if (LG_SPK_DISCOVER_PREFIX_MIN > prefix || 32 < prefix)
+		return (EINVAL);
+
+	mask = ((32 == prefix) ? 0xffffffff : ~(0xffffffff >> prefix));
+	net = (ntohl(in.s_addr) & mask);
+	if (31 > prefix) { /* Skip network and broadcast addresses. */
+		(*first_ret) = (net + 1);
+		(*cnt_ret) = ((~mask) - 1);
+	} else {
+		(*first_ret) = net;
+		(*cnt_ret) = ((~mask) + 1);
+	}
+
+	return (0);
+}
+
+int
+lg_spk_cidr_targets(const char *cidrs, const size_t cidrs_size,
+    lg_spk_target_p *targets_ret, size_t *targets_cnt_ret) {
+	int error;
+	const char *cur, *end, *next;
+	uint32_t i, first, cnt;
+	uint16_t port;
+	size_t total = 0;
+	struct sockaddr_in *sin;
+	lg_spk_target_p targets, target;
+
+	if (NULL == cidrs || 0 == cidrs_size || NULL == targets_ret ||
+	    NULL == targets_cnt_ret)
+		return (EINVAL);
+	/* Count first. */
+	end = (cidrs + cidrs_size);
+	for (cur = cidrs; cur < end; cur = (next + 1)) {
+		next = memchr(cur, ',', (size_t)(end - cur));
+		if (NULL == next) {
+			next = end;
+		}
+		error = lg_spk_cidr_parse(cur, (size_t)(next - cur),
+		    &first, &cnt, &port);
+		if (0 != error)
+			return (error);
+		total += cnt;
+	}
+	targets = lg_calloc(total, sizeof(lg_spk_target_t));
+	if (NULL == targets)
+		return (ENOMEM);
+	target = targets;
+	for (cur = cidrs; cur < end; cur = (next + 1)) {
+		next = memchr(cur, ',', (size_t)(end - cur));
+		if (NULL == next) {
+			next = end;
+		}
+		lg_spk_cidr_parse(cur, (size_t)(next - cur),
+		    &first, &cnt, &port);
+		for (i = 0; i < cnt; i ++, target ++) {
+			sin = (struct sockaddr_in*)&target->addr;
+			sin->sin_family = AF_INET;
+			sin->sin_port = htons(port);
+			sin->sin_addr.s_addr = htonl((first + i));
+			inet_ntop(AF_INET, &sin->sin_addr, target->name,
+			    sizeof(target->name));
+		}
+	}
+	(*targets_ret) = targets;
+	(*targets_cnt_ret) = total;
+
+	return (0);
+}
+
+
+void
+lg_spk_disc_cache_init(lg_spk_disc_cache_p cache) {
+
+	if (NULL == cache)
+		return;
+	memset(cache, 0x00, sizeof(lg_spk_disc_cache_t));
+}
+
+void
+lg_spk_disc_cache_destroy(lg_spk_disc_cache_p cache) {
+
+	if (NULL == cache)
+		return;
+	lg_free(cache->ent);
+	lg_free(cache->keep);
+	memset(cache, 0x00, sizeof(lg_spk_disc_cache_t));
+}
+
+static size_t
+lg_spk_disc_cache_slot(const lg_spk_disc_cache_t *cache, const uint64_t mac) {
+	size_t idx;
+
+	/* Fibonacci hashing: low bits of MAC are not uniform. */
+	idx = (size_t)((mac * 0x9e3779b97f4a7c15ull) >> 32);
+	for (idx &= (cache->allocated - 1);
+	    0 != cache->ent[idx].mac && mac != cache->ent[idx].mac;
+	    idx = ((idx + 1) & (cache->allocated - 1)))
+		;
+
+	return (idx);
+}
+
+lg_spk_disc_ent_p
+lg_spk_disc_cache_find(lg_spk_disc_cache_p cache, const uint64_t mac) {
+	lg_spk_disc_ent_p ent;
+
+	if (NULL == cache || 0 == mac || 0 == cache->cnt)
+		return (NULL);
+	ent = &cache->ent[lg_spk_disc_cache_slot(cache, mac)];
+	if (0 == ent->mac)
+		return (NULL);
+
+	return (ent);
+}
+
+/* Keep load factor at or below 1/2. */
+static int
+lg_spk_disc_cache_grow(lg_spk_disc_cache_p cache) {
+	size_t i;
+	lg_spk_disc_cache_t tmp;
+
+	if ((cache->cnt * 2) < cache->allocated)
+		return (0);
+	tmp.cnt = cache->cnt;
+	tmp.allocated = ((0 != cache->allocated) ?
+	    (cache->allocated * 2) : LG_SPK_DISC_CACHE_MIN);
+	tmp.ent = lg_calloc(tmp.allocated, sizeof(lg_spk_disc_ent_t));
+	if (NULL == tmp.ent)
+		return (ENOMEM);
+	for (i = 0; i < cache->allocated; i ++) {
+		if (0 == cache->ent[i].mac)
+			continue;
+		tmp.ent[lg_spk_disc_cache_slot(&tmp, cache->ent[i].mac)] =
+		    cache->ent[i];
+	}
+	lg_free(cache->ent);
+	cache->ent = tmp.ent;
+	cache->allocated = tmp.allocated;
+
+	return (0);
+}
+
+int
+lg_spk_disc_cache_update(lg_spk_disc_cache_p cache, const uint64_t mac,
+    const struct sockaddr_storage *addr, const char *model,
+    lg_spk_disc_ent_p *ent_ret) {
+	int error;
+	size_t model_size;
+	lg_spk_disc_ent_p ent;
+
+	if (NULL == cache || 0 == mac || NULL == addr)
+		return (EINVAL);
+	error = lg_spk_disc_cache_grow(cache);
+	if (0 != error)
+		return (error);
+	ent = &cache->ent[lg_spk_disc_cache_slot(cache, mac)];
+	if (0 == ent->mac) {
+		ent->mac = mac;
+		ent->state = LG_SPK_DISC_S_NEW;
+		cache->cnt ++;
+	} else if (0 != memcmp(&ent->addr, addr, sizeof(ent->addr))) {
+		ent->state = LG_SPK_DISC_S_MOVED;
+	} else {
+		ent->state = LG_SPK_DISC_S_SAME;
+	}
+	memcpy(&ent->addr, addr, sizeof(ent->addr));
+	if (NULL != model && 0 != model[0]) {
+		model_size = MIN(strlen(model), (sizeof(ent->model) - 1));
+		memcpy(ent->model, model, model_size);
+		ent->model[model_size] = 0;
+	}
+	if (NULL != ent_ret) {
+		(*ent_ret) = ent;
+	}
+
+	return (0);
+}
+
+/* Append line to kept lines as is, one byte more is reserved for
+ * line feed after last line. */
+static int
+lg_spk_disc_cache_keep(lg_spk_disc_cache_p cache, const char *line,
+    const size_t line_size) {
+	char *tmp;
+
+	tmp = lg_realloc(cache->keep, (cache->keep_size + line_size + 1));
+	if (NULL == tmp)
+		return (ENOMEM);
+	memcpy((tmp + cache->keep_size), line, line_size);
+	cache->keep = tmp;
+	cache->keep_size += line_size;
+
+	return (0);
+}
+
+/* Parse "addr:port mac model" line, ENOENT - not cache entry. */
+static int
+lg_spk_disc_cache_line(lg_spk_disc_cache_p cache, const char *line) {
+	int error;
+	size_t addr_size, mac_size, model_size;
+	uint64_t mac;
+	const char *ptr;
+	char model[sizeof(((lg_spk_disc_ent_p)NULL)->model)];
+	lg_spk_target_t target;
+	lg_spk_disc_ent_p ent;
+
+	line += strspn(line, " \t");
+	addr_size = strcspn(line, " \t\r\n");
+	if (0 == addr_size || '#' == line[0])
+		return (ENOENT);
+	ptr = (line + addr_size);
+	ptr += strspn(ptr, " \t");
+	mac_size = strcspn(ptr, " \t\r\n");
+	if (0 != lg_spk_mac_parse(ptr, mac_size, &mac) || 0 == mac ||
+	    0 != lg_spk_target_set(&target, line, addr_size))
+		return (ENOENT);
+	ptr += mac_size;
+	ptr += strspn(ptr, " \t");
+	model_size = strcspn(ptr, "\r\n");
+	while (0 != model_size &&
+	    (' ' == ptr[(model_size - 1)] || '\t' == ptr[(model_size - 1)])) {
+		model_size --;
+	}
+	model_size = MIN(model_size, (sizeof(model) - 1));
+	memcpy(model, ptr, model_size);
+	model[model_size] = 0;
+	error = lg_spk_disc_cache_update(cache, mac, &target.addr, model,
+	    &ent);
+	if (0 != error)
+		return (error);
+	ent->state = LG_SPK_DISC_S_CACHED;
+
+	return (0);
+}
+
+int
+lg_spk_disc_cache_load(lg_spk_disc_cache_p cache, const char *file_name) {
+	int error = 0, part = 0;
+	size_t line_size;
+	FILE *fp;
+	char line[1024];
+
+	if (NULL == cache || NULL == file_name)
+		return (EINVAL);
+	fp = fopen(file_name, "r");
+	if (NULL == fp) {
+		if (ENOENT == errno)
+			return (0);
+		return (errno);
+	}
+	while (NULL != fgets(line, sizeof(line), fp)) {
+		line_size = strlen(line);
+		if (0 == line_size)
+			continue;
+		if (0 != part) {
+			error = ENOENT; /* Rest of too long line. */
+		} else if ((sizeof(LG_SPK_DISC_CACHE_HDR) - 1) ==
+		    strcspn(line, "\r\n") &&
+		    0 == memcmp(line, LG_SPK_DISC_CACHE_HDR,
+		    (sizeof(LG_SPK_DISC_CACHE_HDR) - 1))) {
+			continue; /* Own header, written by save. */
+		} else {
+			error = lg_spk_disc_cache_line(cache, line);
+		}
+		if (ENOENT == error) {
+			/* Comment, empty line, target added by hand. */
+			error = lg_spk_disc_cache_keep(cache, line, line_size);
+		}
+		if (0 != error)
+			break;
+		part = ('\n' != line[(line_size - 1)]);
+	}
+	if (0 == error && 0 != ferror(fp)) {
+		error = EIO;
+	}
+	fclose(fp);
+	/* Entries are written after kept lines. */
+	if (0 != cache->keep_size &&
+	    '\n' != cache->keep[(cache->keep_size - 1)]) {
+		cache->keep[cache->keep_size ++] = '\n';
+	}
+
+	return (error);
+}
+
+int
+lg_spk_disc_cache_save(lg_spk_disc_cache_p cache, const char *file_name) {
+	int error = 0;
+	size_t i, addr_size;
+	FILE *fp;
+	lg_spk_disc_ent_p ent;
+	char tmp_name[1024], addr[(INET6_ADDRSTRLEN + 16)], mac[18];
+
+	if (NULL == cache || NULL == file_name)
+		return (EINVAL);
+	if (sizeof(tmp_name) <= (size_t)snprintf(tmp_name, sizeof(tmp_name),
+	    "%s.tmp", file_name))
+		return (ENAMETOOLONG);
+	fp = fopen(tmp_name, "w");
+	if (NULL == fp)
+		return (errno);
+	fprintf(fp, "%s\n", LG_SPK_DISC_CACHE_HDR);
+	if (0 != cache->keep_size) {
+		fwrite(cache->keep, 1, cache->keep_size, fp);
+	}
+	for (i = 0; i < cache->allocated; i ++) {
+		ent = &cache->ent[i];
+		if (0 == ent->mac)
+			continue;
+		if (0 != sa_addr_port_to_str(&ent->addr, addr, sizeof(addr),
+		    &addr_size))
+			continue;
+		fprintf(fp, "%.*s %s %s\n", (int)addr_size, addr,
+		    lg_spk_mac_fmt(ent->mac, mac, sizeof(mac)), ent->model);
+	}
+	if (0 != fflush(fp) || 0 != ferror(fp)) {
+		error = errno;
+	}
+	fclose(fp);
+	if (0 == error && 0 != rename(tmp_name, file_name)) {
+		error = errno;
+	}
+	if (0 != error) {
+		unlink(tmp_name);
+	}
+
+	return (error);
+}
+
+
+static int
+lg_spk_disc_resp_cb(const lg_ctl_resp_t *resp, const lg_json_ev_t *ev,
+    void *udata) {
+	lg_spk_disc_res_p res = udata;
+	uint64_t mac;
+
+	if (1 != ev->depth || LG_JSON_EV_STRING != ev->type)
+		return (0);
+	switch (resp->msg_idx) {
+	case LG_CTL_MSG_MAC_INFO_DEV:
+		/* Wireless MAC is always there, wired one if no wireless. */
+		if (0 != lg_spk_mac_parse(ev->value, ev->value_size, &mac) ||
+		    0 == mac)
+			break;
+		if (0 == mem_cmpn_cstr("s_wireless_mac", ev->name,
+		    ev->name_size)) {
+			res->mac = mac;
+		} else if (0 == res->mac &&
+		    0 == mem_cmpn_cstr("s_wired_mac", ev->name,
+		    ev->name_size)) {
+			res->mac = mac;
+		}
+		break;
+	case LG_CTL_MSG_PRODUCT_INFO:
+		if (0 != mem_cmpn_cstr("s_model_name", ev->name,
+		    ev->name_size))
+			break;
+		memcpy(res->model, ev->value,
+		    MIN(ev->value_size, (sizeof(res->model) - 1)));
+		break;
+	}
+
+	return (0);
+}
+
+static size_t
+lg_spk_disc_data_cb(lg_spk_sess_p sess, uint8_t *data, size_t data_size,
+    void *udata) {
+	lg_spk_disc_ctx_p ctx = udata;
+	lg_spk_disc_res_p res = &ctx->res[(size_t)(sess - ctx->eng->sess)];
+	lg_ctl_resp_t resp;
+
+	if (0 != lg_ctl_resp_parse((const char*)data, data_size,
+	    lg_spk_disc_resp_cb, res, &resp))
+		return (LG_CTL_MSG_COUNT);
+	if (0 != resp.notify)
+		return (LG_SPK_ENGINE_MSG_NOTIFY);
+	if (LG_CTL_MSG_COUNT > resp.msg_idx && 0 != resp.result) {
+		res->msgs |= (((uint32_t)1) << resp.msg_idx);
+	}
+
+	return (resp.msg_idx);
+}
+
+int
+lg_spk_discover(lg_spk_engine_p eng, lg_spk_target_p targets,
+    size_t targets_cnt, lg_spk_disc_cache_p cache, size_t *found_ret) {
+	int error;
+	size_t i, found = 0;
+	lg_spk_disc_ctx_t ctx;
+	lg_spk_disc_res_p res;
+
+	if (NULL == eng || NULL == targets || 0 == targets_cnt ||
+	    NULL == cache)
+		return (EINVAL);
+	ctx.eng = eng;
+	ctx.res = lg_calloc(targets_cnt, sizeof(lg_spk_disc_res_t));
+	if (NULL == ctx.res)
+		return (ENOMEM);
+	eng->msgs = LG_SPK_DISC_MSGS;
+	eng->data_cb = lg_spk_disc_data_cb;
+	eng->udata = &ctx;
+	error = lg_spk_engine_poll(eng, targets, targets_cnt);
+	if (0 != error)
+		goto err_out;
+	for (i = 0; i < eng->sess_cnt; i ++) {
+		res = &ctx.res[i];
+		/* Both answers decrypted and parsed: it is soundbar. */
+		if (0 != eng->sess[i].error ||
+		    LG_SPK_DISC_MSGS != res->msgs ||
+		    0 == res->mac)
+			continue;
+		error = lg_spk_disc_cache_update(cache, res->mac,
+		    &targets[i].addr, res->model, NULL);
+		if (0 != error)
+			goto err_out;
+		found ++;
+	}
+
+err_out:
+	eng->data_cb = NULL;
+	eng->udata = NULL;
+	lg_free(ctx.res);
+	if (NULL != found_ret) {
+		(*found_ret) = found;
+	}
+
+	return (error);
+}
@@ -0,0 +1,117 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_DISCOVER_H__
+#define __LG_SPK_DISCOVER_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_spk_engine.h"
+
+
+/*
+ * Subnet discovery: every address of given IPv4 ranges is polled by
+ * engine with PRODUCT_INFO and MAC_INFO_DEV GETs, thousands at once
+ * with short per host timeout. Valid encrypted answers confirm
+ * soundbar.
+ * Found soundbars are cached by MAC; cache file has targets file
+ * format: "addr:port mac model", so it can be used with -targets
+ * after address is changed by DHCP. Other lines: comments and
+ * targets added by hand are kept as is and written back before
+ * cache entries.
+ */
+
+#define LG_SPK_DISCOVER_DEF_TIMEOUT	500	/* ms. */
+#define LG_SPK_DISCOVER_DEF_CONCURRENCY	4096
+#define LG_SPK_DISCOVER_PREFIX_MIN	12	/* Up to 1M addresses per range. */
+
+/* Cache entry state after discovery. */
+#define LG_SPK_DISC_S_CACHED	0 /* Loaded, not found now. */
+#define LG_SPK_DISC_S_NEW	1
+#define LG_SPK_DISC_S_MOVED	2 /* Known MAC, address changed. */
+#define LG_SPK_DISC_S_SAME	3
+
+#define LG_SPK_DISC_S_COUNT	4
+
+extern const char *lg_spk_disc_state[LG_SPK_DISC_S_COUNT];
+
+typedef struct lg_spk_disc_ent_s {
+	uint64_t	mac;		/* 48 bit, 0 - free slot. */
+	uint32_t	state;		/* LG_SPK_DISC_S_* */
+	struct sockaddr_storage addr;
+	char		model[32];
+} lg_spk_disc_ent_t, *lg_spk_disc_ent_p;
+
+/* Open addressing hash table, MAC is key. */
+typedef struct lg_spk_disc_cache_s {
+	lg_spk_disc_ent_p ent;
+	size_t		cnt;
+	size_t		allocated;	/* Power of 2. */
+	char		*keep;		/* Other lines of file. */
+	size_t		keep_size;
+} lg_spk_disc_cache_t, *lg_spk_disc_cache_p;
+
+
+/* "aa:bb:cc:dd:ee:ff" <-> 48 bit. buf must be 18 bytes or more. */
+int	lg_spk_mac_parse(const char *str, size_t str_size, uint64_t *mac);
+char	*lg_spk_mac_fmt(uint64_t mac, char *buf, size_t buf_size);
+
+/* "a.b.c.d/prefix[:port][,...]": one target per host address.
+ * Free targets with lg_free(). */
+int	lg_spk_cidr_targets(const char *cidrs, size_t cidrs_size,
+	    lg_spk_target_p *targets_ret, size_t *targets_cnt_ret);
+
+void	lg_spk_disc_cache_init(lg_spk_disc_cache_p cache);
+void	lg_spk_disc_cache_destroy(lg_spk_disc_cache_p cache);
+/* Missing file is not error. Lines that are not "addr:port mac model"
+ * are kept in cache->keep. */
+int	lg_spk_disc_cache_load(lg_spk_disc_cache_p cache,
+	    const char *file_name);
+/* Written to temp file and renamed: header, kept lines, entries. */
+int	lg_spk_disc_cache_save(lg_spk_disc_cache_p cache,
+	    const char *file_name);
+lg_spk_disc_ent_p lg_spk_disc_cache_find(lg_spk_disc_cache_p cache,
+	    uint64_t mac);
+/* Add or update, state is set. */
+int	lg_spk_disc_cache_update(lg_spk_disc_cache_p cache, uint64_t mac,
+	    const struct sockaddr_storage *addr, const char *model,
+	    lg_spk_disc_ent_p *ent_ret);
+
+/* Poll targets, update cache with confirmed soundbars.
+ * Engine settings are kept, except msgs, data_cb and udata. */
+int	lg_spk_discover(lg_spk_engine_p eng, lg_spk_target_p targets,
+	    size_t targets_cnt, lg_spk_disc_cache_p cache,
+	    size_t *found_ret);
+
+
+#endif /* __LG_SPK_DISCOVER_H__ */
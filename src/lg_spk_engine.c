@@ -0,0 +1,787 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h> /* getaddrinfo */
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_spk_engine.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+#include "net/socket.h"
+#include "net/socket_address.h"
+#include "utils/str2num.h"
+
+
+/*
+ * "host[:port]": resolve name, keep first IPv6 and first IPv4 address.
+ * IPv6 is primary and IPv4 is alternative for happy eyeballs connect.
+ */
+static int
+lg_spk_target_resolve(lg_spk_target_p target, const char *addr,
+    const size_t addr_size) {
+	int error;
+	size_t host_size = addr_size;
+	uint32_t port = 0;
+	const char *colon;
+	char host[256];
+	struct addrinfo hints, *res, *ai;
+	struct sockaddr_storage v4, v6;
+
+	/* Only one ':' is port separator, more - IPv6 without port. */
+	colon = memrchr(addr, ':', addr_size);
+	if (NULL != colon &&
+	    NULL == memchr(addr, ':', (size_t)(colon - addr))) {
+		host_size = (size_t)(colon - addr);
+		port = str2u32((colon + 1), (addr_size - host_size - 1));
+		if (0 == port || 65535 < port)
+			return (EINVAL);
+	}
+	if (0 == host_size || sizeof(host) <= host_size)
+		return (EINVAL);
+	memcpy(host, addr, host_size);
+	host[host_size] = 0;
+
+	memset(&hints, 0x00, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	error = getaddrinfo(host, NULL, &hints, &res);
+	if (0 != error)
+		return (((EAI_SYSTEM == error) ? errno : EADDRNOTAVAIL));
+	v4.ss_family = 0;
+	v6.ss_family = 0;
+	for (ai = res; NULL != ai; ai = ai->ai_next) {
+		if (sizeof(struct sockaddr_storage) < ai->ai_addrlen)
+			continue;
+		if (AF_INET6 == ai->ai_family && 0 == v6.ss_family) {
+			memcpy(&v6, ai->ai_addr, ai->ai_addrlen);
+		} else if (AF_INET == ai->ai_family && 0 == v4.ss_family) {
+			memcpy(&v4, ai->ai_addr, ai->ai_addrlen);
+		}
+	}
+	freeaddrinfo(res);
+	if (0 != v6.ss_family) {
+		target->addr = v6;
+		target->addr_alt = v4;
+	} else if (0 != v4.ss_family) {
+		target->addr = v4;
+	} else {
+		return (EADDRNOTAVAIL);
+	}
+	sa_port_set(&target->addr, (uint16_t)port);
+	if (0 != target->addr_alt.ss_family) {
+		sa_port_set(&target->addr_alt, (uint16_t)port);
+	}
+
+	return (0);
+}
+
+int
+lg_spk_target_set(lg_spk_target_p target, const char *addr,
+    size_t addr_size) {
+	int error;
+
+	if (NULL == target || NULL == addr || 0 == addr_size)
+		return (EINVAL);
+
+	memset(target, 0x00, sizeof(lg_spk_target_t));
+	error = sa_addr_port_from_str(&target->addr, addr, addr_size);
+	if (0 != error) { /* Not numeric: host name. */
+		error = lg_spk_target_resolve(target, addr, addr_size);
+		if (0 != error)
+			return (error);
+	}
+	if (0 == sa_port_get(&target->addr)) { /* Set def port. */
+		sa_port_set(&target->addr, LG_CTL_TCP_PORT);
+	}
+	if (0 != target->addr_alt.ss_family &&
+	    0 == sa_port_get(&target->addr_alt)) {
+		sa_port_set(&target->addr_alt, LG_CTL_TCP_PORT);
+	}
+	addr_size = MIN(addr_size, (sizeof(target->name) - 1));
+	memcpy(target->name, addr, addr_size);
+	target->name[addr_size] = 0;
+
+	return (0);
+}
+
+int
+lg_spk_targets_load(const char *file_name,
+    lg_spk_target_p *targets_ret, size_t *targets_cnt_ret) {
+	int error = 0;
+	FILE *fp;
+	char line[1024], *ptr, *name;
+	size_t line_no = 0, addr_size, name_size, cnt = 0, allocated = 0;
+	lg_spk_target_p targets = NULL, tmp;
+
+	if (NULL == file_name || NULL == targets_ret ||
+	    NULL == targets_cnt_ret)
+		return (EINVAL);
+
+	fp = fopen(file_name, "r");
+	if (NULL == fp)
+		return (errno);
+	while (NULL != fgets(line, sizeof(line), fp)) {
+		line_no ++;
+		/* Skip leading spaces, comments and empty lines. */
+		for (ptr = line; ' ' == (*ptr) || '\t' == (*ptr); ptr ++)
+			;
+		if ('#' == (*ptr) || '\r' == (*ptr) || '\n' == (*ptr) ||
+		    0 == (*ptr))
+			continue;
+		addr_size = strcspn(ptr, " \t\r\n");
+		name = (ptr + addr_size);
+		name += strspn(name, " \t");
+		name_size = strcspn(name, "\r\n");
+		/* Trim trailing spaces of name. */
+		while (0 != name_size &&
+		    (' ' == name[(name_size - 1)] ||
+		     '\t' == name[(name_size - 1)])) {
+			name_size --;
+		}
+
+		if (cnt == allocated) {
+			allocated += 64;
+			tmp = lg_realloc(targets,
+			    (allocated * sizeof(lg_spk_target_t)));
+			if (NULL == tmp) {
+				error = ENOMEM;
+				goto err_out;
+			}
+			targets = tmp;
+		}
+		error = lg_spk_target_set(&targets[cnt], ptr, addr_size);
+		if (0 != error) {
+			fprintf(stderr, "%s:%zu: bad address: %.*s\n",
+			    file_name, line_no, (int)addr_size, ptr);
+			goto err_out;
+		}
+		if (0 != name_size) {
+			name_size = MIN(name_size,
+			    (sizeof(targets[cnt].name) - 1));
+			memcpy(targets[cnt].name, name, name_size);
+			targets[cnt].name[name_size] = 0;
+		}
+		cnt ++;
+	}
+	if (0 == cnt) {
+		error = ENOENT;
+		goto err_out;
+	}
+	fclose(fp);
+	(*targets_ret) = targets;
+	(*targets_cnt_ret) = cnt;
+
+	return (0);
+
+err_out:
+	fclose(fp);
+	lg_free(targets);
+	return (error);
+}
+
+
+void
+lg_spk_engine_init(lg_spk_engine_p eng, lg_ctl_crypto_p crypto,
+    lg_ctl_get_pkts_p get_pkts) {
+
+	if (NULL == eng)
+		return;
+	memset(eng, 0x00, sizeof(lg_spk_engine_t));
+	eng->crypto = crypto;
+	eng->get_pkts = get_pkts;
+	eng->pipeline = 1;
+	eng->max_payload = LG_CTL_CONN_BUF_MAX_SIZE;
+	eng->timeout = LG_SPK_ENGINE_DEF_TIMEOUT;
+	eng->ev = (uintptr_t)-1;
+}
+
+void
+lg_spk_engine_destroy(lg_spk_engine_p eng) {
+	size_t i;
+
+	if (NULL == eng)
+		return;
+	if (NULL != eng->sess) {
+		for (i = 0; i < eng->sess_allocated; i ++) {
+			lg_ctl_sess_destroy(&eng->sess[i].ctl);
+		}
+		lg_free(eng->sess);
+		eng->sess = NULL;
+	}
+	eng->sess_cnt = 0;
+	eng->sess_allocated = 0;
+	lg_ev_close(eng->ev);
+	eng->ev = (uintptr_t)-1;
+}
+
+
+static void
+lg_spk_sess_done(lg_spk_engine_p eng, lg_spk_sess_p sess, int error) {
+
+	if (LG_SPK_SESS_S_DONE == sess->state)
+		return;
+	/* Close removes socket from event loop, buffers are kept. */
+	if (((uintptr_t)-1) != sess->skt) {
+		close((int)sess->skt);
+		sess->skt = (uintptr_t)-1;
+	}
+	lg_ctl_sess_reset(&sess->ctl);
+	if (((uintptr_t)-1) != sess->skt_alt) {
+		close((int)sess->skt_alt);
+		sess->skt_alt = (uintptr_t)-1;
+	}
+	sess->ev_flags = 0;
+	sess->ev_flags_alt = 0;
+	sess->state = LG_SPK_SESS_S_DONE;
+	sess->error = error;
+	sess->ts_done = lg_ev_time_us();
+	eng->sess_active --;
+}
+
+/* Deadline is limited by overall timeout. */
+static void
+lg_spk_sess_deadline_set(lg_spk_engine_p eng, lg_spk_sess_p sess,
+    uint64_t deadline) {
+
+	sess->deadline = MIN(deadline,
+	    (sess->ts_start + (eng->timeout * 1000)));
+	eng->next_deadline = MIN(eng->next_deadline, sess->deadline);
+}
+
+static uint64_t
+lg_spk_sess_connect_deadline(lg_spk_engine_p eng, lg_spk_sess_p sess) {
+
+	return (sess->ts_start + (1000 * ((0 != eng->connect_timeout) ?
+	    eng->connect_timeout : eng->timeout)));
+}
+
+static int
+lg_spk_sess_ev_update(lg_spk_engine_p eng, lg_spk_sess_p sess) {
+	int error;
+	uint32_t ev_flags;
+
+	if (LG_SPK_SESS_S_POLL != sess->state)
+		return (0);
+	ev_flags = LG_EV_READ;
+	if (0 != lg_ctl_sess_out_pending(&sess->ctl)) {
+		ev_flags |= LG_EV_WRITE;
+	}
+	error = lg_ev_set(eng->ev, sess->skt, ev_flags, sess->ev_flags, sess);
+	if (0 != error)
+		return (error);
+	sess->ev_flags = ev_flags;
+
+	return (0);
+}
+
+static int
+lg_spk_sess_send(lg_spk_engine_p eng, lg_spk_sess_p sess,
+    const uint64_t now) {
+	int error;
+	const uint8_t *data;
+	size_t data_size;
+
+	/* Fill pipeline. */
+	while (eng->msg_cnt > sess->tx_queued &&
+	    eng->pipeline > sess->ctl.in_flight_cnt) {
+		error = lg_ctl_sess_get(&sess->ctl,
+		    eng->msg_list[sess->tx_queued], now);
+		if (0 != error)
+			return (error);
+		sess->tx_queued ++;
+	}
+	/* Send all queued requests. */
+	while (0 == lg_ctl_sess_out_get(&sess->ctl, &data, &data_size)) {
+		error = lg_ctl_sess_out_done(&sess->ctl,
+		    send((int)sess->skt, data, data_size, MSG_NOSIGNAL), now);
+		if (0 != error) {
+			if (EAGAIN == error || EINTR == error)
+				return (0); /* Wait for LG_EV_WRITE. */
+			return (error);
+		}
+		sess->ts_io = now; /* Send progress. */
+	}
+
+	return (0);
+}
+
+static int
+lg_spk_sess_recv(lg_spk_sess_p sess, const uint64_t now) {
+	int error;
+	uint8_t *buf;
+	size_t buf_size;
+	ssize_t ios;
+
+	error = lg_ctl_sess_in_get(&sess->ctl, &buf, &buf_size);
+	if (0 != error)
+		return (error);
+	ios = recv((int)sess->skt, buf, buf_size, MSG_NOSIGNAL);
+	if (0 < ios) {
+		/* Any received bytes are progress, even part of frame. */
+		sess->ts_io = now;
+	}
+	/* Process all received responces. */
+	error = lg_ctl_sess_in_done(&sess->ctl, ios, now);
+	if (EAGAIN == error || EINTR == error)
+		return (0);
+
+	return (error);
+}
+
+/* Routes responce by engine data_cb. */
+static int
+lg_spk_sess_data_cb(lg_ctl_sess_p ctl, uint8_t *data, size_t data_size,
+    uint64_t now, size_t *msg_idx, void *udata) {
+	lg_spk_sess_p sess = udata;
+
+	(void)ctl;
+	(void)now;
+	if (NULL != sess->eng->data_cb) {
+		(*msg_idx) = sess->eng->data_cb(sess, data, data_size,
+		    sess->eng->udata);
+	}
+
+	return (0);
+}
+
+static void
+lg_spk_sess_cb(lg_ctl_sess_p ctl, size_t msg_idx, int error,
+    const lg_ctl_resp_t *resp, const uint8_t *data, size_t data_size,
+    void *udata) {
+	lg_spk_sess_p sess = udata;
+
+	(void)ctl;
+	(void)resp;
+	(void)data;
+	(void)data_size;
+	if (0 == error && LG_CTL_MSG_COUNT > msg_idx) {
+		sess->done_cnt ++;
+	}
+}
+
+/*
+ * Start non blocking connect and wait for LG_EV_WRITE.
+ * Event udata is skt_ret: &sess->skt or &sess->skt_alt, so connect
+ * result is checked only for socket that is ready.
+ */
+static int
+lg_spk_sess_connect(lg_spk_engine_p eng, lg_spk_sess_p sess,
+    const struct sockaddr_storage *addr, uintptr_t *skt_ret,
+    uint32_t *ev_flags_ret) {
+	int error;
+	uintptr_t skt = (uintptr_t)-1;
+
+	error = skt_connect(addr, SOCK_STREAM, IPPROTO_TCP, SO_F_NONBLOCK,
+	    &skt);
+	if (EINPROGRESS == error) {
+		error = 0;
+	}
+	if (0 != error)
+		goto err_out;
+	error = lg_ev_set(eng->ev, skt, LG_EV_WRITE, 0, skt_ret);
+	if (0 != error)
+		goto err_out;
+	(*skt_ret) = skt;
+	(*ev_flags_ret) = LG_EV_WRITE;
+
+	return (0);
+
+err_out:
+	if (((uintptr_t)-1) != skt) {
+		close((int)skt);
+	}
+	if (0 == sess->error_first) {
+		sess->error_first = error;
+	}
+	return (error);
+}
+
+static int
+lg_spk_sess_connect_alt(lg_spk_engine_p eng, lg_spk_sess_p sess) {
+
+	sess->alt_started = 1;
+	return (lg_spk_sess_connect(eng, sess, &sess->target->addr_alt,
+	    &sess->skt_alt, &sess->ev_flags_alt));
+}
+
+static void
+lg_spk_sess_start(lg_spk_engine_p eng, lg_spk_sess_p sess) {
+	int error;
+	uint64_t deadline;
+
+	sess->ts_start = lg_ev_time_us();
+	sess->skt_alt = (uintptr_t)-1;
+	sess->state = LG_SPK_SESS_S_CONNECT;
+	eng->sess_active ++;
+	error = lg_spk_sess_connect(eng, sess, &sess->target->addr,
+	    &sess->skt, &sess->ev_flags);
+	if (0 != error) {
+		if (0 == sess->target->addr_alt.ss_family)
+			goto err_out;
+		/* Primary failed at once: no reason to wait. */
+		error = lg_spk_sess_connect_alt(eng, sess);
+		if (0 != error)
+			goto err_out;
+	}
+	deadline = lg_spk_sess_connect_deadline(eng, sess);
+	if (0 != sess->target->addr_alt.ss_family && 0 == sess->alt_started) {
+		deadline = MIN(deadline,
+		    (sess->ts_start + (LG_SPK_ENGINE_HE_DELAY * 1000)));
+	}
+	lg_spk_sess_deadline_set(eng, sess, deadline);
+
+	return;
+
+err_out:
+	lg_spk_sess_done(eng, sess, sess->error_first);
+}
+
+/* Start targets in order while below concurrency limit. */
+static void
+lg_spk_engine_start(lg_spk_engine_p eng) {
+
+	while (eng->sess_next < eng->sess_cnt &&
+	    (0 == eng->concurrency || eng->concurrency > eng->sess_active)) {
+		lg_spk_sess_start(eng, &eng->sess[eng->sess_next ++]);
+	}
+}
+
+/* Session deadline reached. */
+static void
+lg_spk_sess_timer(lg_spk_engine_p eng, lg_spk_sess_p sess, uint64_t now) {
+	uint64_t deadline;
+
+	if (LG_SPK_SESS_S_CONNECT != sess->state ||
+	    0 == sess->target->addr_alt.ss_family ||
+	    0 != sess->alt_started) {
+		lg_spk_sess_done(eng, sess, ETIMEDOUT);
+		return;
+	}
+	deadline = MIN(lg_spk_sess_connect_deadline(eng, sess),
+	    (sess->ts_start + (eng->timeout * 1000)));
+	if (now >= deadline) {
+		lg_spk_sess_done(eng, sess, ETIMEDOUT);
+		return;
+	}
+	/* Happy eyeballs delay expired: race IPv4 with IPv6. */
+	if (0 != lg_spk_sess_connect_alt(eng, sess) &&
+	    ((uintptr_t)-1) == sess->skt) {
+		lg_spk_sess_done(eng, sess, sess->error_first);
+		return;
+	}
+	lg_spk_sess_deadline_set(eng, sess, deadline);
+}
+
+/*
+ * Check connect result of socket: 0 - connected, EINPROGRESS - not yet,
+ * other - failed, socket closed.
+ */
+static int
+lg_spk_sess_connect_check(lg_spk_sess_p sess, uintptr_t *skt,
+    uint32_t *ev_flags) {
+	int error = 0;
+	socklen_t optlen = sizeof(error);
+	struct sockaddr_storage ss;
+
+	if (((uintptr_t)-1) == (*skt))
+		return (EBADF);
+	if (0 != getsockopt((int)(*skt), SOL_SOCKET, SO_ERROR, &error,
+	    &optlen)) {
+		error = errno;
+	}
+	if (0 == error) {
+		optlen = sizeof(ss);
+		if (0 == getpeername((int)(*skt), (struct sockaddr*)&ss,
+		    &optlen))
+			return (0);
+		/* Not connected and no error: still connecting. */
+		return (EINPROGRESS);
+	}
+	close((int)(*skt));
+	(*skt) = (uintptr_t)-1;
+	(*ev_flags) = 0;
+	if (0 == sess->error_first) {
+		sess->error_first = error;
+	}
+	return (error);
+}
+
+/* Remove socket from event loop and close it. */
+static void
+lg_spk_sess_skt_close(lg_spk_engine_p eng, uintptr_t *skt,
+    uint32_t *ev_flags) {
+
+	if (((uintptr_t)-1) == (*skt))
+		return;
+	lg_ev_set(eng->ev, (*skt), 0, (*ev_flags), NULL);
+	close((int)(*skt));
+	(*skt) = (uintptr_t)-1;
+	(*ev_flags) = 0;
+}
+
+/* Connecting socket is ready: skt is &sess->skt or &sess->skt_alt. */
+static int
+lg_spk_sess_connected(lg_spk_engine_p eng, lg_spk_sess_p sess,
+    uintptr_t *skt, uint64_t now) {
+	int error, alt = (&sess->skt_alt == skt);
+	uint32_t *ev_flags = ((0 != alt) ?
+	    &sess->ev_flags_alt : &sess->ev_flags);
+
+	if (((uintptr_t)-1) == (*skt))
+		return (0); /* Closed by previous event of same wait. */
+	error = lg_spk_sess_connect_check(sess, skt, ev_flags);
+	if (EINPROGRESS == error)
+		return (0);
+	if (0 != error) {
+		if (((uintptr_t)-1) != sess->skt ||
+		    ((uintptr_t)-1) != sess->skt_alt)
+			return (0); /* Wait for other. */
+		if (0 != sess->target->addr_alt.ss_family &&
+		    0 == sess->alt_started) {
+			/* IPv6 failed before delay, try IPv4 now. */
+			error = lg_spk_sess_connect_alt(eng, sess);
+			if (0 == error) {
+				lg_spk_sess_deadline_set(eng, sess,
+				    lg_spk_sess_connect_deadline(eng, sess));
+			}
+			return (error);
+		}
+		return (sess->error_first);
+	}
+	/* Loser may be still connecting. */
+	if (0 == alt) {
+		lg_spk_sess_skt_close(eng, &sess->skt_alt,
+		    &sess->ev_flags_alt);
+	} else {
+		lg_spk_sess_skt_close(eng, &sess->skt, &sess->ev_flags);
+	}
+	/* Winner is main socket, registered again with session udata
+	 * by lg_spk_sess_ev_update(). */
+	error = lg_ev_set(eng->ev, (*skt), 0, (*ev_flags), NULL);
+	(*ev_flags) = 0;
+	if (0 != alt) {
+		sess->skt = sess->skt_alt;
+		sess->skt_alt = (uintptr_t)-1;
+	}
+	if (0 != error)
+		return (error);
+	sess->ts_connected = now;
+	sess->ts_io = now;
+	sess->state = LG_SPK_SESS_S_POLL;
+	lg_spk_stats_add(eng->stats, (size_t)(sess - eng->sess),
+	    LG_SPK_STATS_ALL, LG_SPK_STAT_CONNECT, (now - sess->ts_start));
+	lg_ctl_cap_rec(eng->cap, LG_CTL_CAP_T_TARGET, sess->ctl.in.cap_target,
+	    (const uint8_t*)sess->target->name, strlen(sess->target->name));
+
+	return (lg_spk_sess_send(eng, sess, now));
+}
+
+/* skt: connecting socket from event udata, NULL - session I/O. */
+static void
+lg_spk_sess_io(lg_spk_engine_p eng, lg_spk_sess_p sess, uintptr_t *skt,
+    uint32_t events, uint64_t now) {
+	int error = 0;
+
+	switch (sess->state) {
+	case LG_SPK_SESS_S_CONNECT:
+		if (NULL == skt)
+			return;
+		error = lg_spk_sess_connected(eng, sess, skt, now);
+		break;
+	case LG_SPK_SESS_S_POLL:
+		if (NULL != skt)
+			return; /* Closed by previous event of same wait. */
+		if (0 != (LG_EV_READ & events)) {
+			error = lg_spk_sess_recv(sess, now);
+			if (0 != error)
+				break;
+		} else if (0 != (LG_EV_ERR & events)) {
+			error = ECONNRESET;
+			break;
+		}
+		if (eng->msg_cnt == sess->done_cnt) {
+			lg_spk_sess_done(eng, sess, 0);
+			return;
+		}
+		error = lg_spk_sess_send(eng, sess, now);
+		break;
+	default:
+		return;
+	}
+	if (0 == error) {
+		error = lg_spk_sess_ev_update(eng, sess);
+	}
+	if (0 != error) {
+		lg_spk_sess_done(eng, sess, error);
+		return;
+	}
+	if (LG_SPK_SESS_S_POLL == sess->state) {
+		lg_spk_sess_deadline_set(eng, sess,
+		    ((0 != eng->io_timeout) ?
+		    (sess->ts_io + (eng->io_timeout * 1000)) : (uint64_t)-1));
+	}
+}
+
+
+int
+lg_spk_engine_poll(lg_spk_engine_p eng,
+    lg_spk_target_p targets, size_t targets_cnt) {
+	int error, timeout_ms;
+	size_t i, ev_cnt;
+	uint64_t now;
+	lg_ev_event_t ev[LG_EV_WAIT_MAX];
+	lg_spk_sess_p sess;
+	lg_ctl_sess_t ctl;
+
+	if (NULL == eng || NULL == eng->crypto || NULL == eng->get_pkts ||
+	    NULL == targets || 0 == targets_cnt)
+		return (EINVAL);
+	if (0 == eng->pipeline) {
+		eng->pipeline = 1;
+	}
+	for (i = 0, eng->msg_cnt = 0; i < LG_CTL_MSG_GET_COUNT; i ++) {
+		if (0 != eng->msgs &&
+		    0 == (eng->msgs & (((uint32_t)1) << i)))
+			continue;
+		eng->msg_list[eng->msg_cnt ++] = i;
+	}
+	if (0 == eng->msg_cnt)
+		return (EINVAL);
+
+	/* Reuse sessions from previous poll, grow if needed. */
+	if (eng->sess_allocated < targets_cnt) {
+		sess = lg_realloc(eng->sess,
+		    (targets_cnt * sizeof(lg_spk_sess_t)));
+		if (NULL == sess)
+			return (ENOMEM);
+		for (i = eng->sess_allocated; i < targets_cnt; i ++) {
+			lg_ctl_sess_init(&sess[i].ctl, eng->crypto,
+			    eng->get_pkts, eng->max_payload);
+		}
+		eng->sess = sess;
+		eng->sess_allocated = targets_cnt;
+	}
+	for (i = 0; i < targets_cnt; i ++) {
+		ctl = eng->sess[i].ctl;
+		lg_ctl_sess_reset(&ctl);
+		ctl.crypto = eng->crypto;
+		ctl.get_pkts = eng->get_pkts;
+		ctl.timeout = 0; /* Engine deadlines. */
+		ctl.cb = lg_spk_sess_cb;
+		ctl.data_cb = lg_spk_sess_data_cb;
+		ctl.udata = &eng->sess[i];
+		ctl.stats = eng->stats;
+		ctl.stats_target = i;
+		ctl.in.buf_max_size = eng->max_payload;
+		ctl.in.cap = eng->cap;
+		ctl.in.cap_target = (uint32_t)i;
+		memset(&eng->sess[i], 0x00, sizeof(lg_spk_sess_t));
+		eng->sess[i].ctl = ctl;
+		eng->sess[i].eng = eng;
+		eng->sess[i].skt = (uintptr_t)-1;
+		eng->sess[i].skt_alt = (uintptr_t)-1;
+	}
+	eng->sess_cnt = targets_cnt;
+	eng->sess_active = 0;
+	eng->sess_first = 0;
+	eng->sess_next = 0;
+	if (((uintptr_t)-1) == eng->ev) {
+		error = lg_ev_open(&eng->ev);
+		if (0 != error)
+			return (error);
+	}
+
+	/* Start all at once, or up to concurrency limit. */
+	eng->ts_start = lg_ev_time_us();
+	for (i = 0; i < targets_cnt; i ++) {
+		eng->sess[i].target = &targets[i];
+	}
+	eng->next_deadline = (uint64_t)-1;
+	lg_spk_engine_start(eng);
+
+	while (0 != eng->sess_active) {
+		now = lg_ev_time_us();
+		timeout_ms = ((eng->next_deadline > now) ?
+		    (int)(((eng->next_deadline - now) + 999) / 1000) : 0);
+		error = lg_ev_wait(eng->ev, ev, LG_EV_WAIT_MAX, timeout_ms,
+		    &ev_cnt);
+		if (0 != error)
+			break;
+		now = lg_ev_time_us();
+		for (i = 0; i < ev_cnt; i ++) {
+			/* udata: session, its skt or skt_alt. */
+			sess = &eng->sess[(size_t)(((uint8_t*)ev[i].udata -
+			    (uint8_t*)eng->sess) / sizeof(lg_spk_sess_t))];
+			lg_spk_sess_io(eng, sess, ((sess == ev[i].udata) ?
+			    NULL : (uintptr_t*)ev[i].udata), ev[i].events,
+			    now);
+		}
+		lg_spk_engine_start(eng);
+		/* Deadlines: connect, happy eyeballs delay, I/O, overall. */
+		now = lg_ev_time_us();
+		if (now < eng->next_deadline)
+			continue;
+		eng->next_deadline = (uint64_t)-1;
+		/* Targets are started in order: only started and not done
+		 * window has to be checked. */
+		while (eng->sess_first < eng->sess_next &&
+		    LG_SPK_SESS_S_DONE == eng->sess[eng->sess_first].state) {
+			eng->sess_first ++;
+		}
+		for (i = eng->sess_first; i < eng->sess_next; i ++) {
+			if (LG_SPK_SESS_S_DONE == eng->sess[i].state)
+				continue;
+			if (now >= eng->sess[i].deadline) {
+				lg_spk_sess_timer(eng, &eng->sess[i], now);
+				continue;
+			}
+			eng->next_deadline = MIN(eng->next_deadline,
+			    eng->sess[i].deadline);
+		}
+		lg_spk_engine_start(eng);
+	}
+	eng->ts_done = lg_ev_time_us();
+
+	return (error);
+}
@@ -0,0 +1,167 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_ENGINE_H__
+#define __LG_SPK_ENGINE_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_conn.h"
+#include "lg_ctl_sess.h"
+#include "lg_spk_stats.h"
+
+
+/*
+ * Event driven poller: GET all info messages from many soundbars at once
+ * from one thread. Every target has own non blocking connection and
+ * state machine: connect -> send -> (partial) recv -> parse -> done.
+ * Each session has own deadline: connect, then idle I/O timeout, both
+ * limited by overall timeout. Targets given by name and resolved to
+ * IPv6 and IPv4 are connected "happy eyeballs" way: IPv6 first, IPv4
+ * after short delay or IPv6 failure, first connected wins.
+ * Requests, responces framing and routing are done by lg_ctl_sess.
+ * If stats is set, every request stage duration is added to it, see
+ * lg_spk_stats.h: two more clock reads per responce.
+ */
+
+#define LG_SPK_TARGET_NAME_MAX	64
+
+typedef struct lg_spk_target_s {
+	struct sockaddr_storage addr;
+	struct sockaddr_storage addr_alt; /* ss_family = 0: no alternative. */
+	char		name[LG_SPK_TARGET_NAME_MAX]; /* For reports. */
+} lg_spk_target_t, *lg_spk_target_p;
+
+
+#define LG_SPK_SESS_S_IDLE	0
+#define LG_SPK_SESS_S_CONNECT	1 /* Wait for connection. */
+#define LG_SPK_SESS_S_POLL	2 /* Send requests / receive responces. */
+#define LG_SPK_SESS_S_DONE	3
+
+typedef struct lg_spk_sess_s {
+	lg_spk_target_p	target;
+	struct lg_spk_engine_s *eng;
+	lg_ctl_sess_t	ctl;		/* Requests and responces. */
+	uintptr_t	skt;		/* Connect udata: &skt, then sess. */
+	uint32_t	state;		/* LG_SPK_SESS_S_* */
+	uint32_t	ev_flags;	/* Registered in event loop. */
+	uintptr_t	skt_alt;	/* Connecting to target->addr_alt,
+					 * connect event udata: &skt_alt. */
+	uint32_t	ev_flags_alt;
+	int		alt_started;
+	int		error_first;	/* First connect error. */
+	int		error;		/* Result, set on done. */
+	size_t		tx_queued;	/* GET requests queued to send,
+					 * position in engine msg_list. */
+	size_t		done_cnt;	/* Responces received. */
+	uint64_t	ts_start;	/* Monotonic time, us. */
+	uint64_t	ts_connected;
+	uint64_t	ts_io;		/* Last send/recv progress. */
+	uint64_t	ts_done;
+	uint64_t	deadline;	/* Current: connect or I/O. */
+} lg_spk_sess_t, *lg_spk_sess_p;
+
+/*
+ * Called for every received responce with zero terminated plain data.
+ * Must return lg_ctl_msg[] index of responce, LG_CTL_MSG_COUNT if
+ * unknown, LG_SPK_ENGINE_MSG_NOTIFY for pushed notification: it is not
+ * answer to request.
+ */
+#define LG_SPK_ENGINE_MSG_NOTIFY	LG_CTL_SESS_MSG_NOTIFY
+typedef size_t (*lg_spk_engine_data_cb)(lg_spk_sess_p sess,
+    uint8_t *data, size_t data_size, void *udata);
+
+typedef struct lg_spk_engine_s {
+	/* Settings, set before lg_spk_engine_poll(). */
+	lg_ctl_crypto_p	crypto;
+	lg_ctl_get_pkts_p get_pkts;
+	size_t		pipeline;	/* Max requests in flight per target. */
+	size_t		max_payload;	/* Receive buffer limit per target. */
+	uint64_t	timeout;	/* Per target poll time limit, ms. */
+	uint64_t	connect_timeout; /* ms, 0 - timeout. */
+	uint64_t	io_timeout;	/* ms, no send/recv progress,
+					 * 0 - only timeout. */
+	size_t		concurrency;	/* Max targets polled at once, 0 - all. */
+	uint32_t	msgs;		/* GET only: bit per lg_ctl_msg[] index,
+					 * 0 - all LG_CTL_MSG_GET_COUNT. */
+	lg_spk_engine_data_cb data_cb;
+	void		*udata;
+	lg_ctl_cap_p	cap;		/* Optional wire capture. */
+	lg_spk_stats_p	stats;		/* Optional, target: targets index. */
+	/* Internal / results. */
+	uintptr_t	ev;
+	size_t		msg_list[LG_CTL_MSG_GET_COUNT]; /* Indexes to GET. */
+	size_t		msg_cnt;
+	lg_spk_sess_p	sess;		/* Kept between polls with buffers. */
+	size_t		sess_cnt;
+	size_t		sess_allocated;
+	size_t		sess_active;
+	size_t		sess_first;	/* Not done with lowest index. */
+	size_t		sess_next;	/* To start next. */
+	uint64_t	next_deadline;	/* Nearest session deadline. */
+	uint64_t	ts_start;	/* Monotonic time, us. */
+	uint64_t	ts_done;
+} lg_spk_engine_t, *lg_spk_engine_p;
+
+#define LG_SPK_ENGINE_DEF_TIMEOUT	10000
+#define LG_SPK_ENGINE_HE_DELAY		250 /* IPv4 connect delay, ms. */
+
+
+/*
+ * Parse "addr[:port]" or resolve "host[:port]", name is set to addr
+ * string.
+ */
+int	lg_spk_target_set(lg_spk_target_p target, const char *addr,
+	    size_t addr_size);
+/*
+ * Load targets from text file: one "addr[:port] [name]" per line,
+ * empty lines and lines started from '#' are ignored.
+ * Free targets with lg_free().
+ */
+int	lg_spk_targets_load(const char *file_name,
+	    lg_spk_target_p *targets_ret, size_t *targets_cnt_ret);
+
+void	lg_spk_engine_init(lg_spk_engine_p eng, lg_ctl_crypto_p crypto,
+	    lg_ctl_get_pkts_p get_pkts);
+/* Free sessions, results are lost. */
+void	lg_spk_engine_destroy(lg_spk_engine_p eng);
+/*
+ * Poll all targets, returns when all done, results in eng->sess.
+ * Sessions, receive buffers and event queue are reused by next call,
+ * so repeated polls of same targets do not allocate memory.
+ */
+int	lg_spk_engine_poll(lg_spk_engine_p eng,
+	    lg_spk_target_p targets, size_t targets_cnt);
+
+
+#endif /* __LG_SPK_ENGINE_H__ */
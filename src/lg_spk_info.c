@@ -0,0 +1,361 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stddef.h> /* offsetof */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_spk_info.h"
+
+
+const char *lg_spk_field_name[LG_SPK_F_COUNT] = {
+	"i_bass",
+	"i_treble",
+	"i_curr_eq",
+	"ai_eq_list",
+	"i_vol",
+	"i_vol_min",
+	"i_vol_max",
+	"b_mute",
+	"i_curr_func",
+	"b_powerstatus",
+	"s_user_name",
+	"ai_func_list",
+	"i_rear_level",
+	"i_rear_min",
+	"i_rear_max",
+	"b_rear",
+	"i_woofer_level",
+	"i_woofer_min",
+	"i_woofer_max",
+	"b_night_time",
+	"b_auto_vol",
+	"b_drc",
+	"b_neuralX",
+	"b_tv_remote",
+	"b_auto_power",
+	"b_auto_display",
+	"b_bt_standby",
+	"b_conn_bt_limit",
+	"i_av_sync",
+	"i_sleep_time",
+	"s_uuid",
+	"i_model_no",
+	"i_model_type",
+	"s_model_name"
+};
+
+/* Field -> messages, for query planner; same as schemas below. */
+#define LG_SPK_M(__msg_idx)	(((uint32_t)1) << (__msg_idx))
+const uint32_t lg_spk_field_msgs[LG_SPK_F_COUNT] = {
+	[LG_SPK_F_I_BASS] =	LG_SPK_M(LG_CTL_MSG_EQ_VIEW_INFO),
+	[LG_SPK_F_I_TREBLE] =	LG_SPK_M(LG_CTL_MSG_EQ_VIEW_INFO),
+	[LG_SPK_F_I_CURR_EQ] =	LG_SPK_M(LG_CTL_MSG_EQ_VIEW_INFO),
+	[LG_SPK_F_AI_EQ_LIST] =	LG_SPK_M(LG_CTL_MSG_EQ_VIEW_INFO),
+	[LG_SPK_F_I_VOL] =	LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO),
+	[LG_SPK_F_I_VOL_MIN] =	LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO),
+	[LG_SPK_F_I_VOL_MAX] =	LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO),
+	[LG_SPK_F_B_MUTE] =	LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO),
+	[LG_SPK_F_I_CURR_FUNC] = (LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO) |
+	    LG_SPK_M(LG_CTL_MSG_FUNC_VIEW_INFO)),
+	[LG_SPK_F_B_POWERSTATUS] = LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO),
+	[LG_SPK_F_S_USER_NAME] = (LG_SPK_M(LG_CTL_MSG_SPK_LIST_VIEW_INFO) |
+	    LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO)),
+	[LG_SPK_F_AI_FUNC_LIST] = LG_SPK_M(LG_CTL_MSG_FUNC_VIEW_INFO),
+	[LG_SPK_F_I_REAR_LEVEL] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_REAR_MIN] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_REAR_MAX] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_REAR] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_WOOFER_LEVEL] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_WOOFER_MIN] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_WOOFER_MAX] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_NIGHT_TIME] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_AUTO_VOL] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_DRC] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_NEURALX] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_TV_REMOTE] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_AUTO_POWER] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_AUTO_DISPLAY] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_BT_STANDBY] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_B_CONN_BT_LIMIT] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_AV_SYNC] =	LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_I_SLEEP_TIME] = LG_SPK_M(LG_CTL_MSG_SETTING_VIEW_INFO),
+	[LG_SPK_F_S_UUID] =	LG_SPK_M(LG_CTL_MSG_PRODUCT_INFO),
+	[LG_SPK_F_I_MODEL_NO] =	LG_SPK_M(LG_CTL_MSG_PRODUCT_INFO),
+	[LG_SPK_F_I_MODEL_TYPE] = LG_SPK_M(LG_CTL_MSG_PRODUCT_INFO),
+	[LG_SPK_F_S_MODEL_NAME] = LG_SPK_M(LG_CTL_MSG_PRODUCT_INFO),
+};
+
+/*
+ * Perfect hash of lg_spk_field_name[]:
+ * (name[2] * 2 + name[size - 1] * 23 + name[size - 2] * 6 + size) & 63
+ * -> LG_SPK_F_*. Must be regenerated if fields are changed.
+ */
+#define LG_SPK_FIELD_HASH(__name, __size)				\
+	    ((((uint8_t)(__name)[2]) * 2 +				\
+	    ((uint8_t)(__name)[((__size) - 1)]) * 23 +			\
+	    ((uint8_t)(__name)[((__size) - 2)]) * 6 + (__size)) & 63)
+static const uint8_t lg_spk_field_hash[64] = {
+	   9, 0xff,   12,    6,   28, 0xff,   13,   33,
+	  18,   19,    8,    1, 0xff,    5,   16, 0xff,
+	0xff,    0,   17,   29,    2,   22,   10, 0xff,
+	0xff,   32,   20, 0xff, 0xff, 0xff,   21, 0xff,
+	0xff, 0xff,   30, 0xff, 0xff, 0xff,    3, 0xff,
+	  11, 0xff,   24,    7, 0xff, 0xff,   15, 0xff,
+	0xff,   31, 0xff, 0xff, 0xff,   25, 0xff,   27,
+	0xff, 0xff, 0xff,   26,   14, 0xff,   23,    4,
+};
+
+
+/* Field value types, from name prefix. */
+#define LG_SPK_FT_INT		0 /* i_: int32_t. */
+#define LG_SPK_FT_BOOL		1 /* b_: uint8_t. */
+#define LG_SPK_FT_STR		2 /* s_: char[], zero terminated. */
+#define LG_SPK_FT_BITMAP	3 /* ai_: uint32_t, bit per item value. */
+
+/* Where field of given message is stored, off = 0: not stored. */
+typedef struct lg_spk_schema_s {
+	uint16_t	off;	/* offsetof(lg_spk_info_t, ...) + 1. */
+	uint16_t	size;
+	uint8_t		type;	/* LG_SPK_FT_*. */
+} lg_spk_schema_t, *lg_spk_schema_p;
+
+#define LG_SPK_SCHEMA(__type, __member)					\
+	    { (uint16_t)(offsetof(lg_spk_info_t, __member) + 1),	\
+	      (uint16_t)sizeof(((lg_spk_info_t*)NULL)->__member),	\
+	      (__type) }
+#define LG_SPK_S_INT(__member)	LG_SPK_SCHEMA(LG_SPK_FT_INT, __member)
+#define LG_SPK_S_BOOL(__member)	LG_SPK_SCHEMA(LG_SPK_FT_BOOL, __member)
+#define LG_SPK_S_STR(__member)	LG_SPK_SCHEMA(LG_SPK_FT_STR, __member)
+#define LG_SPK_S_BITMAP(__member) LG_SPK_SCHEMA(LG_SPK_FT_BITMAP, __member)
+
+static const lg_spk_schema_t lg_spk_schema_eq[LG_SPK_F_COUNT] = {
+	[LG_SPK_F_I_BASS] =	LG_SPK_S_INT(eq.bass),
+	[LG_SPK_F_I_TREBLE] =	LG_SPK_S_INT(eq.treble),
+	[LG_SPK_F_I_CURR_EQ] =	LG_SPK_S_INT(eq.curr_eq),
+	[LG_SPK_F_AI_EQ_LIST] =	LG_SPK_S_BITMAP(eq.eq_list),
+};
+
+static const lg_spk_schema_t lg_spk_schema_spk[LG_SPK_F_COUNT] = {
+	[LG_SPK_F_I_VOL] =	LG_SPK_S_INT(spk.vol),
+	[LG_SPK_F_I_VOL_MIN] =	LG_SPK_S_INT(spk.vol_min),
+	[LG_SPK_F_I_VOL_MAX] =	LG_SPK_S_INT(spk.vol_max),
+	[LG_SPK_F_I_CURR_FUNC] = LG_SPK_S_INT(spk.curr_func),
+	[LG_SPK_F_B_MUTE] =	LG_SPK_S_BOOL(spk.mute),
+	[LG_SPK_F_B_POWERSTATUS] = LG_SPK_S_BOOL(spk.power),
+	[LG_SPK_F_S_USER_NAME] = LG_SPK_S_STR(spk.user_name),
+};
+
+static const lg_spk_schema_t lg_spk_schema_func[LG_SPK_F_COUNT] = {
+	[LG_SPK_F_I_CURR_FUNC] = LG_SPK_S_INT(func.curr_func),
+	[LG_SPK_F_AI_FUNC_LIST] = LG_SPK_S_BITMAP(func.func_list),
+};
+
+static const lg_spk_schema_t lg_spk_schema_setting[LG_SPK_F_COUNT] = {
+	[LG_SPK_F_I_REAR_LEVEL] = LG_SPK_S_INT(setting.rear_level),
+	[LG_SPK_F_I_REAR_MIN] =	LG_SPK_S_INT(setting.rear_min),
+	[LG_SPK_F_I_REAR_MAX] =	LG_SPK_S_INT(setting.rear_max),
+	[LG_SPK_F_I_WOOFER_LEVEL] = LG_SPK_S_INT(setting.woofer_level),
+	[LG_SPK_F_I_WOOFER_MIN] = LG_SPK_S_INT(setting.woofer_min),
+	[LG_SPK_F_I_WOOFER_MAX] = LG_SPK_S_INT(setting.woofer_max),
+	[LG_SPK_F_I_AV_SYNC] =	LG_SPK_S_INT(setting.av_sync),
+	[LG_SPK_F_I_SLEEP_TIME] = LG_SPK_S_INT(setting.sleep_time),
+	[LG_SPK_F_B_REAR] =	LG_SPK_S_BOOL(setting.rear),
+	[LG_SPK_F_B_NIGHT_TIME] = LG_SPK_S_BOOL(setting.night_time),
+	[LG_SPK_F_B_AUTO_VOL] =	LG_SPK_S_BOOL(setting.auto_vol),
+	[LG_SPK_F_B_DRC] =	LG_SPK_S_BOOL(setting.drc),
+	[LG_SPK_F_B_NEURALX] =	LG_SPK_S_BOOL(setting.neural_x),
+	[LG_SPK_F_B_TV_REMOTE] = LG_SPK_S_BOOL(setting.tv_remote),
+	[LG_SPK_F_B_AUTO_POWER] = LG_SPK_S_BOOL(setting.auto_power),
+	[LG_SPK_F_B_AUTO_DISPLAY] = LG_SPK_S_BOOL(setting.auto_display),
+	[LG_SPK_F_B_BT_STANDBY] = LG_SPK_S_BOOL(setting.bt_standby),
+	[LG_SPK_F_B_CONN_BT_LIMIT] = LG_SPK_S_BOOL(setting.bt_limit),
+	[LG_SPK_F_S_USER_NAME] = LG_SPK_S_STR(setting.user_name),
+};
+
+static const lg_spk_schema_t lg_spk_schema_product[LG_SPK_F_COUNT] = {
+	[LG_SPK_F_I_MODEL_NO] =	LG_SPK_S_INT(product.model_no),
+	[LG_SPK_F_I_MODEL_TYPE] = LG_SPK_S_INT(product.model_type),
+	[LG_SPK_F_S_UUID] =	LG_SPK_S_STR(product.uuid),
+	[LG_SPK_F_S_MODEL_NAME] = LG_SPK_S_STR(product.model_name),
+};
+
+/* lg_ctl_msg[] index -> schema, NULL: not decoded. */
+static const lg_spk_schema_t *lg_spk_schema[LG_CTL_MSG_COUNT] = {
+	[LG_CTL_MSG_EQ_VIEW_INFO] =	lg_spk_schema_eq,
+	[LG_CTL_MSG_SPK_LIST_VIEW_INFO] = lg_spk_schema_spk,
+	[LG_CTL_MSG_FUNC_VIEW_INFO] =	lg_spk_schema_func,
+	[LG_CTL_MSG_SETTING_VIEW_INFO] = lg_spk_schema_setting,
+	[LG_CTL_MSG_PRODUCT_INFO] =	lg_spk_schema_product,
+};
+
+
+size_t
+lg_spk_field_id_get(const char *name, const size_t name_size) {
+	size_t id;
+
+	if (NULL == name || 3 > name_size)
+		return (LG_SPK_F_COUNT);
+	id = lg_spk_field_hash[LG_SPK_FIELD_HASH(name, name_size)];
+	if (LG_SPK_F_COUNT <= id ||
+	    0 != strncmp(lg_spk_field_name[id], name, name_size) ||
+	    0 != lg_spk_field_name[id][name_size])
+		return (LG_SPK_F_COUNT);
+
+	return (id);
+}
+
+
+void
+lg_spk_info_dec_init(lg_spk_info_dec_p dec, lg_spk_info_p info) {
+
+	if (NULL == dec)
+		return;
+	dec->info = info;
+	dec->bitmap = NULL;
+}
+
+static void
+lg_spk_info_str_set(char *dst, const size_t dst_size,
+    const lg_json_ev_t *ev) {
+	size_t size;
+
+	if (0 != (LG_JSON_EV_F_ESC & ev->flags)) {
+		/* Truncated on ENOBUFS. */
+		if (EBADMSG != lg_json_str_unescape(ev->value,
+		    ev->value_size, dst, dst_size, NULL))
+			return;
+	}
+	/* Copy as is, truncate. */
+	size = MIN(ev->value_size, (dst_size - 1));
+	memcpy(dst, ev->value, size);
+	dst[size] = 0;
+}
+
+int
+lg_spk_info_dec_cb(const lg_ctl_resp_t *resp, const lg_json_ev_t *ev,
+    void *udata) {
+	lg_spk_info_dec_p dec = udata;
+	const lg_spk_schema_t *schema;
+	size_t id;
+	uint8_t *ptr;
+	int32_t val;
+
+	schema = lg_spk_schema[resp->msg_idx];
+	if (NULL == schema)
+		return (0);
+
+	switch (ev->depth) {
+	case 0: /* "data" object. */
+		if (LG_JSON_EV_OBJ_END == ev->type) {
+			dec->info->msgs |= (((uint32_t)1) << resp->msg_idx);
+		}
+		return (0);
+	case 1:
+		break;
+	case 2: /* Array item. */
+		if (NULL != dec->bitmap &&
+		    LG_JSON_EV_NUMBER == ev->type &&
+		    0 != (LG_JSON_EV_F_INT & ev->flags) &&
+		    0 <= ev->num && 32 > ev->num) {
+			(*dec->bitmap) |= (((uint32_t)1) << ev->num);
+		}
+		return (0);
+	default:
+		return (0);
+	}
+
+	/* Field. */
+	id = lg_spk_field_id_get(ev->name, ev->name_size);
+	if (LG_SPK_F_COUNT == id || 0 == schema[id].off)
+		return (0);
+	ptr = (((uint8_t*)dec->info) + (schema[id].off - 1));
+	switch (schema[id].type) {
+	case LG_SPK_FT_INT:
+		if (LG_JSON_EV_NUMBER != ev->type ||
+		    0 == (LG_JSON_EV_F_INT & ev->flags))
+			return (0);
+		val = (int32_t)MAX(INT32_MIN, MIN(INT32_MAX, ev->num));
+		memcpy(ptr, &val, sizeof(int32_t));
+		break;
+	case LG_SPK_FT_BOOL:
+		switch (ev->type) {
+		case LG_JSON_EV_TRUE:
+			(*ptr) = 1;
+			break;
+		case LG_JSON_EV_FALSE:
+			(*ptr) = 0;
+			break;
+		case LG_JSON_EV_NUMBER:
+			(*ptr) = (0 != ev->num);
+			break;
+		default:
+			return (0);
+		}
+		break;
+	case LG_SPK_FT_STR:
+		if (LG_JSON_EV_STRING != ev->type)
+			return (0);
+		lg_spk_info_str_set((char*)ptr, schema[id].size, ev);
+		break;
+	case LG_SPK_FT_BITMAP:
+		switch (ev->type) {
+		case LG_JSON_EV_ARR_BEGIN:
+			dec->bitmap = (uint32_t*)(void*)ptr;
+			(*dec->bitmap) = 0;
+			return (0);
+		case LG_JSON_EV_ARR_END:
+			dec->bitmap = NULL;
+			break;
+		default:
+			return (0);
+		}
+		break;
+	}
+	dec->info->fields |= (((uint64_t)1) << id);
+
+	return (0);
+}
+
+int
+lg_spk_info_decode(lg_spk_info_p info, const char *buf,
+    const size_t buf_size, lg_ctl_resp_p resp) {
+	lg_spk_info_dec_t dec;
+
+	if (NULL == info)
+		return (EINVAL);
+	lg_spk_info_dec_init(&dec, info);
+
+	return (lg_ctl_resp_parse(buf, buf_size, lg_spk_info_dec_cb,
+	    &dec, resp));
+}
@@ -0,0 +1,181 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_INFO_H__
+#define __LG_SPK_INFO_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_resp.h"
+
+
+/*
+ * Typed soundbar state: known fields of known messages are decoded to
+ * fixed layout structs, so consumers do not need to parse text.
+ * Schema: field id (LG_SPK_F_*) -> type + place in lg_spk_info_t,
+ * separate for every message.
+ */
+
+/* Known fields: lg_spk_field_name[] indexes. */
+#define LG_SPK_F_I_BASS			0
+#define LG_SPK_F_I_TREBLE		1
+#define LG_SPK_F_I_CURR_EQ		2
+#define LG_SPK_F_AI_EQ_LIST		3
+#define LG_SPK_F_I_VOL			4
+#define LG_SPK_F_I_VOL_MIN		5
+#define LG_SPK_F_I_VOL_MAX		6
+#define LG_SPK_F_B_MUTE			7
+#define LG_SPK_F_I_CURR_FUNC		8
+#define LG_SPK_F_B_POWERSTATUS		9
+#define LG_SPK_F_S_USER_NAME		10
+#define LG_SPK_F_AI_FUNC_LIST		11
+#define LG_SPK_F_I_REAR_LEVEL		12
+#define LG_SPK_F_I_REAR_MIN		13
+#define LG_SPK_F_I_REAR_MAX		14
+#define LG_SPK_F_B_REAR			15
+#define LG_SPK_F_I_WOOFER_LEVEL		16
+#define LG_SPK_F_I_WOOFER_MIN		17
+#define LG_SPK_F_I_WOOFER_MAX		18
+#define LG_SPK_F_B_NIGHT_TIME		19
+#define LG_SPK_F_B_AUTO_VOL		20
+#define LG_SPK_F_B_DRC			21
+#define LG_SPK_F_B_NEURALX		22
+#define LG_SPK_F_B_TV_REMOTE		23
+#define LG_SPK_F_B_AUTO_POWER		24
+#define LG_SPK_F_B_AUTO_DISPLAY		25
+#define LG_SPK_F_B_BT_STANDBY		26
+#define LG_SPK_F_B_CONN_BT_LIMIT	27
+#define LG_SPK_F_I_AV_SYNC		28
+#define LG_SPK_F_I_SLEEP_TIME		29
+#define LG_SPK_F_S_UUID			30
+#define LG_SPK_F_I_MODEL_NO		31
+#define LG_SPK_F_I_MODEL_TYPE		32
+#define LG_SPK_F_S_MODEL_NAME		33
+#define LG_SPK_F_COUNT			34
+
+extern const char *lg_spk_field_name[LG_SPK_F_COUNT];
+/* Field -> messages that have it: bit per lg_ctl_msg[] index. */
+extern const uint32_t lg_spk_field_msgs[LG_SPK_F_COUNT];
+
+
+/* EQ_VIEW_INFO */
+typedef struct lg_spk_eq_s {
+	int32_t		bass;
+	int32_t		treble;
+	int32_t		curr_eq;	/* lg_ctl_equalisers[] index. */
+	uint32_t	eq_list;	/* Bitmap of lg_ctl_equalisers[]. */
+} lg_spk_eq_t, *lg_spk_eq_p;
+
+/* SPK_LIST_VIEW_INFO */
+typedef struct lg_spk_list_s {
+	int32_t		vol;
+	int32_t		vol_min;
+	int32_t		vol_max;
+	int32_t		curr_func;	/* lg_ctl_functions[] index. */
+	uint8_t		mute;
+	uint8_t		power;
+	char		user_name[64];
+} lg_spk_list_t, *lg_spk_list_p;
+
+/* FUNC_VIEW_INFO */
+typedef struct lg_spk_func_s {
+	int32_t		curr_func;	/* lg_ctl_functions[] index. */
+	uint32_t	func_list;	/* Bitmap of lg_ctl_functions[]. */
+} lg_spk_func_t, *lg_spk_func_p;
+
+/* SETTING_VIEW_INFO */
+typedef struct lg_spk_setting_s {
+	int32_t		rear_level;
+	int32_t		rear_min;
+	int32_t		rear_max;
+	int32_t		woofer_level;
+	int32_t		woofer_min;
+	int32_t		woofer_max;
+	int32_t		av_sync;
+	int32_t		sleep_time;
+	uint8_t		rear;
+	uint8_t		night_time;
+	uint8_t		auto_vol;
+	uint8_t		drc;
+	uint8_t		neural_x;
+	uint8_t		tv_remote;
+	uint8_t		auto_power;
+	uint8_t		auto_display;
+	uint8_t		bt_standby;
+	uint8_t		bt_limit;
+	char		user_name[64];
+} lg_spk_setting_t, *lg_spk_setting_p;
+
+/* PRODUCT_INFO */
+typedef struct lg_spk_product_s {
+	int32_t		model_no;
+	int32_t		model_type;
+	char		uuid[40];
+	char		model_name[32];
+} lg_spk_product_t, *lg_spk_product_p;
+
+typedef struct lg_spk_info_s {
+	uint32_t	msgs;	/* Decoded: bit per lg_ctl_msg[] index. */
+	uint64_t	fields;	/* Decoded: bit per LG_SPK_F_*. */
+	lg_spk_eq_t	eq;
+	lg_spk_list_t	spk;
+	lg_spk_func_t	func;
+	lg_spk_setting_t setting;
+	lg_spk_product_t product;
+} lg_spk_info_t, *lg_spk_info_p;
+
+#define LG_SPK_INFO_HAS_MSG(__info, __msg_idx)				\
+	    (0 != ((__info)->msgs & (((uint32_t)1) << (__msg_idx))))
+#define LG_SPK_INFO_HAS_FIELD(__info, __field_id)			\
+	    (0 != ((__info)->fields & (((uint64_t)1) << (__field_id))))
+
+
+/* Decoder state, for use as lg_ctl_resp_cb. */
+typedef struct lg_spk_info_dec_s {
+	lg_spk_info_p	info;
+	uint32_t	*bitmap;	/* Array that is decoded now. */
+} lg_spk_info_dec_t, *lg_spk_info_dec_p;
+
+
+/* Returns LG_SPK_F_* or LG_SPK_F_COUNT if name is unknown. */
+size_t	lg_spk_field_id_get(const char *name, size_t name_size);
+
+void	lg_spk_info_dec_init(lg_spk_info_dec_p dec, lg_spk_info_p info);
+/* lg_ctl_resp_cb, udata: lg_spk_info_dec_p. */
+int	lg_spk_info_dec_cb(const lg_ctl_resp_t *resp,
+	    const lg_json_ev_t *ev, void *udata);
+/* Parse responce and update info. */
+int	lg_spk_info_decode(lg_spk_info_p info, const char *buf,
+	    size_t buf_size, lg_ctl_resp_p resp);
+
+
+#endif /* __LG_SPK_INFO_H__ */
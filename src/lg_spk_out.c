@@ -0,0 +1,899 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <stdio.h> /* snprintf, fprintf */
+#include <stdarg.h>
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_ev.h"
+#include "lg_mem.h"
+#include "lg_spk_out.h"
+#include "utils/mem_utils.h"
+
+
+#define LG_SPK_OUT_ALLOC_ALIGN	4096
+
+
+const char *lg_spk_out_fmt[LG_SPK_OUT_FMT_COUNT] = {
+	"tree",
+	"jsonl",
+	"kv"
+};
+
+
+int
+lg_spk_out_fmt_get(const char *name, const size_t name_size) {
+	int i;
+
+	for (i = 0; i < LG_SPK_OUT_FMT_COUNT; i ++) {
+		if (0 == strncmp(lg_spk_out_fmt[i], name, name_size) &&
+		    0 == lg_spk_out_fmt[i][name_size])
+			return (i);
+	}
+
+	return (LG_SPK_OUT_FMT_COUNT);
+}
+
+void
+lg_spk_out_init(lg_spk_out_p out, const int fmt, const int fd) {
+
+	if (NULL == out)
+		return;
+	memset(out, 0x00, sizeof(lg_spk_out_t));
+	out->fmt = fmt;
+	out->fd = fd;
+}
+
+void
+lg_spk_out_destroy(lg_spk_out_p out) {
+
+	if (NULL == out)
+		return;
+	lg_free(out->buf);
+	memset(out, 0x00, sizeof(lg_spk_out_t));
+}
+
+int
+lg_spk_out_flush(lg_spk_out_p out) {
+	int error = 0;
+	ssize_t ios;
+	size_t off = 0;
+
+	if (NULL == out)
+		return (EINVAL);
+	while (off < out->size) {
+		ios = write(out->fd, (out->buf + off), (out->size - off));
+		if (-1 == ios) {
+			error = errno;
+			if (EINTR == error) {
+				error = 0;
+				continue;
+			}
+			break;
+		}
+		off += (size_t)ios;
+	}
+	/* Data is dropped on error: buffer must not grow forever. */
+	out->size = 0;
+
+	return (error);
+}
+
+int
+lg_spk_out_batch(lg_spk_out_p out) {
+
+	if (NULL == out)
+		return (EINVAL);
+	if (LG_SPK_OUT_BATCH_SIZE > out->size)
+		return (0);
+
+	return (lg_spk_out_flush(out));
+}
+
+/* Make sure that size bytes can be appended. */
+static int
+lg_spk_out_reserve(lg_spk_out_p out, const size_t size) {
+	size_t allocated;
+	uint8_t *buf;
+
+	if ((out->allocated - out->size) >= size)
+		return (0);
+	allocated = roundup((out->size + size + (out->allocated / 2)),
+	    LG_SPK_OUT_ALLOC_ALIGN);
+	buf = lg_realloc(out->buf, allocated);
+	if (NULL == buf)
+		return (ENOMEM);
+	out->buf = buf;
+	out->allocated = allocated;
+
+	return (0);
+}
+
+int
+lg_spk_out_write(lg_spk_out_p out, const void *data, const size_t size) {
+	int error;
+
+	if (NULL == out || (NULL == data && 0 != size))
+		return (EINVAL);
+	error = lg_spk_out_reserve(out, size);
+	if (0 != error)
+		return (error);
+	memcpy((out->buf + out->size), data, size);
+	out->size += size;
+
+	return (0);
+}
+
+static int
+lg_spk_out_vprintf(lg_spk_out_p out, const char *fmt, va_list ap) {
+	int error, ret;
+	va_list ap_copy;
+
+	for (;;) {
+		va_copy(ap_copy, ap);
+		ret = vsnprintf((char*)(out->buf + out->size),
+		    (out->allocated - out->size), fmt, ap_copy);
+		va_end(ap_copy);
+		if (0 > ret)
+			return (EINVAL);
+		if ((size_t)ret < (out->allocated - out->size))
+			break;
+		error = lg_spk_out_reserve(out, ((size_t)ret + 1));
+		if (0 != error)
+			return (error);
+	}
+	out->size += (size_t)ret;
+
+	return (0);
+}
+
+int
+lg_spk_out_printf(lg_spk_out_p out, const char *fmt, ...) {
+	int error;
+	va_list ap;
+
+	if (NULL == out || NULL == fmt)
+		return (EINVAL);
+	va_start(ap, fmt);
+	error = lg_spk_out_vprintf(out, fmt, ap);
+	va_end(ap);
+
+	return (error);
+}
+
+/* JSON string escape, without quotes. */
+static int
+lg_spk_out_esc(lg_spk_out_p out, const char *str, const size_t str_size) {
+	int error;
+	size_t i;
+	uint8_t *ptr;
+	static const char *hex = "0123456789abcdef";
+
+	/* Worst case: \u00XX for every char. */
+	error = lg_spk_out_reserve(out, (str_size * 6));
+	if (0 != error)
+		return (error);
+	ptr = (out->buf + out->size);
+	for (i = 0; i < str_size; i ++) {
+		switch (str[i]) {
+		case '"':
+		case '\\':
+			(*ptr ++) = '\\';
+			(*ptr ++) = (uint8_t)str[i];
+			break;
+		default:
+			if (0x20 <= (uint8_t)str[i]) {
+				(*ptr ++) = (uint8_t)str[i];
+				break;
+			}
+			memcpy(ptr, "\\u00", 4);
+			ptr[4] = (uint8_t)hex[(((uint8_t)str[i]) >> 4)];
+			ptr[5] = (uint8_t)hex[(((uint8_t)str[i]) & 0x0f)];
+			ptr += 6;
+		}
+	}
+	out->size = (size_t)(ptr - out->buf);
+
+	return (0);
+}
+
+/* Copy JSON text without whitespace outside of strings.
+ * Strings are already escaped: raw control chars are not allowed
+ * inside, so result is always one line. */
+static int
+lg_spk_out_json_compact(lg_spk_out_p out, const char *json,
+    const size_t json_size, const int esc) {
+	int error, in_str = 0;
+	size_t i;
+	uint8_t *ptr;
+
+	error = lg_spk_out_reserve(out, ((0 != esc) ? (json_size * 2) :
+	    json_size));
+	if (0 != error)
+		return (error);
+	ptr = (out->buf + out->size);
+	for (i = 0; i < json_size; i ++) {
+		if (0 != in_str) {
+			if ('"' == json[i]) {
+				in_str = 0;
+			} else if ('\\' == json[i] && (i + 1) < json_size) {
+				if (0 != esc) {
+					(*ptr ++) = '\\';
+				}
+				(*ptr ++) = (uint8_t)json[i ++];
+			}
+		} else {
+			switch (json[i]) {
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\n':
+				continue;
+			case '"':
+				in_str = 1;
+				break;
+			}
+		}
+		if (0 != esc && ('"' == json[i] || '\\' == json[i])) {
+			(*ptr ++) = '\\';
+		}
+		(*ptr ++) = (uint8_t)json[i];
+	}
+	out->size = (size_t)(ptr - out->buf);
+
+	return (0);
+}
+
+
+int
+lg_spk_out_rec_begin(lg_spk_out_p out) {
+
+	if (NULL == out)
+		return (EINVAL);
+	out->rec_cnt = 0;
+	if (LG_SPK_OUT_FMT_JSONL != out->fmt)
+		return (0);
+
+	return (lg_spk_out_write(out, "{", 1));
+}
+
+/* Separator and key: path + name, path is "" if none. */
+static int
+lg_spk_out_rec_key(lg_spk_out_p out, const char *path,
+    const size_t path_size, const char *name, const size_t name_size) {
+	int error;
+
+	switch (out->fmt) {
+	case LG_SPK_OUT_FMT_TREE:
+		error = lg_spk_out_printf(out, "%s%.*s%.*s: ",
+		    ((0 != out->rec_cnt) ? ", " : ""),
+		    (int)path_size, path, (int)name_size, name);
+		break;
+	case LG_SPK_OUT_FMT_JSONL:
+		error = lg_spk_out_printf(out, "%s\"%.*s%.*s\":",
+		    ((0 != out->rec_cnt) ? "," : ""),
+		    (int)path_size, path, (int)name_size, name);
+		break;
+	case LG_SPK_OUT_FMT_KV:
+		error = lg_spk_out_printf(out, "%s%.*s%.*s=",
+		    ((0 != out->rec_cnt) ? " " : ""),
+		    (int)path_size, path, (int)name_size, name);
+		break;
+	default:
+		error = EINVAL;
+	}
+	out->rec_cnt ++;
+
+	return (error);
+}
+
+/* kv: string value is quoted only if it has to be. */
+static int
+lg_spk_out_kv_is_bare(const char *str, const size_t str_size) {
+	size_t i;
+
+	if (0 == str_size)
+		return (0);
+	for (i = 0; i < str_size; i ++) {
+		if (' ' >= (uint8_t)str[i] || '"' == str[i] ||
+		    '=' == str[i] || '\\' == str[i])
+			return (0);
+	}
+
+	return (1);
+}
+
+static int
+lg_spk_out_val_str(lg_spk_out_p out, const char *str,
+    const size_t str_size) {
+	int error;
+
+	if (LG_SPK_OUT_FMT_TREE == out->fmt ||
+	    (LG_SPK_OUT_FMT_KV == out->fmt &&
+	    0 != lg_spk_out_kv_is_bare(str, str_size)))
+		return (lg_spk_out_write(out, str, str_size));
+	error = lg_spk_out_write(out, "\"", 1);
+	if (0 != error)
+		return (error);
+	error = lg_spk_out_esc(out, str, str_size);
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_out_write(out, "\"", 1));
+}
+
+static int
+lg_spk_out_val_json(lg_spk_out_p out, const char *json,
+    const size_t json_size) {
+	int error;
+
+	if (0 == json_size)
+		return (lg_spk_out_write(out, "null", 4));
+	switch (json[0]) {
+	case '"':
+		if (LG_SPK_OUT_FMT_TREE == out->fmt && 2 <= json_size)
+			return (lg_spk_out_write(out, (json + 1),
+			    (json_size - 2)));
+		return (lg_spk_out_write(out, json, json_size));
+	case '{':
+	case '[':
+		if (LG_SPK_OUT_FMT_KV != out->fmt)
+			return (lg_spk_out_json_compact(out, json, json_size,
+			    0));
+		/* kv: as quoted string. */
+		error = lg_spk_out_write(out, "\"", 1);
+		if (0 != error)
+			return (error);
+		error = lg_spk_out_json_compact(out, json, json_size, 1);
+		if (0 != error)
+			return (error);
+		return (lg_spk_out_write(out, "\"", 1));
+	}
+
+	return (lg_spk_out_write(out, json, json_size));
+}
+
+int
+lg_spk_out_rec_str(lg_spk_out_p out, const char *name,
+    const char *str, const size_t str_size) {
+	int error;
+
+	if (NULL == out || NULL == name || (NULL == str && 0 != str_size))
+		return (EINVAL);
+	error = lg_spk_out_rec_key(out, "", 0, name, strlen(name));
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_out_val_str(out, str, str_size));
+}
+
+int
+lg_spk_out_rec_json(lg_spk_out_p out, const char *name,
+    const char *json, const size_t json_size) {
+	int error;
+
+	if (NULL == out || NULL == name || (NULL == json && 0 != json_size))
+		return (EINVAL);
+	error = lg_spk_out_rec_key(out, "", 0, name, strlen(name));
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_out_val_json(out, json, json_size));
+}
+
+int
+lg_spk_out_rec_fmt(lg_spk_out_p out, const char *name,
+    const char *fmt, ...) {
+	int error;
+	va_list ap;
+
+	if (NULL == out || NULL == name || NULL == fmt)
+		return (EINVAL);
+	error = lg_spk_out_rec_key(out, "", 0, name, strlen(name));
+	if (0 != error)
+		return (error);
+	va_start(ap, fmt);
+	error = lg_spk_out_vprintf(out, fmt, ap);
+	va_end(ap);
+
+	return (error);
+}
+
+int
+lg_spk_out_rec_end(lg_spk_out_p out) {
+
+	if (NULL == out)
+		return (EINVAL);
+	if (LG_SPK_OUT_FMT_JSONL == out->fmt)
+		return (lg_spk_out_write(out, "}\n", 2));
+
+	return (lg_spk_out_write(out, "\n", 1));
+}
+
+
+void
+lg_spk_out_resp_begin(lg_spk_out_p out, const char *target,
+    lg_spk_info_dec_p dec) {
+
+	if (NULL == out)
+		return;
+	out->target = target;
+	out->dec = dec;
+	out->hdr_done = 0;
+	out->resp_size = out->size;
+	out->skip_depth = 0;
+	out->drop_depth = 0;
+	out->data_cnt = 0;
+	out->descr = NULL;
+	out->descr_cnt = 0;
+	out->path_size = 0;
+}
+
+/* Header: target and message name, tree: own line, others: first
+ * values of record. */
+static int
+lg_spk_out_resp_hdr(lg_spk_out_p out, const lg_ctl_resp_t *resp) {
+	int error;
+	const char *msg = resp->msg;
+	size_t msg_size = resp->msg_size;
+
+	if (0 != out->hdr_done)
+		return (0);
+	out->hdr_done = 1;
+	if (LG_CTL_MSG_COUNT > resp->msg_idx) {
+		msg = lg_ctl_msg[resp->msg_idx];
+		msg_size = strlen(msg);
+	}
+	if (LG_SPK_OUT_FMT_TREE == out->fmt) {
+		if (0 != out->ts) {
+			error = lg_spk_out_printf(out, "%"PRIu64" ", out->ts);
+			if (0 != error)
+				return (error);
+		}
+		if (NULL != out->target)
+			return (lg_spk_out_printf(out, "%s: %.*s\n",
+			    out->target, (int)msg_size, msg));
+		return (lg_spk_out_printf(out, "%.*s\n",
+		    (int)msg_size, msg));
+	}
+	error = lg_spk_out_rec_begin(out);
+	if (0 != error)
+		return (error);
+	if (0 != out->ts) {
+		error = lg_spk_out_rec_fmt(out, "ts", "%"PRIu64, out->ts);
+		if (0 != error)
+			return (error);
+	}
+	if (NULL != out->target) {
+		error = lg_spk_out_rec_str(out, "target", out->target,
+		    strlen(out->target));
+		if (0 != error)
+			return (error);
+	}
+	error = lg_spk_out_rec_str(out, "msg", msg, msg_size);
+	if (0 != error)
+		return (error);
+	if (0 != resp->result)
+		return (lg_spk_out_rec_str(out, "result", "ok", 2));
+
+	return (lg_spk_out_rec_str(out, "result", "fail", 4));
+}
+
+/* Printable string value: decode escapes if it fits to buf. */
+static void
+lg_spk_out_tree_str(const lg_json_ev_t *ev, char *buf, const size_t buf_size,
+    const char **str, int *str_size) {
+	size_t size;
+
+	if (0 != (LG_JSON_EV_F_ESC & ev->flags) &&
+	    0 == lg_json_str_unescape(ev->value, ev->value_size,
+	    buf, buf_size, &size)) {
+		(*str) = buf;
+		(*str_size) = (int)size;
+		return;
+	}
+	(*str) = ev->value;
+	(*str_size) = (int)ev->value_size;
+}
+
+static int
+lg_spk_out_tree_cb(lg_spk_out_p out, const lg_json_ev_t *ev) {
+	const char *tabs = "						";
+	const char **descr = NULL, *str;
+	size_t descr_cnt = 0;
+	int level = (int)ev->depth, str_size;
+	char buf[1024];
+
+	if (0 != out->skip_depth) {
+		if (out->skip_depth == ev->depth &&
+		    (LG_JSON_EV_OBJ_END == ev->type ||
+		    LG_JSON_EV_ARR_END == ev->type)) {
+			out->skip_depth = 0;
+		}
+		return (0);
+	}
+
+	if (NULL == ev->name) { /* Array item. */
+		switch (ev->type) {
+		case LG_JSON_EV_STRING:
+			lg_spk_out_tree_str(ev, buf, sizeof(buf), &str,
+			    &str_size);
+			return (lg_spk_out_printf(out, "%.*s%.*s\n",
+			    level, tabs,
+			    str_size, str));
+		case LG_JSON_EV_NUMBER:
+			if (NULL == out->descr ||
+			    0 == (LG_JSON_EV_F_INT & ev->flags) ||
+			    0 > ev->num ||
+			    out->descr_cnt <= (size_t)ev->num)
+				return (lg_spk_out_printf(out, "%.*s%.*s\n",
+				    level, tabs,
+				    (int)ev->value_size, ev->value));
+			return (lg_spk_out_printf(out, "%.*s%-2.*s: %s\n",
+			    level, tabs,
+			    (int)ev->value_size, ev->value,
+			    out->descr[ev->num]));
+		case LG_JSON_EV_OBJ_BEGIN:
+			out->skip_depth = ev->depth;
+			return (lg_spk_out_printf(out, "%.*s%s\n",
+			    level, tabs,
+			    "object"));
+		case LG_JSON_EV_ARR_BEGIN:
+			out->skip_depth = ev->depth;
+			return (lg_spk_out_printf(out, "%.*s%s\n",
+			    level, tabs,
+			    "array"));
+		case LG_JSON_EV_TRUE:
+			return (lg_spk_out_printf(out, "%.*s%s\n",
+			    level, tabs,
+			    "true"));
+		case LG_JSON_EV_FALSE:
+			return (lg_spk_out_printf(out, "%.*s%s\n",
+			    level, tabs,
+			    "false"));
+		case LG_JSON_EV_NULL:
+			return (lg_spk_out_printf(out, "%.*s%s\n",
+			    level, tabs,
+			    "null"));
+		}
+		return (0);
+	}
+
+	/* Object member: values of some fields have descriptions. */
+	switch (lg_spk_field_id_get(ev->name, ev->name_size)) {
+	case LG_SPK_F_I_CURR_EQ:
+	case LG_SPK_F_AI_EQ_LIST:
+		descr = lg_ctl_equalisers;
+		descr_cnt = nitems(lg_ctl_equalisers);
+		break;
+	case LG_SPK_F_I_CURR_FUNC:
+	case LG_SPK_F_AI_FUNC_LIST:
+		descr = lg_ctl_functions;
+		descr_cnt = nitems(lg_ctl_functions);
+		break;
+	}
+	switch (ev->type) {
+	case LG_JSON_EV_STRING:
+		lg_spk_out_tree_str(ev, buf, sizeof(buf), &str, &str_size);
+		return (lg_spk_out_printf(out, "%.*s%.*s: %.*s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name, str_size, str));
+	case LG_JSON_EV_NUMBER:
+		if (0 == (LG_JSON_EV_F_INT & ev->flags) ||
+		    0 > ev->num ||
+		    descr_cnt <= (size_t)ev->num)
+			return (lg_spk_out_printf(out, "%.*s%.*s: %.*s\n",
+			    level, tabs,
+			    (int)ev->name_size, ev->name,
+			    (int)ev->value_size, ev->value));
+		return (lg_spk_out_printf(out, "%.*s%.*s: %.*s - %s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name,
+		    (int)ev->value_size, ev->value,
+		    descr[ev->num]));
+	case LG_JSON_EV_OBJ_BEGIN:
+		return (lg_spk_out_printf(out, "%.*s%.*s: %s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name, "object"));
+	case LG_JSON_EV_ARR_BEGIN:
+		out->descr = descr;
+		out->descr_cnt = descr_cnt;
+		return (lg_spk_out_printf(out, "%.*s%.*s: %s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name, "array"));
+	case LG_JSON_EV_ARR_END:
+		out->descr = NULL;
+		out->descr_cnt = 0;
+		break;
+	case LG_JSON_EV_TRUE:
+		return (lg_spk_out_printf(out, "%.*s%.*s: %s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name, "true"));
+	case LG_JSON_EV_FALSE:
+		return (lg_spk_out_printf(out, "%.*s%.*s: %s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name, "false"));
+	case LG_JSON_EV_NULL:
+		return (lg_spk_out_printf(out, "%.*s%.*s: %s\n",
+		    level, tabs,
+		    (int)ev->name_size, ev->name, "null"));
+	}
+
+	return (0);
+}
+
+/* Flat: members of nested objects get dotted keys, arrays are
+ * formatted as whole values. */
+static int
+lg_spk_out_kv_cb(lg_spk_out_p out, const lg_json_ev_t *ev) {
+	int error;
+
+	if (0 != out->skip_depth) {
+		if (out->skip_depth != ev->depth ||
+		    LG_JSON_EV_ARR_END != ev->type)
+			return (0);
+		out->skip_depth = 0;
+	}
+	if (NULL == ev->name)
+		return (0);
+
+	switch (ev->type) {
+	case LG_JSON_EV_OBJ_BEGIN:
+		if (LG_JSON_DEPTH_MAX <= ev->depth ||
+		    (ev->name_size + 1) >
+		    (sizeof(out->path) - out->path_size))
+			return (ENOBUFS);
+		out->obj_size[ev->depth] = out->path_size;
+		memcpy((out->path + out->path_size), ev->name, ev->name_size);
+		out->path_size += ev->name_size;
+		out->path[out->path_size ++] = '.';
+		return (0);
+	case LG_JSON_EV_OBJ_END:
+		if (LG_JSON_DEPTH_MAX > ev->depth) {
+			out->path_size = out->obj_size[ev->depth];
+		}
+		return (0);
+	case LG_JSON_EV_ARR_BEGIN:
+		out->skip_depth = ev->depth;
+		return (0);
+	}
+	error = lg_spk_out_rec_key(out, out->path, out->path_size,
+	    ev->name, ev->name_size);
+	if (0 != error)
+		return (error);
+	if (LG_JSON_EV_STRING == ev->type) /* Already escaped. */
+		return (lg_spk_out_val_json(out, (ev->value - 1),
+		    (ev->value_size + 2)));
+
+	return (lg_spk_out_val_json(out, ev->value, ev->value_size));
+}
+
+/* jsonl + query: "data" with wanted members only. */
+static int
+lg_spk_out_jsonl_cb(lg_spk_out_p out, const lg_ctl_resp_t *resp,
+    const lg_json_ev_t *ev) {
+	int error;
+
+	if (1 != ev->depth ||
+	    LG_JSON_EV_OBJ_BEGIN == ev->type ||
+	    LG_JSON_EV_ARR_BEGIN == ev->type)
+		return (0); /* Objects and arrays: whole text on end. */
+	error = lg_spk_out_resp_hdr(out, resp);
+	if (0 != error)
+		return (error);
+	error = lg_spk_out_printf(out, "%s\"%.*s\":",
+	    ((0 != out->data_cnt) ? "," : ",\"data\":{"),
+	    (int)ev->name_size, ev->name);
+	if (0 != error)
+		return (error);
+	out->data_cnt ++;
+	if (LG_JSON_EV_STRING == ev->type) /* Already escaped. */
+		return (lg_spk_out_val_json(out, (ev->value - 1),
+		    (ev->value_size + 2)));
+
+	return (lg_spk_out_val_json(out, ev->value, ev->value_size));
+}
+
+int
+lg_spk_out_resp_cb(const lg_ctl_resp_t *resp, const lg_json_ev_t *ev,
+    void *udata) {
+	int error;
+	lg_spk_out_p out = udata;
+
+	if (NULL != out->dec) {
+		error = lg_spk_info_dec_cb(resp, ev, out->dec);
+		if (0 != error)
+			return (error);
+	}
+	if (0 != out->drop_depth) {
+		if (out->drop_depth == ev->depth &&
+		    (LG_JSON_EV_OBJ_END == ev->type ||
+		    LG_JSON_EV_ARR_END == ev->type)) {
+			out->drop_depth = 0;
+		}
+		return (0);
+	}
+	if (NULL != out->query && 1 == ev->depth &&
+	    0 == lg_spk_query_match(out->query, resp->msg_idx,
+	    ev->name, ev->name_size)) {
+		if (LG_JSON_EV_OBJ_BEGIN == ev->type ||
+		    LG_JSON_EV_ARR_BEGIN == ev->type) {
+			out->drop_depth = ev->depth;
+		}
+		return (0);
+	}
+	switch (out->fmt) {
+	case LG_SPK_OUT_FMT_TREE:
+		if (0 == ev->depth) /* "data" object. */
+			return (lg_spk_out_resp_hdr(out, resp));
+		return (lg_spk_out_tree_cb(out, ev));
+	case LG_SPK_OUT_FMT_KV:
+		if (0 == ev->depth)
+			return (lg_spk_out_resp_hdr(out, resp));
+		return (lg_spk_out_kv_cb(out, ev));
+	}
+	/* jsonl: "data" is copied as whole by lg_spk_out_resp_end(). */
+	if (NULL != out->query)
+		return (lg_spk_out_jsonl_cb(out, resp, ev));
+
+	return (0);
+}
+
+int
+lg_spk_out_resp_end(lg_spk_out_p out, const lg_ctl_resp_t *resp) {
+	int error;
+
+	if (NULL == out || NULL == resp)
+		return (EINVAL);
+	/* Nothing was formatted if result is not ok. */
+	error = lg_spk_out_resp_hdr(out, resp);
+	if (0 != error)
+		return (error);
+	switch (out->fmt) {
+	case LG_SPK_OUT_FMT_TREE:
+		if (0 == resp->result || NULL == resp->data)
+			return (0);
+		return (lg_spk_out_write(out, "\n", 1));
+	case LG_SPK_OUT_FMT_JSONL:
+		if (NULL != out->query) {
+			if (0 == out->data_cnt)
+				break;
+			error = lg_spk_out_write(out, "}", 1);
+			if (0 != error)
+				return (error);
+			break;
+		}
+		if (0 != resp->result && NULL != resp->data) {
+			error = lg_spk_out_rec_json(out, "data", resp->data,
+			    resp->data_size);
+			if (0 != error)
+				return (error);
+		}
+		break;
+	}
+
+	return (lg_spk_out_rec_end(out));
+}
+
+void
+lg_spk_out_resp_abort(lg_spk_out_p out) {
+
+	if (NULL == out)
+		return;
+	/* Nothing is flushed inside record. */
+	out->size = MIN(out->size, out->resp_size);
+}
+
+
+int
+lg_spk_out_stats(lg_spk_out_p out, const lg_spk_stats_t *stats,
+    const lg_spk_target_t *targets) {
+	int error;
+	size_t pos = 0;
+	double elapsed;
+	const char *stage, *scope;
+	lg_spk_stats_ent_t ent;
+	lg_spk_hist_sum_t sum;
+
+	if (NULL == out || NULL == stats || NULL == targets)
+		return (EINVAL);
+	elapsed = ((double)MAX(1, (lg_ev_time_us() - stats->ts_start)) /
+	    1000000);
+	if (LG_SPK_OUT_FMT_TREE == out->fmt) {
+		lg_spk_out_printf(out, "stats: %.3f s, rx: %"PRIu64" frames, "
+		    "%"PRIu64" bytes, %.1f frames/s, %.1f KiB/s, "
+		    "tx: %"PRIu64" bytes\n",
+		    elapsed, stats->rx_frames, stats->rx_bytes,
+		    ((double)stats->rx_frames / elapsed),
+		    ((double)stats->rx_bytes / elapsed / 1024),
+		    stats->tx_bytes);
+		error = lg_spk_out_printf(out,
+		    "%-8s %-24s %10s %8s %8s %8s %8s %8s %8s %10s\n",
+		    "stage", "msg / target", "count", "min", "mean", "p50",
+		    "p90", "p99", "p99.9", "max, us");
+	} else {
+		lg_spk_out_rec_begin(out);
+		lg_spk_out_rec_fmt(out, "elapsed_ms", "%.3f", (elapsed * 1000));
+		lg_spk_out_rec_fmt(out, "rx_frames", "%"PRIu64,
+		    stats->rx_frames);
+		lg_spk_out_rec_fmt(out, "rx_bytes", "%"PRIu64, stats->rx_bytes);
+		lg_spk_out_rec_fmt(out, "tx_bytes", "%"PRIu64, stats->tx_bytes);
+		error = lg_spk_out_rec_end(out);
+	}
+	while (0 == error && 0 == lg_spk_stats_next(stats, &pos, &ent)) {
+		lg_spk_hist_sum(ent.hist, &sum);
+		stage = lg_spk_stat_name(ent.stat);
+		if (LG_SPK_STATS_ALL != ent.target) {
+			scope = targets[ent.target].name;
+		} else if (LG_SPK_STATS_ALL != ent.msg_idx) {
+			scope = ((LG_CTL_MSG_COUNT > ent.msg_idx) ?
+			    lg_ctl_msg[ent.msg_idx] : "other");
+		} else {
+			scope = "all";
+		}
+		if (LG_SPK_OUT_FMT_TREE == out->fmt) {
+			error = lg_spk_out_printf(out,
+			    "%-8s %-24s %10"PRIu64" %8"PRIu64" %8"PRIu64
+			    " %8"PRIu64" %8"PRIu64" %8"PRIu64" %8"PRIu64
+			    " %10"PRIu64"\n",
+			    stage, scope, sum.cnt, sum.min, sum.mean, sum.p50,
+			    sum.p90, sum.p99, sum.p999, sum.max);
+			continue;
+		}
+		lg_spk_out_rec_begin(out);
+		lg_spk_out_rec_str(out, "stage", stage, strlen(stage));
+		if (LG_SPK_STATS_ALL != ent.target) {
+			lg_spk_out_rec_str(out, "target", scope, strlen(scope));
+		} else if (LG_SPK_STATS_ALL != ent.msg_idx) {
+			lg_spk_out_rec_str(out, "msg", scope, strlen(scope));
+		}
+		lg_spk_out_rec_fmt(out, "count", "%"PRIu64, sum.cnt);
+		lg_spk_out_rec_fmt(out, "min_us", "%"PRIu64, sum.min);
+		lg_spk_out_rec_fmt(out, "mean_us", "%"PRIu64, sum.mean);
+		lg_spk_out_rec_fmt(out, "p50_us", "%"PRIu64, sum.p50);
+		lg_spk_out_rec_fmt(out, "p90_us", "%"PRIu64, sum.p90);
+		lg_spk_out_rec_fmt(out, "p99_us", "%"PRIu64, sum.p99);
+		lg_spk_out_rec_fmt(out, "p999_us", "%"PRIu64, sum.p999);
+		lg_spk_out_rec_fmt(out, "max_us", "%"PRIu64, sum.max);
+		error = lg_spk_out_rec_end(out);
+	}
+
+	return (error);
+}
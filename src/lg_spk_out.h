@@ -0,0 +1,141 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_OUT_H__
+#define __LG_SPK_OUT_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_json.h"
+#include "lg_ctl_resp.h"
+#include "lg_spk_info.h"
+#include "lg_spk_query.h"
+#include "lg_spk_engine.h"
+#include "lg_spk_stats.h"
+
+
+/*
+ * Buffered output: everything is formatted into one reusable buffer
+ * and written by single write() on flush, buffer grows only while it
+ * is smaller than largest batch.
+ *
+ * Formats:
+ * tree - human readable, responce fields are indented by depth;
+ * jsonl - one JSON object per line;
+ * kv - one line of key=value pairs per record, nested object members
+ * have dotted keys, strings and arrays are quoted.
+ */
+
+#define LG_SPK_OUT_FMT_TREE	0
+#define LG_SPK_OUT_FMT_JSONL	1
+#define LG_SPK_OUT_FMT_KV	2
+#define LG_SPK_OUT_FMT_COUNT	3
+
+extern const char *lg_spk_out_fmt[LG_SPK_OUT_FMT_COUNT];
+
+/* lg_spk_out_batch() writes buffer out if it holds more. */
+#define LG_SPK_OUT_BATCH_SIZE	(64 * 1024)
+#define LG_SPK_OUT_PATH_MAX	1024
+
+typedef struct lg_spk_out_s {
+	int		fmt;		/* LG_SPK_OUT_FMT_* */
+	int		fd;
+	uint8_t		*buf;
+	size_t		size;		/* Used. */
+	size_t		allocated;
+	size_t		rec_cnt;	/* Values in current record. */
+	const lg_spk_query_t *query;	/* Responce fields to format, NULL - all. */
+	/* Responce formatting state. */
+	const char	*target;	/* May be NULL. */
+	uint64_t	ts;		/* Unix time, ms, 0 - not shown. */
+	lg_spk_info_dec_p dec;		/* Typed decoder to call, may be NULL. */
+	int		hdr_done;
+	size_t		resp_size;	/* size at lg_spk_out_resp_begin(). */
+	size_t		skip_depth;	/* Do not format deeper, 0 - none. */
+	size_t		drop_depth;	/* Not wanted by query, 0 - none. */
+	size_t		data_cnt;	/* jsonl + query: members formatted. */
+	const char	**descr;	/* Current array items descriptions. */
+	size_t		descr_cnt;
+	size_t		path_size;	/* kv: dotted path of current object. */
+	size_t		obj_size[LG_JSON_DEPTH_MAX];
+	char		path[LG_SPK_OUT_PATH_MAX];
+} lg_spk_out_t, *lg_spk_out_p;
+
+
+/* Returns LG_SPK_OUT_FMT_COUNT if name is unknown. */
+int	lg_spk_out_fmt_get(const char *name, size_t name_size);
+
+void	lg_spk_out_init(lg_spk_out_p out, int fmt, int fd);
+/* Does not flush. */
+void	lg_spk_out_destroy(lg_spk_out_p out);
+int	lg_spk_out_flush(lg_spk_out_p out);
+/* Flush only if buffer is larger than LG_SPK_OUT_BATCH_SIZE. */
+int	lg_spk_out_batch(lg_spk_out_p out);
+
+int	lg_spk_out_write(lg_spk_out_p out, const void *data, size_t size);
+int	lg_spk_out_printf(lg_spk_out_p out, const char *fmt, ...)
+	    __attribute__((__format__(__printf__, 2, 3)));
+
+/* Record: flat list of named values, one line in any format. */
+int	lg_spk_out_rec_begin(lg_spk_out_p out);
+/* Plain string, escaped as needed. */
+int	lg_spk_out_rec_str(lg_spk_out_p out, const char *name,
+	    const char *str, size_t str_size);
+/* JSON value text: number, literal, quoted string, object or array. */
+int	lg_spk_out_rec_json(lg_spk_out_p out, const char *name,
+	    const char *json, size_t json_size);
+/* Unquoted value: numbers. */
+int	lg_spk_out_rec_fmt(lg_spk_out_p out, const char *name,
+	    const char *fmt, ...)
+	    __attribute__((__format__(__printf__, 3, 4)));
+int	lg_spk_out_rec_end(lg_spk_out_p out);
+
+/* Responce: lg_spk_out_resp_begin(), lg_ctl_resp_parse() with
+ * lg_spk_out_resp_cb() and out as udata, lg_spk_out_resp_end().
+ * target: may be NULL; dec: typed decoder to call, may be NULL.
+ * out->ts is not reset: set it before lg_ctl_resp_parse() to show
+ * responce time. */
+void	lg_spk_out_resp_begin(lg_spk_out_p out, const char *target,
+	    lg_spk_info_dec_p dec);
+int	lg_spk_out_resp_cb(const lg_ctl_resp_t *resp,
+	    const lg_json_ev_t *ev, void *udata);
+int	lg_spk_out_resp_end(lg_spk_out_p out, const lg_ctl_resp_t *resp);
+/* Parse or later failed: drop partly formatted responce, NULL safe. */
+void	lg_spk_out_resp_abort(lg_spk_out_p out);
+
+/* Stats: throughput, then one line per not empty histogram, in us.
+ * targets: names for per target histograms. */
+int	lg_spk_out_stats(lg_spk_out_p out, const lg_spk_stats_t *stats,
+	    const lg_spk_target_t *targets);
+
+
+#endif /* __LG_SPK_OUT_H__ */
@@ -0,0 +1,178 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <strings.h> /* ffs */
+#include <errno.h>
+
+#include "lg_spk_query.h"
+
+
+#define LG_SPK_QUERY_MSG_BIT(__msg_idx)	(((uint32_t)1) << (__msg_idx))
+#define LG_SPK_QUERY_GET_MSGS						\
+	    ((((uint32_t)1) << LG_CTL_MSG_GET_COUNT) - 1)
+
+
+void
+lg_spk_query_init(lg_spk_query_p query) {
+
+	if (NULL == query)
+		return;
+	memset(query, 0x00, sizeof(lg_spk_query_t));
+}
+
+int
+lg_spk_query_add(lg_spk_query_p query, const char *path,
+    const size_t path_size) {
+	size_t msg_size;
+	const char *dot;
+	lg_spk_query_fld_p fld;
+
+	if (NULL == query || NULL == path || 0 == path_size)
+		return (EINVAL);
+	if (LG_SPK_QUERY_MAX <= query->cnt)
+		return (ENOBUFS);
+	fld = &query->fld[query->cnt];
+	dot = memchr(path, '.', path_size);
+	msg_size = ((NULL != dot) ? (size_t)(dot - path) : path_size);
+	fld->msg_idx = lg_ctl_msg_idx_get(path, msg_size);
+	if (LG_CTL_MSG_GET_COUNT <= fld->msg_idx) {
+		/* Not a message: must be known field. */
+		if (NULL != dot)
+			return (EINVAL);
+		fld->msg_idx = LG_CTL_MSG_COUNT;
+		fld->field_id = lg_spk_field_id_get(path, path_size);
+		if (LG_SPK_F_COUNT == fld->field_id)
+			return (EINVAL);
+		fld->name = path;
+		fld->name_size = path_size;
+		query->cnt ++;
+		return (0);
+	}
+	if (NULL == dot) { /* Whole message. */
+		fld->field_id = LG_SPK_F_COUNT;
+		fld->name = NULL;
+		fld->name_size = 0;
+		query->msgs |= LG_SPK_QUERY_MSG_BIT(fld->msg_idx);
+		query->msgs_all |= LG_SPK_QUERY_MSG_BIT(fld->msg_idx);
+		query->cnt ++;
+		return (0);
+	}
+	fld->name = (dot + 1);
+	fld->name_size = (path_size - msg_size - 1);
+	if (0 == fld->name_size ||
+	    NULL != memchr(fld->name, '.', fld->name_size))
+		return (EINVAL); /* Top level members only. */
+	fld->field_id = lg_spk_field_id_get(fld->name, fld->name_size);
+	query->msgs |= LG_SPK_QUERY_MSG_BIT(fld->msg_idx);
+	query->cnt ++;
+
+	return (0);
+}
+
+int
+lg_spk_query_plan(lg_spk_query_p query) {
+	size_t i, best, left;
+	uint32_t msgs;
+	size_t cover[LG_CTL_MSG_GET_COUNT], size[LG_CTL_MSG_GET_COUNT];
+	lg_spk_query_fld_p fld;
+
+	if (NULL == query)
+		return (EINVAL);
+	/* Message "size": known fields count. */
+	memset(size, 0x00, sizeof(size));
+	for (i = 0; i < LG_SPK_F_COUNT; i ++) {
+		for (msgs = (lg_spk_field_msgs[i] & LG_SPK_QUERY_GET_MSGS);
+		    0 != msgs; msgs &= (msgs - 1)) {
+			size[(ffs((int)msgs) - 1)] ++;
+		}
+	}
+
+	for (;;) {
+		/* Take from messages already planned. */
+		memset(cover, 0x00, sizeof(cover));
+		for (i = 0, left = 0; i < query->cnt; i ++) {
+			fld = &query->fld[i];
+			if (LG_CTL_MSG_COUNT != fld->msg_idx)
+				continue;
+			msgs = (lg_spk_field_msgs[fld->field_id] &
+			    LG_SPK_QUERY_GET_MSGS);
+			if (0 == msgs)
+				return (EINVAL);
+			if (0 != (msgs & query->msgs)) {
+				fld->msg_idx = (size_t)(ffs((int)(msgs &
+				    query->msgs)) - 1);
+				continue;
+			}
+			for (; 0 != msgs; msgs &= (msgs - 1)) {
+				cover[(ffs((int)msgs) - 1)] ++;
+			}
+			left ++;
+		}
+		if (0 == left)
+			break;
+		/* Greedy set cover: message with most of rest fields. */
+		for (i = 1, best = 0; i < LG_CTL_MSG_GET_COUNT; i ++) {
+			if (cover[i] > cover[best] ||
+			    (cover[i] == cover[best] && size[i] < size[best])) {
+				best = i;
+			}
+		}
+		query->msgs |= LG_SPK_QUERY_MSG_BIT(best);
+	}
+
+	return (0);
+}
+
+int
+lg_spk_query_match(const lg_spk_query_t *query, const size_t msg_idx,
+    const char *name, const size_t name_size) {
+	size_t i;
+	const lg_spk_query_fld_t *fld;
+
+	if (NULL == query || LG_CTL_MSG_COUNT <= msg_idx)
+		return (0);
+	if (0 != (query->msgs_all & LG_SPK_QUERY_MSG_BIT(msg_idx)))
+		return (1);
+	if (NULL == name)
+		return (0);
+	for (i = 0; i < query->cnt; i ++) {
+		fld = &query->fld[i];
+		if (msg_idx == fld->msg_idx &&
+		    name_size == fld->name_size &&
+		    0 == memcmp(name, fld->name, name_size))
+			return (1);
+	}
+
+	return (0);
+}
@@ -0,0 +1,82 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_QUERY_H__
+#define __LG_SPK_QUERY_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_spk_info.h"
+
+
+/*
+ * Field level query: turns list of wanted fields to minimal set of
+ * messages to GET.
+ * Path forms:
+ * "MSG" - whole message;
+ * "MSG.field" - member of message "data", any name;
+ * "field" - known field (LG_SPK_F_*), message is chosen by planner:
+ * if field is in several messages then one that is already requested
+ * or that gives most of other wanted fields, smaller one on tie.
+ * Only top level members of "data" can be selected.
+ */
+
+#define LG_SPK_QUERY_MAX	64
+
+typedef struct lg_spk_query_fld_s {
+	size_t		msg_idx;	/* LG_CTL_MSG_COUNT: not planned yet. */
+	size_t		field_id;	/* LG_SPK_F_COUNT if not known. */
+	const char	*name;		/* NULL: whole message. */
+	size_t		name_size;
+} lg_spk_query_fld_t, *lg_spk_query_fld_p;
+
+typedef struct lg_spk_query_s {
+	size_t		cnt;
+	lg_spk_query_fld_t fld[LG_SPK_QUERY_MAX];
+	uint32_t	msgs;		/* To GET: bit per lg_ctl_msg[] index. */
+	uint32_t	msgs_all;	/* Whole message requested. */
+} lg_spk_query_t, *lg_spk_query_p;
+
+
+void	lg_spk_query_init(lg_spk_query_p query);
+/* Path is not copied. Returns EINVAL if message or bare field name
+ * is unknown, ENOBUFS if there are too many fields. */
+int	lg_spk_query_add(lg_spk_query_p query, const char *path,
+	    size_t path_size);
+/* Choose messages for known fields, set query->msgs. */
+int	lg_spk_query_plan(lg_spk_query_p query);
+/* Non zero if "data" member name of msg_idx responce is wanted. */
+int	lg_spk_query_match(const lg_spk_query_t *query, size_t msg_idx,
+	    const char *name, size_t name_size);
+
+
+#endif /* __LG_SPK_QUERY_H__ */
@@ -0,0 +1,611 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "lg_spk_replay.h"
+#include "lg_ctl_resp.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+
+
+/* Damaged file must not cause huge names table. */
+#define LG_SPK_REPLAY_TARGET_MAX	(16 * 1024 * 1024)
+
+
+void
+lg_spk_replay_init(lg_spk_replay_p replay) {
+
+	if (NULL == replay)
+		return;
+	memset(replay, 0x00, sizeof(lg_spk_replay_t));
+	replay->fmt = LG_SPK_OUT_FMT_JSONL;
+	replay->fd = STDOUT_FILENO;
+}
+
+void
+lg_spk_replay_destroy(lg_spk_replay_p replay) {
+	size_t i;
+
+	if (NULL == replay)
+		return;
+	for (i = 0; i < replay->seg_cnt; i ++) {
+		lg_free(replay->seg[i].name);
+		lg_free(replay->seg[i].name_size);
+	}
+	lg_free(replay->seg);
+	lg_free(replay->chunk);
+	if (NULL != replay->out) {
+		for (i = 0; i < (2 * replay->window); i ++) {
+			lg_spk_out_destroy(&replay->out[i]);
+		}
+		lg_free(replay->out);
+	}
+	for (i = 0; i < replay->worker_cnt; i ++) {
+		lg_ctl_crypto_destroy(&replay->worker[i].crypto);
+		lg_free(replay->worker[i].buf);
+	}
+	lg_free(replay->worker);
+	if (NULL != replay->map) {
+		munmap((void*)(size_t)replay->map, replay->map_size);
+	}
+	lg_spk_replay_init(replay);
+}
+
+
+static int
+lg_spk_replay_chunk_add(lg_spk_replay_p replay, const size_t off,
+    const size_t end) {
+	size_t allocated;
+	lg_spk_replay_chunk_p chunk;
+
+	if (off == end)
+		return (0);
+	if (replay->chunk_cnt == replay->chunk_allocated) {
+		allocated = MAX(64, (replay->chunk_allocated * 2));
+		chunk = lg_realloc(replay->chunk,
+		    (allocated * sizeof(lg_spk_replay_chunk_t)));
+		if (NULL == chunk)
+			return (ENOMEM);
+		replay->chunk = chunk;
+		replay->chunk_allocated = allocated;
+	}
+	chunk = &replay->chunk[replay->chunk_cnt ++];
+	chunk->off = off;
+	chunk->end = end;
+	chunk->seg = (replay->seg_cnt - 1);
+	chunk->ts_real = replay->seg[chunk->seg].ts_real;
+
+	return (0);
+}
+
+static int
+lg_spk_replay_seg_add(lg_spk_replay_p replay, const lg_ctl_cap_rec_t *rec,
+    const lg_ctl_cap_start_t *start) {
+	lg_spk_replay_seg_p seg;
+
+	if (0 != memcmp(start->magic, LG_CTL_CAP_MAGIC, sizeof(start->magic)) ||
+	    LG_CTL_CAP_VERSION != start->version)
+		return (EBADMSG);
+	seg = lg_realloc(replay->seg,
+	    ((replay->seg_cnt + 1) * sizeof(lg_spk_replay_seg_t)));
+	if (NULL == seg)
+		return (ENOMEM);
+	replay->seg = seg;
+	seg = &replay->seg[replay->seg_cnt ++];
+	memset(seg, 0x00, sizeof(lg_spk_replay_seg_t));
+	seg->ts_mono = rec->ts;
+	seg->ts_real = start->ts_real;
+
+	return (0);
+}
+
+static int
+lg_spk_replay_name_set(lg_spk_replay_seg_p seg, const uint32_t target,
+    const char *name, const size_t name_size) {
+	size_t cnt;
+	const char **names;
+	size_t *sizes;
+
+	if (LG_SPK_REPLAY_TARGET_MAX <= target)
+		return (EBADMSG);
+	if (seg->name_cnt <= target) {
+		cnt = MAX(((size_t)target + 1), (seg->name_cnt * 2));
+		names = lg_realloc(seg->name, (cnt * sizeof(char*)));
+		if (NULL == names)
+			return (ENOMEM);
+		seg->name = names;
+		sizes = lg_realloc(seg->name_size, (cnt * sizeof(size_t)));
+		if (NULL == sizes)
+			return (ENOMEM);
+		seg->name_size = sizes;
+		memset(&names[seg->name_cnt], 0x00,
+		    ((cnt - seg->name_cnt) * sizeof(char*)));
+		memset(&sizes[seg->name_cnt], 0x00,
+		    ((cnt - seg->name_cnt) * sizeof(size_t)));
+		seg->name_cnt = cnt;
+	}
+	seg->name[target] = name;
+	seg->name_size[target] = name_size;
+
+	return (0);
+}
+
+/* One pass over record headers: segments, target names, chunks.
+ * Stops on damaged record, chunks before it are kept. */
+static int
+lg_spk_replay_index(lg_spk_replay_p replay) {
+	int error = 0;
+	size_t off = 0, chunk_off = 0, size, full_size;
+	uint32_t type;
+	const lg_ctl_cap_rec_t *rec;
+
+	while (off < replay->map_size) {
+		if (sizeof(lg_ctl_cap_rec_t) > (replay->map_size - off)) {
+			error = EBADMSG;
+			break;
+		}
+		rec = (const lg_ctl_cap_rec_t*)(const void*)(replay->map + off);
+		type = LG_CTL_CAP_REC_TYPE(rec->info);
+		size = LG_CTL_CAP_REC_SIZE(rec->info);
+		full_size = LG_CTL_CAP_REC_FULL_SIZE(size);
+		if (LG_CTL_CAP_T_COUNT <= type ||
+		    full_size > (replay->map_size - off) ||
+		    (LG_CTL_CAP_T_START != type && 0 == replay->seg_cnt)) {
+			error = EBADMSG;
+			break;
+		}
+		switch (type) {
+		case LG_CTL_CAP_T_START:
+			if (sizeof(lg_ctl_cap_start_t) > size) {
+				error = EBADMSG;
+				break;
+			}
+			/* Chunk never crosses segments. */
+			error = lg_spk_replay_chunk_add(replay, chunk_off, off);
+			if (0 != error)
+				break;
+			error = lg_spk_replay_seg_add(replay, rec,
+			    (const lg_ctl_cap_start_t*)(const void*)(rec + 1));
+			chunk_off = (off + full_size);
+			break;
+		case LG_CTL_CAP_T_TARGET:
+			error = lg_spk_replay_name_set(
+			    &replay->seg[(replay->seg_cnt - 1)], rec->target,
+			    (const char*)(rec + 1), size);
+			break;
+		}
+		if (0 != error)
+			break;
+		off += full_size;
+		replay->records ++;
+		if (LG_SPK_REPLAY_CHUNK_SIZE <= (off - chunk_off)) {
+			error = lg_spk_replay_chunk_add(replay, chunk_off, off);
+			if (0 != error)
+				return (error);
+			chunk_off = off;
+		}
+	}
+	if (0 != replay->seg_cnt &&
+	    0 != lg_spk_replay_chunk_add(replay, chunk_off, off))
+		return (ENOMEM);
+
+	return (error);
+}
+
+
+/* Appended captures: by start time, records inside are in time order. */
+static int
+lg_spk_replay_chunk_cmp(const void *a, const void *b) {
+	const lg_spk_replay_chunk_t *ca = a, *cb = b;
+
+	if (ca->ts_real != cb->ts_real)
+		return ((ca->ts_real < cb->ts_real) ? -1 : 1);
+	if (ca->off != cb->off)
+		return ((ca->off < cb->off) ? -1 : 1);
+
+	return (0);
+}
+
+
+/* Packet to plain data in worker buffer. */
+static int
+lg_spk_replay_decrypt(lg_spk_replay_worker_p w, const uint8_t *pkt,
+    const size_t pkt_size, size_t *data_size) {
+	int error;
+	size_t off = 0, payload_size, buf_size;
+	const uint8_t *payload;
+	uint8_t *buf;
+
+	error = lg_ctl_pkt_payload_get(&off, pkt, pkt_size, &payload,
+	    &payload_size);
+	if (0 != error)
+		return (EBADMSG);
+	if (w->buf_size < payload_size) {
+		buf_size = roundup(payload_size, 4096);
+		buf = lg_realloc(w->buf, buf_size);
+		if (NULL == buf)
+			return (ENOMEM);
+		w->buf = buf;
+		w->buf_size = buf_size;
+	}
+	error = lg_ctl_pkt_payload_decrypt(&w->crypto, payload,
+	    payload_size, w->buf, w->buf_size, data_size);
+	if (0 != error)
+		return (EBADMSG);
+
+	return (0);
+}
+
+/* Request or not valid data: one record. */
+static int
+lg_spk_replay_rec(lg_spk_out_p out, const char *name, const size_t name_size,
+    const char *key, const char *json, const size_t json_size) {
+	int error;
+
+	error = lg_spk_out_rec_begin(out);
+	if (0 != error)
+		return (error);
+	error = lg_spk_out_rec_fmt(out, "ts", "%"PRIu64, out->ts);
+	if (0 != error)
+		return (error);
+	error = lg_spk_out_rec_str(out, "target", name, name_size);
+	if (0 != error)
+		return (error);
+	error = lg_spk_out_rec_json(out, key, json, json_size);
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_out_rec_end(out));
+}
+
+static int
+lg_spk_replay_chunk(lg_spk_replay_worker_p w, const size_t chunk_idx) {
+	int error;
+	lg_spk_replay_p replay = w->replay;
+	const lg_spk_replay_chunk_t *chunk = &replay->chunk[chunk_idx];
+	const lg_spk_replay_seg_t *seg = &replay->seg[chunk->seg];
+	lg_spk_out_p out = &replay->out[(chunk_idx % (2 * replay->window))];
+	const lg_ctl_cap_rec_t *rec;
+	const uint8_t *data;
+	const char *name;
+	size_t off, size, data_size, name_size, num_size;
+	uint32_t type;
+	lg_ctl_resp_t resp;
+	lg_spk_info_dec_t dec;
+	char name_buf[32], num[32];
+
+	out->size = 0;
+	for (off = chunk->off; off < chunk->end;
+	    off += LG_CTL_CAP_REC_FULL_SIZE(size)) {
+		rec = (const lg_ctl_cap_rec_t*)(const void*)(replay->map + off);
+		type = LG_CTL_CAP_REC_TYPE(rec->info);
+		size = LG_CTL_CAP_REC_SIZE(rec->info);
+		data = (const uint8_t*)(rec + 1);
+		if (LG_CTL_CAP_T_RX != type && LG_CTL_CAP_T_TX != type &&
+		    LG_CTL_CAP_T_RX_RAW != type)
+			continue;
+		if (LG_CTL_CAP_T_TX == type && NULL != replay->query)
+			continue; /* Only wanted fields. */
+		if (rec->target < seg->name_cnt &&
+		    NULL != seg->name[rec->target]) {
+			name = seg->name[rec->target];
+			name_size = seg->name_size[rec->target];
+		} else {
+			name = name_buf;
+			name_size = (size_t)snprintf(name_buf,
+			    sizeof(name_buf), "#%"PRIu32, rec->target);
+		}
+		out->ts = ((seg->ts_real + (rec->ts - seg->ts_mono)) / 1000);
+		error = EBADMSG;
+		if (LG_CTL_CAP_T_RX_RAW != type) {
+			error = lg_spk_replay_decrypt(w, data, size, &data_size);
+			if (ENOMEM == error)
+				return (error);
+		}
+		if (0 != error) { /* Not a packet: size only. */
+			w->bad ++;
+			num_size = (size_t)snprintf(num, sizeof(num), "%zu",
+			    size);
+			error = lg_spk_replay_rec(out, name, name_size, "bad",
+			    num, num_size);
+		} else if (LG_CTL_CAP_T_TX == type) {
+			w->tx ++;
+			error = lg_spk_replay_rec(out, name, name_size, "req",
+			    (const char*)w->buf, data_size);
+		} else {
+			w->rx ++;
+			lg_spk_info_dec_init(&dec, &w->info);
+			lg_spk_out_resp_begin(out, name, &dec);
+			error = lg_ctl_resp_parse((const char*)w->buf,
+			    data_size, lg_spk_out_resp_cb, out, &resp);
+			if (0 == error && NULL != replay->query &&
+			    0 == (replay->query->msgs &
+			    (((uint32_t)1) << resp.msg_idx))) {
+				lg_spk_out_resp_abort(out); /* Not wanted. */
+				continue;
+			}
+			if (0 == error) {
+				error = lg_spk_out_resp_end(out, &resp);
+			} else if (ENOMEM != error) {
+				lg_spk_out_resp_abort(out);
+				w->bad ++;
+				error = lg_spk_replay_rec(out, name, name_size,
+				    "bad", "\"responce\"", 10);
+			}
+		}
+		if (0 != error)
+			return (error);
+	}
+
+	return (0);
+}
+
+
+/* Take chunk from front (owner) or back (thief) of range. */
+static int
+lg_spk_replay_take(uint64_t *range, const int front, size_t *idx) {
+	uint64_t cur, next;
+	uint32_t lo, hi;
+
+	cur = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+	do {
+		lo = (uint32_t)cur;
+		hi = (uint32_t)(cur >> 32);
+		if (lo >= hi)
+			return (0);
+		if (0 != front) {
+			next = (cur + 1);
+			(*idx) = lo;
+		} else {
+			next = ((((uint64_t)(hi - 1)) << 32) | lo);
+			(*idx) = (hi - 1);
+		}
+	} while (0 == __atomic_compare_exchange_n(range, &cur, next, 0,
+	    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return (1);
+}
+
+static void *
+lg_spk_replay_worker(void *arg) {
+	lg_spk_replay_worker_p w = arg, victim;
+	lg_spk_replay_p replay = w->replay;
+	size_t i, idx, win_off, self = (size_t)(w - replay->worker);
+
+	for (;;) {
+		pthread_mutex_lock(&replay->mtx);
+		while (0 == replay->stop && w->gen == replay->gen) {
+			pthread_cond_wait(&replay->cond_start, &replay->mtx);
+		}
+		if (0 != replay->stop) {
+			pthread_mutex_unlock(&replay->mtx);
+			break;
+		}
+		w->gen = replay->gen;
+		win_off = replay->win_off;
+		pthread_mutex_unlock(&replay->mtx);
+
+		/* Own range first, then steal from others. */
+		for (i = 0; i < replay->worker_cnt; i ++) {
+			victim = &replay->worker[((self + i) %
+			    replay->worker_cnt)];
+			while (0 == w->error &&
+			    0 != lg_spk_replay_take(&victim->range, (0 == i),
+			    &idx)) {
+				w->error = lg_spk_replay_chunk(w,
+				    (win_off + idx));
+			}
+		}
+
+		pthread_mutex_lock(&replay->mtx);
+		replay->busy --;
+		if (0 == replay->busy) {
+			pthread_cond_signal(&replay->cond_done);
+		}
+		pthread_mutex_unlock(&replay->mtx);
+	}
+
+	return (NULL);
+}
+
+/* Split window to workers and wake them. */
+static void
+lg_spk_replay_launch(lg_spk_replay_p replay, const size_t win_off) {
+	size_t i, cnt;
+
+	cnt = MIN(replay->window, (replay->chunk_cnt - win_off));
+	pthread_mutex_lock(&replay->mtx);
+	replay->win_off = win_off;
+	for (i = 0; i < replay->worker_cnt; i ++) {
+		replay->worker[i].range =
+		    ((uint64_t)((i * cnt) / replay->worker_cnt)) |
+		    (((uint64_t)(((i + 1) * cnt) / replay->worker_cnt)) << 32);
+	}
+	replay->busy = replay->worker_cnt;
+	replay->gen ++;
+	pthread_cond_broadcast(&replay->cond_start);
+	pthread_mutex_unlock(&replay->mtx);
+}
+
+static void
+lg_spk_replay_wait(lg_spk_replay_p replay) {
+
+	pthread_mutex_lock(&replay->mtx);
+	while (0 != replay->busy) {
+		pthread_cond_wait(&replay->cond_done, &replay->mtx);
+	}
+	pthread_mutex_unlock(&replay->mtx);
+}
+
+static int
+lg_spk_replay_decode(lg_spk_replay_p replay) {
+	int error = 0;
+	size_t i, cnt, started = 0, win_off, win_cnt;
+	long cpus;
+
+	cnt = replay->threads;
+	if (0 == cnt) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		cnt = ((0 < cpus) ? (size_t)cpus : 1);
+	}
+	cnt = MIN(cnt, replay->chunk_cnt);
+	replay->worker = lg_calloc(cnt, sizeof(lg_spk_replay_worker_t));
+	if (NULL == replay->worker)
+		return (ENOMEM);
+	replay->worker_cnt = cnt;
+	replay->out = lg_calloc((2 * cnt * LG_SPK_REPLAY_WINDOW_PER_WORKER),
+	    sizeof(lg_spk_out_t));
+	if (NULL == replay->out)
+		return (ENOMEM);
+	replay->window = (cnt * LG_SPK_REPLAY_WINDOW_PER_WORKER);
+	for (i = 0; i < (2 * replay->window); i ++) {
+		lg_spk_out_init(&replay->out[i], replay->fmt, replay->fd);
+		replay->out[i].query = replay->query;
+	}
+	for (i = 0; i < replay->worker_cnt; i ++) {
+		replay->worker[i].replay = replay;
+		error = lg_ctl_crypto_init(&replay->worker[i].crypto);
+		if (0 != error)
+			return (error);
+	}
+	pthread_mutex_init(&replay->mtx, NULL);
+	pthread_cond_init(&replay->cond_start, NULL);
+	pthread_cond_init(&replay->cond_done, NULL);
+	for (started = 0; started < replay->worker_cnt; started ++) {
+		error = pthread_create(&replay->worker[started].thread, NULL,
+		    lg_spk_replay_worker, &replay->worker[started]);
+		if (0 != error)
+			goto err_out;
+	}
+
+	/* Write window while next one is decoded. */
+	lg_spk_replay_launch(replay, 0);
+	for (win_off = 0; win_off < replay->chunk_cnt; win_off += win_cnt) {
+		win_cnt = MIN(replay->window, (replay->chunk_cnt - win_off));
+		lg_spk_replay_wait(replay);
+		for (i = 0; i < replay->worker_cnt; i ++) {
+			if (0 != replay->worker[i].error) {
+				error = replay->worker[i].error;
+				goto err_out;
+			}
+		}
+		if ((win_off + win_cnt) < replay->chunk_cnt) {
+			lg_spk_replay_launch(replay, (win_off + win_cnt));
+		}
+		for (i = win_off; i < (win_off + win_cnt); i ++) {
+			error = lg_spk_out_flush(
+			    &replay->out[(i % (2 * replay->window))]);
+			if (0 != error) {
+				lg_spk_replay_wait(replay);
+				goto err_out;
+			}
+		}
+	}
+
+err_out:
+	pthread_mutex_lock(&replay->mtx);
+	replay->stop = 1;
+	pthread_cond_broadcast(&replay->cond_start);
+	pthread_mutex_unlock(&replay->mtx);
+	for (i = 0; i < started; i ++) {
+		pthread_join(replay->worker[i].thread, NULL);
+	}
+	pthread_cond_destroy(&replay->cond_done);
+	pthread_cond_destroy(&replay->cond_start);
+	pthread_mutex_destroy(&replay->mtx);
+
+	return (error);
+}
+
+int
+lg_spk_replay_run(lg_spk_replay_p replay, const char *file_name) {
+	int error, error_index, fd;
+	struct stat st;
+	void *map;
+
+	if (NULL == replay || NULL == file_name || NULL != replay->map)
+		return (EINVAL);
+
+	replay->ts_start = lg_ev_time_us();
+	replay->ts_done = replay->ts_start;
+	fd = open(file_name, (O_RDONLY | O_CLOEXEC));
+	if (-1 == fd)
+		return (errno);
+	if (0 != fstat(fd, &st)) {
+		error = errno;
+		close(fd);
+		return (error);
+	}
+	if (0 == st.st_size) {
+		close(fd);
+		return (EBADMSG);
+	}
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	error = errno;
+	close(fd);
+	if (MAP_FAILED == map)
+		return (error);
+	replay->map = map;
+	replay->map_size = (size_t)st.st_size;
+	posix_madvise(map, replay->map_size, POSIX_MADV_WILLNEED);
+
+	error_index = lg_spk_replay_index(replay);
+	if (ENOMEM == error_index)
+		return (error_index);
+	if (1 < replay->seg_cnt) {
+		qsort(replay->chunk, replay->chunk_cnt,
+		    sizeof(lg_spk_replay_chunk_t), lg_spk_replay_chunk_cmp);
+	}
+	error = 0;
+	if (0 != replay->chunk_cnt) {
+		error = lg_spk_replay_decode(replay);
+	}
+	replay->ts_done = lg_ev_time_us();
+	if (0 != error)
+		return (error);
+
+	return (error_index);
+}
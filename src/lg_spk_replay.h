@@ -0,0 +1,138 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_REPLAY_H__
+#define __LG_SPK_REPLAY_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_cap.h"
+#include "lg_spk_info.h"
+#include "lg_spk_out.h"
+#include "lg_spk_query.h"
+
+
+/*
+ * Offline decoder of lg_ctl_cap files.
+ * File is mapped to memory and cut to chunks on record boundaries by one
+ * pass over record headers. Chunks are decrypted and formatted by worker
+ * threads, each with own crypto context and output buffer per chunk.
+ * Work goes by windows of chunks: every worker gets range of window and
+ * takes chunks from its front, idle worker steals from back of others.
+ * Records of one capture are already in time order, appended captures
+ * are ordered by start time, so chunk outputs are written in chunk
+ * order, previous window is written while next one is decoded.
+ *
+ * Output: responces as in poll mode, with time and target name;
+ * sent requests and not valid received data as records.
+ */
+
+/* Capture segment: from START record to next one. */
+typedef struct lg_spk_replay_seg_s {
+	uint64_t	ts_mono;	/* START record time, us. */
+	uint64_t	ts_real;	/* Unix time at ts_mono, us. */
+	const char	**name;		/* Target names, by index, into map. */
+	size_t		*name_size;
+	size_t		name_cnt;
+} lg_spk_replay_seg_t, *lg_spk_replay_seg_p;
+
+/* Records [off, end) of one segment. */
+typedef struct lg_spk_replay_chunk_s {
+	size_t		off;
+	size_t		end;
+	size_t		seg;
+	uint64_t	ts_real;	/* Segment start: chunks order. */
+} lg_spk_replay_chunk_t, *lg_spk_replay_chunk_p;
+
+typedef struct lg_spk_replay_s *lg_spk_replay_p;
+
+typedef struct lg_spk_replay_worker_s {
+	lg_spk_replay_p	replay;
+	pthread_t	thread;
+	uint64_t	range;		/* Window chunks: front | back << 32. */
+	uint64_t	gen;		/* Last processed window. */
+	lg_ctl_crypto_t	crypto;
+	lg_spk_info_t	info;		/* Typed decoding scratch. */
+	uint8_t		*buf;		/* Decrypted payload. */
+	size_t		buf_size;
+	uint64_t	rx;		/* Counters. */
+	uint64_t	tx;
+	uint64_t	bad;
+	int		error;
+} lg_spk_replay_worker_t, *lg_spk_replay_worker_p;
+
+typedef struct lg_spk_replay_s {
+	/* Settings, set before lg_spk_replay_run(). */
+	int		fmt;		/* LG_SPK_OUT_FMT_* */
+	const lg_spk_query_t *query;	/* NULL - all responces and requests. */
+	size_t		threads;	/* 0 - online CPUs. */
+	int		fd;		/* Output. */
+	/* Internal. */
+	const uint8_t	*map;
+	size_t		map_size;
+	lg_spk_replay_seg_p seg;
+	size_t		seg_cnt;
+	lg_spk_replay_chunk_p chunk;
+	size_t		chunk_cnt;
+	size_t		chunk_allocated;
+	uint64_t	records;
+	lg_spk_out_p	out;		/* 2 windows, by chunk index. */
+	size_t		window;		/* Chunks per window. */
+	size_t		win_off;	/* First chunk of current window. */
+	lg_spk_replay_worker_p worker;
+	size_t		worker_cnt;
+	pthread_mutex_t	mtx;
+	pthread_cond_t	cond_start;
+	pthread_cond_t	cond_done;
+	uint64_t	gen;		/* Current window generation. */
+	size_t		busy;		/* Workers not done with window. */
+	int		stop;
+	uint64_t	ts_start;	/* Monotonic time, us. */
+	uint64_t	ts_done;
+} lg_spk_replay_t;
+
+#define LG_SPK_REPLAY_CHUNK_SIZE	(1024 * 1024)
+#define LG_SPK_REPLAY_WINDOW_PER_WORKER	4 /* Chunks. */
+
+
+void	lg_spk_replay_init(lg_spk_replay_p replay);
+void	lg_spk_replay_destroy(lg_spk_replay_p replay);
+/*
+ * Decode whole capture file to replay->fd.
+ * Returns EBADMSG if file is not capture or record is damaged, records
+ * before damaged one are decoded.
+ */
+int	lg_spk_replay_run(lg_spk_replay_p replay, const char *file_name);
+
+
+#endif /* __LG_SPK_REPLAY_H__ */
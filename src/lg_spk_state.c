@@ -0,0 +1,172 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_spk_state.h"
+#include "lg_mem.h"
+
+
+void
+lg_spk_state_destroy(lg_spk_state_p state) {
+	size_t i;
+
+	if (NULL == state)
+		return;
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		lg_free(state->ent[i].data);
+	}
+	memset(state, 0x00, sizeof(lg_spk_state_t));
+}
+
+uint64_t
+lg_spk_state_hash(const uint8_t *data, const size_t data_size) {
+	size_t i;
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	for (i = 0; i < data_size; i ++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return (hash);
+}
+
+size_t
+lg_spk_state_hash_find(const lg_spk_state_t *state, const uint64_t hash,
+    const size_t data_size) {
+	size_t i;
+
+	if (NULL == state)
+		return (LG_CTL_MSG_COUNT);
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		if (hash == state->ent[i].hash &&
+		    data_size == state->ent[i].size &&
+		    0 != state->ent[i].version)
+			return (i);
+	}
+
+	return (LG_CTL_MSG_COUNT);
+}
+
+int
+lg_spk_state_store(lg_spk_state_p state, const lg_ctl_resp_t *resp,
+    const uint8_t *data, const size_t data_size, const uint64_t now) {
+	lg_spk_state_ent_p ent;
+	uint8_t *tmp;
+
+	if (NULL == state || NULL == resp || NULL == data)
+		return (EINVAL);
+	if (LG_CTL_MSG_COUNT <= resp->msg_idx ||
+	    0 == resp->result || NULL == resp->data)
+		return (0);
+
+	ent = &state->ent[resp->msg_idx];
+	ent->ts = now;
+	if (0 != resp->notify) {
+		ent->ts_push = now;
+		ent->push_cnt ++;
+		state->pushed |= (((uint32_t)1) << resp->msg_idx);
+	}
+	if (0 != ent->version && data_size == ent->size &&
+	    0 == memcmp(ent->data, data, data_size))
+		return (0); /* Not changed. */
+	if (data_size >= ent->allocated) {
+		tmp = lg_realloc(ent->data, (data_size + 1));
+		if (NULL == tmp)
+			return (ENOMEM);
+		ent->data = tmp;
+		ent->allocated = (data_size + 1);
+	}
+	memcpy(ent->data, data, data_size);
+	ent->data[data_size] = 0;
+	ent->size = data_size;
+	ent->hash = lg_spk_state_hash(data, data_size);
+	ent->notify = resp->notify;
+	ent->version ++;
+	ent->ts_change = now;
+
+	return (0);
+}
+
+int
+lg_spk_state_update(lg_spk_state_p state, const uint8_t *data,
+    const size_t data_size, const uint64_t now, lg_ctl_resp_p resp) {
+	int error;
+
+	if (NULL == state || NULL == data || NULL == resp)
+		return (EINVAL);
+	error = lg_spk_info_decode(&state->info, (const char*)data, data_size,
+	    resp);
+	if (0 != error)
+		return (error);
+
+	return (lg_spk_state_store(state, resp, data, data_size, now));
+}
+
+const lg_spk_state_ent_t *
+lg_spk_state_get(const lg_spk_state_t *state, const size_t msg_idx,
+    const uint64_t max_age, const uint64_t now) {
+	const lg_spk_state_ent_t *ent;
+
+	if (NULL == state || LG_CTL_MSG_COUNT <= msg_idx || 0 == max_age)
+		return (NULL);
+	ent = &state->ent[msg_idx];
+	if (0 == ent->version)
+		return (NULL);
+	if (LG_SPK_STATE_IS_PUSHED(state, msg_idx) ||
+	    (now - ent->ts) <= max_age)
+		return (ent);
+
+	return (NULL);
+}
+
+uint64_t
+lg_spk_state_poll_due(const lg_spk_state_t *state, const size_t msg_idx,
+    const uint64_t interval, const uint64_t ts_poll) {
+	uint64_t ts;
+
+	if (NULL == state || LG_CTL_MSG_COUNT <= msg_idx)
+		return ((uint64_t)-1);
+	ts = MAX(state->ent[msg_idx].ts, ts_poll);
+	if (LG_SPK_STATE_IS_PUSHED(state, msg_idx))
+		return (ts + (interval * LG_SPK_STATE_PUSH_BACKOFF));
+
+	return (ts + interval);
+}
@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_STATE_H__
+#define __LG_SPK_STATE_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_resp.h"
+#include "lg_spk_info.h"
+
+
+/*
+ * Soundbar state cache: last good responce of every message, fed by
+ * polled replies and by pushed "notibyget" notifications.
+ * Entry version is changed only when content is changed, so consumers
+ * can skip not changed state without parse; payload hash lets find
+ * not changed responce before parse.
+ * Message that was pushed on current connection is kept up to date by
+ * device: it may be served from cache and polled rarely.
+ */
+
+typedef struct lg_spk_state_ent_s {
+	uint8_t		*data;		/* Plain JSON, zero terminated. */
+	size_t		size;
+	size_t		allocated;	/* Kept on update: no realloc. */
+	uint64_t	version;	/* 0 - empty. */
+	uint64_t	hash;		/* lg_spk_state_hash() of data. */
+	int		notify;		/* data is notification. */
+	uint64_t	ts;		/* Last update time, us. */
+	uint64_t	ts_change;	/* Last content change time, us. */
+	uint64_t	ts_push;	/* Last notification time, us. */
+	uint64_t	push_cnt;
+} lg_spk_state_ent_t, *lg_spk_state_ent_p;
+
+typedef struct lg_spk_state_s {
+	lg_spk_state_ent_t ent[LG_CTL_MSG_COUNT]; /* lg_ctl_msg[] indexed. */
+	uint32_t	pushed;		/* Pushed on current connection. */
+	lg_spk_info_t	info;		/* Typed state from all responces. */
+} lg_spk_state_t, *lg_spk_state_p;
+
+#define LG_SPK_STATE_IS_PUSHED(__state, __msg_idx)			\
+	    (0 != ((__state)->pushed & (((uint32_t)1) << (__msg_idx))))
+
+/* Poll interval multiplier for pushed messages. */
+#define LG_SPK_STATE_PUSH_BACKOFF	10
+
+
+void	lg_spk_state_destroy(lg_spk_state_p state);
+/* FNV-1a 64. */
+uint64_t lg_spk_state_hash(const uint8_t *data, size_t data_size);
+/* Returns lg_ctl_msg[] index of entry with same payload or
+ * LG_CTL_MSG_COUNT. */
+size_t	lg_spk_state_hash_find(const lg_spk_state_t *state, uint64_t hash,
+	    size_t data_size);
+/*
+ * Store responce: resp is result of lg_ctl_resp_parse() of data, typed
+ * info must be decoded by caller. Failed and unknown responces are
+ * ignored.
+ */
+int	lg_spk_state_store(lg_spk_state_p state, const lg_ctl_resp_t *resp,
+	    const uint8_t *data, size_t data_size, uint64_t now);
+/* Parse data, decode to state->info and store. */
+int	lg_spk_state_update(lg_spk_state_p state, const uint8_t *data,
+	    size_t data_size, uint64_t now, lg_ctl_resp_p resp);
+/* Connection lost: device will not push changes until reconnect. */
+#define lg_spk_state_push_reset(__state)	(__state)->pushed = 0
+/*
+ * Returns entry if it is not older than max_age (us) or if message is
+ * pushed, NULL otherwise. max_age = 0: cache is not used.
+ */
+const lg_spk_state_ent_t *lg_spk_state_get(const lg_spk_state_t *state,
+	    size_t msg_idx, uint64_t max_age, uint64_t now);
+/* Next poll time of message, interval is counted from last update or
+ * last poll (ts_poll) and is increased for pushed one. */
+uint64_t lg_spk_state_poll_due(const lg_spk_state_t *state,
+	    size_t msg_idx, uint64_t interval, uint64_t ts_poll);
+
+
+#endif /* __LG_SPK_STATE_H__ */
@@ -0,0 +1,260 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <errno.h>
+
+#include "lg_spk_stats.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+#include "utils/mem_utils.h"
+
+
+static const char *lg_spk_stat_names[] = {
+	"connect",
+	"send",
+	"wait",
+	"recv",
+	"decrypt",
+	"decode",
+	"total",
+	"output"
+};
+
+
+static inline size_t
+lg_spk_hist_idx(const uint64_t value) {
+	size_t exp;
+
+	if (LG_SPK_HIST_SUB_CNT > value)
+		return ((size_t)value);
+	exp = (size_t)(63 - __builtin_clzll(value));
+	if (LG_SPK_HIST_EXP_MAX < exp)
+		return ((LG_SPK_HIST_BUCKETS - 1));
+
+	return ((((exp - LG_SPK_HIST_SUB_BITS + 1) << LG_SPK_HIST_SUB_BITS) |
+	    (size_t)((value >> (exp - LG_SPK_HIST_SUB_BITS)) &
+	    (LG_SPK_HIST_SUB_CNT - 1))));
+}
+
+/* Highest value that is counted in bucket. */
+static inline uint64_t
+lg_spk_hist_idx_value(const size_t idx) {
+	size_t shift;
+
+	if (LG_SPK_HIST_SUB_CNT > idx)
+		return ((uint64_t)idx);
+	shift = ((idx >> LG_SPK_HIST_SUB_BITS) - 1);
+
+	return (((((uint64_t)(LG_SPK_HIST_SUB_CNT |
+	    (idx & (LG_SPK_HIST_SUB_CNT - 1)))) + 1) << shift) - 1);
+}
+
+void
+lg_spk_hist_add(lg_spk_hist_p hist, const uint64_t value) {
+
+	if (0 == hist->cnt || hist->min > value) {
+		hist->min = value;
+	}
+	if (hist->max < value) {
+		hist->max = value;
+	}
+	hist->cnt ++;
+	hist->sum += value;
+	hist->bucket[lg_spk_hist_idx(value)] ++;
+}
+
+void
+lg_spk_hist_sum(const lg_spk_hist_t *hist, lg_spk_hist_sum_p sum) {
+	size_t i, q;
+	uint64_t acc, rank[4], *val[4];
+	static const uint64_t pmil[4] = { 500, 900, 990, 999 };
+
+	if (NULL == hist || NULL == sum)
+		return;
+	memset(sum, 0x00, sizeof(lg_spk_hist_sum_t));
+	if (0 == hist->cnt)
+		return;
+	sum->cnt = hist->cnt;
+	sum->min = hist->min;
+	sum->max = hist->max;
+	sum->mean = (hist->sum / hist->cnt);
+	val[0] = &sum->p50;
+	val[1] = &sum->p90;
+	val[2] = &sum->p99;
+	val[3] = &sum->p999;
+	for (q = 0; q < nitems(pmil); q ++) {
+		rank[q] = MAX(1, (((hist->cnt * pmil[q]) + 999) / 1000));
+	}
+	/* One pass: ranks are ascending. */
+	for (i = 0, q = 0, acc = 0; i < LG_SPK_HIST_BUCKETS &&
+	    q < nitems(pmil); i ++) {
+		acc += hist->bucket[i];
+		for (; q < nitems(pmil) && acc >= rank[q]; q ++) {
+			(*val[q]) = MIN(hist->max,
+			    MAX(hist->min, lg_spk_hist_idx_value(i)));
+		}
+	}
+}
+
+
+const char *
+lg_spk_stat_name(const size_t stat) {
+
+	if (nitems(lg_spk_stat_names) <= stat)
+		return (NULL);
+	return (lg_spk_stat_names[stat]);
+}
+
+int
+lg_spk_stats_create(const size_t targets_cnt, lg_spk_stats_p *stats_ret) {
+	lg_spk_stats_p stats;
+
+	if (NULL == stats_ret)
+		return (EINVAL);
+	stats = lg_calloc(1, sizeof(lg_spk_stats_t));
+	if (NULL == stats)
+		return (ENOMEM);
+	if (0 != targets_cnt) {
+		stats->target = lg_calloc((targets_cnt * LG_SPK_STAT_T_COUNT),
+		    sizeof(lg_spk_hist_t));
+		if (NULL == stats->target) {
+			lg_free(stats);
+			return (ENOMEM);
+		}
+	}
+	stats->targets_cnt = targets_cnt;
+	stats->ts_start = lg_ev_time_us();
+	(*stats_ret) = stats;
+
+	return (0);
+}
+
+void
+lg_spk_stats_destroy(lg_spk_stats_p stats) {
+
+	if (NULL == stats)
+		return;
+	lg_free(stats->target);
+	lg_free(stats);
+}
+
+void
+lg_spk_stats_reset(lg_spk_stats_p stats) {
+	lg_spk_hist_p target;
+	size_t targets_cnt;
+
+	if (NULL == stats)
+		return;
+	target = stats->target;
+	targets_cnt = stats->targets_cnt;
+	memset(stats, 0x00, sizeof(lg_spk_stats_t));
+	if (NULL != target) {
+		memset(target, 0x00, (targets_cnt * LG_SPK_STAT_T_COUNT *
+		    sizeof(lg_spk_hist_t)));
+	}
+	stats->target = target;
+	stats->targets_cnt = targets_cnt;
+	stats->ts_start = lg_ev_time_us();
+}
+
+void
+lg_spk_stats_add(lg_spk_stats_p stats, const size_t target,
+    const size_t msg_idx, const size_t stat, const uint64_t value) {
+
+	if (NULL == stats || LG_SPK_STAT_COUNT <= stat)
+		return;
+	lg_spk_hist_add(&stats->stage[stat], value);
+	if (LG_SPK_STATS_ALL != msg_idx) {
+		lg_spk_hist_add(
+		    &stats->msg[MIN(msg_idx, LG_CTL_MSG_COUNT)][stat], value);
+	}
+	if (stats->targets_cnt <= target)
+		return;
+	switch (stat) {
+	case LG_SPK_STAT_CONNECT:
+		lg_spk_hist_add(&stats->target[(target * LG_SPK_STAT_T_COUNT)],
+		    value);
+		break;
+	case LG_SPK_STAT_TOTAL:
+		lg_spk_hist_add(
+		    &stats->target[((target * LG_SPK_STAT_T_COUNT) + 1)],
+		    value);
+		break;
+	}
+}
+
+int
+lg_spk_stats_next(const lg_spk_stats_t *stats, size_t *pos,
+    lg_spk_stats_ent_p ent) {
+	size_t i, idx;
+	const size_t msg_cnt = ((LG_CTL_MSG_COUNT + 1) * LG_SPK_STAT_COUNT);
+	static const size_t target_stat[LG_SPK_STAT_T_COUNT] = {
+		LG_SPK_STAT_CONNECT,
+		LG_SPK_STAT_TOTAL
+	};
+
+	if (NULL == stats || NULL == pos || NULL == ent)
+		return (EINVAL);
+	for (i = (*pos);; i ++) {
+		if (LG_SPK_STAT_COUNT > i) {
+			ent->stat = i;
+			ent->msg_idx = LG_SPK_STATS_ALL;
+			ent->target = LG_SPK_STATS_ALL;
+			ent->hist = &stats->stage[i];
+		} else if ((LG_SPK_STAT_COUNT + msg_cnt) > i) {
+			idx = (i - LG_SPK_STAT_COUNT);
+			ent->stat = (idx % LG_SPK_STAT_COUNT);
+			ent->msg_idx = (idx / LG_SPK_STAT_COUNT);
+			ent->target = LG_SPK_STATS_ALL;
+			ent->hist = &stats->msg[ent->msg_idx][ent->stat];
+		} else {
+			idx = (i - LG_SPK_STAT_COUNT - msg_cnt);
+			if ((stats->targets_cnt * LG_SPK_STAT_T_COUNT) <= idx) {
+				(*pos) = i;
+				return (ENOENT);
+			}
+			ent->stat = target_stat[(idx % LG_SPK_STAT_T_COUNT)];
+			ent->msg_idx = LG_SPK_STATS_ALL;
+			ent->target = (idx / LG_SPK_STAT_T_COUNT);
+			ent->hist = &stats->target[idx];
+		}
+		if (0 != ent->hist->cnt)
+			break;
+	}
+	(*pos) = (i + 1);
+
+	return (0);
+}
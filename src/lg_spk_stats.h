@@ -0,0 +1,147 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_SPK_STATS_H__
+#define __LG_SPK_STATS_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include "lgspkctl.h"
+
+
+/*
+ * Latency instrumentation: every request is split to stages by
+ * monotonic timestamps, stage durations are added to HDR style
+ * histograms: aggregated, per message and per target.
+ * Adding value is few arithmetic operations on preallocated arrays,
+ * without locks and allocations, so stats can stay on in production.
+ * Not thread safe: owner event loop only.
+ *
+ * Histogram is log linear: values below LG_SPK_HIST_SUB_CNT are exact,
+ * every next power of two range is split to LG_SPK_HIST_SUB_CNT equal
+ * buckets, so relative error is below 1 / LG_SPK_HIST_SUB_CNT.
+ * Values are in us, larger than 2^LG_SPK_HIST_EXP_MAX are counted in
+ * last bucket, exact max is kept anyway.
+ */
+
+#define LG_SPK_HIST_SUB_BITS	3
+#define LG_SPK_HIST_SUB_CNT	(1 << LG_SPK_HIST_SUB_BITS)
+#define LG_SPK_HIST_EXP_MAX	35 /* ~9.5 hours. */
+#define LG_SPK_HIST_BUCKETS						\
+    ((LG_SPK_HIST_EXP_MAX - LG_SPK_HIST_SUB_BITS + 2) * LG_SPK_HIST_SUB_CNT)
+
+typedef struct lg_spk_hist_s {
+	uint64_t	cnt;
+	uint64_t	sum;
+	uint64_t	min;
+	uint64_t	max;
+	uint64_t	bucket[LG_SPK_HIST_BUCKETS];
+} lg_spk_hist_t, *lg_spk_hist_p;
+
+/* Summary, all values in us. */
+typedef struct lg_spk_hist_sum_s {
+	uint64_t	cnt;
+	uint64_t	min;
+	uint64_t	mean;
+	uint64_t	p50;
+	uint64_t	p90;
+	uint64_t	p99;
+	uint64_t	p999;
+	uint64_t	max;
+} lg_spk_hist_sum_t, *lg_spk_hist_sum_p;
+
+
+/* Request stages. */
+#define LG_SPK_STAT_CONNECT	0 /* Connect start -> connected. */
+#define LG_SPK_STAT_SEND	1 /* Request queued -> first byte sent. */
+#define LG_SPK_STAT_WAIT	2 /* First byte sent -> first byte received. */
+#define LG_SPK_STAT_RECV	3 /* First byte received -> frame complete. */
+#define LG_SPK_STAT_DECRYPT	4 /* Frame complete -> decrypt done. */
+#define LG_SPK_STAT_DECODE	5 /* Decrypt done -> decode done. */
+#define LG_SPK_STAT_TOTAL	6 /* Request queued -> decode done. */
+#define LG_SPK_STAT_OUTPUT	7 /* Results write. */
+#define LG_SPK_STAT_COUNT	8
+
+/* Per target histograms: LG_SPK_STAT_CONNECT and LG_SPK_STAT_TOTAL. */
+#define LG_SPK_STAT_T_COUNT	2
+
+/* msg_idx / target: not specific. */
+#define LG_SPK_STATS_ALL	((size_t)-1)
+
+typedef struct lg_spk_stats_s {
+	uint64_t	ts_start;	/* Monotonic time, us. */
+	uint64_t	rx_frames;
+	uint64_t	rx_bytes;
+	uint64_t	tx_reqs;
+	uint64_t	tx_bytes;
+	lg_spk_hist_t	stage[LG_SPK_STAT_COUNT];
+	/* lg_ctl_msg[] indexed, LG_CTL_MSG_COUNT - unknown / pushed. */
+	lg_spk_hist_t	msg[(LG_CTL_MSG_COUNT + 1)][LG_SPK_STAT_COUNT];
+	lg_spk_hist_p	target;		/* targets_cnt * LG_SPK_STAT_T_COUNT. */
+	size_t		targets_cnt;
+} lg_spk_stats_t, *lg_spk_stats_p;
+
+/* lg_spk_stats_next() result. */
+typedef struct lg_spk_stats_ent_s {
+	size_t		stat;		/* LG_SPK_STAT_* */
+	size_t		msg_idx;	/* Or LG_SPK_STATS_ALL. */
+	size_t		target;		/* Or LG_SPK_STATS_ALL. */
+	const lg_spk_hist_t *hist;
+} lg_spk_stats_ent_t, *lg_spk_stats_ent_p;
+
+
+void	lg_spk_hist_add(lg_spk_hist_p hist, const uint64_t value);
+void	lg_spk_hist_sum(const lg_spk_hist_t *hist, lg_spk_hist_sum_p sum);
+
+/* Returns "connect", "send"... or NULL. */
+const char *lg_spk_stat_name(const size_t stat);
+
+/* Histograms memory is allocated once, free with lg_spk_stats_destroy(). */
+int	lg_spk_stats_create(const size_t targets_cnt,
+	    lg_spk_stats_p *stats_ret);
+void	lg_spk_stats_destroy(lg_spk_stats_p stats);
+void	lg_spk_stats_reset(lg_spk_stats_p stats);
+/*
+ * Add stage duration, us.
+ * target: targets index or LG_SPK_STATS_ALL.
+ * msg_idx: lg_ctl_msg[] index, LG_CTL_MSG_COUNT or LG_SPK_STATS_ALL.
+ */
+void	lg_spk_stats_add(lg_spk_stats_p stats, const size_t target,
+	    const size_t msg_idx, const size_t stat, const uint64_t value);
+/*
+ * Iterate not empty histograms: aggregated, per message, per target.
+ * Start with pos = 0, returns ENOENT after last one.
+ */
+int	lg_spk_stats_next(const lg_spk_stats_t *stats, size_t *pos,
+	    lg_spk_stats_ent_p ent);
+
+
+#endif /* __LG_SPK_STATS_H__ */
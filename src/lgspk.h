@@ -0,0 +1,91 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LGSPK_H__
+#define __LGSPK_H__
+
+/*
+ * liblgspk: LG soundbar control protocol library.
+ * Link with -llgspk (shared or static), -lcrypto and -lpthread.
+ *
+ * lgspkctl.h		Protocol: message names, crypto context, frame
+ *			encoder / decoder, pre encrypted GET packets.
+ * lg_ctl_conn.h	Receive buffer: frame reassembly and in place
+ *			decryption without copy.
+ * lg_ctl_cap.h		Wire capture to binary log, writer thread.
+ * lg_ctl_resp.h	Responce decoder: one pass, no allocations.
+ * lg_spk_info.h	Typed decoding of info messages to lg_spk_info_t.
+ * lg_ctl_sess.h	Session without I/O: driven by bytes in / bytes
+ *			out / next deadline from any event loop.
+ * lg_spk_state.h	Per soundbar state cache.
+ * lg_spk_delta.h	Field level diff of two responces.
+ * lg_spk_query.h	Field list to minimal set of messages to GET.
+ * lg_spk_engine.h	Poll many soundbars from own event loop.
+ * lg_spk_discover.h	Find soundbars in subnets.
+ * lg_spk_stats.h		Per stage latency histograms.
+ * lg_mem.h		Allocator used by library, counters.
+ *
+ * Minimal embedding, error handling omitted:
+ *
+ *	lg_ctl_crypto_init(&crypto);
+ *	lg_ctl_sess_init(&sess, &crypto, NULL, 0);
+ *	sess.info = &info;
+ *	sess.cb = my_cb;
+ *	lg_ctl_sess_get(&sess, LG_CTL_MSG_SPK_LIST_VIEW_INFO, now);
+ *	... socket writable:
+ *	while (0 == lg_ctl_sess_out_get(&sess, &data, &size) &&
+ *	    0 == lg_ctl_sess_out_done(&sess, send(skt, data, size, 0),
+ *	    now))
+ *		;
+ *	... socket readable:
+ *	lg_ctl_sess_in_get(&sess, &buf, &size);
+ *	error = lg_ctl_sess_in_done(&sess, recv(skt, buf, size, 0), now);
+ *	if (0 != error && EAGAIN != error && EINTR != error)
+ *		... reconnect: lg_ctl_sess_reset(&sess);
+ *	... timer at lg_ctl_sess_deadline(&sess):
+ *	lg_ctl_sess_timer(&sess, now);
+ */
+
+#include "lgspkctl.h"
+#include "lg_mem.h"
+#include "lg_ctl_cap.h"
+#include "lg_ctl_conn.h"
+#include "lg_ctl_resp.h"
+#include "lg_ctl_sess.h"
+#include "lg_spk_info.h"
+#include "lg_spk_state.h"
+#include "lg_spk_delta.h"
+#include "lg_spk_query.h"
+#include "lg_spk_engine.h"
+#include "lg_spk_discover.h"
+#include "lg_spk_stats.h"
+
+
+#endif /* __LGSPK_H__ */
@@ -28,11 +28,11 @@
  */
 
 
-#include <sys/param.h>
 #ifdef __linux__ /* Linux specific code. */
 #	define _GNU_SOURCE /* See feature_test_macros(7) */
 #	define __USE_GNU 1
 #endif /* Linux specific code. */
+#include <sys/param.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
@@ -47,9 +47,26 @@
 #include <time.h>
 #include <errno.h>
 #include <getopt.h>
+#include <libgen.h> /* basename */
+#include <signal.h>
+#include <sys/resource.h>
 
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
 #include "lgspkctl.h"
-#include "json.h"
+#include "lg_ctl_conn.h"
+#include "lg_ev.h"
+#include "lg_spk_engine.h"
+#include "lg_spk_daemon.h"
+#include "lg_ctl_resp.h"
+#include "lg_spk_info.h"
+#include "lg_spk_state.h"
+#include "lg_spk_delta.h"
+#include "lg_spk_out.h"
+#include "lg_spk_query.h"
+#include "lg_spk_discover.h"
+#include "lg_spk_replay.h"
 #include "net/socket.h"
 #include "net/socket_address.h"
 #include "utils/mem_utils.h"
@@ -80,441 +97,217 @@
 
 
 
+/*
+ * out: format responce to it, may be NULL.
+ * state: store responce and decode known fields to it, may be NULL.
+ * resp_ret: parsed responce, msg_idx is LG_CTL_MSG_COUNT if unknown.
+ */
 static int
-lg_ctl_pkt_send(const uintptr_t skt, const uint8_t *data, const size_t data_size) {
+lg_spk_handle_responce(const char *target, lg_spk_out_p out,
+    lg_spk_state_p state, const uint8_t *data, const size_t data_size,
+    lg_ctl_resp_p resp_ret) {
 	int error;
-	uint8_t *buf;
-	size_t buf_size, off;
-	ssize_t ios;
-
-	if (((uintptr_t)-1) == skt)
-		return (EINVAL);
-
-	/* Get buf size for packet. */
-	error = lg_ctl_pkt_create(data, data_size, NULL, &buf_size);
-	if (ENOBUFS != error)
-		return (error);
-	/* Allocate buf. */
-	buf = malloc(buf_size);
-	if (NULL == buf)
-		return (ENOMEM);
-	/* Make packet. */
-	error = lg_ctl_pkt_create(data, data_size, buf, &buf_size);
-	if (0 != error)
+	lg_ctl_resp_t resp;
+	lg_ctl_resp_cb cb = NULL;
+	lg_spk_info_dec_t dec;
+	void *udata = &dec;
+
+	memset(&resp, 0x00, sizeof(resp));
+	resp.msg_idx = LG_CTL_MSG_COUNT;
+	if (NULL == data || 0 == data_size) {
+		error = EINVAL;
 		goto err_out;
-	/* Send it. */
-	for (off = 0; off < buf_size;) {
-		ios = send((int)skt, (buf + off), (buf_size - off),
-		    MSG_NOSIGNAL);
-		if (-1 == ios) {
-			error = errno;
-			break;
-		}
-		off += (size_t)ios;
 	}
 
-err_out:
-	free(buf);
-
-	return (error);
-}
-
-static int
-lg_ctl_pkt_recv(const uintptr_t skt, uint8_t *data, const size_t data_size,
-    size_t *buf_size_ret) {
-	int error;
-	const size_t buf_size = (data_size * 2);
-	size_t off, rcvd = 0;
-	ssize_t ios;
-	uint8_t *buf;
-
-	if (((uintptr_t)-1) == skt || NULL == data || 0 == data_size)
-		return (EINVAL);
-
-	/* Allocate buf. */
-	buf = malloc(buf_size);
-	if (NULL == buf)
-		return (ENOMEM);
-	for (;;) {
-		ios = recv((int)skt, (buf + rcvd), (buf_size - rcvd),
-		    MSG_NOSIGNAL);
-		if (0 >= ios) {
-			error = ((-1 == ios) ? errno : ECONNRESET);
-			break;
-		}
-		rcvd += (size_t)ios;
-		off = 0;
-		error = lg_ctl_pkt_data_get(&off, buf, rcvd,
-		    data, data_size, buf_size_ret);
-		if (EAGAIN != error)
-			break;
-		/* Clean up space to receive packet data. */
-		rcvd -= off;
-		memmove(buf, (buf + off), rcvd);
+	lg_spk_info_dec_init(&dec, ((NULL != state) ? &state->info : NULL));
+	if (NULL != out) {
+		lg_spk_out_resp_begin(out, target,
+		    ((NULL != state) ? &dec : NULL));
+		cb = lg_spk_out_resp_cb;
+		udata = out;
+	} else if (NULL != state) {
+		cb = lg_spk_info_dec_cb;
 	}
-	free(buf);
-
-	return (error);
-}
-
-
-static struct json_object_element_s *
-json_object_element_by_name(struct json_object_element_s *start_elem,
-    const char *name, const size_t name_size) {
-	struct json_object_element_s *elem;
-
-	if (NULL == start_elem)
-		return (NULL);
-
-	for (elem = start_elem; NULL != elem; elem = elem->next) {
-		if (elem->name->string_size != name_size ||
-		    0 != memcmp(elem->name->string, name, name_size))
-			continue;
-		return (elem);
-	}
-
-	return (NULL);
-}
-
-static int
-lg_spk_responce_is_ok(const char *ctl_msg, const size_t ctl_msg_size,
-    struct json_object_element_s *start_elem) {
-	struct json_object_element_s *elem;
-	struct json_string_s *string;
-
-	if (NULL == ctl_msg || NULL == start_elem)
-		return (0);
-
-	/* Check: msg. */
-	elem = json_object_element_by_name(start_elem, "msg", 3);
-	if (NULL == elem || elem->value->type != json_type_string)
-		return (0);
-	string = elem->value->payload;
-	if (ctl_msg_size != string->string_size ||
-	    0 != memcmp(string->string, ctl_msg, ctl_msg_size))
-		return (0);
-
-	/* Check: cmd. */
-	/* "cmd": "notibyget" */
-
-	/* Check: result. */
-	elem = json_object_element_by_name(start_elem, "result", 6);
-	if (NULL == elem)
-		return (0);
-	switch (elem->value->type) {
-	case json_type_string:
-		string = elem->value->payload;
-		if (string->string_size == 2 &&
-		    0 == memcmp(string->string, "ok", 2))
-			return (1);
-		return (0);
-	case json_type_true:
-		return (1);
-	}
-
-	return (0);
-}
-
-
-static int
-lg_spk_array_dump(const char *ctl_msg, const size_t ctl_msg_size,
-    const char *array_name, const size_t array_name_size,
-    struct json_array_s *array, const int level) {
-	struct json_array_element_s *elem;
-	struct json_string_s *string;
-	struct json_number_s *number;
-	const char *tabs = "						";
-	const char **array_descr = NULL;
-	size_t array_descr_size = 0, num;
-
-	if (NULL == array)
-		return (EINVAL);
-
-	if (0 == mem_cmpn_cstr("EQ_VIEW_INFO", ctl_msg, ctl_msg_size) &&
-	    0 == mem_cmpn_cstr("ai_eq_list", array_name, array_name_size)) {
-		array_descr = lg_ctl_equalisers;
-		array_descr_size = nitems(lg_ctl_equalisers);
-	} else if (0 == mem_cmpn_cstr("FUNC_VIEW_INFO", ctl_msg, ctl_msg_size) &&
-	    0 == mem_cmpn_cstr("ai_func_list", array_name, array_name_size)) {
-		array_descr = lg_ctl_functions;
-		array_descr_size = nitems(lg_ctl_functions);
-	}
-
-	for (elem = array->start; NULL != elem; elem = elem->next) {
-		switch (elem->value->type) {
-		case json_type_string:
-			string = elem->value->payload;
-			LOG_INFO_FMT("%.*s%s",
-			    level, tabs,
-			    string->string);
-			break;
-		case json_type_number:
-			number = elem->value->payload;
-			num = str2usize(number->number, number->number_size);
-			if (NULL == array_descr ||
-			    array_descr_size <= num) {
-				LOG_INFO_FMT("%.*s%s",
-				    level, tabs,
-				    number->number);
-				break;
-			}
-			LOG_INFO_FMT("%.*s%-2s: %s",
-			    level, tabs,
-			    number->number, array_descr[num]);
-			break;
-		case json_type_object:
-			LOG_INFO_FMT("%.*s%s",
-			    level, tabs,
-			    "object");
-			break;
-		case json_type_array:
-			LOG_INFO_FMT("%.*s%s",
-			    level, tabs,
-			    "array");
-			break;
-		case json_type_true:
-			LOG_INFO_FMT("%.*s%s",
-			    level, tabs,
-			    "true");
-			break;
-		case json_type_false:
-			LOG_INFO_FMT("%.*s%s",
-			    level, tabs,
-			    "false");
-			break;
-		case json_type_null:
-			LOG_INFO_FMT("%.*s%s",
-			    level, tabs,
-			    "null");
-			break;
-		}
+	error = lg_ctl_resp_parse((const char*)data, data_size, cb, udata,
+	    &resp);
+	if (0 != error) {
+		resp.msg_idx = LG_CTL_MSG_COUNT;
+		lg_spk_out_resp_abort(out); /* No half record. */
+		goto err_out;
 	}
-
-	return (0);
-}
-
-static int
-lg_spk_object_dump(const char *ctl_msg, const size_t ctl_msg_size,
-    struct json_object_s *obj, const int level) {
-	int error;
-	struct json_object_element_s *elem;
-	struct json_string_s *string;
-	struct json_number_s *number;
-	const char *tabs = "						";
-	const char **array_descr = NULL;
-	size_t array_descr_size = 0, num;
-
-	if (NULL == obj)
-		return (EINVAL);
-
-	if (0 == mem_cmpn_cstr("EQ_VIEW_INFO", ctl_msg, ctl_msg_size)) {
-		array_descr = lg_ctl_equalisers;
-		array_descr_size = nitems(lg_ctl_equalisers);
-	} else if (0 == mem_cmpn_cstr("FUNC_VIEW_INFO", ctl_msg, ctl_msg_size)) {
-		array_descr = lg_ctl_functions;
-		array_descr_size = nitems(lg_ctl_functions);
-	}
-
-	for (elem = obj->start; NULL != elem; elem = elem->next) {
-		switch (elem->value->type) {
-		case json_type_string:
-			string = elem->value->payload;
-			LOG_INFO_FMT("%.*s%s: %s",
-			    level, tabs,
-			    elem->name->string, string->string);
-			break;
-		case json_type_number:
-			number = elem->value->payload;
-			num = str2usize(number->number, number->number_size);
-			if (array_descr_size <= num ||
-			    (0 != mem_cmpn_cstr("i_curr_eq",
-			    elem->name->string, elem->name->string_size) &&
-			    0 != mem_cmpn_cstr("i_curr_func",
-			    elem->name->string, elem->name->string_size))) {
-				LOG_INFO_FMT("%.*s%s: %s",
-				    level, tabs,
-				    elem->name->string, number->number);
-				    break;
-			}
-			LOG_INFO_FMT("%.*s%s: %s - %s",
-			    level, tabs,
-			    elem->name->string, number->number,
-			    array_descr[num]);
-			break;
-		case json_type_object:
-			LOG_INFO_FMT("%.*s%s: %s",
-			    level, tabs,
-			    elem->name->string, "object");
-			error = lg_spk_object_dump(ctl_msg, ctl_msg_size,
-			    (struct json_object_s*)elem->value->payload,
-			    (level + 1));
-			if (0 != error)
-				return (error);
-			break;
-		case json_type_array:
-			LOG_INFO_FMT("%.*s%s: %s",
-			    level, tabs,
-			    elem->name->string, "array");
-			error = lg_spk_array_dump(ctl_msg, ctl_msg_size,
-			    elem->name->string, elem->name->string_size,
-			    (struct json_array_s*)elem->value->payload,
-			    (level + 1));
-			if (0 != error)
-				return (error);
-			break;
-		case json_type_true:
-			LOG_INFO_FMT("%.*s%s: %s",
-			    level, tabs,
-			    elem->name->string, "true");
-			break;
-		case json_type_false:
-			LOG_INFO_FMT("%.*s%s: %s",
-			    level, tabs,
-			    elem->name->string, "false");
-			break;
-		case json_type_null:
-			LOG_INFO_FMT("%.*s%s: %s",
-			    level, tabs,
-			    elem->name->string, "null");
-			break;
+	if (NULL != state) {
+		error = lg_spk_state_store(state, &resp, data, data_size,
+		    lg_ev_time_us());
+		if (0 != error) {
+			lg_spk_out_resp_abort(out);
+			goto err_out;
 		}
 	}
-
-	return (0);
-}
-
-static int
-lg_spk_handle_responce(const char *ctl_msg, const size_t ctl_msg_size,
-    const uint8_t *data, const size_t data_size) {
-	int error = EBADMSG;
-	struct json_value_s *root;
-	struct json_object_s *obj;
-	struct json_object_element_s *joe_data;
-
-	if (NULL == ctl_msg || NULL == data || 0 == data_size)
-		return (EINVAL);
-
-	root = json_parse(data, data_size);
-	obj = root->payload;
-
-	if (0 == lg_spk_responce_is_ok(ctl_msg, ctl_msg_size, obj->start))
+	if (NULL == out)
 		goto err_out;
-	joe_data = json_object_element_by_name(obj->start, "data", 4);
-	if (NULL == joe_data || json_type_object != joe_data->value->type)
+	error = lg_spk_out_resp_end(out, &resp);
+	if (0 != error)
 		goto err_out;
-
-	error = lg_spk_object_dump(ctl_msg, ctl_msg_size,
-	    (struct json_object_s*)joe_data->value->payload, 1);
+	if (0 == resp.result || NULL == resp.data) {
+		error = EBADMSG;
+		goto err_out;
+	}
+	error = lg_spk_out_batch(out);
 
 err_out:
-	free(root);
+	if (NULL != resp_ret) {
+		(*resp_ret) = resp;
+	}
 	return (error);
 }
 
 
-
-
-
-
-
-
-
-
-
-#if 0
-#define MAX_ARGS_COUNT	64
-
 typedef struct command_line_options_s {
 	int		quiet;
-	int		cmd; /* Raw, get, set. */
-	const char	*raw_data[MAX_ARGS_COUNT];
-	size_t		raw_data_count;
-
-
-	uint32_t	write_flags;
-	int		post_wr_verify;
-	off_t		file_offset;
-	const char	*chip_name;
-	uint32_t	chip_id;
-	uint8_t		chip_id_size;
-	uint32_t	address;
-	size_t		size;
-	int		page;
-	uint8_t		icsp;
-	const char	*db_file_name;
-	int		chip_id_check_no_fail;
-	int		chip_id_check_disable;
-	int		size_error;
-	int		size_error_no_warn;
+	const char	*addr;
+	const char	*targets_file;
+	size_t		pipeline; /* Max requests in flight. */
+	size_t		max_payload; /* Receive buffer limit. */
+	uint64_t	timeout; /* Per target, ms, 0 - mode default. */
+	uint64_t	connect_timeout; /* ms, 0 - timeout. */
+	uint64_t	io_timeout; /* ms, 0 - timeout. */
+	size_t		rounds; /* Poll repeat count. */
+	const char	*daemon; /* Unix socket path. */
+	uint64_t	keepalive; /* ms. */
+	uint64_t	cache_ttl; /* ms. */
+	uint64_t	poll; /* ms. */
+	size_t		poll_pipeline; /* Max background GETs in flight. */
+	uint64_t	watch; /* Poll interval, ms, 0 - no watch. */
+	int		format; /* LG_SPK_OUT_FMT_* */
+	const char	*discover; /* CIDR list. */
+	const char	*cache; /* Discovery cache file. */
+	const char	*capture; /* Wire capture file. */
+	const char	*replay; /* Capture file to decode. */
+	size_t		threads; /* Replay workers, 0 - CPUs. */
+	int		stats; /* Print latency stats on exit. */
+	const char	*metrics; /* Daemon: HTTP endpoint addr:port. */
 } cmd_opts_t, *cmd_opts_p;
 
+#define CMD_OPTS_DEF_ADDR	"172.16.0.227"
+#define CMD_OPTS_DEPTH_MAX	1024 /* pipeline, poll-pipeline, threads. */
+#define CMD_OPTS_KIB_MAX	(1024 * 1024) /* max-payload: 1 GiB. */
+#define CMD_OPTS_MS_MAX		(24 * 3600 * 1000) /* Time: 1 day. */
+//#define CMD_OPTS_DEF_ADDR	"[2001:470:1f15:3d8:9a93:ccff:fece:16a1]"
+
 
 static struct option long_options[] = {
 	{ "help",	no_argument,		NULL,	'?'	},
 	{ "quiet",	no_argument,		NULL,	'q'	},
-	{ "raw",	required_argument,	NULL,	'R'	},
-	{ "get",	no_argument,		NULL,	'g'	},
-	{ "set",	no_argument,		NULL,	's'	},
-
-	{ "no-pre-unprotect",	no_argument,	NULL,	'u'	},
-	{ "no-post-protect",	no_argument,	NULL,	'P'	},
-	{ "no-post-verify",	no_argument,	NULL,	'v'	},
-	{ "file-offset", required_argument,	NULL,	0	},
-	{ "chip",	required_argument,	NULL,	'p'	},
-	{ "chip-id",	required_argument,	NULL,	0	},
-	{ "addr",	required_argument,	NULL,	0	},
-	{ "size",	required_argument,	NULL,	0	},
-	{ "page",	required_argument,	NULL,	'c'	},
-	{ "icsp",	no_argument,		NULL,	'I'	},
-	{ "icsp-vcc",	no_argument,		NULL,	'i'	},
-	{ "db-file",	required_argument,	NULL,	'b'	},
-	{ "chip-id-check-no-fail", no_argument,	NULL,	'y'	},
-	{ "chip-id-check-disable", no_argument,	NULL,	'f'	},
-	{ "no-size-error", no_argument,		NULL,	's'	},
-	{ "no-size-error-warn", no_argument,	NULL,	'S'	},
+	{ "addr",	required_argument,	NULL,	'a'	},
+	{ "targets",	required_argument,	NULL,	't'	},
+	{ "pipeline",	required_argument,	NULL,	'p'	},
+	{ "max-payload", required_argument,	NULL,	'm'	},
+	{ "timeout",	required_argument,	NULL,	'T'	},
+	{ "rounds",	required_argument,	NULL,	'r'	},
+	{ "daemon",	required_argument,	NULL,	'd'	},
+	{ "keepalive",	required_argument,	NULL,	'k'	},
+	{ "cache-ttl",	required_argument,	NULL,	'c'	},
+	{ "poll",	required_argument,	NULL,	'P'	},
+	{ "watch",	required_argument,	NULL,	'w'	},
+	{ "format",	required_argument,	NULL,	'f'	},
+	{ "discover",	required_argument,	NULL,	'D'	},
+	{ "cache",	required_argument,	NULL,	'C'	},
+	{ "connect-timeout", required_argument,	NULL,	'o'	},
+	{ "io-timeout",	required_argument,	NULL,	'i'	},
+	{ "capture",	required_argument,	NULL,	'W'	},
+	{ "replay",	required_argument,	NULL,	'R'	},
+	{ "threads",	required_argument,	NULL,	'j'	},
+	{ "stats",	no_argument,		NULL,	'S'	},
+	{ "metrics",	required_argument,	NULL,	'M'	},
+	{ "poll-pipeline", required_argument,	NULL,	'B'	},
 	{ NULL,		0,			NULL,	0	}
 };
 
 static const char *long_options_descr[] = {
 	"			Show help",
-	"				Less verboce",
-	"<json_data>		Send raw JSON request",
-	"			Get - read soundbar props",
-	"			Set - write soundbar props",
-
-	"<file_name>		Verify memory",
-	"<file_name>		Write memory",
-	"		Do NOT disable write-protect before write",
-	"		Do NOT enable write-protect after write",
-	"		Do NOT verify after write",
-	"<offset>		File offset (hex)",
-	"<chip>		Specify chip (use quotes)",
-	"<chip_id>		Specify chip ID (hex)",
-	"<chip_addr>		Start pos for read/verify/write",
-	"<size>			Size to read/verify/write (hex)",
-	"<page>		Specify memory page type (optional)\n"
-	"					Possible values: code, data, config",
-	"			Use ICSP (without enabling Vcc)",
-	"			Use ICSP",
-	"	Do NOT error on chip ID mismatch",
-	"	Disable all chip ID checks and reading",
-	"		Do NOT error on file size mismatch (only a warning)",
-	"	No warning message for file size mismatch (can't combine with -s)",
+	"				Do not dump responces",
+	"<addr[:port]>		Soundbar address, default: "CMD_OPTS_DEF_ADDR,
+	"<file>		Poll all soundbars from file, one per line:\n"
+	"					addr[:port] [name]",
+	"<depth>		Max requests in flight, default: 1\n"
+	"					Use 14 or more to get all at once",
+	"<size>		Max responce size, KiB, default: 1024",
+	"<ms>		Poll time limit per soundbar, default: 10000\n"
+	"					Discovery: per host, default: 500\n"
+	"					Daemon: connect / responce time limit",
+	"<count>		Poll all soundbars count times, default: 1\n"
+	"					Heap allocations are reported per round",
+	"<path>		Keep soundbars connected, serve requests on\n"
+	"					unix socket, see lg_spk_daemon.h",
+	"<ms>		Daemon: probe idle soundbar, default: 30000",
+	"<ms>		Daemon: default cache age for get, default: 1000",
+	"<ms>		Daemon: refresh cache interval, default: 0 - off\n"
+	"					Pushed messages are polled 10 times less often",
+	"<ms>		Poll every ms until interrupted, print only changed\n"
+	"					fields",
+	"<fmt>		Output format: tree, jsonl, kv, default: tree\n"
+	"					Watch: jsonl",
+	"<cidr,...>	Find soundbars: a.b.c.d/prefix[:port], prefix: 12-32",
+	"<file>		Discovery: cache found soundbars by MAC, in targets\n"
+	"					file format",
+	"<ms>	Connect time limit, default: timeout\n"
+	"					Name with IPv6 and IPv4: IPv4 tried after 250",
+	"<ms>		No send / receive progress limit, default: timeout",
+	"<file>		Append all sent / received packets to binary log",
+	"<file>		Decode capture file, output: time ordered records\n"
+	"					Format default: jsonl",
+	"<count>		Replay: decode threads, default: CPUs count",
+	"			Print latency histograms to stderr on exit\n"
+	"					SIGUSR1: print them any time",
+	"<addr:port>	Daemon: serve Prometheus metrics from cache at\n"
+	"					http://addr:port/metrics, use with -poll",
+	"<depth>	Daemon: max background GETs in flight per\n"
+	"					soundbar, default: 1, client requests go first",
 	NULL
 };
 
 
+/* Decimal number in [min, max], usage error otherwise. */
+static int
+cmd_opt_num(const char *name, const char *str, const uint64_t min,
+    const uint64_t max, uint64_t *ret) {
+	size_t i;
+	uint64_t val = 0;
+
+	for (i = 0; NULL != str && 0 != str[i]; i ++) {
+		if ('0' > str[i] || '9' < str[i] ||
+		    ((UINT64_MAX - (uint64_t)(str[i] - '0')) / 10) < val)
+			goto err_out;
+		val = ((val * 10) + (uint64_t)(str[i] - '0'));
+	}
+	if (0 == i || min > val || max < val)
+		goto err_out;
+	(*ret) = val;
+
+	return (0);
+
+err_out:
+	fprintf(stderr, "%s: must be %"PRIu64" - %"PRIu64".\n",
+	    name, min, max);
+	return (EINVAL);
+}
+
 static int
 cmd_opts_parse(int argc, char **argv, struct option *opts,
     cmd_opts_p cmd_opts) {
 	int i, ch, opt_idx;
+	uint64_t val;
 	char opts_str[1024];
 
-
 	memset(cmd_opts, 0x00, sizeof(cmd_opts_t));
-	cmd_opts->action = -1;
-	cmd_opts->post_wr_verify = 1;
-	cmd_opts->size_error = 1;
+	cmd_opts->addr = CMD_OPTS_DEF_ADDR;
+	cmd_opts->pipeline = 1;
+	cmd_opts->max_payload = LG_CTL_CONN_BUF_MAX_SIZE;
+	cmd_opts->rounds = 1;
+	cmd_opts->format = LG_SPK_OUT_FMT_COUNT; /* Depends on mode. */
+	cmd_opts->keepalive = LG_SPK_DAEMON_DEF_KEEPALIVE;
+	cmd_opts->cache_ttl = LG_SPK_DAEMON_DEF_CACHE_TTL;
+	cmd_opts->poll_pipeline = LG_SPK_DAEMON_DEF_POLL_PIPELINE;
 
 	/* Process command line. */
 	/* Generate opts string from long options. */
@@ -527,7 +320,7 @@ cmd_opts_parse(int argc, char **argv, struct option *opts,
 		switch (opts[i].has_arg) {
 		case optional_argument:
 			opts_str[opt_idx ++] = ':';
-			/* PASSTROUTH. */
+			/* FALLTHROUGH */
 		case required_argument:
 			opts_str[opt_idx ++] = ':';
 		}
@@ -547,48 +340,118 @@ restart_opts:
 					goto restart_opts;
 			}
 			/* Unknown option. */
-			break;
+			return (EINVAL);
 		case 0: /* help */
 			return (EINVAL);
 		case 1: /* quiet */
 			cmd_opts->quiet = 1;
 			break;
-		case 2: /* raw */
-			cmd_opts->raw_data[cmd_opts->raw_data_count] = optarg;
-			cmd_opts->raw_data_count ++;
+		case 2: /* addr */
+			cmd_opts->addr = optarg;
+			break;
+		case 3: /* targets */
+			cmd_opts->targets_file = optarg;
+			break;
+		case 4: /* pipeline */
+			if (0 != cmd_opt_num("pipeline", optarg, 1,
+			    CMD_OPTS_DEPTH_MAX, &val))
+				return (EINVAL);
+			cmd_opts->pipeline = (size_t)val;
+			break;
+		case 5: /* max-payload */
+			if (0 != cmd_opt_num("max-payload", optarg, 1,
+			    CMD_OPTS_KIB_MAX, &val))
+				return (EINVAL);
+			cmd_opts->max_payload = (size_t)(val * 1024);
+			break;
+		case 6: /* timeout */
+			if (0 != cmd_opt_num("timeout", optarg, 1,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->timeout = val;
 			break;
-		case 2: /* write */
-		case 3: /* hwtest */
-			if (-1 != cmd_opts->action) {
-				fprintf(stderr,
-				    "write / read / verify / hwtest - can not be "
-				    "combined, select one of them.\n");
+		case 7: /* rounds */
+			if (0 != cmd_opt_num("rounds", optarg, 1,
+			    UINT32_MAX, &val))
+				return (EINVAL);
+			cmd_opts->rounds = (size_t)val;
+			break;
+		case 8: /* daemon */
+			cmd_opts->daemon = optarg;
+			break;
+		case 9: /* keepalive */
+			if (0 != cmd_opt_num("keepalive", optarg, 1,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->keepalive = val;
+			break;
+		case 10: /* cache-ttl */
+			if (0 != cmd_opt_num("cache-ttl", optarg, 0,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->cache_ttl = val;
+			break;
+		case 11: /* poll */
+			if (0 != cmd_opt_num("poll", optarg, 0,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->poll = val;
+			break;
+		case 12: /* watch */
+			if (0 != cmd_opt_num("watch", optarg, 1,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->watch = val;
+			break;
+		case 13: /* format */
+			cmd_opts->format = lg_spk_out_fmt_get(optarg,
+			    sstrlen(optarg));
+			if (LG_SPK_OUT_FMT_COUNT == cmd_opts->format) {
+				fprintf(stderr, "format: unknown.\n");
 				return (EINVAL);
 			}
-			cmd_opts->action = opt_idx;
-			cmd_opts->file_name = optarg;
 			break;
-		case 7: /* no-post-verify */
-			cmd_opts->post_wr_verify = 0;
+		case 14: /* discover */
+			cmd_opts->discover = optarg;
 			break;
-		case 9: /* chip */
-			cmd_opts->chip_name = optarg;
+		case 15: /* cache */
+			cmd_opts->cache = optarg;
 			break;
-		case 16: /* db-file */
-			cmd_opts->db_file_name = optarg;
+		case 16: /* connect-timeout */
+			if (0 != cmd_opt_num("connect-timeout", optarg, 0,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->connect_timeout = val;
 			break;
-		case 17: /* chip-id-check-no-fail */
-			cmd_opts->chip_id_check_no_fail = 1;
+		case 17: /* io-timeout */
+			if (0 != cmd_opt_num("io-timeout", optarg, 0,
+			    CMD_OPTS_MS_MAX, &val))
+				return (EINVAL);
+			cmd_opts->io_timeout = val;
 			break;
-		case 18: /* chip-id-check-disable */
-			cmd_opts->chip_id_check_disable = 1;
+		case 18: /* capture */
+			cmd_opts->capture = optarg;
 			break;
-		case 19: /* no-size-error */
-			cmd_opts->size_error = 0;
+		case 19: /* replay */
+			cmd_opts->replay = optarg;
+			break;
+		case 20: /* threads */
+			if (0 != cmd_opt_num("threads", optarg, 0,
+			    CMD_OPTS_DEPTH_MAX, &val))
+				return (EINVAL);
+			cmd_opts->threads = (size_t)val;
 			break;
-		case 20: /* no-size-error-warn */
-			cmd_opts->size_error = 0;
-			cmd_opts->size_error_no_warn = 1;
+		case 21: /* stats */
+			cmd_opts->stats = 1;
+			break;
+		case 22: /* metrics */
+			cmd_opts->metrics = optarg;
+			break;
+		case 23: /* poll-pipeline */
+			if (0 != cmd_opt_num("poll-pipeline", optarg, 1,
+			    CMD_OPTS_DEPTH_MAX, &val))
+				return (EINVAL);
+			cmd_opts->poll_pipeline = (size_t)val;
 			break;
 		default:
 			return (EINVAL);
@@ -603,12 +466,14 @@ static void
 print_usage(const char *progname, struct option *opts,
     const char **opts_descr) {
 	size_t i;
-	/*const char *usage =
+	const char *usage =
 		PACKAGE_STRING"     "PACKAGE_DESCRIPTION"\n"
-		"Usage: %s [options]\n"
+		"Usage: %s [options] [field ...]\n"
+		"fields: MSG, MSG.field or known field, GET only messages\n"
+		"	that have them and show only them; default: all\n"
 		"options:\n";
-	fprintf(stderr, usage, basename(progname));*/
 
+	fprintf(stderr, usage, basename((char*)progname));
 	for (i = 0; NULL != opts[i].name; i ++) {
 		if (0 == opts[i].val) {
 			fprintf(stderr, "	-%s %s\n",
@@ -619,77 +484,725 @@ print_usage(const char *progname, struct option *opts,
 		}
 	}
 }
-#endif
+
+
+static volatile sig_atomic_t lg_spk_stop = 0;
+
+static void
+lg_spk_sig_handler(int sig) {
+
+	(void)sig;
+	lg_spk_stop = 1;
+}
+
+static volatile sig_atomic_t lg_spk_stats_dump = 0;
+
+static void
+lg_spk_sig_usr1_handler(int sig) {
+
+	(void)sig;
+	lg_spk_stats_dump = 1;
+}
+
+static void
+lg_spk_sig_init(void) {
+	struct sigaction sa;
+
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sa_handler = lg_spk_sig_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+}
+
+/* Stats to stderr, in output format. */
+static void
+lg_spk_stats_print(lg_spk_stats_p stats, const int fmt,
+    const lg_spk_target_t *targets) {
+	lg_spk_out_t out;
+
+	lg_spk_out_init(&out, fmt, STDERR_FILENO);
+	lg_spk_out_stats(&out, stats, targets);
+	lg_spk_out_flush(&out);
+	lg_spk_out_destroy(&out);
+}
+
+/* Output write time is last request stage. */
+static int
+lg_spk_stats_flush(lg_spk_out_p out, lg_spk_stats_p stats) {
+	int error;
+	uint64_t ts = lg_ev_time_us();
+
+	error = lg_spk_out_flush(out);
+	lg_spk_stats_add(stats, LG_SPK_STATS_ALL, LG_SPK_STATS_ALL,
+	    LG_SPK_STAT_OUTPUT, (lg_ev_time_us() - ts));
+
+	return (error);
+}
+
+static int
+lg_spk_daemon(cmd_opts_p cmd_opts, lg_ctl_crypto_p crypto,
+    lg_ctl_get_pkts_p get_pkts, lg_ctl_cap_p cap, lg_spk_stats_p stats,
+    lg_spk_target_p targets, size_t targets_cnt) {
+	int error;
+	lg_spk_daemon_t d;
+
+	lg_spk_sig_init();
+	lg_spk_daemon_init(&d, crypto, get_pkts);
+	d.pipeline = cmd_opts->pipeline;
+	d.max_payload = cmd_opts->max_payload;
+	d.timeout = cmd_opts->timeout;
+	d.keepalive = cmd_opts->keepalive;
+	d.cache_ttl = cmd_opts->cache_ttl;
+	d.poll = cmd_opts->poll;
+	d.poll_pipeline = cmd_opts->poll_pipeline;
+	d.cap = cap;
+	d.stats = stats;
+	d.stats_dump = &lg_spk_stats_dump;
+	if (NULL != cmd_opts->metrics) {
+		error = sa_addr_port_from_str(&d.metrics, cmd_opts->metrics,
+		    strlen(cmd_opts->metrics));
+		if (0 != error || 0 == sa_port_get(&d.metrics)) {
+			error = EINVAL;
+			LOG_ERR_FMT(error, " - %s: metrics address",
+			    cmd_opts->metrics);
+			lg_spk_daemon_destroy(&d);
+			return (error);
+		}
+	}
+	error = lg_spk_daemon_run(&d, cmd_opts->daemon, targets, targets_cnt,
+	    &lg_spk_stop);
+	LOG_ERR_FMT(error, " - %s: lg_spk_daemon_run()", cmd_opts->daemon);
+	lg_spk_daemon_destroy(&d);
+
+	return (error);
+}
+
+
+typedef struct lg_spk_poll_ctx_s {
+	cmd_opts_p	cmd_opts;
+	lg_spk_engine_p	eng;
+	lg_spk_state_p	state;		/* Per target. */
+	lg_spk_out_p	out;
+	lg_spk_out_p	dump;		/* Responces: out or NULL if quiet. */
+	int		*error;		/* Watch: last status per target. */
+	uint64_t	decoded;	/* Watch: responces parsed. */
+	uint64_t	skipped;	/* Watch: not changed, by hash. */
+} lg_spk_poll_ctx_t, *lg_spk_poll_ctx_p;
+
+
+static size_t
+lg_spk_poll_data_cb(lg_spk_sess_p sess, uint8_t *data, size_t data_size,
+    void *udata) {
+	int error;
+	lg_ctl_resp_t resp;
+	lg_spk_poll_ctx_p ctx = udata;
+
+	//LOG_INFO(data);
+	error = lg_spk_handle_responce(
+	    ((NULL != ctx->cmd_opts->targets_file) ? sess->target->name : NULL),
+	    ctx->dump,
+	    &ctx->state[(size_t)(sess - ctx->eng->sess)],
+	    data, data_size, &resp);
+	LOG_ERR_FMT(error, " - %s: lg_spk_handle_responce()",
+	    sess->target->name);
+	if (0 != resp.notify)
+		return (LG_SPK_ENGINE_MSG_NOTIFY);
+
+	return (resp.msg_idx);
+}
+
+static void
+lg_spk_poll_report(lg_spk_engine_p eng, lg_spk_state_p states,
+    lg_spk_out_p out) {
+	size_t i, ok_cnt = 0;
+	int32_t func = -1;
+	double connect_ms, total_ms;
+	lg_spk_sess_p sess;
+	lg_spk_info_p info;
+	const char *status, *func_name;
+	char vol[16];
+
+	if (LG_SPK_OUT_FMT_TREE == out->fmt) {
+		lg_spk_out_printf(out, "%-24s %-24s %12s %12s %6s %-8s %s\n",
+		    "target", "status", "connect, ms", "total, ms", "msgs",
+		    "volume", "function");
+	}
+	for (i = 0; i < eng->sess_cnt; i ++) {
+		sess = &eng->sess[i];
+		info = &states[i].info;
+		if (0 == sess->error) {
+			ok_cnt ++;
+		}
+		/* From typed state. */
+		if (LG_SPK_INFO_HAS_FIELD(info, LG_SPK_F_I_VOL)) {
+			snprintf(vol, sizeof(vol), "%"PRIi32"%s", info->spk.vol,
+			    ((0 != info->spk.mute) ? " mute" : ""));
+		} else {
+			memcpy(vol, "-", 2);
+		}
+		if (LG_SPK_INFO_HAS_MSG(info, LG_CTL_MSG_FUNC_VIEW_INFO)) {
+			func = info->func.curr_func;
+		} else if (LG_SPK_INFO_HAS_MSG(info,
+		    LG_CTL_MSG_SPK_LIST_VIEW_INFO)) {
+			func = info->spk.curr_func;
+		} else {
+			func = -1;
+		}
+		status = ((0 == sess->error) ? "ok" : strerror(sess->error));
+		connect_ms = ((0 != sess->ts_connected) ?
+		    ((double)(sess->ts_connected - sess->ts_start) / 1000) : 0);
+		total_ms = ((double)(sess->ts_done - sess->ts_start) / 1000);
+		func_name = ((0 <= func &&
+		    nitems(lg_ctl_functions) > (size_t)func) ?
+		    lg_ctl_functions[func] : "-");
+		if (LG_SPK_OUT_FMT_TREE == out->fmt) {
+			lg_spk_out_printf(out,
+			    "%-24s %-24s %12.3f %12.3f %3zu/%-2zu %-8s %s\n",
+			    sess->target->name, status, connect_ms, total_ms,
+			    sess->done_cnt, eng->msg_cnt, vol,
+			    func_name);
+			continue;
+		}
+		lg_spk_out_rec_begin(out);
+		lg_spk_out_rec_str(out, "target", sess->target->name,
+		    strlen(sess->target->name));
+		lg_spk_out_rec_str(out, "status", status, strlen(status));
+		lg_spk_out_rec_fmt(out, "connect_ms", "%.3f", connect_ms);
+		lg_spk_out_rec_fmt(out, "total_ms", "%.3f", total_ms);
+		lg_spk_out_rec_fmt(out, "msgs", "%zu", sess->done_cnt);
+		if (LG_SPK_INFO_HAS_FIELD(info, LG_SPK_F_I_VOL)) {
+			lg_spk_out_rec_fmt(out, "volume", "%"PRIi32,
+			    info->spk.vol);
+			lg_spk_out_rec_json(out, "mute",
+			    ((0 != info->spk.mute) ? "true" : "false"),
+			    ((0 != info->spk.mute) ? 4 : 5));
+		}
+		if (0 <= func) {
+			lg_spk_out_rec_str(out, "function", func_name,
+			    strlen(func_name));
+		}
+		lg_spk_out_rec_end(out);
+	}
+	if (LG_SPK_OUT_FMT_TREE != out->fmt)
+		return;
+	lg_spk_out_printf(out,
+	    "targets: %zu, ok: %zu, failed: %zu, wall time: %.3f ms\n",
+	    eng->sess_cnt, ok_cnt, (eng->sess_cnt - ok_cnt),
+	    ((double)(eng->ts_done - eng->ts_start) / 1000));
+}
+
+
+/* Watch: one record per changed field. */
+typedef struct lg_spk_watch_s {
+	lg_spk_out_p	out;
+	const lg_spk_query_t *query;	/* NULL - all fields. */
+	size_t		msg_idx;
+	uint64_t	ts;		/* Unix time, ms. */
+	const char	*target;
+	const char	*msg;
+} lg_spk_watch_t, *lg_spk_watch_p;
+
+static uint64_t
+lg_spk_watch_ts(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return ((((uint64_t)ts.tv_sec) * 1000) +
+	    (((uint64_t)ts.tv_nsec) / 1000000));
+}
+
+static int
+lg_spk_watch_delta_cb(const char *path, size_t path_size,
+    const char *old, size_t old_size, const char *new, size_t new_size,
+    void *udata) {
+	lg_spk_watch_p w = udata;
+	const char *dot;
+
+	if (NULL != w->query) { /* Top level member. */
+		dot = memchr(path, '.', path_size);
+		if (0 == lg_spk_query_match(w->query, w->msg_idx, path,
+		    ((NULL != dot) ? (size_t)(dot - path) : path_size)))
+			return (0);
+	}
+	lg_spk_out_rec_begin(w->out);
+	lg_spk_out_rec_fmt(w->out, "ts", "%"PRIu64, w->ts);
+	lg_spk_out_rec_str(w->out, "target", w->target, strlen(w->target));
+	lg_spk_out_rec_str(w->out, "msg", w->msg, strlen(w->msg));
+	lg_spk_out_rec_str(w->out, "path", path, path_size);
+	if (NULL != old) {
+		lg_spk_out_rec_json(w->out, "old", old, old_size);
+	}
+	if (NULL != new) {
+		lg_spk_out_rec_json(w->out, "new", new, new_size);
+	}
+
+	return (lg_spk_out_rec_end(w->out));
+}
+
+static size_t
+lg_spk_watch_data_cb(lg_spk_sess_p sess, uint8_t *data, size_t data_size,
+    void *udata) {
+	int error;
+	size_t msg_idx;
+	uint64_t hash, now = lg_ev_time_us();
+	lg_spk_poll_ctx_p ctx = udata;
+	lg_spk_state_p state = &ctx->state[(size_t)(sess - ctx->eng->sess)];
+	lg_spk_state_ent_p ent;
+	lg_spk_info_dec_t dec;
+	lg_ctl_resp_t resp, old_resp;
+	lg_spk_fields_t fields[2]; /* Old, new. */
+	lg_spk_watch_t w;
+
+	/* Same payload as before: nothing to decode. */
+	hash = lg_spk_state_hash(data, data_size);
+	msg_idx = lg_spk_state_hash_find(state, hash, data_size);
+	if (LG_CTL_MSG_COUNT != msg_idx) {
+		ent = &state->ent[msg_idx];
+		ent->ts = now;
+		ctx->skipped ++;
+		return (((0 != ent->notify) ? LG_SPK_ENGINE_MSG_NOTIFY : msg_idx));
+	}
+
+	ctx->decoded ++;
+	lg_spk_info_dec_init(&dec, &state->info);
+	lg_spk_fields_init(&fields[1], &dec);
+	error = lg_spk_fields_parse(&fields[1], (const char*)data, data_size,
+	    &resp);
+	if (0 != error || 0 == resp.result || NULL == resp.data) {
+		LOG_ERR_FMT(error, " - %s: lg_spk_fields_parse()",
+		    sess->target->name);
+		goto out;
+	}
+	ent = &state->ent[resp.msg_idx];
+	lg_spk_fields_init(&fields[0], NULL);
+	if (0 != ent->version &&
+	    0 != lg_spk_fields_parse(&fields[0], (const char*)ent->data,
+	    ent->size, &old_resp)) {
+		fields[0].cnt = 0;
+	}
+	w.out = ctx->out;
+	w.query = ctx->out->query;
+	w.msg_idx = resp.msg_idx;
+	w.ts = lg_spk_watch_ts();
+	w.target = sess->target->name;
+	w.msg = lg_ctl_msg[resp.msg_idx];
+	lg_spk_fields_diff(&fields[0], &fields[1], lg_spk_watch_delta_cb, &w);
+	error = lg_spk_state_store(state, &resp, data, data_size, now);
+	LOG_ERR_FMT(error, " - %s: lg_spk_state_store()", sess->target->name);
+
+out:
+	if (0 != resp.notify)
+		return (LG_SPK_ENGINE_MSG_NOTIFY);
+	return (resp.msg_idx);
+}
+
+/* Poll until interrupted, statuses are printed on change. */
+static int
+lg_spk_watch(cmd_opts_p cmd_opts, lg_spk_engine_p eng,
+    lg_spk_poll_ctx_p ctx, lg_spk_target_p targets, size_t targets_cnt) {
+	int error = 0;
+	size_t i;
+	uint64_t ts_start, elapsed;
+	struct timespec ts;
+	lg_spk_sess_p sess;
+	const char *status;
+
+	ctx->error = lg_calloc(targets_cnt, sizeof(int));
+	if (NULL == ctx->error)
+		return (ENOMEM);
+	lg_spk_sig_init();
+	eng->data_cb = lg_spk_watch_data_cb;
+	while (0 == lg_spk_stop) {
+		ts_start = lg_ev_time_us();
+		error = lg_spk_engine_poll(eng, targets, targets_cnt);
+		if (0 != error) {
+			LOG_ERR(error, "lg_spk_engine_poll()");
+			break;
+		}
+		for (i = 0; i < eng->sess_cnt; i ++) {
+			sess = &eng->sess[i];
+			if (sess->error == ctx->error[i])
+				continue;
+			ctx->error[i] = sess->error;
+			status = ((0 == sess->error) ? "ok" :
+			    strerror(sess->error));
+			lg_spk_out_rec_begin(ctx->out);
+			lg_spk_out_rec_fmt(ctx->out, "ts", "%"PRIu64,
+			    lg_spk_watch_ts());
+			lg_spk_out_rec_str(ctx->out, "target", sess->target->name,
+			    strlen(sess->target->name));
+			lg_spk_out_rec_str(ctx->out, "status", status,
+			    strlen(status));
+			lg_spk_out_rec_end(ctx->out);
+		}
+		/* One write per round. */
+		error = lg_spk_stats_flush(ctx->out, eng->stats);
+		if (0 != error) {
+			LOG_ERR(error, "lg_spk_out_flush()");
+			break;
+		}
+		if (0 != lg_spk_stats_dump) {
+			lg_spk_stats_dump = 0;
+			lg_spk_stats_print(eng->stats, ctx->out->fmt, targets);
+		}
+		elapsed = (lg_ev_time_us() - ts_start);
+		if ((cmd_opts->watch * 1000) <= elapsed)
+			continue;
+		elapsed = ((cmd_opts->watch * 1000) - elapsed);
+		ts.tv_sec = (time_t)(elapsed / 1000000);
+		ts.tv_nsec = (long)((elapsed % 1000000) * 1000);
+		nanosleep(&ts, NULL);
+	}
+	fprintf(stderr, "responces: %"PRIu64", decoded: %"PRIu64", "
+	    "not changed: %"PRIu64"\n",
+	    (ctx->decoded + ctx->skipped), ctx->decoded, ctx->skipped);
+	lg_free(ctx->error);
+	ctx->error = NULL;
+
+	return (error);
+}
+
+
+/* Decode capture file to stdout. */
+static int
+lg_spk_replay(cmd_opts_p cmd_opts, const lg_spk_query_t *query) {
+	int error;
+	size_t i;
+	uint64_t rx = 0, tx = 0, bad = 0, elapsed;
+	lg_spk_replay_t replay;
+
+	lg_spk_replay_init(&replay);
+	replay.fmt = ((LG_SPK_OUT_FMT_COUNT == cmd_opts->format) ?
+	    LG_SPK_OUT_FMT_JSONL : cmd_opts->format);
+	replay.query = ((0 != query->cnt) ? query : NULL);
+	replay.threads = cmd_opts->threads;
+	error = lg_spk_replay_run(&replay, cmd_opts->replay);
+	LOG_ERR_FMT(error, " - %s: lg_spk_replay_run()", cmd_opts->replay);
+	if (0 == replay.records)
+		goto err_out;
+	for (i = 0; i < replay.worker_cnt; i ++) {
+		rx += replay.worker[i].rx;
+		tx += replay.worker[i].tx;
+		bad += replay.worker[i].bad;
+	}
+	elapsed = MAX(1, (replay.ts_done - replay.ts_start));
+	fprintf(stderr, "records: %"PRIu64", responces: %"PRIu64", "
+	    "requests: %"PRIu64", bad: %"PRIu64", threads: %zu, "
+	    "%.3f ms, %.1f MB/s\n",
+	    replay.records, rx, tx, bad, replay.worker_cnt,
+	    ((double)elapsed / 1000),
+	    ((double)replay.map_size / (double)elapsed));
+
+err_out:
+	lg_spk_replay_destroy(&replay);
+
+	return (error);
+}
+
+
+/* Scan ranges, update cache, print all known soundbars. */
+static int
+lg_spk_discovery(cmd_opts_p cmd_opts, lg_ctl_crypto_p crypto,
+    lg_ctl_get_pkts_p get_pkts, lg_ctl_cap_p cap) {
+	int error;
+	size_t i, targets_cnt, found = 0, addr_size;
+	struct rlimit rl;
+	lg_spk_target_p targets = NULL;
+	lg_spk_engine_t eng;
+	lg_spk_disc_cache_t cache;
+	lg_spk_disc_ent_p ent;
+	lg_spk_out_t out;
+	const char *state;
+	char addr[(INET6_ADDRSTRLEN + 16)], mac[18];
+
+	lg_spk_disc_cache_init(&cache);
+	lg_spk_engine_init(&eng, crypto, get_pkts);
+	lg_spk_out_init(&out, cmd_opts->format, STDOUT_FILENO);
+	error = lg_spk_cidr_targets(cmd_opts->discover,
+	    strlen(cmd_opts->discover), &targets, &targets_cnt);
+	if (0 != error) {
+		LOG_ERR_FMT(error, " - %s: lg_spk_cidr_targets()",
+		    cmd_opts->discover);
+		goto err_out;
+	}
+	if (NULL != cmd_opts->cache) {
+		error = lg_spk_disc_cache_load(&cache, cmd_opts->cache);
+		if (0 != error) {
+			LOG_ERR_FMT(error, " - %s: lg_spk_disc_cache_load()",
+			    cmd_opts->cache);
+			goto err_out;
+		}
+	}
+	/* Socket per host in flight: as many as allowed. */
+	eng.concurrency = LG_SPK_DISCOVER_DEF_CONCURRENCY;
+	if (0 == getrlimit(RLIMIT_NOFILE, &rl)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+		if (RLIM_INFINITY != rl.rlim_cur && 128 < rl.rlim_cur) {
+			eng.concurrency = MIN(eng.concurrency,
+			    (size_t)(rl.rlim_cur - 64));
+		}
+	}
+	eng.pipeline = 2;
+	eng.max_payload = cmd_opts->max_payload;
+	eng.timeout = cmd_opts->timeout;
+	eng.connect_timeout = cmd_opts->connect_timeout;
+	eng.cap = cap;
+	error = lg_spk_discover(&eng, targets, targets_cnt, &cache, &found);
+	if (0 != error) {
+		LOG_ERR(error, "lg_spk_discover()");
+		goto err_out;
+	}
+	for (i = 0; i < cache.allocated; i ++) {
+		ent = &cache.ent[i];
+		if (0 == ent->mac ||
+		    0 != sa_addr_port_to_str(&ent->addr, addr, sizeof(addr),
+		    &addr_size))
+			continue;
+		lg_spk_mac_fmt(ent->mac, mac, sizeof(mac));
+		state = lg_spk_disc_state[ent->state];
+		if (LG_SPK_OUT_FMT_TREE == out.fmt) {
+			lg_spk_out_printf(&out, "%-24.*s %s %-8s %s\n",
+			    (int)addr_size, addr, mac, state, ent->model);
+			continue;
+		}
+		lg_spk_out_rec_begin(&out);
+		lg_spk_out_rec_str(&out, "addr", addr, addr_size);
+		lg_spk_out_rec_str(&out, "mac", mac, strlen(mac));
+		lg_spk_out_rec_str(&out, "model", ent->model,
+		    strlen(ent->model));
+		lg_spk_out_rec_str(&out, "state", state, strlen(state));
+		lg_spk_out_rec_end(&out);
+	}
+	lg_spk_out_flush(&out);
+	fprintf(stderr, "hosts: %zu, found: %zu, cached: %zu, "
+	    "wall time: %.3f ms\n",
+	    targets_cnt, found, cache.cnt,
+	    ((double)(eng.ts_done - eng.ts_start) / 1000));
+	if (NULL != cmd_opts->cache) {
+		error = lg_spk_disc_cache_save(&cache, cmd_opts->cache);
+		LOG_ERR_FMT(error, " - %s: lg_spk_disc_cache_save()",
+		    cmd_opts->cache);
+	}
+
+err_out:
+	lg_spk_out_destroy(&out);
+	lg_spk_engine_destroy(&eng);
+	lg_spk_disc_cache_destroy(&cache);
+	lg_free(targets);
+
+	return (error);
+}
+
 
 int
 main(int argc, char *argv[]) {
 	int error = 0;
-	uintptr_t skt = (uintptr_t)-1;
-	struct sockaddr_storage addr;
-	const char *ctl_addr = "172.16.0.227";
-	//const char *ctl_addr = "[2001:470:1f15:3d8:9a93:ccff:fece:16a1]";
-	uint8_t buf[4096];
-	size_t i, buf_size;
-#if 0
+	lg_ctl_crypto_t crypto;
+	lg_ctl_get_pkts_t get_pkts;
+	lg_spk_engine_t eng;
+	lg_spk_target_t target, *targets = &target;
+	size_t i, targets_cnt = 1;
+	uint64_t alloc_cnt;
+	lg_spk_poll_ctx_t ctx;
+	lg_spk_out_t out;
+	lg_spk_query_t query;
+	lg_ctl_cap_t cap, *capp = NULL;
+	lg_spk_stats_p stats;
+	struct sigaction sa;
 	cmd_opts_t cmd_opts;
 
 
+	/* Before any OpenSSL call. */
+	lg_mem_openssl_hook();
 	error = cmd_opts_parse(argc, argv, long_options, &cmd_opts);
 	if (0 != error) {
-		if (-1 == error)
-			return (0); /* Handled action. */
 		print_usage(argv[0], long_options, long_options_descr);
 		return (error);
 	}
-
-	if (optind >= argc) {
-		fprintf(stderr, "Expected argument after options\n");
-		//exit(EXIT_FAILURE);
+	if (0 == cmd_opts.timeout) {
+		cmd_opts.timeout = ((NULL != cmd_opts.discover) ?
+		    LG_SPK_DISCOVER_DEF_TIMEOUT : LG_SPK_ENGINE_DEF_TIMEOUT);
 	}
-#endif
-
+	if (NULL != cmd_opts.discover &&
+	    LG_SPK_OUT_FMT_COUNT == cmd_opts.format) {
+		cmd_opts.format = LG_SPK_OUT_FMT_TREE;
+	}
+	lg_spk_query_init(&query);
+	for (i = (size_t)optind; i < (size_t)argc; i ++) {
+		error = lg_spk_query_add(&query, argv[i], strlen(argv[i]));
+		if (0 != error) {
+			LOG_ERR_FMT(error, " - %s: lg_spk_query_add()", argv[i]);
+			return (error);
+		}
+	}
+	error = lg_spk_query_plan(&query);
+	if (0 != error) {
+		LOG_ERR(error, "lg_spk_query_plan()");
+		return (error);
+	}
+	if (NULL != cmd_opts.replay)
+		return (lg_spk_replay(&cmd_opts, &query));
 
+	if (NULL != cmd_opts.targets_file) {
+		error = lg_spk_targets_load(cmd_opts.targets_file,
+		    &targets, &targets_cnt);
+		if (0 != error) {
+			LOG_ERR_FMT(error, " - %s: lg_spk_targets_load()",
+			    cmd_opts.targets_file);
+			return (error);
+		}
+	} else {
+		error = lg_spk_target_set(&target, cmd_opts.addr,
+		    sstrlen(cmd_opts.addr));
+		if (0 != error) {
+			LOG_ERR(error, "lg_spk_target_set()");
+			return (error);
+		}
+	}
 
-	error = sa_addr_port_from_str(&addr, ctl_addr, sstrlen(ctl_addr));
+	error = lg_ctl_crypto_init(&crypto);
 	if (0 != error) {
-		LOG_ERR(error, "sa_addr_port_from_str()");
-		goto err_out;
+		LOG_ERR(error, "lg_ctl_crypto_init()");
+		goto err_out_targets;
 	}
-	if (0 == sa_port_get(&addr)) { /* Set def port. */
-		sa_port_set(&addr, LG_CTL_TCP_PORT);
+	error = lg_ctl_get_pkts_create(&crypto, &get_pkts);
+	if (0 != error) {
+		LOG_ERR(error, "lg_ctl_get_pkts_create()");
+		goto err_out_crypto;
 	}
-
-	error = skt_connect(&addr, SOCK_STREAM, 0, 0, &skt);
+	if (NULL != cmd_opts.capture) {
+		error = lg_ctl_cap_open(&cap, cmd_opts.capture, 0);
+		if (0 != error) {
+			LOG_ERR_FMT(error, " - %s: lg_ctl_cap_open()",
+			    cmd_opts.capture);
+			goto err_out_get_pkts;
+		}
+		capp = &cap;
+	}
+	if (NULL != cmd_opts.discover) {
+		error = lg_spk_discovery(&cmd_opts, &crypto, &get_pkts, capp);
+		goto err_out_cap;
+	}
+	/* Cheap: always on, SIGUSR1 prints. */
+	error = lg_spk_stats_create(targets_cnt, &stats);
 	if (0 != error) {
-		LOG_ERR(error, "skt_connect()");
-		goto err_out;
+		LOG_ERR(error, "lg_spk_stats_create()");
+		goto err_out_cap;
+	}
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sa_handler = lg_spk_sig_usr1_handler;
+	sigaction(SIGUSR1, &sa, NULL);
+	if (NULL != cmd_opts.daemon) {
+		error = lg_spk_daemon(&cmd_opts, &crypto, &get_pkts, capp,
+		    stats, targets, targets_cnt);
+		goto err_out_stats;
+	}
+	if (LG_SPK_OUT_FMT_COUNT == cmd_opts.format) {
+		cmd_opts.format = ((0 != cmd_opts.watch) ?
+		    LG_SPK_OUT_FMT_JSONL : LG_SPK_OUT_FMT_TREE);
+	}
+	lg_spk_out_init(&out, cmd_opts.format, STDOUT_FILENO);
+	if (0 != query.cnt) {
+		out.query = &query;
+	}
+	ctx.cmd_opts = &cmd_opts;
+	ctx.eng = &eng;
+	ctx.out = &out;
+	ctx.dump = ((0 == cmd_opts.quiet) ? &out : NULL);
+	ctx.state = lg_calloc(targets_cnt, sizeof(lg_spk_state_t));
+	if (NULL == ctx.state) {
+		error = ENOMEM;
+		LOG_ERR(error, "lg_calloc()");
+		goto err_out_stats;
 	}
 
-	for (i = 0; i < 14; i ++) {
-		buf_size = (size_t)snprintf((char*)buf, sizeof(buf),
-		    "{\"cmd\": \"get\", \"msg\": \"%s\"}",
-		    lg_ctl_msg[i]);
-
-		error = lg_ctl_pkt_send(skt, buf, buf_size);
+	lg_spk_engine_init(&eng, &crypto, &get_pkts);
+	eng.pipeline = cmd_opts.pipeline;
+	eng.max_payload = cmd_opts.max_payload;
+	eng.timeout = cmd_opts.timeout;
+	eng.connect_timeout = cmd_opts.connect_timeout;
+	eng.io_timeout = cmd_opts.io_timeout;
+	eng.msgs = query.msgs;
+	eng.data_cb = lg_spk_poll_data_cb;
+	eng.udata = &ctx;
+	eng.cap = capp;
+	eng.stats = stats;
+	ctx.error = NULL;
+	ctx.decoded = 0;
+	ctx.skipped = 0;
+	if (0 != cmd_opts.watch) {
+		error = lg_spk_watch(&cmd_opts, &eng, &ctx, targets,
+		    targets_cnt);
+		cmd_opts.rounds = 0;
+	}
+	for (i = 0; i < cmd_opts.rounds; i ++) {
+		alloc_cnt = lg_mem_stat.alloc_cnt;
+		error = lg_spk_engine_poll(&eng, targets, targets_cnt);
 		if (0 != error) {
-			LOG_ERR(error, "lg_ctl_pkt_send()");
-			goto err_out;
+			LOG_ERR(error, "lg_spk_engine_poll()");
+			break;
 		}
-		error = lg_ctl_pkt_recv(skt, buf, sizeof(buf), &buf_size);
-		if (0 != error) {
-			LOG_ERR(error, "lg_ctl_pkt_recv()");
-			goto err_out;
+		if (NULL != cmd_opts.targets_file) {
+			lg_spk_poll_report(&eng, ctx.state, &out);
+		} else {
+			error = eng.sess[0].error;
+			LOG_ERR_FMT(error, " - %s", eng.sess[0].target->name);
 		}
-		//LOG_INFO(buf);
-		LOG_INFO(lg_ctl_msg[i]);
-
-		lg_spk_handle_responce(lg_ctl_msg[i], strlen(lg_ctl_msg[i]),
-		    buf, buf_size);
-		LOG_INFO("");
+		if (1 < cmd_opts.rounds) {
+			alloc_cnt = (lg_mem_stat.alloc_cnt - alloc_cnt);
+			if (LG_SPK_OUT_FMT_TREE == out.fmt) {
+				lg_spk_out_printf(&out,
+				    "round %zu: heap allocations: %"PRIu64"\n",
+				    (i + 1), alloc_cnt);
+			} else {
+				lg_spk_out_rec_begin(&out);
+				lg_spk_out_rec_fmt(&out, "round", "%zu", (i + 1));
+				lg_spk_out_rec_fmt(&out, "heap_allocations",
+				    "%"PRIu64, alloc_cnt);
+				lg_spk_out_rec_end(&out);
+			}
+		}
+		/* One write per round. */
+		lg_spk_stats_flush(&out, stats);
+		if (0 != lg_spk_stats_dump) {
+			lg_spk_stats_dump = 0;
+			lg_spk_stats_print(stats, out.fmt, targets);
+		}
+	}
+	lg_spk_out_destroy(&out);
+	lg_spk_engine_destroy(&eng);
+	for (i = 0; i < targets_cnt; i ++) {
+		lg_spk_state_destroy(&ctx.state[i]);
 	}
+	lg_free(ctx.state);
 
-err_out:
-	close((int)skt);
+err_out_stats:
+	if (0 != cmd_opts.stats) {
+		lg_spk_stats_print(stats,
+		    ((LG_SPK_OUT_FMT_COUNT == cmd_opts.format) ?
+		    LG_SPK_OUT_FMT_TREE : cmd_opts.format), targets);
+	}
+	lg_spk_stats_destroy(stats);
+err_out_cap:
+	if (NULL != capp) {
+		lg_ctl_cap_close(capp);
+		LOG_ERR_FMT(cap.error, " - %s: capture write", cmd_opts.capture);
+		fprintf(stderr, "capture: records: %"PRIu64", bytes: %"PRIu64", "
+		    "dropped: %"PRIu64"\n",
+		    cap.frames, cap.bytes, cap.dropped);
+	}
+err_out_get_pkts:
+	lg_ctl_get_pkts_destroy(&get_pkts);
+err_out_crypto:
+	lg_ctl_crypto_destroy(&crypto);
+err_out_targets:
+	if (&target != targets) {
+		lg_free(targets);
+	}
 
 	return (error);
 }
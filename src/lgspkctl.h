@@ -38,24 +38,23 @@
 
 #include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
 #include <stdlib.h>
-#include <openssl/aes.h> /* Requires: -lcrypto from OpenSSL/LibreSSL. */
+#include <stdio.h> /* snprintf */
+#include <limits.h>
+#include <openssl/aes.h> /* AES_BLOCK_SIZE. */
+#include <openssl/evp.h> /* Requires: -lcrypto from OpenSSL/LibreSSL. */
 
+#include "lg_mem.h"
+#include "lg_aes_mb.h"
+
+
+/*
+ * LG soundbar control protocol: message names, crypto context and
+ * frame encoder / decoder. Part of liblgspk, see lgspk.h.
+ */
 
-#define LG_AES_IV_SIZE		AES_BLOCK_SIZE
-/* "\'%^Ur7gy$~t+f)%@" */
-static const uint8_t lg_aes_iv[LG_AES_IV_SIZE] = {
-	0x27, 0x25, 0x5e, 0x55, 0x72, 0x37, 0x67, 0x79,
-	0x24, 0x7e, 0x74, 0x2b, 0x66, 0x29, 0x25, 0x40
-};
 
+#define LG_AES_IV_SIZE		AES_BLOCK_SIZE
 #define LG_AES_KEY_SIZE		32
-/* "T^&*J%^7tr~4^%^&I(o%^!jIJ__+a0 k" */
-static const uint8_t lg_aes_key[LG_AES_KEY_SIZE] = {
-	0x54, 0x5e, 0x26, 0x2a, 0x4a, 0x25, 0x5e, 0x37,
-	0x74, 0x72, 0x7e, 0x34, 0x5e, 0x25, 0x5e, 0x26,
-	0x49, 0x28, 0x6f, 0x25, 0x5e, 0x21, 0x6a, 0x49,
-	0x4a, 0x5f, 0x5f, 0x2b, 0x61, 0x30, 0x20, 0x6b
-};
 #define LG_CTL_TCP_PORT		9741
 
 #define LG_CTL_PKT_HDR_MAGIC	0x10
@@ -66,167 +65,120 @@ typedef struct lg_ctl_pkt_hdr_s {
 } __attribute__((__packed__)) lg_ctl_pkt_hdr_t, *lg_ctl_pkt_hdr_p;
 
 
-static const char *lg_ctl_msg[] = {
-	"EQ_VIEW_INFO",
-	"SPK_LIST_VIEW_INFO",
-	"PLAY_INFO",
-	"FUNC_VIEW_INFO",
-	"SETTING_VIEW_INFO",
-	"PRODUCT_INFO",
-	"C4A_SETTING_INFO",
-	"RADIO_VIEW_INFO",
-	"SHARE_AP_INFO",
-	"UPDATE_VIEW_INFO",
-	"BUILD_INFO_DEV",
-	"OPTION_INFO_DEV",
-	"MAC_INFO_DEV",
-	"MEM_MON_DEV",
-	"TEST_DEV",
-	"TEST_TONE_REQ",
-	"FACTORY_SET_REQ"
-};
+extern const char *lg_ctl_msg[];
+/* lg_ctl_msg[] indexes. */
+#define LG_CTL_MSG_EQ_VIEW_INFO		0
+#define LG_CTL_MSG_SPK_LIST_VIEW_INFO	1
+#define LG_CTL_MSG_PLAY_INFO		2
+#define LG_CTL_MSG_FUNC_VIEW_INFO	3
+#define LG_CTL_MSG_SETTING_VIEW_INFO	4
+#define LG_CTL_MSG_PRODUCT_INFO		5
+#define LG_CTL_MSG_C4A_SETTING_INFO	6
+#define LG_CTL_MSG_RADIO_VIEW_INFO	7
+#define LG_CTL_MSG_SHARE_AP_INFO	8
+#define LG_CTL_MSG_UPDATE_VIEW_INFO	9
+#define LG_CTL_MSG_BUILD_INFO_DEV	10
+#define LG_CTL_MSG_OPTION_INFO_DEV	11
+#define LG_CTL_MSG_MAC_INFO_DEV		12
+#define LG_CTL_MSG_MEM_MON_DEV		13
+#define LG_CTL_MSG_TEST_DEV		14
+#define LG_CTL_MSG_TEST_TONE_REQ	15
+#define LG_CTL_MSG_FACTORY_SET_REQ	16
+#define LG_CTL_MSG_COUNT		17
+/* First messages are info only and safe to GET at any time. */
+#define LG_CTL_MSG_GET_COUNT		LG_CTL_MSG_TEST_DEV
+
+#define LG_CTL_GET_REQ_FMT	"{\"cmd\": \"get\", \"msg\": \"%s\"}"
+
+/* Returns lg_ctl_msg[] index or LG_CTL_MSG_COUNT if msg is unknown. */
+size_t	lg_ctl_msg_idx_get(const char *msg, const size_t msg_size);
 
 /* EQ_VIEW_INFO: i_curr_eq, ai_eq_list */
-static const char *lg_ctl_equalisers[] = {
-	"Standard",
-	"Bass",
-	"Flat",
-	"Boost",
-	"Treble and Bass",
-	"User",
-	"Music",
-	"Cinema",
-	"Night",
-	"News",
-	"Voice",
-	"ia_sound",
-	"Adaptive Sound Control",
-	"Movie",
-	"Bass Blast",
-	"Dolby Atmos",
-	"DTS Virtual X",
-	"Bass Boost Plus"
-};
+#define LG_CTL_EQUALISERS_COUNT	18
+extern const char *lg_ctl_equalisers[LG_CTL_EQUALISERS_COUNT];
 
 /* FUNC_VIEW_INFO: i_curr_func, ai_func_list */
-static const char *lg_ctl_functions[] = {
-	"Wifi",
-	"Bluetooth",
-	"Portable",
-	"Aux",
-	"Optical",
-	"CP",
-	"HDMI",
-	"ARC",
-	"Spotify",
-	"Optical2",
-	"HDMI2",
-	"HDMI3",
-	"LG TV",
-	"Mic",
-	"Chromecast",
-	"Optical/HDMI ARC",
-	"LG Optical",
-	"FM",
-	"USB"
-};
-
-
-static int
-lg_ctl_pkt_create(const uint8_t *data, const size_t data_size,
-    uint8_t *buf, size_t *buf_size_ret) {
-	AES_KEY enc_key;
-	const size_t pad_size = (AES_BLOCK_SIZE - (data_size % AES_BLOCK_SIZE));
-	const size_t payload_size = (data_size + pad_size);
-	const uint32_t payload32n_size = htonl((uint32_t)payload_size);
-	uint8_t *plain_buf, iv[AES_BLOCK_SIZE];
-
-	if (NULL != buf_size_ret) {
-		(*buf_size_ret) = ((sizeof(lg_ctl_pkt_hdr_t) + payload_size));
-	}
-	if (NULL == buf)
-		return (ENOBUFS); /* Allow delayed mem alloc. */
-	if (NULL == data || 0 == data_size || NULL == buf_size_ret)
-		return (EINVAL);
-
-	/* Prepare data to crypt: PADd it. */
-	plain_buf = malloc(payload_size);
-	if (NULL == plain_buf)
-		return (ENOMEM);
-	memcpy(plain_buf, data, data_size);
-	memset((plain_buf + data_size), (uint8_t)pad_size, pad_size);
-
-	/* Write pcaket header: magic + size. */
-	buf[0] = LG_CTL_PKT_HDR_MAGIC;
-	memcpy((buf + 1), &payload32n_size, sizeof(uint32_t));
-
-	/* Encrypt peyload data. */
-	AES_set_encrypt_key(lg_aes_key, (LG_AES_KEY_SIZE * 8), &enc_key);
-	memcpy(iv, lg_aes_iv, AES_BLOCK_SIZE);
-	AES_cbc_encrypt(plain_buf, (buf + sizeof(lg_ctl_pkt_hdr_t)),
-	    payload_size, &enc_key, iv, AES_ENCRYPT);
-	free(plain_buf);
-
-	return (0);
-}
-
-static int
-lg_ctl_pkt_data_get(size_t *buf_off, const uint8_t *buf, const size_t buf_size,
-    uint8_t *data, const size_t data_size, size_t *data_size_ret) {
-	AES_KEY dec_key;
-	size_t pkt_size, pad_size;
-	uint32_t payload32n_size;
-	uint8_t *ptr, iv[AES_BLOCK_SIZE];
-
-	if (NULL == buf || NULL == buf_off || (*buf_off) >= buf_size)
-		return (EINVAL);
-
-	/* Looking for packet header start. */
-	ptr = memchr((buf + (*buf_off)), LG_CTL_PKT_HDR_MAGIC,
-	    (buf_size - (*buf_off)));
-	if (NULL == ptr) {
-		(*buf_off) = buf_size;
-		return (EAGAIN);
-	}
-	(*buf_off) = (size_t)(ptr - buf); /* Remember packet offset in buf. */
-	ptr ++;
-
-	/* Read packet size from header. */
-	if ((buf_size - (size_t)(ptr - buf)) < sizeof(uint32_t))
-		return (EAGAIN); /* Not enough data received. */
-	memcpy(&payload32n_size, ptr, sizeof(uint32_t));
-	pkt_size = ntohl(payload32n_size);
-	ptr += sizeof(uint32_t);
-
-	/* Check available data and buffer space. */
-	if ((buf_size - (size_t)(ptr - buf)) < pkt_size)
-		return (EAGAIN); /* Not enough data received. */
-	if (data_size < pkt_size || NULL == data) {
-		if (NULL != data_size_ret) {
-			(*data_size_ret) = pkt_size;
-		}
-		return (ENOBUFS); /* Allow delayed mem alloc. */
-	}
-
-	(*buf_off) = (size_t)((ptr + pkt_size) - buf); /* Set next packet offset. */
-
-	/* Decrypt peyload data. */
-	AES_set_decrypt_key(lg_aes_key, (LG_AES_KEY_SIZE * 8), &dec_key);
-	memcpy(iv, lg_aes_iv, AES_BLOCK_SIZE);
-	AES_cbc_encrypt(ptr, data, pkt_size, &dec_key, iv, AES_DECRYPT);
-
-	/* Process PADding. */
-	pad_size = data[(pkt_size - 1)];
-	if (AES_BLOCK_SIZE < pad_size)
-		return (EBADMSG); /* Bad payload. */
-	/* Zeroize end, we always have space for that. */
-	data[(pkt_size - pad_size)] = 0;
-	if (NULL != data_size_ret) { /* Decrease PADding size. */
-		(*data_size_ret) = (pkt_size - pad_size);
-	}
-
-	return (0);
-}
+#define LG_CTL_FUNCTIONS_COUNT	19
+extern const char *lg_ctl_functions[LG_CTL_FUNCTIONS_COUNT];
+
+
+/* Crypto context: key schedules expanded once and reused for every packet. */
+typedef struct lg_ctl_crypto_s {
+	EVP_CIPHER_CTX	*enc_ctx;	/* AES-256-CBC encrypt, key set. */
+	EVP_CIPHER_CTX	*dec_ctx;	/* AES-256-CBC decrypt, key set. */
+	lg_aes_mb_key_t	mb;		/* AES-NI / VAES, if CPU has. */
+} lg_ctl_crypto_t, *lg_ctl_crypto_p;
+
+
+int	lg_ctl_crypto_init(lg_ctl_crypto_p crypto);
+void	lg_ctl_crypto_destroy(lg_ctl_crypto_p crypto);
+
+/*
+ * buf = NULL: only return packet size in buf_size_ret.
+ * data may already be at (buf + sizeof(lg_ctl_pkt_hdr_t)): it is padded
+ * and encrypted in place.
+ */
+int	lg_ctl_pkt_create(lg_ctl_crypto_p crypto, const uint8_t *data,
+	    const size_t data_size, uint8_t *buf, size_t *buf_size_ret);
+
+/* Packet for lg_ctl_pkt_create_batch(). */
+typedef struct lg_ctl_pkt_job_s {
+	const uint8_t	*data;
+	size_t		data_size;
+	uint8_t		*buf;		/* lg_ctl_pkt_create() size. */
+	size_t		buf_size;	/* Packet size, set on return. */
+} lg_ctl_pkt_job_t, *lg_ctl_pkt_job_p;
+
+#define LG_CTL_PKT_BATCH_MAX	256 /* Jobs per kernel call. */
+
+/*
+ * lg_ctl_pkt_create() for many independent packets: CBC is serial
+ * inside packet, so packets are encrypted interleaved by multi buffer
+ * AES if CPU has AES-NI, one by one otherwise.
+ */
+int	lg_ctl_pkt_create_batch(lg_ctl_crypto_p crypto,
+	    lg_ctl_pkt_job_p jobs, const size_t jobs_cnt);
+
+/*
+ * Find next packet in buf, payload is not copied.
+ * Returns:
+ * 0: payload points to encrypted payload, buf_off - to next packet.
+ * EAGAIN: more data required, buf_off points to packet start (or to
+ * buf_size if no packet start found), payload_size is set to payload
+ * size if packet header is complete, 0 otherwise.
+ * EBADMSG: bad packet header.
+ */
+int	lg_ctl_pkt_payload_get(size_t *buf_off, const uint8_t *buf,
+	    const size_t buf_size, const uint8_t **payload,
+	    size_t *payload_size);
+
+/* data may point to payload: in place decrypt. */
+int	lg_ctl_pkt_payload_decrypt(lg_ctl_crypto_p crypto,
+	    const uint8_t *payload, const size_t payload_size,
+	    uint8_t *data, const size_t data_size, size_t *data_size_ret);
+/* Find next packet in buf and decrypt it to data. */
+int	lg_ctl_pkt_data_get(lg_ctl_crypto_p crypto, size_t *buf_off,
+	    const uint8_t *buf, const size_t buf_size,
+	    uint8_t *data, const size_t data_size, size_t *data_size_ret);
+
+
+/* Ready to send GET packets for all info messages.
+ * Key and IV are constants, so encrypted GET request is constant too. */
+typedef struct lg_ctl_pkt_s {
+	const uint8_t	*data;
+	size_t		size;
+} lg_ctl_pkt_t, *lg_ctl_pkt_p;
+
+typedef struct lg_ctl_get_pkts_s {
+	uint8_t		*mem;		/* All packets in one block. */
+	size_t		mem_size;
+	lg_ctl_pkt_t	pkt[LG_CTL_MSG_GET_COUNT]; /* lg_ctl_msg[] indexed. */
+} lg_ctl_get_pkts_t, *lg_ctl_get_pkts_p;
+
+
+int	lg_ctl_get_pkts_create(lg_ctl_crypto_p crypto,
+	    lg_ctl_get_pkts_p get_pkts);
+void	lg_ctl_get_pkts_destroy(lg_ctl_get_pkts_p get_pkts);
 
 
 #endif /* __LG_SPK_CONTROL_PROTO_H__ */
@@ -0,0 +1,1673 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * LG soundbar emulator: speaks TCP 9741 protocol with real framing and
+ * crypto, answers GET from canned JSON, applies SET to its state.
+ * For tests and load benchmarks of lgspkctl without hardware.
+ */
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <inttypes.h>
+#include <signal.h>
+#include <errno.h>
+#include <getopt.h>
+#include <libgen.h> /* basename */
+
+#ifdef HAVE_CONFIG_H
+#	include "config.h"
+#endif
+#include "lgspkctl.h"
+#include "lg_ctl_conn.h"
+#include "lg_ctl_resp.h"
+#include "lg_ev.h"
+#include "lg_mem.h"
+#include "json.h"
+#include "net/socket.h"
+#include "net/socket_address.h"
+#include "utils/mem_utils.h"
+#include "utils/str2num.h"
+
+
+#define sstrlen(__str)	((NULL == (__str)) ? 0 : strlen((__str)))
+
+#define LOG_ERR(_error, _descr)						\
+	    if (0 != (_error))						\
+		fprintf(stderr, "%s , line: %i, error: %i - %s - %s\n",	\
+		    __FUNCTION__, __LINE__, (_error), strerror((_error)), (_descr))
+#define LOG_INFO_FMT(fmt, args...)					\
+	    fprintf(stdout, fmt"\n", ##args)
+
+
+/* Canned data, used if not overridden by -data file. */
+static const char *lg_emu_def_data[LG_CTL_MSG_COUNT] = {
+	/* EQ_VIEW_INFO */
+	"{\"i_bass\": 5, \"i_treble\": 5, \"i_curr_eq\": 2, "
+	"\"ai_eq_list\": [0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13]}",
+	/* SPK_LIST_VIEW_INFO */
+	"{\"i_vol\": 12, \"i_vol_min\": 0, \"i_vol_max\": 40, "
+	"\"b_mute\": false, \"i_curr_func\": 6, \"b_powerstatus\": true, "
+	"\"s_user_name\": \"LG Soundbar\"}",
+	/* PLAY_INFO */
+	"{\"i_stream_type\": 0, \"b_play\": false, \"i_curr_time\": 0, "
+	"\"i_duration\": 0, \"s_title\": \"\", \"s_artist\": \"\", "
+	"\"s_albumname\": \"\"}",
+	/* FUNC_VIEW_INFO */
+	"{\"i_curr_func\": 6, \"ai_func_list\": [0, 1, 4, 6, 7, 8, 14]}",
+	/* SETTING_VIEW_INFO */
+	"{\"i_rear_level\": 0, \"i_woofer_level\": 0, \"i_woofer_min\": -15, "
+	"\"i_woofer_max\": 6, \"b_night_time\": false, \"b_auto_vol\": false, "
+	"\"b_auto_power\": true, \"b_drc\": false, \"b_tv_remote\": false, "
+	"\"i_av_sync\": 0, \"s_user_name\": \"LG Soundbar\"}",
+	/* PRODUCT_INFO */
+	"{\"s_uuid\": \"00000000-0000-0000-0000-000000000000\", "
+	"\"i_model_no\": 0, \"i_model_type\": 0, \"s_model_name\": \"SN11RG\", "
+	"\"s_user_name\": \"LG Soundbar\"}",
+	/* C4A_SETTING_INFO */
+	"{\"b_c4a_enable\": false}",
+	/* RADIO_VIEW_INFO */
+	"{\"i_radio_type\": 0, \"s_station\": \"\"}",
+	/* SHARE_AP_INFO */
+	"{\"b_share_ap\": false}",
+	/* UPDATE_VIEW_INFO */
+	"{\"b_update\": false, \"i_update_state\": 0, "
+	"\"s_version\": \"NB9.502.00000.C\"}",
+	/* BUILD_INFO_DEV */
+	"{\"s_main_ver\": \"NB9.502.00000.C\", \"s_build_date\": \"20240101\"}",
+	/* OPTION_INFO_DEV */
+	"{\"i_country\": 0}",
+	/* MAC_INFO_DEV */
+	"{\"s_wireless_mac\": \"00:00:5e:00:53:01\", "
+	"\"s_wired_mac\": \"00:00:5e:00:53:02\", "
+	"\"s_bt_mac\": \"00:00:5e:00:53:03\"}",
+	/* MEM_MON_DEV */
+	"{\"i_mem_total\": 262144, \"i_mem_free\": 131072}",
+	/* TEST_DEV */
+	"{}",
+	/* TEST_TONE_REQ */
+	"{}",
+	/* FACTORY_SET_REQ */
+	"{}"
+};
+
+
+/* One field of message "data" object: name + raw JSON value. */
+typedef struct lg_emu_field_s {
+	char		*name;
+	size_t		name_size;
+	char		*value;
+	size_t		value_size;
+} lg_emu_field_t, *lg_emu_field_p;
+
+typedef struct lg_emu_msg_s {
+	lg_emu_field_p	fields;
+	size_t		fields_cnt;
+	size_t		fields_allocated;
+	uint8_t		*pkt;		/* Cached GET responce, NULL if changed. */
+	size_t		pkt_size;
+} lg_emu_msg_t, *lg_emu_msg_p;
+
+/* Responce that waits for latency. */
+typedef struct lg_emu_pend_s {
+	uint64_t	due;		/* Monotonic time, us. */
+	size_t		tx_end;		/* Can send tx_buf up to this offset. */
+} lg_emu_pend_t, *lg_emu_pend_p;
+
+typedef struct lg_emu_conn_s {
+	struct lg_emu_conn_s *next;	/* In active or free list. */
+	struct lg_emu_conn_s *prev;
+	lg_ctl_conn_t	conn;		/* Socket and receive buffer. */
+	uint32_t	gen;		/* Changed on close, for timers. */
+	uint32_t	ev_flags;
+	uint8_t		*tx_buf;
+	size_t		tx_buf_size;
+	size_t		tx_len;		/* Queued to send. */
+	size_t		tx_ready;	/* Allowed to send. */
+	size_t		tx_sent;
+	uint64_t	tx_next;	/* Next fragment send time, us. */
+	lg_emu_pend_p	pend;
+	size_t		pend_first;
+	size_t		pend_cnt;	/* Used, including first. */
+	size_t		pend_allocated;
+} lg_emu_conn_t, *lg_emu_conn_p;
+
+typedef struct lg_emu_timer_s {
+	uint64_t	due;		/* Monotonic time, us. */
+	lg_emu_conn_p	conn;
+	uint32_t	gen;
+} lg_emu_timer_t, *lg_emu_timer_p;
+
+typedef struct lg_emu_s {
+	lg_ctl_crypto_t	crypto;
+	uintptr_t	ev;
+	uintptr_t	skt;		/* Listen socket. */
+	lg_emu_msg_t	msg[LG_CTL_MSG_COUNT];
+	lg_arena_t	arena;		/* Request DOM. */
+	lg_emu_conn_p	active;		/* Connected clients. */
+	lg_emu_conn_p	free;		/* Closed, for reuse. */
+	lg_emu_timer_p	timers;		/* Binary min heap by due. */
+	size_t		timers_cnt;
+	size_t		timers_allocated;
+	uint64_t	notify_next;
+	size_t		notify_msg;
+	/* Settings. */
+	uint64_t	latency;	/* Responce delay, us. */
+	int		serial;		/* Requests handled one by one. */
+	size_t		fragment;	/* Max bytes per write, 0 - no limit. */
+	uint64_t	fragment_delay;	/* Delay between fragments, us. */
+	uint64_t	notify;		/* Unsolicited notify interval, us. */
+	size_t		max_payload;
+	/* Stats. */
+	size_t		conns_cur;
+	size_t		conns_max;
+	uint64_t	conns_total;
+	uint64_t	requests;
+	uint64_t	notifications;
+} lg_emu_t, *lg_emu_p;
+
+#define LG_EMU_DEF_LISTEN	"0.0.0.0:9741"
+#define LG_EMU_FRAGMENT_DELAY	1000 /* us. */
+
+static volatile sig_atomic_t lg_emu_stop = 0;
+
+
+static void
+lg_emu_sig_handler(int sig) {
+
+	(void)sig;
+	lg_emu_stop = 1;
+}
+
+
+/* Buffer with JSON text. */
+typedef struct lg_emu_buf_s {
+	char		*data;
+	size_t		size;
+	size_t		allocated;
+} lg_emu_buf_t, *lg_emu_buf_p;
+
+static int
+lg_emu_buf_add(lg_emu_buf_p buf, const char *data, const size_t data_size) {
+	size_t allocated;
+	char *tmp;
+
+	if ((buf->size + data_size + 1) > buf->allocated) {
+		allocated = MAX(256, ((buf->size + data_size + 1) * 2));
+		tmp = realloc(buf->data, allocated);
+		if (NULL == tmp)
+			return (ENOMEM);
+		buf->data = tmp;
+		buf->allocated = allocated;
+	}
+	memcpy((buf->data + buf->size), data, data_size);
+	buf->size += data_size;
+	buf->data[buf->size] = 0;
+
+	return (0);
+}
+#define lg_emu_buf_add_cstr(__buf, __cstr)				\
+	    lg_emu_buf_add((__buf), (__cstr), strlen((__cstr)))
+
+
+static void
+lg_emu_msg_pkt_reset(lg_emu_msg_p msg) {
+
+	free(msg->pkt);
+	msg->pkt = NULL;
+	msg->pkt_size = 0;
+}
+
+static void
+lg_emu_msg_destroy(lg_emu_msg_p msg) {
+	size_t i;
+
+	for (i = 0; i < msg->fields_cnt; i ++) {
+		free(msg->fields[i].name);
+		free(msg->fields[i].value);
+	}
+	free(msg->fields);
+	lg_emu_msg_pkt_reset(msg);
+	memset(msg, 0x00, sizeof(lg_emu_msg_t));
+}
+
+/* Add or replace field. */
+static int
+lg_emu_msg_field_set(lg_emu_msg_p msg, const char *name,
+    const size_t name_size, const struct json_value_s *value) {
+	size_t i, value_size;
+	char *value_str;
+	lg_emu_field_p field, tmp;
+
+	/* Names are written back as is, skip ones that require escaping. */
+	if (NULL != memchr(name, '"', name_size) ||
+	    NULL != memchr(name, '\\', name_size))
+		return (EINVAL);
+	value_str = json_write_minified(value, &value_size);
+	if (NULL == value_str)
+		return (ENOMEM);
+	value_size = strlen(value_str);
+
+	for (i = 0; i < msg->fields_cnt; i ++) {
+		field = &msg->fields[i];
+		if (field->name_size != name_size ||
+		    0 != memcmp(field->name, name, name_size))
+			continue;
+		free(field->value);
+		field->value = value_str;
+		field->value_size = value_size;
+		goto ok_out;
+	}
+	/* New field. */
+	if (msg->fields_cnt == msg->fields_allocated) {
+		tmp = realloc(msg->fields,
+		    ((msg->fields_allocated + 16) * sizeof(lg_emu_field_t)));
+		if (NULL == tmp)
+			goto err_out;
+		msg->fields = tmp;
+		msg->fields_allocated += 16;
+	}
+	field = &msg->fields[msg->fields_cnt];
+	field->name = malloc((name_size + 1));
+	if (NULL == field->name)
+		goto err_out;
+	memcpy(field->name, name, name_size);
+	field->name[name_size] = 0;
+	field->name_size = name_size;
+	field->value = value_str;
+	field->value_size = value_size;
+	msg->fields_cnt ++;
+
+ok_out:
+	lg_emu_msg_pkt_reset(msg);
+	return (0);
+
+err_out:
+	free(value_str);
+	return (ENOMEM);
+}
+
+/* Set all fields from JSON object. */
+static int
+lg_emu_msg_update(lg_emu_msg_p msg, const struct json_value_s *data) {
+	int error;
+	const struct json_object_element_s *elem;
+
+	if (NULL == data || json_type_object != data->type)
+		return (EINVAL);
+	for (elem = ((struct json_object_s*)data->payload)->start;
+	    NULL != elem; elem = elem->next) {
+		error = lg_emu_msg_field_set(msg, elem->name->string,
+		    elem->name->string_size, elem->value);
+		if (0 != error)
+			return (error);
+	}
+
+	return (0);
+}
+
+/* {"cmd": "<cmd>", "msg": "<msg>", "result": "ok", "data": {...}} */
+static int
+lg_emu_msg_json(lg_emu_p emu, const size_t msg_idx, const char *cmd,
+    lg_emu_buf_p buf) {
+	int error = 0;
+	size_t i;
+	lg_emu_msg_p msg = &emu->msg[msg_idx];
+
+	buf->size = 0;
+	error |= lg_emu_buf_add_cstr(buf, "{");
+	if (NULL != cmd) {
+		error |= lg_emu_buf_add_cstr(buf, "\"cmd\": \"");
+		error |= lg_emu_buf_add_cstr(buf, cmd);
+		error |= lg_emu_buf_add_cstr(buf, "\", ");
+	}
+	error |= lg_emu_buf_add_cstr(buf, "\"msg\": \"");
+	error |= lg_emu_buf_add_cstr(buf, lg_ctl_msg[msg_idx]);
+	error |= lg_emu_buf_add_cstr(buf, "\", \"result\": \"ok\", \"data\": {");
+	for (i = 0; i < msg->fields_cnt; i ++) {
+		if (0 != i) {
+			error |= lg_emu_buf_add_cstr(buf, ", ");
+		}
+		error |= lg_emu_buf_add_cstr(buf, "\"");
+		error |= lg_emu_buf_add(buf, msg->fields[i].name,
+		    msg->fields[i].name_size);
+		error |= lg_emu_buf_add_cstr(buf, "\": ");
+		error |= lg_emu_buf_add(buf, msg->fields[i].value,
+		    msg->fields[i].value_size);
+	}
+	error |= lg_emu_buf_add_cstr(buf, "}}");
+
+	return (((0 != error) ? ENOMEM : 0));
+}
+
+/* Encrypt JSON to new packet. */
+static int
+lg_emu_pkt_create(lg_emu_p emu, const lg_emu_buf_p buf,
+    uint8_t **pkt_ret, size_t *pkt_size_ret) {
+	int error;
+	uint8_t *pkt;
+	size_t pkt_size;
+
+	lg_ctl_pkt_create(&emu->crypto, (const uint8_t*)buf->data, buf->size,
+	    NULL, &pkt_size);
+	pkt = malloc(pkt_size);
+	if (NULL == pkt)
+		return (ENOMEM);
+	error = lg_ctl_pkt_create(&emu->crypto, (const uint8_t*)buf->data,
+	    buf->size, pkt, &pkt_size);
+	if (0 != error) {
+		free(pkt);
+		return (error);
+	}
+	(*pkt_ret) = pkt;
+	(*pkt_size_ret) = pkt_size;
+
+	return (0);
+}
+
+/* GET responce is same for all clients until SET: keep it encrypted. */
+static int
+lg_emu_msg_pkt_get(lg_emu_p emu, const size_t msg_idx) {
+	int error;
+	lg_emu_buf_t buf;
+	lg_emu_msg_p msg = &emu->msg[msg_idx];
+
+	if (NULL != msg->pkt)
+		return (0);
+	memset(&buf, 0x00, sizeof(buf));
+	error = lg_emu_msg_json(emu, msg_idx, NULL, &buf);
+	if (0 == error) {
+		error = lg_emu_pkt_create(emu, &buf, &msg->pkt,
+		    &msg->pkt_size);
+	}
+	free(buf.data);
+
+	return (error);
+}
+
+static int
+lg_emu_data_load(lg_emu_p emu, const char *file_name) {
+	int error = 0;
+	FILE *fp;
+	size_t i, data_size = 0, msg_idx;
+	char *data = NULL;
+	struct json_value_s *root = NULL, *value;
+	struct json_object_element_s *elem;
+
+	/* Defaults. */
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		value = json_parse(lg_emu_def_data[i],
+		    strlen(lg_emu_def_data[i]));
+		error = lg_emu_msg_update(&emu->msg[i], value);
+		free(value);
+		if (0 != error)
+			return (error);
+	}
+	if (NULL == file_name)
+		return (0);
+
+	/* {"EQ_VIEW_INFO": {...}, ...}: replace default data. */
+	fp = fopen(file_name, "r");
+	if (NULL == fp)
+		return (errno);
+	if (0 != fseek(fp, 0, SEEK_END) ||
+	    0 > (long)(data_size = (size_t)ftell(fp)) ||
+	    0 != fseek(fp, 0, SEEK_SET)) {
+		error = errno;
+		goto err_out;
+	}
+	data = malloc((data_size + 1));
+	if (NULL == data) {
+		error = ENOMEM;
+		goto err_out;
+	}
+	if (data_size != fread(data, 1, data_size, fp)) {
+		error = EIO;
+		goto err_out;
+	}
+	root = json_parse(data, data_size);
+	if (NULL == root || json_type_object != root->type) {
+		error = EBADMSG;
+		goto err_out;
+	}
+	for (elem = ((struct json_object_s*)root->payload)->start;
+	    NULL != elem; elem = elem->next) {
+		msg_idx = lg_ctl_msg_idx_get(elem->name->string,
+		    elem->name->string_size);
+		if (LG_CTL_MSG_COUNT == msg_idx) {
+			fprintf(stderr, "%s: unknown msg: %s\n",
+			    file_name, elem->name->string);
+			error = EINVAL;
+			goto err_out;
+		}
+		lg_emu_msg_destroy(&emu->msg[msg_idx]);
+		error = lg_emu_msg_update(&emu->msg[msg_idx], elem->value);
+		if (0 != error)
+			goto err_out;
+	}
+
+err_out:
+	fclose(fp);
+	free(root);
+	free(data);
+
+	return (error);
+}
+
+
+static int
+lg_emu_timer_add(lg_emu_p emu, lg_emu_conn_p conn, const uint64_t due) {
+	size_t i, parent;
+	lg_emu_timer_t timer, *tmp;
+
+	if (emu->timers_cnt == emu->timers_allocated) {
+		tmp = realloc(emu->timers, ((emu->timers_allocated + 1024) *
+		    sizeof(lg_emu_timer_t)));
+		if (NULL == tmp)
+			return (ENOMEM);
+		emu->timers = tmp;
+		emu->timers_allocated += 1024;
+	}
+	timer.due = due;
+	timer.conn = conn;
+	timer.gen = conn->gen;
+	/* Sift up. */
+	for (i = emu->timers_cnt ++; 0 != i; i = parent) {
+		parent = ((i - 1) / 2);
+		if (emu->timers[parent].due <= due)
+			break;
+		emu->timers[i] = emu->timers[parent];
+	}
+	emu->timers[i] = timer;
+
+	return (0);
+}
+
+static void
+lg_emu_timer_pop(lg_emu_p emu) {
+	size_t i, child;
+	lg_emu_timer_t last;
+
+	if (0 == emu->timers_cnt)
+		return;
+	last = emu->timers[-- emu->timers_cnt];
+	/* Sift down. */
+	for (i = 0; (child = ((2 * i) + 1)) < emu->timers_cnt; i = child) {
+		if ((child + 1) < emu->timers_cnt &&
+		    emu->timers[(child + 1)].due < emu->timers[child].due) {
+			child ++;
+		}
+		if (last.due <= emu->timers[child].due)
+			break;
+		emu->timers[i] = emu->timers[child];
+	}
+	emu->timers[i] = last;
+}
+
+
+static void
+lg_emu_conn_close(lg_emu_p emu, lg_emu_conn_p conn) {
+
+	/* Close removes socket from event loop. */
+	lg_ctl_conn_close(&conn->conn);
+	conn->gen ++;
+	conn->ev_flags = 0;
+	conn->tx_len = 0;
+	conn->tx_ready = 0;
+	conn->tx_sent = 0;
+	conn->tx_next = 0;
+	conn->pend_first = 0;
+	conn->pend_cnt = 0;
+	/* Move to free list, keep buffers for reuse. */
+	if (NULL != conn->prev) {
+		conn->prev->next = conn->next;
+	} else {
+		emu->active = conn->next;
+	}
+	if (NULL != conn->next) {
+		conn->next->prev = conn->prev;
+	}
+	conn->prev = NULL;
+	conn->next = emu->free;
+	emu->free = conn;
+	emu->conns_cur --;
+}
+
+/* Send what allowed and update event flags. */
+static int
+lg_emu_conn_tx(lg_emu_p emu, lg_emu_conn_p conn, const uint64_t now) {
+	int error;
+	size_t i, to_send;
+	ssize_t ios;
+	uint32_t ev_flags = LG_EV_READ;
+
+	/* Release responces that waited for latency. */
+	for (i = conn->pend_first; i < conn->pend_cnt &&
+	    now >= conn->pend[i].due; i ++) {
+		conn->tx_ready = conn->pend[i].tx_end;
+	}
+	conn->pend_first = i;
+	if (conn->pend_first == conn->pend_cnt) {
+		conn->pend_first = 0;
+		conn->pend_cnt = 0;
+	}
+
+	while (conn->tx_sent < conn->tx_ready) {
+		to_send = (conn->tx_ready - conn->tx_sent);
+		if (0 != emu->fragment) {
+			if (now < conn->tx_next)
+				break; /* Timer already set. */
+			to_send = MIN(to_send, emu->fragment);
+		}
+		ios = send((int)conn->conn.skt, (conn->tx_buf + conn->tx_sent),
+		    to_send, MSG_NOSIGNAL);
+		if (-1 == ios) {
+			if (EAGAIN != errno && EINTR != errno)
+				return (errno);
+			ev_flags |= LG_EV_WRITE;
+			break;
+		}
+		conn->tx_sent += (size_t)ios;
+		if (0 != emu->fragment &&
+		    conn->tx_sent < conn->tx_ready) {
+			conn->tx_next = (now + emu->fragment_delay);
+			error = lg_emu_timer_add(emu, conn, conn->tx_next);
+			if (0 != error)
+				return (error);
+			break;
+		}
+	}
+	if (conn->tx_sent == conn->tx_len) { /* All sent: rewind. */
+		conn->tx_len = 0;
+		conn->tx_ready = 0;
+		conn->tx_sent = 0;
+	}
+
+	error = lg_ev_set(emu->ev, conn->conn.skt, ev_flags, conn->ev_flags,
+	    conn);
+	if (0 != error)
+		return (error);
+	conn->ev_flags = ev_flags;
+
+	return (0);
+}
+
+/* Queue packet to send, with latency if set. */
+static int
+lg_emu_conn_send(lg_emu_p emu, lg_emu_conn_p conn, const uint8_t *pkt,
+    const size_t pkt_size, const uint64_t latency, const uint64_t now) {
+	int error;
+	size_t i, buf_size;
+	uint64_t due;
+	uint8_t *buf;
+	lg_emu_pend_p pend;
+
+	/* Make space. */
+	if (0 != conn->tx_sent &&
+	    (conn->tx_len + pkt_size) > conn->tx_buf_size) {
+		memmove(conn->tx_buf, (conn->tx_buf + conn->tx_sent),
+		    (conn->tx_len - conn->tx_sent));
+		for (i = conn->pend_first; i < conn->pend_cnt; i ++) {
+			conn->pend[i].tx_end -= conn->tx_sent;
+		}
+		conn->tx_len -= conn->tx_sent;
+		conn->tx_ready -= conn->tx_sent;
+		conn->tx_sent = 0;
+	}
+	if ((conn->tx_len + pkt_size) > conn->tx_buf_size) {
+		buf_size = MAX(4096, ((conn->tx_len + pkt_size) * 2));
+		buf = realloc(conn->tx_buf, buf_size);
+		if (NULL == buf)
+			return (ENOMEM);
+		conn->tx_buf = buf;
+		conn->tx_buf_size = buf_size;
+	}
+	memcpy((conn->tx_buf + conn->tx_len), pkt, pkt_size);
+	conn->tx_len += pkt_size;
+
+	if (0 == latency) {
+		if (conn->pend_first == conn->pend_cnt) {
+			conn->tx_ready = conn->tx_len;
+		} else { /* Keep order: send after delayed. */
+			conn->pend[(conn->pend_cnt - 1)].tx_end = conn->tx_len;
+		}
+		return (0);
+	}
+
+	/* Delayed. */
+	if (conn->pend_cnt == conn->pend_allocated) {
+		pend = realloc(conn->pend, ((conn->pend_allocated + 16) *
+		    sizeof(lg_emu_pend_t)));
+		if (NULL == pend)
+			return (ENOMEM);
+		conn->pend = pend;
+		conn->pend_allocated += 16;
+	}
+	due = (now + latency);
+	if (0 != emu->serial && conn->pend_first != conn->pend_cnt) {
+		/* Like soundbar: next request after previous is done. */
+		due = MAX(due, (conn->pend[(conn->pend_cnt - 1)].due + latency));
+	}
+	conn->pend[conn->pend_cnt].due = due;
+	conn->pend[conn->pend_cnt].tx_end = conn->tx_len;
+	conn->pend_cnt ++;
+	error = lg_emu_timer_add(emu, conn, due);
+
+	return (error);
+}
+
+static int
+lg_emu_conn_request(lg_emu_p emu, lg_emu_conn_p conn,
+    const uint8_t *data, const size_t data_size, const uint64_t now) {
+	int error = 0;
+	size_t msg_idx, pkt_size;
+	uint8_t *pkt = NULL;
+	struct json_value_s *root;
+	struct json_object_element_s *elem, *joe_cmd = NULL,
+	    *joe_msg = NULL, *joe_data = NULL;
+	struct json_string_s *cmd, *msg;
+	lg_emu_buf_t buf;
+
+	/* DOM lives in reusable arena: GET does not allocate. */
+	lg_arena_reset(&emu->arena);
+	root = json_parse_ex(data, data_size, json_parse_flags_default,
+	    lg_arena_json_alloc, &emu->arena, NULL);
+	if (NULL == root || json_type_object != root->type)
+		return (EBADMSG);
+	for (elem = ((struct json_object_s*)root->payload)->start;
+	    NULL != elem; elem = elem->next) {
+		if (0 == mem_cmpn_cstr("cmd", elem->name->string,
+		    elem->name->string_size)) {
+			joe_cmd = elem;
+		} else if (0 == mem_cmpn_cstr("msg", elem->name->string,
+		    elem->name->string_size)) {
+			joe_msg = elem;
+		} else if (0 == mem_cmpn_cstr("data", elem->name->string,
+		    elem->name->string_size)) {
+			joe_data = elem;
+		}
+	}
+	if (NULL == joe_cmd || json_type_string != joe_cmd->value->type ||
+	    NULL == joe_msg || json_type_string != joe_msg->value->type) {
+		error = EBADMSG;
+		goto err_out;
+	}
+	cmd = joe_cmd->value->payload;
+	msg = joe_msg->value->payload;
+	msg_idx = lg_ctl_msg_idx_get(msg->string, msg->string_size);
+	emu->requests ++;
+
+	memset(&buf, 0x00, sizeof(buf));
+	if (LG_CTL_MSG_COUNT == msg_idx) {
+		/* Unknown msg: report error. */
+		error |= lg_emu_buf_add_cstr(&buf, "{\"msg\": \"");
+		error |= lg_emu_buf_add(&buf, msg->string, msg->string_size);
+		error |= lg_emu_buf_add_cstr(&buf, "\", \"result\": \"fail\"}");
+		if (0 == error) {
+			error = lg_emu_pkt_create(emu, &buf, &pkt, &pkt_size);
+		}
+		free(buf.data);
+		if (0 == error) {
+			error = lg_emu_conn_send(emu, conn, pkt, pkt_size,
+			    emu->latency, now);
+		}
+		free(pkt);
+		goto err_out;
+	}
+	if (0 == mem_cmpn_cstr("set", cmd->string, cmd->string_size)) {
+		if (NULL == joe_data) {
+			error = EBADMSG;
+			goto err_out;
+		}
+		error = lg_emu_msg_update(&emu->msg[msg_idx], joe_data->value);
+		if (0 != error)
+			goto err_out;
+	} else if (0 != mem_cmpn_cstr("get", cmd->string, cmd->string_size)) {
+		error = EBADMSG;
+		goto err_out;
+	}
+	/* Answer with current state. */
+	error = lg_emu_msg_pkt_get(emu, msg_idx);
+	if (0 != error)
+		goto err_out;
+	error = lg_emu_conn_send(emu, conn, emu->msg[msg_idx].pkt,
+	    emu->msg[msg_idx].pkt_size, emu->latency, now);
+
+err_out:
+	return (error);
+}
+
+static void
+lg_emu_conn_io(lg_emu_p emu, lg_emu_conn_p conn, const uint32_t events,
+    const uint64_t now) {
+	int error = 0;
+	uint8_t *data;
+	size_t data_size;
+
+	if (0 != (LG_EV_READ & events)) {
+		error = lg_ctl_conn_recv(&conn->conn);
+		if (EAGAIN == error || EINTR == error) {
+			error = 0;
+		}
+		if (0 != error)
+			goto err_out;
+		for (;;) {
+			error = lg_ctl_conn_data_get(&conn->conn, &emu->crypto,
+			    &data, &data_size);
+			if (EAGAIN == error) {
+				error = 0;
+				break;
+			}
+			if (0 != error)
+				goto err_out;
+			error = lg_emu_conn_request(emu, conn, data,
+			    data_size, now);
+			LOG_ERR(error, "lg_emu_conn_request()");
+		}
+	} else if (0 != (LG_EV_ERR & events)) {
+		error = ECONNRESET;
+		goto err_out;
+	}
+	error = lg_emu_conn_tx(emu, conn, now);
+
+err_out:
+	if (0 != error) {
+		lg_emu_conn_close(emu, conn);
+	}
+}
+
+static void
+lg_emu_accept(lg_emu_p emu) {
+	int error, on = 1;
+	uintptr_t skt;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	lg_emu_conn_p conn;
+
+	for (;;) {
+		addrlen = sizeof(addr);
+		error = skt_accept(emu->skt, &addr, &addrlen, SO_F_NONBLOCK,
+		    &skt);
+		if (0 != error) {
+			if (EAGAIN != error && EINTR != error &&
+			    ECONNABORTED != error) {
+				LOG_ERR(error, "skt_accept()");
+			}
+			return;
+		}
+		setsockopt((int)skt, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		/* Get from free list or allocate. */
+		conn = emu->free;
+		if (NULL != conn) {
+			emu->free = conn->next;
+		} else {
+			conn = calloc(1, sizeof(lg_emu_conn_t));
+			if (NULL == conn) {
+				close((int)skt);
+				LOG_ERR(ENOMEM, "calloc()");
+				return;
+			}
+			lg_ctl_conn_init(&conn->conn, (uintptr_t)-1,
+			    emu->max_payload);
+		}
+		lg_ctl_conn_open(&conn->conn, skt);
+		conn->prev = NULL;
+		conn->next = emu->active;
+		if (NULL != emu->active) {
+			emu->active->prev = conn;
+		}
+		emu->active = conn;
+		emu->conns_cur ++;
+		emu->conns_total ++;
+		emu->conns_max = MAX(emu->conns_max, emu->conns_cur);
+		error = lg_emu_conn_tx(emu, conn, lg_ev_time_us());
+		if (0 != error) {
+			LOG_ERR(error, "lg_emu_conn_tx()");
+			lg_emu_conn_close(emu, conn);
+		}
+	}
+}
+
+/* Push next message to every client, as on real device state change. */
+static void
+lg_emu_notify(lg_emu_p emu, const uint64_t now) {
+	int error;
+	uint8_t *pkt = NULL;
+	size_t pkt_size;
+	lg_emu_buf_t buf;
+	lg_emu_conn_p conn, conn_next;
+
+	memset(&buf, 0x00, sizeof(buf));
+	error = lg_emu_msg_json(emu, emu->notify_msg, "notibyget", &buf);
+	if (0 == error) {
+		error = lg_emu_pkt_create(emu, &buf, &pkt, &pkt_size);
+	}
+	free(buf.data);
+	if (0 != error) {
+		LOG_ERR(error, "lg_emu_pkt_create()");
+		return;
+	}
+	for (conn = emu->active; NULL != conn; conn = conn_next) {
+		conn_next = conn->next;
+		error = lg_emu_conn_send(emu, conn, pkt, pkt_size, 0, now);
+		if (0 == error) {
+			error = lg_emu_conn_tx(emu, conn, now);
+		}
+		if (0 != error) {
+			lg_emu_conn_close(emu, conn);
+			continue;
+		}
+		emu->notifications ++;
+	}
+	free(pkt);
+	emu->notify_msg = ((emu->notify_msg + 1) % LG_CTL_MSG_GET_COUNT);
+}
+
+static int
+lg_emu_run(lg_emu_p emu) {
+	int error = 0, timeout_ms;
+	size_t i, ev_cnt;
+	uint64_t now, next;
+	lg_ev_event_t ev[LG_EV_WAIT_MAX];
+	lg_emu_timer_t timer;
+
+	error = lg_ev_set(emu->ev, emu->skt, LG_EV_READ, 0, NULL);
+	if (0 != error)
+		return (error);
+	now = lg_ev_time_us();
+	emu->notify_next = (now + emu->notify);
+
+	while (0 == lg_emu_stop) {
+		next = (uint64_t)-1;
+		if (0 != emu->timers_cnt) {
+			next = emu->timers[0].due;
+		}
+		if (0 != emu->notify) {
+			next = MIN(next, emu->notify_next);
+		}
+		if ((uint64_t)-1 == next) {
+			timeout_ms = -1;
+		} else {
+			timeout_ms = ((next > now) ?
+			    (int)(((next - now) + 999) / 1000) : 0);
+		}
+		error = lg_ev_wait(emu->ev, ev, LG_EV_WAIT_MAX, timeout_ms,
+		    &ev_cnt);
+		if (0 != error)
+			break;
+		now = lg_ev_time_us();
+		for (i = 0; i < ev_cnt; i ++) {
+			if (NULL == ev[i].udata) {
+				lg_emu_accept(emu);
+				continue;
+			}
+			lg_emu_conn_io(emu, (lg_emu_conn_p)ev[i].udata,
+			    ev[i].events, now);
+		}
+		/* Timers. */
+		while (0 != emu->timers_cnt && now >= emu->timers[0].due) {
+			timer = emu->timers[0];
+			lg_emu_timer_pop(emu);
+			if (timer.gen != timer.conn->gen)
+				continue; /* Connection closed. */
+			error = lg_emu_conn_tx(emu, timer.conn, now);
+			if (0 != error) {
+				lg_emu_conn_close(emu, timer.conn);
+			}
+		}
+		if (0 != emu->notify && now >= emu->notify_next) {
+			emu->notify_next = (now + emu->notify);
+			lg_emu_notify(emu, now);
+		}
+	}
+
+	return (error);
+}
+
+
+/*
+ * Packet crypto throughput: EVP one by one vs each multi buffer impl.
+ * Every impl output is checked against EVP before timing.
+ */
+#define LG_EMU_BENCH_BIG_SIZE	(64 * 1024)
+
+static void
+lg_emu_bench_rate(const char *what, const char *impl, const size_t pkts,
+    const size_t bytes, const uint64_t time_us) {
+	const uint64_t us = MAX(1, time_us);
+
+	LOG_INFO_FMT("%-14s %-6s %10.1f MB/s %12"PRIu64" pkt/s",
+	    what, impl, (((double)bytes) / (double)us),
+	    ((((uint64_t)pkts) * 1000000) / us));
+}
+
+/*
+ * Plain text is restored and packets are encrypted with crypto->mb.impl:
+ * packets must be same as ref (EVP output) and decrypt back to big
+ * ('x' bytes). big_ref: EVP decryption of big.
+ */
+static int
+lg_emu_bench_crypto_check(lg_ctl_crypto_p crypto, lg_ctl_pkt_job_p jobs,
+    const size_t count, uint8_t *mem, const uint8_t *ref,
+    const size_t mem_size, const uint8_t *big, const uint8_t *big_ref,
+    uint8_t *out) {
+	int error;
+	size_t i, data_size;
+
+	memset(mem, 'x', mem_size);
+	error = lg_ctl_pkt_create_batch(crypto, jobs, count);
+	if (0 != error) {
+		LOG_ERR(error, "lg_ctl_pkt_create_batch()");
+		return (error);
+	}
+	if (NULL != ref && 0 != memcmp(mem, ref, mem_size)) {
+		LOG_ERR(EBADMSG, "encrypt: output differs from EVP");
+		return (EBADMSG);
+	}
+	for (i = 0; i < count; i ++) {
+		error = lg_ctl_pkt_payload_decrypt(crypto,
+		    (jobs[i].buf + sizeof(lg_ctl_pkt_hdr_t)),
+		    (jobs[i].buf_size - sizeof(lg_ctl_pkt_hdr_t)),
+		    out, LG_EMU_BENCH_BIG_SIZE, &data_size);
+		if (0 != error) {
+			LOG_ERR(error, "lg_ctl_pkt_payload_decrypt()");
+			return (error);
+		}
+		if (data_size != jobs[i].data_size ||
+		    0 != memcmp(out, big, data_size)) {
+			LOG_ERR(EBADMSG, "decrypt: plain text mismatch");
+			return (EBADMSG);
+		}
+	}
+	if (NULL == big_ref)
+		return (0);
+	lg_ctl_pkt_payload_decrypt(crypto, big, LG_EMU_BENCH_BIG_SIZE, out,
+	    LG_EMU_BENCH_BIG_SIZE, NULL);
+	if (0 != memcmp(out, big_ref, LG_EMU_BENCH_BIG_SIZE)) {
+		LOG_ERR(EBADMSG, "decrypt 64 KiB: output differs from EVP");
+		return (EBADMSG);
+	}
+
+	return (0);
+}
+
+static int
+lg_emu_bench_crypto(lg_ctl_crypto_p crypto, const size_t count) {
+	int error = 0;
+	size_t i, off, mem_size, pkt_size, data_size, bytes_small = 0;
+	uint32_t impl;
+	const uint32_t impl_max = crypto->mb.impl;
+	uint64_t tm;
+	uint8_t *mem = NULL, *ref, *big, *big_ref, *out;
+	lg_ctl_pkt_job_p jobs = NULL;
+
+	/* Typical JSON requests / responses: 32..287 bytes. */
+	jobs = calloc(count, sizeof(lg_ctl_pkt_job_t));
+	if (NULL == jobs)
+		return (ENOMEM);
+	for (i = 0, off = 0; i < count; i ++) {
+		jobs[i].data_size = (32 + ((i * 37) % 256));
+		lg_ctl_pkt_create(NULL, NULL, jobs[i].data_size, NULL,
+		    &pkt_size);
+		off += roundup(pkt_size, 64);
+	}
+	mem_size = off;
+	/* Packets, EVP packets, big, EVP big decrypt, out. */
+	mem = malloc((2 * mem_size) + (3 * LG_EMU_BENCH_BIG_SIZE));
+	if (NULL == mem) {
+		error = ENOMEM;
+		goto err_out;
+	}
+	ref = (mem + mem_size);
+	big = (ref + mem_size);
+	big_ref = (big + LG_EMU_BENCH_BIG_SIZE);
+	out = (big_ref + LG_EMU_BENCH_BIG_SIZE);
+	memset(big, 'x', LG_EMU_BENCH_BIG_SIZE);
+	for (i = 0, off = 0; i < count; i ++) {
+		jobs[i].buf = (mem + off);
+		/* In place: packet is encrypted over its data. */
+		jobs[i].data = (jobs[i].buf + sizeof(lg_ctl_pkt_hdr_t));
+		lg_ctl_pkt_create(NULL, NULL, jobs[i].data_size, NULL,
+		    &pkt_size);
+		off += roundup(pkt_size, 64);
+	}
+
+	/* Reference output: EVP. */
+	crypto->mb.impl = LG_AES_MB_IMPL_NONE;
+	error = lg_emu_bench_crypto_check(crypto, jobs, count, mem, NULL,
+	    mem_size, big, NULL, out);
+	if (0 != error)
+		goto err_out;
+	memcpy(ref, mem, mem_size);
+	lg_ctl_pkt_payload_decrypt(crypto, big, LG_EMU_BENCH_BIG_SIZE,
+	    big_ref, LG_EMU_BENCH_BIG_SIZE, NULL);
+
+	LOG_INFO_FMT("crypto bench: %zu packets, best impl: %s",
+	    count, lg_aes_mb_impl_name(impl_max));
+	for (impl = LG_AES_MB_IMPL_NONE; impl <= impl_max; impl ++) {
+		crypto->mb.impl = impl;
+		/* Output must match EVP before it is timed. */
+		error = lg_emu_bench_crypto_check(crypto, jobs, count, mem,
+		    ref, mem_size, big, big_ref, out);
+		if (0 != error) {
+			LOG_INFO_FMT("%s: check failed",
+			    lg_aes_mb_impl_name(impl));
+			goto err_out;
+		}
+		/* Encrypt: pkt buf is overwritten, sizes are fixed. */
+		tm = lg_ev_time_us();
+		error = lg_ctl_pkt_create_batch(crypto, jobs, count);
+		tm = (lg_ev_time_us() - tm);
+		if (0 != error) {
+			LOG_ERR(error, "lg_ctl_pkt_create_batch()");
+			goto err_out;
+		}
+		for (i = 0, bytes_small = 0; i < count; i ++) {
+			bytes_small += jobs[i].buf_size;
+		}
+		lg_emu_bench_rate("encrypt", lg_aes_mb_impl_name(impl),
+		    count, bytes_small, tm);
+		/* Decrypt small packets. */
+		tm = lg_ev_time_us();
+		for (i = 0; i < count; i ++) {
+			error = lg_ctl_pkt_payload_decrypt(crypto,
+			    (jobs[i].buf + sizeof(lg_ctl_pkt_hdr_t)),
+			    (jobs[i].buf_size - sizeof(lg_ctl_pkt_hdr_t)),
+			    out, LG_EMU_BENCH_BIG_SIZE, &data_size);
+			if (0 != error) {
+				LOG_ERR(error, "lg_ctl_pkt_payload_decrypt()");
+				goto err_out;
+			}
+		}
+		tm = (lg_ev_time_us() - tm);
+		lg_emu_bench_rate("decrypt", lg_aes_mb_impl_name(impl),
+		    count, bytes_small, tm);
+		/* Decrypt big payloads: padding is not checked here. */
+		tm = lg_ev_time_us();
+		for (i = 0; i < count; i ++) {
+			lg_ctl_pkt_payload_decrypt(crypto, big,
+			    LG_EMU_BENCH_BIG_SIZE, out,
+			    LG_EMU_BENCH_BIG_SIZE, NULL);
+		}
+		tm = (lg_ev_time_us() - tm);
+		lg_emu_bench_rate("decrypt 64 KiB", lg_aes_mb_impl_name(impl),
+		    count, (count * LG_EMU_BENCH_BIG_SIZE), tm);
+	}
+	error = 0;
+
+err_out:
+	crypto->mb.impl = impl_max;
+	free(mem);
+	free(jobs);
+
+	return (error);
+}
+
+/*
+ * Packet create / parse: key expanded for every packet (EVP context
+ * per packet, as before lg_ctl_crypto_t) vs reused lg_ctl_crypto_t.
+ * Key value does not change the cost, so own key is used for "keypkt".
+ */
+static const uint8_t lg_emu_bench_key256[32] = "lgspkemu bench key 0123456789ab";
+static const uint8_t lg_emu_bench_iv[16] = "lgspkemu bench!";
+static const size_t lg_emu_bench_key_sizes[] = {
+	32, 256, 1024, 4096, 16384, LG_EMU_BENCH_BIG_SIZE
+};
+
+static int
+lg_emu_bench_key_pkt(const int enc, const uint8_t *in, uint8_t *out,
+    const size_t size) {
+	int error = 0, out_size;
+	EVP_CIPHER_CTX *ctx;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (NULL == ctx)
+		return (ENOMEM);
+	if (1 != EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL,
+	    lg_emu_bench_key256, lg_emu_bench_iv, enc) ||
+	    1 != EVP_CIPHER_CTX_set_padding(ctx, 0) ||
+	    1 != EVP_CipherUpdate(ctx, out, &out_size, in, (int)size)) {
+		error = EINVAL;
+	}
+	EVP_CIPHER_CTX_free(ctx);
+
+	return (error);
+}
+
+static int
+lg_emu_bench_key(lg_ctl_crypto_p crypto, const size_t count) {
+	int error = 0;
+	size_t i, j, cnt, off, data_size, pkt_size, payload_size;
+	const uint32_t impl = crypto->mb.impl;
+	uint64_t tm;
+	uint8_t *mem = NULL, *data, *pkt, *tmp;
+	char what[32];
+
+	/* Data + packet + temp buffer for per packet path. */
+	mem = malloc(3 * (LG_EMU_BENCH_BIG_SIZE + 64));
+	if (NULL == mem)
+		return (ENOMEM);
+	data = mem;
+	pkt = (data + LG_EMU_BENCH_BIG_SIZE + 64);
+	tmp = (pkt + LG_EMU_BENCH_BIG_SIZE + 64);
+	memset(data, 'x', LG_EMU_BENCH_BIG_SIZE);
+	/* EVP on both sides. */
+	crypto->mb.impl = LG_AES_MB_IMPL_NONE;
+
+	LOG_INFO_FMT("key schedule bench: %s",
+	    "keypkt - key expanded per packet, reuse - lg_ctl_crypto_t");
+	for (i = 0; i < nitems(lg_emu_bench_key_sizes); i ++) {
+		data_size = lg_emu_bench_key_sizes[i];
+		payload_size = (data_size +
+		    (AES_BLOCK_SIZE - (data_size % AES_BLOCK_SIZE)));
+		/* Same bytes volume for every size. */
+		cnt = MAX(16, ((count * 256) / data_size));
+		/* Create: old path copied data to temp buf and padded it. */
+		tm = lg_ev_time_us();
+		for (j = 0; j < cnt; j ++) {
+			memcpy(tmp, data, data_size);
+			memset((tmp + data_size),
+			    (uint8_t)(payload_size - data_size),
+			    (payload_size - data_size));
+			error = lg_emu_bench_key_pkt(1, tmp,
+			    (pkt + sizeof(lg_ctl_pkt_hdr_t)), payload_size);
+			if (0 != error)
+				goto err_out;
+		}
+		tm = (lg_ev_time_us() - tm);
+		snprintf(what, sizeof(what), "create %zu", data_size);
+		lg_emu_bench_rate(what, "keypkt", cnt, (cnt * data_size), tm);
+		tm = lg_ev_time_us();
+		for (j = 0; j < cnt; j ++) {
+			error = lg_ctl_pkt_create(crypto, data, data_size,
+			    pkt, &pkt_size);
+			if (0 != error) {
+				LOG_ERR(error, "lg_ctl_pkt_create()");
+				goto err_out;
+			}
+		}
+		tm = (lg_ev_time_us() - tm);
+		lg_emu_bench_rate(what, "reuse", cnt, (cnt * data_size), tm);
+		/* Parse: pkt holds valid packet from lg_ctl_pkt_create(). */
+		tm = lg_ev_time_us();
+		for (j = 0; j < cnt; j ++) {
+			error = lg_emu_bench_key_pkt(0,
+			    (pkt + sizeof(lg_ctl_pkt_hdr_t)), tmp,
+			    payload_size);
+			if (0 != error)
+				goto err_out;
+		}
+		tm = (lg_ev_time_us() - tm);
+		snprintf(what, sizeof(what), "parse %zu", data_size);
+		lg_emu_bench_rate(what, "keypkt", cnt, (cnt * data_size), tm);
+		tm = lg_ev_time_us();
+		for (j = 0; j < cnt; j ++) {
+			off = 0;
+			error = lg_ctl_pkt_data_get(crypto, &off, pkt,
+			    pkt_size, tmp, (LG_EMU_BENCH_BIG_SIZE + 64), NULL);
+			if (0 != error) {
+				LOG_ERR(error, "lg_ctl_pkt_data_get()");
+				goto err_out;
+			}
+		}
+		tm = (lg_ev_time_us() - tm);
+		lg_emu_bench_rate(what, "reuse", cnt, (cnt * data_size), tm);
+	}
+
+err_out:
+	crypto->mb.impl = impl;
+	free(mem);
+
+	return (error);
+}
+
+
+/*
+ * Responce decode: DOM (json.h, malloc and arena) vs streaming
+ * lg_ctl_resp_parse(). Both visit every value of "data".
+ */
+static size_t
+lg_emu_bench_json_walk(const struct json_value_s *value) {
+	size_t cnt = 1;
+	struct json_object_element_s *elem;
+	struct json_array_element_s *aelem;
+
+	switch (value->type) {
+	case json_type_object:
+		for (elem = ((struct json_object_s*)value->payload)->start;
+		    NULL != elem; elem = elem->next) {
+			cnt += lg_emu_bench_json_walk(elem->value);
+		}
+		break;
+	case json_type_array:
+		for (aelem = ((struct json_array_s*)value->payload)->start;
+		    NULL != aelem; aelem = aelem->next) {
+			cnt += lg_emu_bench_json_walk(aelem->value);
+		}
+		break;
+	}
+
+	return (cnt);
+}
+
+static size_t
+lg_emu_bench_json_dom(const struct json_value_s *root) {
+	size_t cnt = 0;
+	struct json_object_element_s *elem;
+
+	if (NULL == root || json_type_object != root->type)
+		return (0);
+	for (elem = ((struct json_object_s*)root->payload)->start;
+	    NULL != elem; elem = elem->next) {
+		if (0 == mem_cmpn_cstr("msg", elem->name->string,
+		    elem->name->string_size) ||
+		    0 == mem_cmpn_cstr("result", elem->name->string,
+		    elem->name->string_size)) {
+			cnt ++;
+		} else if (0 == mem_cmpn_cstr("data", elem->name->string,
+		    elem->name->string_size)) {
+			cnt += lg_emu_bench_json_walk(elem->value);
+		}
+	}
+
+	return (cnt);
+}
+
+static int
+lg_emu_bench_json_cb(const lg_ctl_resp_t *resp, const lg_json_ev_t *ev,
+    void *udata) {
+
+	(void)resp;
+	(void)ev;
+	(*((size_t*)udata)) ++;
+
+	return (0);
+}
+
+static int
+lg_emu_bench_json(lg_emu_p emu, const size_t count) {
+	int error = 0;
+	size_t i, j, cnt = 0, bytes = 0;
+	uint64_t tm;
+	struct json_value_s *root;
+	lg_ctl_resp_t resp;
+	lg_emu_buf_t buf[LG_CTL_MSG_COUNT];
+
+	memset(buf, 0x00, sizeof(buf));
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		error = lg_emu_msg_json(emu, i, NULL, &buf[i]);
+		if (0 != error) {
+			LOG_ERR(error, "lg_emu_msg_json()");
+			goto err_out;
+		}
+	}
+	for (j = 0; j < count; j ++) {
+		bytes += buf[(j % LG_CTL_MSG_COUNT)].size;
+	}
+
+	LOG_INFO_FMT("json bench: %zu responces of %i messages",
+	    count, LG_CTL_MSG_COUNT);
+	tm = lg_ev_time_us();
+	for (j = 0; j < count; j ++) {
+		i = (j % LG_CTL_MSG_COUNT);
+		root = json_parse(buf[i].data, buf[i].size);
+		if (NULL == root) {
+			error = EBADMSG;
+			LOG_ERR(error, "json_parse()");
+			goto err_out;
+		}
+		cnt += lg_emu_bench_json_dom(root);
+		free(root);
+	}
+	tm = (lg_ev_time_us() - tm);
+	lg_emu_bench_rate("responce dom", "malloc", count, bytes, tm);
+	tm = lg_ev_time_us();
+	for (j = 0; j < count; j ++) {
+		i = (j % LG_CTL_MSG_COUNT);
+		lg_arena_reset(&emu->arena);
+		root = json_parse_ex(buf[i].data, buf[i].size,
+		    json_parse_flags_default, lg_arena_json_alloc,
+		    &emu->arena, NULL);
+		if (NULL == root) {
+			error = EBADMSG;
+			LOG_ERR(error, "json_parse_ex()");
+			goto err_out;
+		}
+		cnt += lg_emu_bench_json_dom(root);
+	}
+	tm = (lg_ev_time_us() - tm);
+	lg_emu_bench_rate("responce dom", "arena", count, bytes, tm);
+	tm = lg_ev_time_us();
+	for (j = 0; j < count; j ++) {
+		i = (j % LG_CTL_MSG_COUNT);
+		error = lg_ctl_resp_parse(buf[i].data, buf[i].size,
+		    lg_emu_bench_json_cb, &cnt, &resp);
+		if (0 != error) {
+			LOG_ERR(error, "lg_ctl_resp_parse()");
+			goto err_out;
+		}
+	}
+	tm = (lg_ev_time_us() - tm);
+	lg_emu_bench_rate("responce", "stream", count, bytes, tm);
+	/* Keeps walks from being optimized out. */
+	LOG_INFO_FMT("values visited: %zu", cnt);
+
+err_out:
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		free(buf[i].data);
+	}
+
+	return (error);
+}
+
+typedef struct command_line_options_s {
+	const char	*listen;
+	const char	*data_file;
+	uint64_t	latency; /* ms */
+	size_t		fragment;
+	uint64_t	notify; /* ms */
+	size_t		max_payload;
+	size_t		bench_crypto; /* Packets count. */
+	int		serial;
+	size_t		bench_json; /* Responces count. */
+} cmd_opts_t, *cmd_opts_p;
+
+static struct option long_options[] = {
+	{ "help",	no_argument,		NULL,	'?'	},
+	{ "listen",	required_argument,	NULL,	'l'	},
+	{ "data",	required_argument,	NULL,	'd'	},
+	{ "latency",	required_argument,	NULL,	'L'	},
+	{ "fragment",	required_argument,	NULL,	'f'	},
+	{ "notify",	required_argument,	NULL,	'n'	},
+	{ "max-payload", required_argument,	NULL,	'm'	},
+	{ "bench-crypto", required_argument,	NULL,	'b'	},
+	{ "serial",	no_argument,		NULL,	's'	},
+	{ "bench-json",	required_argument,	NULL,	'j'	},
+	{ NULL,		0,			NULL,	0	}
+};
+
+static const char *long_options_descr[] = {
+	"			Show help",
+	"<addr:port>		Listen address, default: "LG_EMU_DEF_LISTEN,
+	"<file>		JSON: {\"EQ_VIEW_INFO\": {<data>}, ...}\n"
+	"					Replaces canned data of given messages",
+	"<ms>		Delay every responce",
+	"<bytes>		Split writes to fragments, 1 ms apart",
+	"<ms>		Push unsolicited \"notibyget\" to all clients",
+	"<size>		Max request size, KiB, default: 1024",
+	"<count>	Measure packet encrypt / decrypt speed and exit:\n"
+	"					multi buffer AES, key schedule reuse",
+	"			Latency: handle requests one by one, not in\n"
+	"					parallel",
+	"<count>	Measure responce JSON decode speed: DOM vs\n"
+	"					streaming, and exit",
+	NULL
+};
+
+
+static int
+cmd_opts_parse(int argc, char **argv, struct option *opts,
+    cmd_opts_p cmd_opts) {
+	int i, ch, opt_idx;
+	char opts_str[1024];
+
+	memset(cmd_opts, 0x00, sizeof(cmd_opts_t));
+	cmd_opts->listen = LG_EMU_DEF_LISTEN;
+	cmd_opts->max_payload = LG_CTL_CONN_BUF_MAX_SIZE;
+
+	/* Process command line. */
+	/* Generate opts string from long options. */
+	for (i = 0, opt_idx = 0;
+	    NULL != opts[i].name && (int)(sizeof(opts_str) - 1) > opt_idx;
+	    i ++) {
+		if (0 == opts[i].val)
+			continue;
+		opts_str[opt_idx ++] = (char)opts[i].val;
+		switch (opts[i].has_arg) {
+		case optional_argument:
+			opts_str[opt_idx ++] = ':';
+			/* FALLTHROUGH */
+		case required_argument:
+			opts_str[opt_idx ++] = ':';
+		}
+	}
+
+	opts_str[opt_idx] = 0;
+	opt_idx = -1;
+	while ((ch = getopt_long_only(argc, argv, opts_str, opts,
+	    &opt_idx)) != -1) {
+restart_opts:
+		switch (opt_idx) {
+		case -1: /* Short option to index. */
+			for (opt_idx = 0;
+			    NULL != opts[opt_idx].name;
+			    opt_idx ++) {
+				if (ch == opts[opt_idx].val)
+					goto restart_opts;
+			}
+			/* Unknown option. */
+			return (EINVAL);
+		case 0: /* help */
+			return (EINVAL);
+		case 1: /* listen */
+			cmd_opts->listen = optarg;
+			break;
+		case 2: /* data */
+			cmd_opts->data_file = optarg;
+			break;
+		case 3: /* latency */
+			cmd_opts->latency = str2usize(optarg, sstrlen(optarg));
+			break;
+		case 4: /* fragment */
+			cmd_opts->fragment = str2usize(optarg, sstrlen(optarg));
+			break;
+		case 5: /* notify */
+			cmd_opts->notify = str2usize(optarg, sstrlen(optarg));
+			break;
+		case 6: /* max-payload */
+			cmd_opts->max_payload = (1024 *
+			    str2usize(optarg, sstrlen(optarg)));
+			if (0 == cmd_opts->max_payload) {
+				fprintf(stderr, "max-payload: must be 1 or more.\n");
+				return (EINVAL);
+			}
+			break;
+		case 7: /* bench-crypto */
+			cmd_opts->bench_crypto = str2usize(optarg,
+			    sstrlen(optarg));
+			break;
+		case 8: /* serial */
+			cmd_opts->serial = 1;
+			break;
+		case 9: /* bench-json */
+			cmd_opts->bench_json = str2usize(optarg,
+			    sstrlen(optarg));
+			break;
+		default:
+			return (EINVAL);
+		}
+		opt_idx = -1;
+	}
+
+	return (0);
+}
+
+static void
+print_usage(const char *progname, struct option *opts,
+    const char **opts_descr) {
+	size_t i;
+	const char *usage =
+		PACKAGE_STRING"     LG soundbar emulator\n"
+		"Usage: %s [options]\n"
+		"options:\n";
+
+	fprintf(stderr, usage, basename((char*)progname));
+	for (i = 0; NULL != opts[i].name; i ++) {
+		if (0 == opts[i].val) {
+			fprintf(stderr, "	-%s %s\n",
+			    opts[i].name, opts_descr[i]);
+		} else {
+			fprintf(stderr, "	-%s, -%c %s\n",
+			    opts[i].name, opts[i].val, opts_descr[i]);
+		}
+	}
+}
+
+
+int
+main(int argc, char *argv[]) {
+	int error = 0;
+	size_t i;
+	struct sockaddr_storage addr;
+	struct rlimit rlim;
+	struct sigaction sa;
+	lg_emu_t emu;
+	lg_emu_conn_p conn;
+	cmd_opts_t cmd_opts;
+
+
+	error = cmd_opts_parse(argc, argv, long_options, &cmd_opts);
+	if (0 != error) {
+		print_usage(argv[0], long_options, long_options_descr);
+		return (error);
+	}
+
+	memset(&emu, 0x00, sizeof(emu));
+	emu.ev = (uintptr_t)-1;
+	emu.skt = (uintptr_t)-1;
+	emu.latency = (cmd_opts.latency * 1000);
+	emu.serial = cmd_opts.serial;
+	emu.fragment = cmd_opts.fragment;
+	emu.fragment_delay = LG_EMU_FRAGMENT_DELAY;
+	emu.notify = (cmd_opts.notify * 1000);
+	emu.max_payload = cmd_opts.max_payload;
+
+	/* Thousands of clients: allow as many descriptors as possible. */
+	if (0 == getrlimit(RLIMIT_NOFILE, &rlim)) {
+		rlim.rlim_cur = rlim.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rlim);
+	}
+	memset(&sa, 0x00, sizeof(sa));
+	sa.sa_handler = lg_emu_sig_handler;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	error = lg_ctl_crypto_init(&emu.crypto);
+	if (0 != error) {
+		LOG_ERR(error, "lg_ctl_crypto_init()");
+		return (error);
+	}
+	if (0 != cmd_opts.bench_crypto) {
+		error = lg_emu_bench_crypto(&emu.crypto, cmd_opts.bench_crypto);
+		if (0 == error) {
+			error = lg_emu_bench_key(&emu.crypto,
+			    cmd_opts.bench_crypto);
+		}
+		lg_ctl_crypto_destroy(&emu.crypto);
+		return (error);
+	}
+	error = lg_emu_data_load(&emu, cmd_opts.data_file);
+	if (0 != error) {
+		LOG_ERR(error, "lg_emu_data_load()");
+		goto err_out;
+	}
+	if (0 != cmd_opts.bench_json) {
+		error = lg_emu_bench_json(&emu, cmd_opts.bench_json);
+		goto err_out;
+	}
+	error = sa_addr_port_from_str(&addr, cmd_opts.listen,
+	    sstrlen(cmd_opts.listen));
+	if (0 != error) {
+		LOG_ERR(error, "sa_addr_port_from_str()");
+		goto err_out;
+	}
+	if (0 == sa_port_get(&addr)) { /* Set def port. */
+		sa_port_set(&addr, LG_CTL_TCP_PORT);
+	}
+	error = skt_bind(&addr, SOCK_STREAM, IPPROTO_TCP,
+	    (SO_F_NONBLOCK | SO_F_REUSEADDR), &emu.skt);
+	if (0 != error) {
+		LOG_ERR(error, "skt_bind()");
+		goto err_out;
+	}
+	if (0 != listen((int)emu.skt, -1)) {
+		error = errno;
+		LOG_ERR(error, "listen()");
+		goto err_out;
+	}
+	error = lg_ev_open(&emu.ev);
+	if (0 != error) {
+		LOG_ERR(error, "lg_ev_open()");
+		goto err_out;
+	}
+
+	error = lg_emu_run(&emu);
+	LOG_ERR(error, "lg_emu_run()");
+	LOG_INFO_FMT("connections: %"PRIu64", max concurrent: %zu, "
+	    "requests: %"PRIu64", notifications: %"PRIu64,
+	    emu.conns_total, emu.conns_max, emu.requests, emu.notifications);
+
+err_out:
+	while (NULL != emu.active) {
+		lg_emu_conn_close(&emu, emu.active);
+	}
+	while (NULL != (conn = emu.free)) {
+		emu.free = conn->next;
+		lg_ctl_conn_destroy(&conn->conn);
+		free(conn->tx_buf);
+		free(conn->pend);
+		free(conn);
+	}
+	free(emu.timers);
+	lg_arena_destroy(&emu.arena);
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		lg_emu_msg_destroy(&emu.msg[i]);
+	}
+	lg_ev_close(emu.ev);
+	if (((uintptr_t)-1) != emu.skt) {
+		close((int)emu.skt);
+	}
+	lg_ctl_crypto_destroy(&emu.crypto);
+
+	return (error);
+}
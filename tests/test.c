@@ -0,0 +1,102 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <fcntl.h> /* open, fcntl */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lgspkctl.h"
+#include "lg_mem.h"
+#include "test.h"
+
+
+size_t test_failed = 0;
+
+const uint8_t test_raw[TEST_RAW_SIZE] = { 0xde, 0xad, 0xbe, 0xef, 0x01 };
+
+
+size_t
+test_pkt(lg_ctl_crypto_p crypto, const char *json, uint8_t *buf,
+    const size_t buf_size) {
+	size_t pkt_size;
+
+	lg_ctl_pkt_create(crypto, (const uint8_t*)json, strlen(json), NULL,
+	    &pkt_size);
+	if (pkt_size > buf_size ||
+	    0 != lg_ctl_pkt_create(crypto, (const uint8_t*)json,
+	    strlen(json), buf, &pkt_size))
+		return (0);
+
+	return (pkt_size);
+}
+
+void *
+test_file_read(const char *file_name, size_t *size_ret) {
+	int fd;
+	uint8_t *buf;
+	struct stat st;
+
+	fd = open(file_name, O_RDONLY);
+	if (-1 == fd)
+		return (NULL);
+	if (0 != fstat(fd, &st) ||
+	    NULL == (buf = lg_malloc(((size_t)st.st_size + 1)))) {
+		close(fd);
+		return (NULL);
+	}
+	if (st.st_size != read(fd, buf, (size_t)st.st_size)) {
+		lg_free(buf);
+		buf = NULL;
+	} else {
+		buf[st.st_size] = 0;
+	}
+	close(fd);
+	(*size_ret) = (size_t)st.st_size;
+
+	return (buf);
+}
+
+int
+test_result(void) {
+
+	if (0 == test_failed)
+		return (0);
+	fprintf(stderr, "%zu checks failed.\n", test_failed);
+
+	return (1);
+}
@@ -0,0 +1,68 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+
+#ifndef __LG_TEST_H__
+#define __LG_TEST_H__
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stdio.h> /* snprintf, fprintf */
+
+#include "lgspkctl.h"
+
+
+/* Shared by unit tests, test.c is built into every test program. */
+
+#define TEST_CHECK(__expr)						\
+	do {								\
+		if (0 == (__expr)) {					\
+			fprintf(stderr, "%s , line: %i: %s\n",		\
+			    __FUNCTION__, __LINE__, #__expr);		\
+			test_failed ++;					\
+		}							\
+	} while (0)
+
+extern size_t test_failed;
+
+/* Not a packet: written as RX_RAW record. */
+#define TEST_RAW_SIZE	5
+extern const uint8_t test_raw[TEST_RAW_SIZE];
+
+
+/* Encrypted packet with JSON text, returns size, 0 on error. */
+size_t	test_pkt(lg_ctl_crypto_p crypto, const char *json, uint8_t *buf,
+	    const size_t buf_size);
+/* Read whole file, zero terminated, free with lg_free(). */
+void	*test_file_read(const char *file_name, size_t *size_ret);
+/* Report failed checks, returns program exit code. */
+int	test_result(void);
+
+
+#endif /* __LG_TEST_H__ */
@@ -0,0 +1,202 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_aes_mb: every implementation this CPU has gives same output as
+ * OpenSSL EVP AES-256-CBC: lane counts not multiple of width, mixed
+ * packet sizes, in place and separate decryption.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include <openssl/evp.h>
+
+#include "lg_aes_mb.h"
+#include "lg_mem.h"
+#include "utils/mem_utils.h"
+#include "test.h"
+
+
+#define TEST_JOBS_MAX		37 /* Not multiple of lanes. */
+#define TEST_PKT_MAX		(64 * LG_AES_MB_BLOCK_SIZE)
+#define TEST_BIG_SIZE		(65536 + (3 * LG_AES_MB_BLOCK_SIZE))
+
+
+/* Deterministic not trivial bytes. */
+static void
+test_fill(uint8_t *buf, const size_t size, uint32_t seed) {
+	size_t i;
+
+	for (i = 0; i < size; i ++) {
+		seed = ((seed * 1103515245) + 12345);
+		buf[i] = (uint8_t)(seed >> 16);
+	}
+}
+
+/* Reference: EVP without padding. */
+static int
+test_evp(const int enc, const uint8_t *key256, const uint8_t *iv,
+    const uint8_t *in, uint8_t *out, const size_t size) {
+	int error = EINVAL, out_size = 0, fin_size = 0;
+	EVP_CIPHER_CTX *ctx;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (NULL == ctx)
+		return (ENOMEM);
+	if (1 == EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, key256, iv,
+	    enc) &&
+	    1 == EVP_CIPHER_CTX_set_padding(ctx, 0) &&
+	    1 == EVP_CipherUpdate(ctx, out, &out_size, in, (int)size) &&
+	    1 == EVP_CipherFinal_ex(ctx, (out + out_size), &fin_size) &&
+	    size == (size_t)(out_size + fin_size)) {
+		error = 0;
+	}
+	EVP_CIPHER_CTX_free(ctx);
+
+	return (error);
+}
+
+/* jobs_cnt packets of mixed sizes, encrypted in one call. */
+static void
+test_encrypt(const lg_aes_mb_key_t *key, const uint8_t *key256,
+    const uint8_t *iv, const size_t jobs_cnt, uint8_t *mem, uint8_t *ref) {
+	size_t i, off, size;
+	lg_aes_mb_job_t jobs[TEST_JOBS_MAX];
+
+	for (i = 0, off = 0; i < jobs_cnt; i ++) {
+		size = (LG_AES_MB_BLOCK_SIZE *
+		    (1 + ((i * 7) % (TEST_PKT_MAX / LG_AES_MB_BLOCK_SIZE))));
+		jobs[i].data = (mem + off);
+		jobs[i].size = size;
+		test_fill(jobs[i].data, size, (uint32_t)(i + 1));
+		TEST_CHECK(0 == test_evp(1, key256, iv, jobs[i].data,
+		    (ref + off), size));
+		off += size;
+	}
+	lg_aes_mb_cbc_encrypt(key, iv, jobs, jobs_cnt);
+	for (i = 0; i < jobs_cnt; i ++) {
+		off = (size_t)(jobs[i].data - mem);
+		TEST_CHECK(0 == memcmp(jobs[i].data, (ref + off),
+		    jobs[i].size));
+	}
+}
+
+/* Sizes around lane width, in place and to other buffer. */
+static void
+test_decrypt(const lg_aes_mb_key_t *key, const uint8_t *key256,
+    const uint8_t *iv, uint8_t *in, uint8_t *out, uint8_t *ref) {
+	static const size_t sizes[] = {
+		1, 2, 7, 8, 9, 15, 16, 17, 31, 33, 64,
+		(TEST_BIG_SIZE / LG_AES_MB_BLOCK_SIZE)
+	};
+	size_t i, size;
+
+	for (i = 0; i < nitems(sizes); i ++) {
+		size = (sizes[i] * LG_AES_MB_BLOCK_SIZE);
+		test_fill(in, size, (uint32_t)(100 + i));
+		TEST_CHECK(0 == test_evp(0, key256, iv, in, ref, size));
+		memset(out, 0xaa, (size + LG_AES_MB_BLOCK_SIZE));
+		lg_aes_mb_cbc_decrypt(key, iv, in, out, size);
+		TEST_CHECK(0 == memcmp(out, ref, size));
+		TEST_CHECK(0xaa == out[size]); /* No write past end. */
+		lg_aes_mb_cbc_decrypt(key, iv, in, in, size);
+		TEST_CHECK(0 == memcmp(in, ref, size));
+	}
+}
+
+static void
+test_impls(void) {
+	uint32_t impl;
+	const uint32_t impl_max = lg_aes_mb_impl_detect();
+	size_t cnt;
+	lg_aes_mb_key_t key;
+	uint8_t key256[32], iv[LG_AES_MB_BLOCK_SIZE], *mem, *ref, *out;
+	const size_t mem_size = MAX((TEST_JOBS_MAX * TEST_PKT_MAX),
+	    (TEST_BIG_SIZE + LG_AES_MB_BLOCK_SIZE));
+
+	TEST_CHECK(LG_AES_MB_IMPL_COUNT > impl_max);
+	TEST_CHECK(NULL != lg_aes_mb_impl_name(impl_max));
+	TEST_CHECK(0 == strcmp("unknown",
+	    lg_aes_mb_impl_name(LG_AES_MB_IMPL_COUNT)));
+	mem = lg_malloc(mem_size);
+	ref = lg_malloc(mem_size);
+	out = lg_malloc(mem_size);
+	TEST_CHECK(NULL != mem && NULL != ref && NULL != out);
+	if (NULL == mem || NULL == ref || NULL == out)
+		goto err_out;
+	test_fill(key256, sizeof(key256), 1);
+	test_fill(iv, sizeof(iv), 2);
+
+	/* Not supported impl is limited. */
+	lg_aes_mb_key_init(&key, key256, (LG_AES_MB_IMPL_COUNT - 1));
+	TEST_CHECK(impl_max == key.impl);
+	/* NONE: caller uses EVP, kernels do nothing. */
+	lg_aes_mb_key_init(&key, key256, LG_AES_MB_IMPL_NONE);
+	TEST_CHECK(LG_AES_MB_IMPL_NONE == key.impl);
+	test_fill(mem, LG_AES_MB_BLOCK_SIZE, 3);
+	memcpy(ref, mem, LG_AES_MB_BLOCK_SIZE);
+	lg_aes_mb_cbc_decrypt(&key, iv, mem, mem, LG_AES_MB_BLOCK_SIZE);
+	TEST_CHECK(0 == memcmp(mem, ref, LG_AES_MB_BLOCK_SIZE));
+
+	for (impl = (LG_AES_MB_IMPL_NONE + 1); impl <= impl_max; impl ++) {
+		lg_aes_mb_key_init(&key, key256, impl);
+		TEST_CHECK(impl == key.impl);
+		for (cnt = 1; cnt <= TEST_JOBS_MAX; cnt += 6) {
+			test_encrypt(&key, key256, iv, cnt, mem, ref);
+		}
+		test_decrypt(&key, key256, iv, mem, out, ref);
+	}
+	if (LG_AES_MB_IMPL_NONE == impl_max) {
+		fprintf(stderr, "No AES-NI: only EVP path is checked.\n");
+	}
+
+err_out:
+	lg_free(out);
+	lg_free(ref);
+	lg_free(mem);
+}
+
+
+int
+main(int argc, char *argv[]) {
+
+	(void)argc;
+	(void)argv;
+
+	test_impls();
+
+	return (test_result());
+}
@@ -0,0 +1,198 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_ctl_cap: records written by capture are read back from file:
+ * START first, types, targets, data, alignment, appended captures.
+ */
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <fcntl.h> /* open, fcntl */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_cap.h"
+#include "lg_mem.h"
+#include "utils/mem_utils.h"
+#include "test.h"
+
+
+/* Capture to file_name: target, request, responce, garbage. */
+static void
+test_cap_write(lg_ctl_crypto_p crypto, const char *file_name,
+    const uint32_t target, const char *name) {
+	lg_ctl_cap_t cap;
+	uint8_t pkt[512];
+	size_t pkt_size;
+
+	TEST_CHECK(0 == lg_ctl_cap_open(&cap, file_name, 0));
+	lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_TARGET, target,
+	    (const uint8_t*)name, strlen(name));
+	pkt_size = test_pkt(crypto, "{\"cmd\": \"get\", "
+	    "\"msg\": \"EQ_VIEW_INFO\"}", pkt, sizeof(pkt));
+	lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_TX, target, pkt, pkt_size);
+	pkt_size = test_pkt(crypto, "{\"msg\": \"EQ_VIEW_INFO\", "
+	    "\"result\": \"ok\", \"data\": {\"i_bass\": 7}}", pkt,
+	    sizeof(pkt));
+	lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_RX, target, pkt, pkt_size);
+	lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_RX_RAW, target, test_raw,
+	    sizeof(test_raw));
+	lg_ctl_cap_rec(NULL, LG_CTL_CAP_T_RX_RAW, target, test_raw,
+	    sizeof(test_raw)); /* No capture: ignored. */
+	TEST_CHECK(5 == cap.frames);
+	TEST_CHECK(0 == cap.dropped);
+	lg_ctl_cap_close(&cap);
+}
+
+/* Check one capture from off, returns offset of next. */
+static size_t
+test_cap_check(lg_ctl_crypto_p crypto, const uint8_t *buf,
+    const size_t buf_size, size_t off, const uint32_t target,
+    const char *name) {
+	static const uint32_t types[] = {
+		LG_CTL_CAP_T_START, LG_CTL_CAP_T_TARGET, LG_CTL_CAP_T_TX,
+		LG_CTL_CAP_T_RX, LG_CTL_CAP_T_RX_RAW
+	};
+	size_t i, size, pkt_off, plain_size;
+	uint64_t ts = 0;
+	lg_ctl_cap_rec_t rec;
+	lg_ctl_cap_start_t start;
+	const uint8_t *data;
+	uint8_t plain[512];
+
+	for (i = 0; i < nitems(types); i ++) {
+		TEST_CHECK(0 == (off % LG_CTL_CAP_REC_ALIGN));
+		if ((off + sizeof(rec)) > buf_size) {
+			TEST_CHECK(0);
+			return (buf_size);
+		}
+		memcpy(&rec, (buf + off), sizeof(rec));
+		size = LG_CTL_CAP_REC_SIZE(rec.info);
+		data = (buf + off + sizeof(rec));
+		off += LG_CTL_CAP_REC_FULL_SIZE(size);
+		if (off > buf_size) {
+			TEST_CHECK(0);
+			return (buf_size);
+		}
+		TEST_CHECK(types[i] == LG_CTL_CAP_REC_TYPE(rec.info));
+		TEST_CHECK(ts <= rec.ts);
+		ts = rec.ts;
+		TEST_CHECK(((0 == i) ? 0 : target) == rec.target);
+		switch (types[i]) {
+		case LG_CTL_CAP_T_START:
+			TEST_CHECK(sizeof(start) == size);
+			memcpy(&start, data, sizeof(start));
+			TEST_CHECK(0 == memcmp(start.magic, LG_CTL_CAP_MAGIC,
+			    sizeof(start.magic)));
+			TEST_CHECK(LG_CTL_CAP_VERSION == start.version);
+			TEST_CHECK(0 != start.ts_real);
+			break;
+		case LG_CTL_CAP_T_TARGET:
+			TEST_CHECK(strlen(name) == size);
+			TEST_CHECK(0 == memcmp(data, name, size));
+			break;
+		case LG_CTL_CAP_T_TX:
+		case LG_CTL_CAP_T_RX:
+			pkt_off = 0;
+			TEST_CHECK(0 == lg_ctl_pkt_data_get(crypto, &pkt_off,
+			    data, size, plain, sizeof(plain), &plain_size));
+			TEST_CHECK(size == pkt_off);
+			TEST_CHECK(0 == memcmp(plain, ((LG_CTL_CAP_T_TX ==
+			    types[i]) ? "{\"cmd\"" : "{\"msg\""), 6));
+			break;
+		case LG_CTL_CAP_T_RX_RAW:
+			TEST_CHECK(sizeof(test_raw) == size);
+			TEST_CHECK(0 == memcmp(data, test_raw, size));
+			/* Padding is zeroes. */
+			TEST_CHECK(0 == data[size]);
+			break;
+		}
+	}
+
+	return (off);
+}
+
+static void
+test_cap(lg_ctl_crypto_p crypto) {
+	int fd;
+	uint8_t *buf;
+	size_t buf_size = 0, off;
+	lg_ctl_cap_t cap;
+	char file_name[] = "/tmp/test_lg_ctl_cap.XXXXXX";
+
+	fd = mkstemp(file_name);
+	if (-1 == fd) {
+		TEST_CHECK(0);
+		return;
+	}
+	close(fd);
+	/* Two captures to same file. */
+	test_cap_write(crypto, file_name, 3, "spk-a");
+	test_cap_write(crypto, file_name, 1, "spk-b");
+	buf = test_file_read(file_name, &buf_size);
+	TEST_CHECK(NULL != buf);
+	if (NULL != buf) {
+		off = test_cap_check(crypto, buf, buf_size, 0, 3, "spk-a");
+		off = test_cap_check(crypto, buf, buf_size, off, 1, "spk-b");
+		TEST_CHECK(off == buf_size);
+		lg_free(buf);
+	}
+	unlink(file_name);
+	/* Not writable. */
+	TEST_CHECK(0 != lg_ctl_cap_open(&cap, "/nonexistent/dir/cap.bin", 0));
+}
+
+
+int
+main(int argc, char *argv[]) {
+	lg_ctl_crypto_t crypto;
+
+	(void)argc;
+	(void)argv;
+
+	if (0 != lg_ctl_crypto_init(&crypto)) {
+		fprintf(stderr, "lg_ctl_crypto_init() fail.\n");
+		return (1);
+	}
+	test_cap(&crypto);
+	lg_ctl_crypto_destroy(&crypto);
+
+	return (test_result());
+}
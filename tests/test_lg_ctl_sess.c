@@ -0,0 +1,328 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_ctl_sess: requests out, responces in by fragments, notifications,
+ * send() / recv() results mapping, timeouts, own decoder and stats.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_ctl_sess.h"
+#include "test.h"
+
+
+typedef struct test_cb_s {
+	size_t		cnt;
+	size_t		msg_idx;
+	int		error;
+	int		notify;
+} test_cb_t, *test_cb_p;
+
+
+static void
+test_sess_cb(lg_ctl_sess_p sess, size_t msg_idx, int error,
+    const lg_ctl_resp_t *resp, const uint8_t *data, size_t data_size,
+    void *udata) {
+	test_cb_p tcb = udata;
+
+	(void)sess;
+	(void)data;
+	(void)data_size;
+	tcb->cnt ++;
+	tcb->msg_idx = msg_idx;
+	tcb->error = error;
+	tcb->notify = ((NULL != resp) ? resp->notify : 0);
+}
+
+/* Own decoder: message index is first byte of data, '-' - notification. */
+static int
+test_sess_data_cb(lg_ctl_sess_p sess, uint8_t *data, size_t data_size,
+    uint64_t now, size_t *msg_idx, void *udata) {
+
+	(void)sess;
+	(void)data_size;
+	(void)now;
+	(void)udata;
+	(*msg_idx) = (('-' == data[0]) ? LG_CTL_SESS_MSG_NOTIFY :
+	    (size_t)(data[0] - 'a'));
+
+	return (0);
+}
+
+/* Feed packet by size bytes, as recv() would. */
+static int
+test_recv(lg_ctl_sess_p sess, const uint8_t *pkt, size_t pkt_size,
+    const size_t size, const uint64_t now) {
+	int error;
+	uint8_t *buf;
+	size_t buf_size;
+
+	while (0 != pkt_size) {
+		error = lg_ctl_sess_in_get(sess, &buf, &buf_size);
+		if (0 != error)
+			return (error);
+		buf_size = MIN(buf_size, MIN(size, pkt_size));
+		memcpy(buf, pkt, buf_size);
+		error = lg_ctl_sess_in_done(sess, (ssize_t)buf_size, now);
+		if (0 != error)
+			return (error);
+		pkt += buf_size;
+		pkt_size -= buf_size;
+	}
+
+	return (0);
+}
+
+static void
+test_out(lg_ctl_crypto_p crypto) {
+	lg_ctl_sess_t sess;
+	const uint8_t *data;
+	size_t data_size, off = 0, plain_size;
+	uint8_t plain[256];
+
+	lg_ctl_sess_init(&sess, crypto, NULL, 0);
+	TEST_CHECK(EAGAIN == lg_ctl_sess_out_get(&sess, &data, &data_size));
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, LG_CTL_MSG_EQ_VIEW_INFO, 1));
+	/* Not sent GET of same message is not duplicated. */
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, LG_CTL_MSG_EQ_VIEW_INFO, 2));
+	TEST_CHECK(1 == sess.in_flight_cnt);
+	TEST_CHECK(EINVAL == lg_ctl_sess_get(&sess, LG_CTL_MSG_COUNT, 2));
+	TEST_CHECK(0 == lg_ctl_sess_out_get(&sess, &data, &data_size));
+	TEST_CHECK(0 == lg_ctl_pkt_data_get(crypto, &off, data, data_size,
+	    plain, sizeof(plain), &plain_size));
+	TEST_CHECK(off == data_size);
+	TEST_CHECK(0 == memcmp(plain,
+	    "{\"cmd\": \"get\", \"msg\": \"EQ_VIEW_INFO\"}", plain_size));
+
+	/* send() errors: errno passed, nothing is consumed. */
+	errno = EAGAIN;
+	TEST_CHECK(EAGAIN == lg_ctl_sess_out_done(&sess, -1, 4));
+	errno = EPIPE;
+	TEST_CHECK(EPIPE == lg_ctl_sess_out_done(&sess, -1, 4));
+	TEST_CHECK(0 == sess.out_off);
+	/* Partial send. */
+	TEST_CHECK(0 == lg_ctl_sess_out_done(&sess, 3, 4));
+	TEST_CHECK(0 == lg_ctl_sess_out_get(&sess, &data, &off));
+	TEST_CHECK((data_size - 3) == off);
+	TEST_CHECK(0 == lg_ctl_sess_out_done(&sess, (ssize_t)off, 5));
+	TEST_CHECK(EAGAIN == lg_ctl_sess_out_get(&sess, &data, &data_size));
+
+	/* SET is always sent. */
+	TEST_CHECK(0 == lg_ctl_sess_set(&sess, LG_CTL_MSG_SPK_LIST_VIEW_INFO,
+	    "{\"i_vol\": 5}", 12, 3));
+	TEST_CHECK(0 == lg_ctl_sess_out_get(&sess, &data, &data_size));
+	off = 0;
+	TEST_CHECK(0 == lg_ctl_pkt_data_get(crypto, &off, data, data_size,
+	    plain, sizeof(plain), &plain_size));
+	TEST_CHECK(0 == memcmp(plain, "{\"cmd\": \"set\", \"msg\": "
+	    "\"SPK_LIST_VIEW_INFO\", \"data\": {\"i_vol\": 5}}", plain_size));
+	TEST_CHECK(2 == sess.in_flight_cnt);
+	lg_ctl_sess_destroy(&sess);
+}
+
+static void
+test_in(lg_ctl_crypto_p crypto) {
+	lg_ctl_sess_t sess;
+	lg_spk_info_t info;
+	test_cb_t tcb;
+	uint8_t *buf, pkt[512];
+	size_t buf_size, pkt_size;
+
+	memset(&info, 0x00, sizeof(info));
+	memset(&tcb, 0x00, sizeof(tcb));
+	lg_ctl_sess_init(&sess, crypto, NULL, 0);
+	sess.info = &info;
+	sess.cb = test_sess_cb;
+	sess.udata = &tcb;
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, LG_CTL_MSG_SPK_LIST_VIEW_INFO,
+	    10));
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, LG_CTL_MSG_EQ_VIEW_INFO, 10));
+
+	/* Answer by 1 byte fragments: cb once, after last byte. */
+	pkt_size = test_pkt(crypto, "{\"msg\": \"SPK_LIST_VIEW_INFO\", "
+	    "\"result\": \"ok\", \"data\": {\"i_vol\": 12, \"b_mute\": true}}",
+	    pkt, sizeof(pkt));
+	TEST_CHECK(0 != pkt_size);
+	TEST_CHECK(0 == test_recv(&sess, pkt, (pkt_size - 1), 1, 20));
+	TEST_CHECK(0 == tcb.cnt);
+	TEST_CHECK(0 == test_recv(&sess, (pkt + pkt_size - 1), 1, 1, 20));
+	TEST_CHECK(1 == tcb.cnt);
+	TEST_CHECK(LG_CTL_MSG_SPK_LIST_VIEW_INFO == tcb.msg_idx);
+	TEST_CHECK(0 == tcb.error);
+	TEST_CHECK(12 == info.spk.vol);
+	TEST_CHECK(1 == info.spk.mute);
+	TEST_CHECK(1 == sess.in_flight_cnt);
+
+	/* Notification is not an answer. */
+	pkt_size = test_pkt(crypto, "{\"cmd\": \"notibyget\", "
+	    "\"msg\": \"EQ_VIEW_INFO\", \"result\": \"ok\", "
+	    "\"data\": {\"i_bass\": 3}}", pkt, sizeof(pkt));
+	TEST_CHECK(0 == lg_ctl_sess_input(&sess, pkt, pkt_size, 30));
+	TEST_CHECK(2 == tcb.cnt);
+	TEST_CHECK(LG_CTL_MSG_COUNT == tcb.msg_idx);
+	TEST_CHECK(1 == tcb.notify);
+	TEST_CHECK(3 == info.eq.bass);
+	TEST_CHECK(1 == sess.in_flight_cnt);
+
+	/* Broken JSON answers the only request in flight. */
+	pkt_size = test_pkt(crypto, "{\"msg\": ", pkt, sizeof(pkt));
+	TEST_CHECK(0 == lg_ctl_sess_input(&sess, pkt, pkt_size, 40));
+	TEST_CHECK(3 == tcb.cnt);
+	TEST_CHECK(LG_CTL_MSG_EQ_VIEW_INFO == tcb.msg_idx);
+	TEST_CHECK(EBADMSG == tcb.error);
+	TEST_CHECK(0 == sess.in_flight_cnt);
+
+	/* recv() results. */
+	TEST_CHECK(0 == lg_ctl_sess_in_get(&sess, &buf, &buf_size));
+	TEST_CHECK(ECONNRESET == lg_ctl_sess_in_done(&sess, 0, 50));
+	errno = EAGAIN;
+	TEST_CHECK(EAGAIN == lg_ctl_sess_in_done(&sess, -1, 50));
+	errno = ECONNREFUSED;
+	TEST_CHECK(ECONNREFUSED == lg_ctl_sess_in_done(&sess, -1, 50));
+	TEST_CHECK(3 == tcb.cnt);
+	lg_ctl_sess_destroy(&sess);
+}
+
+static void
+test_timeout(lg_ctl_crypto_p crypto) {
+	lg_ctl_sess_t sess;
+	test_cb_t tcb;
+
+	memset(&tcb, 0x00, sizeof(tcb));
+	lg_ctl_sess_init(&sess, crypto, NULL, 0);
+	sess.timeout = 100; /* ms */
+	sess.cb = test_sess_cb;
+	sess.udata = &tcb;
+	TEST_CHECK(((uint64_t)-1) == lg_ctl_sess_deadline(&sess));
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, LG_CTL_MSG_PLAY_INFO, 1000));
+	TEST_CHECK(101000 == lg_ctl_sess_deadline(&sess));
+	lg_ctl_sess_timer(&sess, 100999);
+	TEST_CHECK(0 == tcb.cnt);
+	lg_ctl_sess_timer(&sess, 101000);
+	TEST_CHECK(1 == tcb.cnt);
+	TEST_CHECK(LG_CTL_MSG_PLAY_INFO == tcb.msg_idx);
+	TEST_CHECK(ETIMEDOUT == tcb.error);
+	TEST_CHECK(((uint64_t)-1) == lg_ctl_sess_deadline(&sess));
+	/* Reset forgets requests without cb. */
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, LG_CTL_MSG_PLAY_INFO, 2000));
+	lg_ctl_sess_reset(&sess);
+	lg_ctl_sess_timer(&sess, 1000000);
+	TEST_CHECK(1 == tcb.cnt);
+	TEST_CHECK(0 == sess.in_flight_cnt);
+	lg_ctl_sess_destroy(&sess);
+}
+
+static void
+test_data_cb(lg_ctl_crypto_p crypto) {
+	lg_ctl_sess_t sess;
+	lg_spk_stats_p stats;
+	test_cb_t tcb;
+	const uint8_t *data;
+	uint8_t pkt[512];
+	size_t data_size, pkt_size;
+
+	memset(&tcb, 0x00, sizeof(tcb));
+	TEST_CHECK(0 == lg_spk_stats_create(1, &stats));
+	if (NULL == stats)
+		return;
+	lg_ctl_sess_init(&sess, crypto, NULL, 0);
+	sess.cb = test_sess_cb;
+	sess.data_cb = test_sess_data_cb;
+	sess.udata = &tcb;
+	sess.stats = stats;
+	sess.stats_target = 0;
+	/* Ready packet, not deduplicated. */
+	pkt_size = test_pkt(crypto, "{}", pkt, sizeof(pkt));
+	TEST_CHECK(0 != pkt_size);
+	TEST_CHECK(0 == lg_ctl_sess_pkt_add(&sess, 1, pkt, pkt_size, 100));
+	TEST_CHECK(0 == lg_ctl_sess_pkt_add(&sess, 1, pkt, pkt_size, 100));
+	TEST_CHECK(0 == lg_ctl_sess_get(&sess, 2, 100));
+	TEST_CHECK(3 == sess.in_flight_cnt);
+	TEST_CHECK(3 == stats->tx_reqs);
+	TEST_CHECK(0 != lg_ctl_sess_out_pending(&sess));
+	/* First byte of both messages is sent by one call. */
+	TEST_CHECK(0 == lg_ctl_sess_out_get(&sess, &data, &data_size));
+	TEST_CHECK(0 == lg_ctl_sess_out_done(&sess, (ssize_t)data_size, 150));
+	TEST_CHECK(0 == lg_ctl_sess_out_pending(&sess));
+	TEST_CHECK(data_size == stats->tx_bytes);
+	TEST_CHECK(2 == stats->stage[LG_SPK_STAT_SEND].cnt);
+	TEST_CHECK(50 == stats->stage[LG_SPK_STAT_SEND].max);
+
+	/* Routed by decoder, no resp. */
+	pkt_size = test_pkt(crypto, "b", pkt, sizeof(pkt));
+	TEST_CHECK(0 == lg_ctl_sess_input(&sess, pkt, pkt_size, 200));
+	TEST_CHECK(1 == tcb.cnt);
+	TEST_CHECK(1 == tcb.msg_idx);
+	TEST_CHECK(0 == tcb.error);
+	TEST_CHECK(0 == tcb.notify);
+	TEST_CHECK(2 == sess.in_flight_cnt);
+	TEST_CHECK(1 == stats->rx_frames);
+	TEST_CHECK(1 == stats->stage[LG_SPK_STAT_WAIT].cnt);
+	TEST_CHECK(50 == stats->stage[LG_SPK_STAT_WAIT].max);
+	TEST_CHECK(1 == stats->stage[LG_SPK_STAT_TOTAL].cnt);
+	/* Notification. */
+	pkt_size = test_pkt(crypto, "-", pkt, sizeof(pkt));
+	TEST_CHECK(0 == lg_ctl_sess_input(&sess, pkt, pkt_size, 210));
+	TEST_CHECK(2 == tcb.cnt);
+	TEST_CHECK(LG_CTL_MSG_COUNT == tcb.msg_idx);
+	TEST_CHECK(2 == sess.in_flight_cnt);
+	TEST_CHECK(2 == stats->rx_frames);
+	TEST_CHECK(1 == stats->stage[LG_SPK_STAT_TOTAL].cnt);
+	lg_ctl_sess_destroy(&sess);
+	lg_spk_stats_destroy(stats);
+}
+
+
+int
+main(int argc, char *argv[]) {
+	lg_ctl_crypto_t crypto;
+
+	(void)argc;
+	(void)argv;
+
+	if (0 != lg_ctl_crypto_init(&crypto)) {
+		fprintf(stderr, "lg_ctl_crypto_init() fail.\n");
+		return (1);
+	}
+	test_out(&crypto);
+	test_in(&crypto);
+	test_timeout(&crypto);
+	test_data_cb(&crypto);
+	lg_ctl_crypto_destroy(&crypto);
+
+	return (test_result());
+}
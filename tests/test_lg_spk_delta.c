@@ -0,0 +1,190 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_spk_delta: flattening to paths, changed / added / removed fields,
+ * arrays as whole values, limits.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_spk_delta.h"
+#include "lg_mem.h"
+#include "test.h"
+
+
+/* Changes as "path:old>new\n" lines, "-" for NULL. */
+typedef struct test_delta_s {
+	size_t		cnt;
+	size_t		size;
+	char		buf[1024];
+} test_delta_t, *test_delta_p;
+
+
+static int
+test_delta_cb(const char *path, size_t path_size, const char *old,
+    size_t old_size, const char *new, size_t new_size, void *udata) {
+	test_delta_p td = udata;
+	int ret;
+
+	ret = snprintf((td->buf + td->size), (sizeof(td->buf) - td->size),
+	    "%.*s:%.*s>%.*s\n", (int)path_size, path,
+	    (int)((NULL != old) ? old_size : 1), ((NULL != old) ? old : "-"),
+	    (int)((NULL != new) ? new_size : 1), ((NULL != new) ? new : "-"));
+	if (0 > ret || (sizeof(td->buf) - td->size) <= (size_t)ret)
+		return (ENOBUFS);
+	td->size += (size_t)ret;
+	td->cnt ++;
+
+	return (0);
+}
+
+static int
+test_parse(lg_spk_fields_p fields, char *buf, const char *data) {
+	int len;
+	lg_ctl_resp_t resp;
+
+	len = snprintf(buf, 1024, "{\"msg\": \"SPK_LIST_VIEW_INFO\", "
+	    "\"result\": \"ok\", \"data\": %s}", data);
+
+	return (lg_spk_fields_parse(fields, buf, (size_t)len, &resp));
+}
+
+
+static void
+test_diff(void) {
+	lg_spk_fields_p old, new;
+	test_delta_t td;
+	char old_buf[1024], new_buf[1024];
+
+	old = lg_malloc(sizeof(lg_spk_fields_t));
+	new = lg_malloc(sizeof(lg_spk_fields_t));
+	if (NULL == old || NULL == new) {
+		TEST_CHECK(0);
+		goto out;
+	}
+	lg_spk_fields_init(old, NULL);
+	lg_spk_fields_init(new, NULL);
+	TEST_CHECK(0 == test_parse(old, old_buf, "{\"i_vol\": 5, "
+	    "\"s_name\": \"a\", \"o\": {\"x\": 1, \"p\": {\"y\": true}}, "
+	    "\"ai_list\": [1, [2, 3], {\"z\": 4}], \"b_gone\": false}"));
+	TEST_CHECK(6 == old->cnt);
+
+	/* Same values, other order and spaces outside values. */
+	TEST_CHECK(0 == test_parse(new, new_buf, "{\"b_gone\":false, "
+	    "\"ai_list\": [1, [2, 3], {\"z\": 4}], \"s_name\": \"a\", "
+	    "\"o\": {\"p\": {\"y\": true}, \"x\": 1}, \"i_vol\": 5}"));
+	memset(&td, 0x00, sizeof(td));
+	TEST_CHECK(0 == lg_spk_fields_diff(old, new, test_delta_cb, &td));
+	TEST_CHECK(0 == td.cnt);
+
+	/* Changed, added, removed; nested and arrays. */
+	TEST_CHECK(0 == test_parse(new, new_buf, "{\"i_vol\": 6, "
+	    "\"s_name\": \"a\", \"o\": {\"x\": 1, \"p\": {\"y\": false}}, "
+	    "\"ai_list\": [1, [2, 4], {\"z\": 4}], \"i_new\": 0}"));
+	memset(&td, 0x00, sizeof(td));
+	TEST_CHECK(0 == lg_spk_fields_diff(old, new, test_delta_cb, &td));
+	TEST_CHECK(5 == td.cnt);
+	TEST_CHECK(0 == strcmp(td.buf,
+	    "i_vol:5>6\n"
+	    "o.p.y:true>false\n"
+	    "ai_list:[1, [2, 3], {\"z\": 4}]>[1, [2, 4], {\"z\": 4}]\n"
+	    "i_new:->0\n"
+	    "b_gone:false>-\n"));
+
+	/* Callback error stops diff. */
+	memset(&td, 0x00, sizeof(td));
+	td.size = (sizeof(td.buf) - 4);
+	TEST_CHECK(ENOBUFS == lg_spk_fields_diff(old, new, test_delta_cb,
+	    &td));
+	TEST_CHECK(0 == td.cnt);
+	TEST_CHECK(EINVAL == lg_spk_fields_diff(old, NULL, test_delta_cb,
+	    &td));
+out:
+	lg_free(old);
+	lg_free(new);
+}
+
+static void
+test_limits(void) {
+	lg_spk_fields_p fields;
+	char *buf;
+	size_t i, off;
+	lg_ctl_resp_t resp;
+
+	fields = lg_malloc(sizeof(lg_spk_fields_t));
+	buf = lg_malloc(8192);
+	if (NULL == fields || NULL == buf) {
+		TEST_CHECK(0);
+		goto out;
+	}
+	lg_spk_fields_init(fields, NULL);
+	/* One field more than LG_SPK_FIELDS_MAX. */
+	off = (size_t)snprintf(buf, 8192, "{\"msg\": \"PLAY_INFO\", "
+	    "\"result\": \"ok\", \"data\": {");
+	for (i = 0; i <= LG_SPK_FIELDS_MAX; i ++) {
+		off += (size_t)snprintf((buf + off), (8192 - off),
+		    "%s\"f%zu\": %zu", ((0 != i) ? ", " : ""), i, i);
+	}
+	off += (size_t)snprintf((buf + off), (8192 - off), "}}");
+	TEST_CHECK(ENOBUFS == lg_spk_fields_parse(fields, buf, off, &resp));
+	/* Exactly LG_SPK_FIELDS_MAX fit. */
+	off = (size_t)snprintf(buf, 8192, "{\"msg\": \"PLAY_INFO\", "
+	    "\"result\": \"ok\", \"data\": {");
+	for (i = 0; i < LG_SPK_FIELDS_MAX; i ++) {
+		off += (size_t)snprintf((buf + off), (8192 - off),
+		    "%s\"f%zu\": %zu", ((0 != i) ? ", " : ""), i, i);
+	}
+	off += (size_t)snprintf((buf + off), (8192 - off), "}}");
+	TEST_CHECK(0 == lg_spk_fields_parse(fields, buf, off, &resp));
+	TEST_CHECK(LG_SPK_FIELDS_MAX == fields->cnt);
+out:
+	lg_free(fields);
+	lg_free(buf);
+}
+
+
+int
+main(int argc, char *argv[]) {
+
+	(void)argc;
+	(void)argv;
+
+	test_diff();
+	test_limits();
+
+	return (test_result());
+}
@@ -0,0 +1,163 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_spk_discover cache file: entries are loaded, other lines are kept
+ * and written back, repeated load / save does not change file.
+ */
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_spk_discover.h"
+#include "lg_mem.h"
+#include "test.h"
+
+
+#define TEST_MAC	0xaabbccddeeffull
+#define TEST_MAC_NEW	0x001122334455ull
+
+/* Hand edited cache: last line has no line feed. */
+static const char *test_cache_in =
+    "# lgspkctl discovery cache: addr:port mac model\n"
+    "# Living room, fixed address.\n"
+    "10.0.0.5:9741 kitchen\n"
+    "\n"
+    "192.168.1.2:9741 aa:bb:cc:dd:ee:ff SN5Y  \n"
+    "not-an-address!:1 bad\n"
+    "# tail";
+
+/* Saved: header, kept lines, entries. */
+static const char *test_cache_kept =
+    "# lgspkctl discovery cache: addr:port mac model\n"
+    "# Living room, fixed address.\n"
+    "10.0.0.5:9741 kitchen\n"
+    "\n"
+    "not-an-address!:1 bad\n"
+    "# tail\n";
+
+
+static void
+test_cache(void) {
+	int fd;
+	size_t size, size2;
+	char *buf, *buf2, file_name[] = "/tmp/test_lg_spk_disc.XXXXXX";
+	struct sockaddr_storage addr;
+	lg_spk_disc_cache_t cache;
+	lg_spk_disc_ent_p ent;
+
+	fd = mkstemp(file_name);
+	TEST_CHECK(-1 != fd);
+	if (-1 == fd)
+		return;
+	TEST_CHECK((ssize_t)strlen(test_cache_in) ==
+	    write(fd, test_cache_in, strlen(test_cache_in)));
+	close(fd);
+
+	lg_spk_disc_cache_init(&cache);
+	TEST_CHECK(0 == lg_spk_disc_cache_load(&cache, file_name));
+	TEST_CHECK(1 == cache.cnt);
+	ent = lg_spk_disc_cache_find(&cache, TEST_MAC);
+	TEST_CHECK(NULL != ent);
+	if (NULL != ent) {
+		TEST_CHECK(LG_SPK_DISC_S_CACHED == ent->state);
+		TEST_CHECK(0 == strcmp("SN5Y", ent->model));
+	}
+	TEST_CHECK(strlen(test_cache_kept) ==
+	    (strlen("# lgspkctl discovery cache: addr:port mac model\n") +
+	    cache.keep_size));
+	/* Found one more. */
+	memset(&addr, 0x00, sizeof(addr));
+	addr.ss_family = AF_INET;
+	((struct sockaddr_in*)&addr)->sin_port = htons(9741);
+	((struct sockaddr_in*)&addr)->sin_addr.s_addr = htonl(0x0a000006);
+	TEST_CHECK(0 == lg_spk_disc_cache_update(&cache, TEST_MAC_NEW,
+	    &addr, "S80QY", NULL));
+	TEST_CHECK(0 == lg_spk_disc_cache_save(&cache, file_name));
+	lg_spk_disc_cache_destroy(&cache);
+
+	buf = test_file_read(file_name, &size);
+	TEST_CHECK(NULL != buf);
+	if (NULL == buf)
+		goto out;
+	TEST_CHECK(0 == strncmp(buf, test_cache_kept,
+	    strlen(test_cache_kept)));
+	TEST_CHECK(NULL != strstr(buf, "\n192.168.1.2:9741 "
+	    "aa:bb:cc:dd:ee:ff SN5Y\n"));
+	TEST_CHECK(NULL != strstr(buf, "\n10.0.0.6:9741 "
+	    "00:11:22:33:44:55 S80QY\n"));
+
+	/* Load and save again: same file. */
+	lg_spk_disc_cache_init(&cache);
+	TEST_CHECK(0 == lg_spk_disc_cache_load(&cache, file_name));
+	TEST_CHECK(2 == cache.cnt);
+	TEST_CHECK(0 == lg_spk_disc_cache_save(&cache, file_name));
+	lg_spk_disc_cache_destroy(&cache);
+	buf2 = test_file_read(file_name, &size2);
+	TEST_CHECK(NULL != buf2);
+	if (NULL != buf2) {
+		TEST_CHECK(size == size2);
+		TEST_CHECK(0 == memcmp(buf, buf2, MIN(size, size2)));
+		lg_free(buf2);
+	}
+	lg_free(buf);
+
+out:
+	unlink(file_name);
+	/* Missing file: empty cache. */
+	lg_spk_disc_cache_init(&cache);
+	TEST_CHECK(0 == lg_spk_disc_cache_load(&cache, file_name));
+	TEST_CHECK(0 == cache.cnt && 0 == cache.keep_size);
+	lg_spk_disc_cache_destroy(&cache);
+}
+
+
+int
+main(int argc, char *argv[]) {
+
+	(void)argc;
+	(void)argv;
+
+	test_cache();
+
+	return (test_result());
+}
@@ -0,0 +1,258 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_spk_engine: happy eyeballs with primary address that never
+ * connects: listener with full accept queue drops SYN, alternative
+ * wins after LG_SPK_ENGINE_HE_DELAY, pending primary must be closed.
+ */
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <fcntl.h> /* open, fcntl */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <signal.h>
+#include <errno.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_resp.h"
+#include "lg_spk_engine.h"
+#include "utils/mem_utils.h"
+#include "test.h"
+
+
+#define TEST_BACKLOG_FILL	4 /* Connects to fill primary queue. */
+#define TEST_POLLS		3
+#define TEST_MSGS		((((uint32_t)1) << LG_CTL_MSG_EQ_VIEW_INFO) | \
+				 (((uint32_t)1) << LG_CTL_MSG_PLAY_INFO))
+
+
+/* Listen on 127.0.0.1, random port. */
+static int
+test_listen(int backlog, struct sockaddr_storage *addr) {
+	int skt;
+	socklen_t addrlen = sizeof(struct sockaddr_in);
+	struct sockaddr_in *sin = (struct sockaddr_in*)addr;
+
+	memset(addr, 0x00, sizeof(struct sockaddr_storage));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	skt = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (-1 == skt)
+		return (-1);
+	if (0 != bind(skt, (struct sockaddr*)sin, addrlen) ||
+	    0 != listen(skt, backlog) ||
+	    0 != getsockname(skt, (struct sockaddr*)sin, &addrlen)) {
+		close(skt);
+		return (-1);
+	}
+
+	return (skt);
+}
+
+/* Answer every GET request with empty "ok" responce until EOF. */
+static void
+test_srv_conn(lg_ctl_crypto_p crypto, int skt) {
+	size_t buf_size = 0, off, data_size, pkt_size;
+	ssize_t ios;
+	uint8_t buf[4096], data[256], pkt[512];
+	char json[256];
+	lg_ctl_resp_t resp;
+
+	for (;;) {
+		ios = recv(skt, (buf + buf_size), (sizeof(buf) - buf_size), 0);
+		if (0 >= ios)
+			return;
+		buf_size += (size_t)ios;
+		off = 0;
+		while (0 == lg_ctl_pkt_data_get(crypto, &off, buf, buf_size,
+		    data, (sizeof(data) - 1), &data_size)) {
+			data[data_size] = 0;
+			if (0 != lg_ctl_resp_parse((const char*)data, data_size,
+			    NULL, NULL, &resp))
+				return;
+			snprintf(json, sizeof(json), "{\"msg\": \"%s\", "
+			    "\"result\": \"ok\", \"data\": {}}",
+			    lg_ctl_msg[resp.msg_idx]);
+			pkt_size = test_pkt(crypto, json, pkt, sizeof(pkt));
+			if (0 == pkt_size ||
+			    (ssize_t)pkt_size != send(skt, pkt, pkt_size,
+			    MSG_NOSIGNAL))
+				return;
+		}
+		memmove(buf, (buf + off), (buf_size - off));
+		buf_size -= off;
+	}
+}
+
+static size_t
+test_data_cb(lg_spk_sess_p sess, uint8_t *data, size_t data_size,
+    void *udata) {
+	lg_ctl_resp_t resp;
+
+	(void)sess;
+	(void)udata;
+	if (0 != lg_ctl_resp_parse((const char*)data, data_size, NULL, NULL,
+	    &resp))
+		return (LG_CTL_MSG_COUNT);
+
+	return (resp.msg_idx);
+}
+
+/* Lowest free descriptor: grows if engine leaks sockets. */
+static int
+test_fd_free(void) {
+	int fd;
+
+	fd = dup(STDIN_FILENO);
+	if (-1 != fd) {
+		close(fd);
+	}
+
+	return (fd);
+}
+
+static void
+test_happy_eyeballs(lg_ctl_crypto_p crypto, lg_ctl_get_pkts_p get_pkts) {
+	int skt_pri, skt_alt, skt, fill[TEST_BACKLOG_FILL], fd_free = -1;
+	size_t i;
+	pid_t pid;
+	lg_spk_target_t target;
+	lg_spk_engine_t eng;
+	lg_spk_sess_p sess;
+
+	memset(&target, 0x00, sizeof(target));
+	snprintf(target.name, sizeof(target.name), "he");
+	skt_pri = test_listen(0, &target.addr);
+	skt_alt = test_listen(TEST_BACKLOG_FILL, &target.addr_alt);
+	TEST_CHECK(-1 != skt_pri);
+	TEST_CHECK(-1 != skt_alt);
+	if (-1 == skt_pri || -1 == skt_alt)
+		goto out;
+	/* Never accepted: queue is full, next SYN to primary is dropped. */
+	for (i = 0; i < nitems(fill); i ++) {
+		fill[i] = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (-1 == fill[i])
+			continue;
+		fcntl(fill[i], F_SETFL, O_NONBLOCK);
+		connect(fill[i], (struct sockaddr*)&target.addr,
+		    sizeof(struct sockaddr_in));
+	}
+	usleep(100000);
+
+	pid = fork();
+	TEST_CHECK(-1 != pid);
+	if (-1 == pid)
+		goto out_fill;
+	if (0 == pid) { /* Alternative address server. */
+		close(skt_pri);
+		for (;;) {
+			skt = accept(skt_alt, NULL, NULL);
+			if (-1 == skt)
+				_exit(0);
+			test_srv_conn(crypto, skt);
+			close(skt);
+		}
+	}
+
+	lg_spk_engine_init(&eng, crypto, get_pkts);
+	eng.timeout = 5000;
+	eng.msgs = TEST_MSGS;
+	eng.data_cb = test_data_cb;
+	for (i = 0; i < TEST_POLLS; i ++) {
+		TEST_CHECK(0 == lg_spk_engine_poll(&eng, &target, 1));
+		sess = &eng.sess[0];
+		TEST_CHECK(LG_SPK_SESS_S_DONE == sess->state);
+		TEST_CHECK(0 == sess->error);
+		TEST_CHECK(eng.msg_cnt == sess->done_cnt);
+		TEST_CHECK(0 != sess->alt_started);
+		/* Primary was pending, alternative connected after delay. */
+		TEST_CHECK((LG_SPK_ENGINE_HE_DELAY * 1000) <=
+		    (sess->ts_connected - sess->ts_start));
+		/* Event queue is opened by first poll, then nothing. */
+		if (0 == i) {
+			fd_free = test_fd_free();
+		}
+		TEST_CHECK(fd_free == test_fd_free());
+	}
+	lg_spk_engine_destroy(&eng);
+
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+out_fill:
+	for (i = 0; i < nitems(fill); i ++) {
+		if (-1 != fill[i]) {
+			close(fill[i]);
+		}
+	}
+out:
+	if (-1 != skt_pri) {
+		close(skt_pri);
+	}
+	if (-1 != skt_alt) {
+		close(skt_alt);
+	}
+}
+
+
+int
+main(int argc, char *argv[]) {
+	lg_ctl_crypto_t crypto;
+	lg_ctl_get_pkts_t get_pkts;
+
+	(void)argc;
+	(void)argv;
+
+	if (0 != lg_ctl_crypto_init(&crypto)) {
+		fprintf(stderr, "lg_ctl_crypto_init() fail.\n");
+		return (1);
+	}
+	if (0 != lg_ctl_get_pkts_create(&crypto, &get_pkts)) {
+		fprintf(stderr, "lg_ctl_get_pkts_create() fail.\n");
+		return (1);
+	}
+	test_happy_eyeballs(&crypto, &get_pkts);
+	lg_ctl_get_pkts_destroy(&get_pkts);
+	lg_ctl_crypto_destroy(&crypto);
+
+	return (test_result());
+}
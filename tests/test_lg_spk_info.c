@@ -0,0 +1,171 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_spk_info: message and field name perfect hashes, typed decoding.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_spk_info.h"
+#include "test.h"
+
+
+static void
+test_msg_hash(void) {
+	size_t i, size;
+	char name[64];
+
+	/* Every known name is found. */
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		TEST_CHECK(i == lg_ctl_msg_idx_get(lg_ctl_msg[i],
+		    strlen(lg_ctl_msg[i])));
+	}
+	/* Prefix, longer, changed and lower case names are not. */
+	for (i = 0; i < LG_CTL_MSG_COUNT; i ++) {
+		size = strlen(lg_ctl_msg[i]);
+		if (sizeof(name) <= (size + 1))
+			continue;
+		memcpy(name, lg_ctl_msg[i], size);
+		name[size] = 'X';
+		TEST_CHECK(LG_CTL_MSG_COUNT == lg_ctl_msg_idx_get(name,
+		    (size - 1)));
+		TEST_CHECK(LG_CTL_MSG_COUNT == lg_ctl_msg_idx_get(name,
+		    (size + 1)));
+		name[(size - 1)] ^= 0x20;
+		TEST_CHECK(LG_CTL_MSG_COUNT == lg_ctl_msg_idx_get(name,
+		    size));
+	}
+	TEST_CHECK(LG_CTL_MSG_COUNT == lg_ctl_msg_idx_get(NULL, 5));
+	TEST_CHECK(LG_CTL_MSG_COUNT == lg_ctl_msg_idx_get("EQ", 2));
+	TEST_CHECK(LG_CTL_MSG_COUNT == lg_ctl_msg_idx_get("eq_view_info",
+	    12));
+}
+
+static void
+test_field_hash(void) {
+	size_t i, size;
+	char name[64];
+
+	for (i = 0; i < LG_SPK_F_COUNT; i ++) {
+		TEST_CHECK(i == lg_spk_field_id_get(lg_spk_field_name[i],
+		    strlen(lg_spk_field_name[i])));
+		/* Every field belongs to some message. */
+		TEST_CHECK(0 != lg_spk_field_msgs[i]);
+	}
+	for (i = 0; i < LG_SPK_F_COUNT; i ++) {
+		size = strlen(lg_spk_field_name[i]);
+		if (sizeof(name) <= (size + 1))
+			continue;
+		memcpy(name, lg_spk_field_name[i], size);
+		name[size] = 'x';
+		TEST_CHECK(LG_SPK_F_COUNT == lg_spk_field_id_get(name,
+		    (size - 1)));
+		TEST_CHECK(LG_SPK_F_COUNT == lg_spk_field_id_get(name,
+		    (size + 1)));
+		name[(size - 1)] ^= 0x01;
+		TEST_CHECK(LG_SPK_F_COUNT == lg_spk_field_id_get(name,
+		    size));
+	}
+	TEST_CHECK(LG_SPK_F_COUNT == lg_spk_field_id_get(NULL, 5));
+	TEST_CHECK(LG_SPK_F_COUNT == lg_spk_field_id_get("i_", 2));
+	TEST_CHECK(LG_SPK_F_COUNT == lg_spk_field_id_get("i_volume", 8));
+}
+
+static void
+test_decode(void) {
+	lg_spk_info_t info;
+	lg_ctl_resp_t resp;
+	char buf[512];
+	int len;
+
+	memset(&info, 0x00, sizeof(info));
+	len = snprintf(buf, sizeof(buf), "{\"msg\": \"SPK_LIST_VIEW_INFO\", "
+	    "\"result\": \"ok\", \"data\": {\"i_vol\": 12, \"i_vol_min\": 0, "
+	    "\"i_vol_max\": 99999999999, \"b_mute\": true, "
+	    "\"b_powerstatus\": 0, \"i_curr_func\": \"6\", \"s_unknown\": 1, "
+	    "\"s_user_name\": \"%s\"}}",
+	    "0123456789012345678901234567890123456789012345678901234567890"
+	    "123456789");
+	TEST_CHECK(0 == lg_spk_info_decode(&info, buf, (size_t)len, &resp));
+	TEST_CHECK(LG_CTL_MSG_SPK_LIST_VIEW_INFO == resp.msg_idx);
+	TEST_CHECK(LG_SPK_INFO_HAS_MSG(&info, LG_CTL_MSG_SPK_LIST_VIEW_INFO));
+	TEST_CHECK(!LG_SPK_INFO_HAS_MSG(&info, LG_CTL_MSG_EQ_VIEW_INFO));
+	TEST_CHECK(12 == info.spk.vol);
+	TEST_CHECK(INT32_MAX == info.spk.vol_max); /* Clamped. */
+	TEST_CHECK(1 == info.spk.mute);
+	TEST_CHECK(0 == info.spk.power);
+	/* Wrong type is skipped. */
+	TEST_CHECK(!LG_SPK_INFO_HAS_FIELD(&info, LG_SPK_F_I_CURR_FUNC));
+	TEST_CHECK(LG_SPK_INFO_HAS_FIELD(&info, LG_SPK_F_I_VOL_MIN));
+	/* Truncated, zero terminated. */
+	TEST_CHECK((sizeof(info.spk.user_name) - 1) ==
+	    strlen(info.spk.user_name));
+	TEST_CHECK(0 == memcmp(info.spk.user_name, "0123456789", 10));
+
+	len = snprintf(buf, sizeof(buf), "{\"msg\": \"EQ_VIEW_INFO\", "
+	    "\"result\": \"ok\", \"data\": {\"i_bass\": -3, "
+	    "\"ai_eq_list\": [0, 2, 31, 32, -1, \"x\"], \"i_curr_eq\": 2}}");
+	TEST_CHECK(0 == lg_spk_info_decode(&info, buf, (size_t)len, &resp));
+	TEST_CHECK(LG_SPK_INFO_HAS_MSG(&info, LG_CTL_MSG_EQ_VIEW_INFO));
+	TEST_CHECK(-3 == info.eq.bass);
+	TEST_CHECK(2 == info.eq.curr_eq);
+	TEST_CHECK(((((uint32_t)1) << 0) | (((uint32_t)1) << 2) |
+	    (((uint32_t)1) << 31)) == info.eq.eq_list);
+	TEST_CHECK(LG_SPK_INFO_HAS_FIELD(&info, LG_SPK_F_AI_EQ_LIST));
+	/* Escaped string. */
+	len = snprintf(buf, sizeof(buf), "{\"msg\": \"PRODUCT_INFO\", "
+	    "\"result\": \"ok\", \"data\": {\"s_model_name\": "
+	    "\"SN\\\"11\\u0041\"}}");
+	TEST_CHECK(0 == lg_spk_info_decode(&info, buf, (size_t)len, &resp));
+	TEST_CHECK(0 == strcmp(info.product.model_name, "SN\"11A"));
+	/* Not JSON. */
+	TEST_CHECK(0 != lg_spk_info_decode(&info, "{\"msg\": ", 8, &resp));
+}
+
+
+int
+main(int argc, char *argv[]) {
+
+	(void)argc;
+	(void)argv;
+
+	test_msg_hash();
+	test_field_hash();
+	test_decode();
+
+	return (test_result());
+}
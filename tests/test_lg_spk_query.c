@@ -0,0 +1,173 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_spk_query: path forms, errors, planner message choice, matching.
+ */
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lg_spk_query.h"
+#include "test.h"
+
+
+#define TEST_MSG(__msg_idx)	(((uint32_t)1) << (__msg_idx))
+
+
+static int
+test_add(lg_spk_query_p query, const char *path) {
+
+	return (lg_spk_query_add(query, path, strlen(path)));
+}
+
+static void
+test_add_errors(void) {
+	size_t i;
+	lg_spk_query_t query;
+
+	lg_spk_query_init(&query);
+	TEST_CHECK(EINVAL == test_add(&query, "NO_SUCH_MSG"));
+	TEST_CHECK(EINVAL == test_add(&query, "i_no_such_field"));
+	TEST_CHECK(EINVAL == test_add(&query, "i_vol.x"));
+	TEST_CHECK(EINVAL == test_add(&query, "EQ_VIEW_INFO."));
+	TEST_CHECK(EINVAL == test_add(&query, "EQ_VIEW_INFO.a.b"));
+	/* SET only message is not for GET. */
+	TEST_CHECK(EINVAL == test_add(&query, "TEST_TONE_REQ"));
+	TEST_CHECK(EINVAL == lg_spk_query_add(&query, "i_vol", 0));
+	TEST_CHECK(EINVAL == lg_spk_query_add(NULL, "i_vol", 5));
+	TEST_CHECK(0 == query.cnt);
+	TEST_CHECK(0 == query.msgs);
+
+	for (i = 0; i < LG_SPK_QUERY_MAX; i ++) {
+		TEST_CHECK(0 == test_add(&query, "i_vol"));
+	}
+	TEST_CHECK(ENOBUFS == test_add(&query, "i_vol"));
+}
+
+static void
+test_plan(void) {
+	lg_spk_query_t query;
+
+	/* Tie: smaller message. */
+	lg_spk_query_init(&query);
+	TEST_CHECK(0 == test_add(&query, "i_curr_func"));
+	TEST_CHECK(0 == query.msgs);
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK(TEST_MSG(LG_CTL_MSG_FUNC_VIEW_INFO) == query.msgs);
+	TEST_CHECK(LG_CTL_MSG_FUNC_VIEW_INFO == query.fld[0].msg_idx);
+
+	/* Message that gives most of wanted fields. */
+	lg_spk_query_init(&query);
+	TEST_CHECK(0 == test_add(&query, "i_curr_func"));
+	TEST_CHECK(0 == test_add(&query, "i_vol"));
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK(TEST_MSG(LG_CTL_MSG_SPK_LIST_VIEW_INFO) == query.msgs);
+	TEST_CHECK(LG_CTL_MSG_SPK_LIST_VIEW_INFO == query.fld[0].msg_idx);
+
+	/* Already requested message is reused. */
+	lg_spk_query_init(&query);
+	TEST_CHECK(0 == test_add(&query, "s_user_name"));
+	TEST_CHECK(0 == test_add(&query, "SETTING_VIEW_INFO.i_av_sync"));
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK(TEST_MSG(LG_CTL_MSG_SETTING_VIEW_INFO) == query.msgs);
+	TEST_CHECK(LG_CTL_MSG_SETTING_VIEW_INFO == query.fld[0].msg_idx);
+	TEST_CHECK(LG_SPK_F_I_AV_SYNC == query.fld[1].field_id);
+
+	/* Several messages. */
+	lg_spk_query_init(&query);
+	TEST_CHECK(0 == test_add(&query, "i_bass"));
+	TEST_CHECK(0 == test_add(&query, "s_model_name"));
+	TEST_CHECK(0 == test_add(&query, "ai_func_list"));
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK((TEST_MSG(LG_CTL_MSG_EQ_VIEW_INFO) |
+	    TEST_MSG(LG_CTL_MSG_PRODUCT_INFO) |
+	    TEST_MSG(LG_CTL_MSG_FUNC_VIEW_INFO)) == query.msgs);
+	/* Plan is stable. */
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK((TEST_MSG(LG_CTL_MSG_EQ_VIEW_INFO) |
+	    TEST_MSG(LG_CTL_MSG_PRODUCT_INFO) |
+	    TEST_MSG(LG_CTL_MSG_FUNC_VIEW_INFO)) == query.msgs);
+}
+
+static void
+test_match(void) {
+	lg_spk_query_t query;
+
+	lg_spk_query_init(&query);
+	TEST_CHECK(0 == test_add(&query, "PLAY_INFO.s_title"));
+	TEST_CHECK(0 == test_add(&query, "EQ_VIEW_INFO"));
+	TEST_CHECK(0 == test_add(&query, "i_vol"));
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK((TEST_MSG(LG_CTL_MSG_PLAY_INFO) |
+	    TEST_MSG(LG_CTL_MSG_EQ_VIEW_INFO) |
+	    TEST_MSG(LG_CTL_MSG_SPK_LIST_VIEW_INFO)) == query.msgs);
+	TEST_CHECK(TEST_MSG(LG_CTL_MSG_EQ_VIEW_INFO) == query.msgs_all);
+	/* Any member name. */
+	TEST_CHECK(0 != lg_spk_query_match(&query, LG_CTL_MSG_PLAY_INFO,
+	    "s_title", 7));
+	TEST_CHECK(0 == lg_spk_query_match(&query, LG_CTL_MSG_PLAY_INFO,
+	    "s_titl", 6));
+	TEST_CHECK(0 == lg_spk_query_match(&query, LG_CTL_MSG_PLAY_INFO,
+	    "s_artist", 8));
+	/* Whole message. */
+	TEST_CHECK(0 != lg_spk_query_match(&query, LG_CTL_MSG_EQ_VIEW_INFO,
+	    "i_bass", 6));
+	TEST_CHECK(0 != lg_spk_query_match(&query, LG_CTL_MSG_EQ_VIEW_INFO,
+	    NULL, 0));
+	/* Planned field only in chosen message. */
+	TEST_CHECK(0 != lg_spk_query_match(&query,
+	    LG_CTL_MSG_SPK_LIST_VIEW_INFO, "i_vol", 5));
+	TEST_CHECK(0 == lg_spk_query_match(&query,
+	    LG_CTL_MSG_SPK_LIST_VIEW_INFO, "i_vol_max", 9));
+	TEST_CHECK(0 == lg_spk_query_match(&query,
+	    LG_CTL_MSG_SETTING_VIEW_INFO, "i_vol", 5));
+	TEST_CHECK(0 == lg_spk_query_match(&query, LG_CTL_MSG_COUNT,
+	    "i_vol", 5));
+}
+
+
+int
+main(int argc, char *argv[]) {
+
+	(void)argc;
+	(void)argv;
+
+	test_add_errors();
+	test_plan();
+	test_match();
+
+	return (test_result());
+}
@@ -0,0 +1,279 @@
+/*-
+ * Copyright (c) 2019-2024 Rozhuk Ivan <rozhuk.im@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE REGENTS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE REGENTS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Author: Rozhuk Ivan <rozhuk.im@gmail.com>
+ *
+ */
+
+/*
+ * lg_spk_replay: capture written by lg_ctl_cap is decoded back by
+ * several workers: all records, order, target names, query filter,
+ * damaged and not capture files.
+ */
+
+#ifdef __linux__ /* Linux specific code. */
+#	define _GNU_SOURCE /* See feature_test_macros(7) */
+#	define __USE_GNU 1
+#endif /* Linux specific code. */
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+
+#include <stdlib.h> /* malloc, exit */
+#include <unistd.h> /* close, write, sysconf */
+#include <fcntl.h> /* open, fcntl */
+#include <string.h> /* bcopy, bzero, memcpy, memmove, memset, strerror... */
+#include <stdio.h> /* snprintf, fprintf */
+#include <errno.h>
+
+#include "lgspkctl.h"
+#include "lg_ctl_cap.h"
+#include "lg_spk_query.h"
+#include "lg_spk_replay.h"
+#include "lg_mem.h"
+#include "utils/mem_utils.h"
+#include "test.h"
+
+
+/* Enough responces for several replay chunks. */
+#define TEST_RESP_CNT		40000
+#define TEST_TARGET_CNT		3
+
+
+/*
+ * Capture: target names, one request, numbered responces round robin
+ * by targets, one not encrypted record.
+ */
+static void
+test_cap_write(lg_ctl_crypto_p crypto, const char *file_name) {
+	lg_ctl_cap_t cap;
+	uint32_t i;
+	uint8_t pkt[512];
+	size_t pkt_size;
+	char buf[256];
+
+	TEST_CHECK(0 == lg_ctl_cap_open(&cap, file_name, (16 * 1024 * 1024)));
+	for (i = 0; i < TEST_TARGET_CNT; i ++) {
+		snprintf(buf, sizeof(buf), "spk-%"PRIu32, i);
+		lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_TARGET, i,
+		    (const uint8_t*)buf, strlen(buf));
+	}
+	pkt_size = test_pkt(crypto, "{\"cmd\": \"get\", "
+	    "\"msg\": \"SPK_LIST_VIEW_INFO\"}", pkt, sizeof(pkt));
+	lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_TX, 0, pkt, pkt_size);
+	lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_RX_RAW, 1, test_raw,
+	    sizeof(test_raw));
+	for (i = 0; i < TEST_RESP_CNT; i ++) {
+		snprintf(buf, sizeof(buf), "{\"msg\": \"SPK_LIST_VIEW_INFO\", "
+		    "\"result\": \"ok\", \"data\": {\"i_vol\": %"PRIu32", "
+		    "\"i_seq\": %"PRIu32"}}", (i % 50), i);
+		pkt_size = test_pkt(crypto, buf, pkt, sizeof(pkt));
+		TEST_CHECK(0 != pkt_size);
+		lg_ctl_cap_rec(&cap, LG_CTL_CAP_T_RX,
+		    (i % TEST_TARGET_CNT), pkt, pkt_size);
+	}
+	TEST_CHECK((TEST_TARGET_CNT + 3 + TEST_RESP_CNT) == cap.frames);
+	TEST_CHECK(0 == cap.dropped);
+	lg_ctl_cap_close(&cap);
+}
+
+/* Replay cap_name to out_name, returns lg_spk_replay_run() result. */
+static int
+test_replay(const char *cap_name, const char *out_name,
+    const lg_spk_query_t *query, uint64_t *records, uint64_t *rx,
+    uint64_t *tx, uint64_t *bad) {
+	int error, fd;
+	size_t i;
+	lg_spk_replay_t replay;
+
+	fd = open(out_name, (O_WRONLY | O_TRUNC));
+	if (-1 == fd)
+		return (errno);
+	lg_spk_replay_init(&replay);
+	replay.fmt = LG_SPK_OUT_FMT_JSONL;
+	replay.query = query;
+	replay.threads = 4;
+	replay.fd = fd;
+	error = lg_spk_replay_run(&replay, cap_name);
+	(*records) = replay.records;
+	(*rx) = 0;
+	(*tx) = 0;
+	(*bad) = 0;
+	for (i = 0; i < replay.worker_cnt; i ++) {
+		(*rx) += replay.worker[i].rx;
+		(*tx) += replay.worker[i].tx;
+		(*bad) += replay.worker[i].bad;
+	}
+	lg_spk_replay_destroy(&replay);
+	close(fd);
+
+	return (error);
+}
+
+/*
+ * Check output lines: request (not filtered), bad record, then responces
+ * in capture order with right target names; returns number of responces.
+ */
+static size_t
+test_out_check(const char *out_name, const int filtered) {
+	char *buf, *line, *eol, *ptr, name[32];
+	size_t size = 0, line_cnt = 0, resp_cnt = 0;
+
+	buf = test_file_read(out_name, &size);
+	TEST_CHECK(NULL != buf);
+	if (NULL == buf)
+		return (0);
+	for (line = buf; line < (buf + size); line = (eol + 1)) {
+		eol = strchr(line, '\n');
+		if (NULL == eol) {
+			TEST_CHECK(0); /* Not terminated record. */
+			break;
+		}
+		(*eol) = 0;
+		line_cnt ++;
+		TEST_CHECK(0 == strncmp(line, "{\"ts\":", 6));
+		if (NULL != strstr(line, "\"req\":")) {
+			TEST_CHECK(0 == filtered);
+			TEST_CHECK(1 == line_cnt);
+			TEST_CHECK(NULL != strstr(line, "\"target\":\"spk-0\""));
+			continue;
+		}
+		if (NULL != strstr(line, "\"bad\":")) {
+			/* Not valid data is reported with query too. */
+			TEST_CHECK(((0 == filtered) ? 2 : 1) == line_cnt);
+			TEST_CHECK(NULL != strstr(line, "\"target\":\"spk-1\""));
+			continue;
+		}
+		snprintf(name, sizeof(name), "\"target\":\"spk-%zu\"",
+		    (resp_cnt % TEST_TARGET_CNT));
+		TEST_CHECK(NULL != strstr(line, name));
+		TEST_CHECK(NULL != strstr(line, "\"i_vol\":"));
+		ptr = strstr(line, "\"i_seq\":");
+		if (0 != filtered) {
+			TEST_CHECK(NULL == ptr); /* Not wanted field. */
+		} else {
+			TEST_CHECK(NULL != ptr);
+			if (NULL != ptr) {
+				TEST_CHECK(resp_cnt ==
+				    strtoul((ptr + 8), NULL, 10));
+			}
+		}
+		resp_cnt ++;
+	}
+	lg_free(buf);
+
+	return (resp_cnt);
+}
+
+static void
+test_round_trip(lg_ctl_crypto_p crypto) {
+	int fd;
+	uint64_t records, rx, tx, bad;
+	lg_spk_query_t query;
+	struct stat st;
+	char cap_name[] = "/tmp/test_lg_spk_replay_cap.XXXXXX";
+	char out_name[] = "/tmp/test_lg_spk_replay_out.XXXXXX";
+
+	fd = mkstemp(cap_name);
+	if (-1 == fd) {
+		TEST_CHECK(0);
+		return;
+	}
+	close(fd);
+	fd = mkstemp(out_name);
+	if (-1 == fd) {
+		TEST_CHECK(0);
+		unlink(cap_name);
+		return;
+	}
+	close(fd);
+	test_cap_write(crypto, cap_name);
+	TEST_CHECK(0 == stat(cap_name, &st));
+	TEST_CHECK((2 * LG_SPK_REPLAY_CHUNK_SIZE) < st.st_size);
+
+	/* All records. */
+	TEST_CHECK(0 == test_replay(cap_name, out_name, NULL, &records,
+	    &rx, &tx, &bad));
+	TEST_CHECK((1 + TEST_TARGET_CNT + 2 + TEST_RESP_CNT) == records);
+	TEST_CHECK(TEST_RESP_CNT == rx);
+	TEST_CHECK(1 == tx);
+	TEST_CHECK(1 == bad);
+	TEST_CHECK(TEST_RESP_CNT == test_out_check(out_name, 0));
+
+	/* Wanted field only, no requests. */
+	lg_spk_query_init(&query);
+	TEST_CHECK(0 == lg_spk_query_add(&query, "i_vol", 5));
+	TEST_CHECK(0 == lg_spk_query_plan(&query));
+	TEST_CHECK(0 == test_replay(cap_name, out_name, &query, &records,
+	    &rx, &tx, &bad));
+	TEST_CHECK(0 == tx);
+	TEST_CHECK(TEST_RESP_CNT == test_out_check(out_name, 1));
+
+	/* Last record cut: decoded up to it. */
+	TEST_CHECK(0 == truncate(cap_name, (st.st_size - 3)));
+	TEST_CHECK(EBADMSG == test_replay(cap_name, out_name, NULL,
+	    &records, &rx, &tx, &bad));
+	TEST_CHECK((TEST_RESP_CNT - 1) == rx);
+	TEST_CHECK((TEST_RESP_CNT - 1) == test_out_check(out_name, 0));
+
+	/* Not capture: no START record. */
+	fd = open(cap_name, (O_WRONLY | O_TRUNC));
+	TEST_CHECK(-1 != fd);
+	if (-1 != fd) {
+		TEST_CHECK((ssize_t)sizeof(test_raw) ==
+		    write(fd, test_raw, sizeof(test_raw)));
+		close(fd);
+	}
+	TEST_CHECK(EBADMSG == test_replay(cap_name, out_name, NULL,
+	    &records, &rx, &tx, &bad));
+	TEST_CHECK(0 == records);
+	/* Empty and missing. */
+	TEST_CHECK(0 == truncate(cap_name, 0));
+	TEST_CHECK(EBADMSG == test_replay(cap_name, out_name, NULL,
+	    &records, &rx, &tx, &bad));
+	unlink(cap_name);
+	TEST_CHECK(ENOENT == test_replay(cap_name, out_name, NULL,
+	    &records, &rx, &tx, &bad));
+	unlink(out_name);
+}
+
+
+int
+main(int argc, char *argv[]) {
+	lg_ctl_crypto_t crypto;
+
+	(void)argc;
+	(void)argv;
+
+	if (0 != lg_ctl_crypto_init(&crypto)) {
+		fprintf(stderr, "lg_ctl_crypto_init() fail.\n");
+		return (1);
+	}
+	test_round_trip(&crypto);
+	lg_ctl_crypto_destroy(&crypto);
+
+	return (test_result());
+}